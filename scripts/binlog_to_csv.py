@@ -0,0 +1,318 @@
+"""Convert a binary SD log (LOG_<n>.BIN, src/binlog/binlog.h) back into the .CSV layout.
+
+The file header describes every message and signal, so the converter does not depend on the
+firmware version that wrote the file. Blocks with a bad CRC are skipped and reported, the
+converter resynchronises on the next block header. Blocks tagged for another file (data left
+on the card under a preallocated region) are not taken. Coded blocks are restored: LZSS
+(version 4, src/lzss/lzss.h) and record deltas (version 5, src/record_codec/record_codec.h).
+--check also prints the latest commit (end of the data synced before a power cut) and the
+compression ratio. The Label column holds the block number.
+
+Usage:
+    python binlog_to_csv.py LOG_0.BIN                 # writes LOG_0.CSV next to it
+    python binlog_to_csv.py LOG_0.BIN -o drive.csv --physical
+    python binlog_to_csv.py LOG_0.BIN --check         # CRC and sequence check only
+"""
+
+import argparse
+import pathlib
+import struct
+import sys
+import zlib
+from datetime import datetime, timezone
+
+# Mirrors src/binlog/binlog.h
+MAGIC = b"ASURTLOG"
+VERSIONS = (1, 2, 3, 4, 5)  # 2: block tag, 3: commit slots, 4: LZSS blocks, 5: delta blocks
+FILE_HEADER = struct.Struct("<8sHHHHHHq32s")
+MESSAGE_DESC = struct.Struct("<IBB16s")
+SIGNAL_DESC = struct.Struct("<IfBBBB20s8s")
+BLOCK_MAGIC = 0x4B4C4241
+LZ_MAGIC = 0x5A4C4241
+LZ_PACKED = struct.Struct("<I")
+PACKED_SIZE_MASK = 0x00FFFFFF
+PACKED_DELTA = 0x80000000
+PACKED_STORED = 0x40000000
+BLOCK_HEADER = struct.Struct("<IIHH")
+COMMIT_MAGIC = 0x4D4F4341
+COMMIT = struct.Struct("<IIIHHqI")
+COMMIT_SLOT_SIZE = 512
+COMMIT_SLOTS = 2
+CRC = struct.Struct("<I")
+DT_MISSING = -(2 ** 31)
+
+# COMM_signal_type_t -> struct format of the value in a record
+SIGNAL_FORMATS = {0: "H", 1: "I", 2: "f"}
+
+
+def cstr(raw: bytes) -> str:
+    return raw.split(b"\0", 1)[0].decode("ascii", "replace")
+
+
+def lzss_decompress(data: bytes, limit: int) -> bytes:
+    """Restore an LZSS block of limit bytes at most (src/lzss/lzss.c), ValueError if it is corrupt."""
+    out = bytearray()
+    i = 0
+    while i < len(data):
+        flags = data[i]
+        i += 1
+        for bit in range(8):
+            if i >= len(data):
+                break
+            if flags & (1 << bit):
+                out.append(data[i])
+                i += 1
+                continue
+            if i + 2 > len(data):
+                raise ValueError("truncated match")
+            token = data[i] | (data[i + 1] << 8)
+            i += 2
+            distance, length = (token >> 4) + 1, (token & 0x0F) + 3
+            if token & 0x0F == 15:
+                if i >= len(data):
+                    raise ValueError("truncated match")
+                length = 18 + data[i]
+                i += 1
+            if distance > len(out) or len(out) + length > limit:
+                raise ValueError("match outside the block")
+            for _ in range(length):  # Overlapping copies repeat the last distance bytes
+                out.append(out[-distance])
+    if len(out) > limit:
+        raise ValueError(f"more than {limit} bytes restored")
+    return bytes(out)
+
+
+class Varints:
+    """LEB128 reader of record_codec bytes."""
+
+    def __init__(self, data: bytes, offset: int):
+        self.data, self.offset = data, offset
+
+    def next(self) -> int:
+        value = shift = 0
+        while True:
+            if self.offset >= len(self.data) or shift >= 64:
+                raise ValueError("truncated varint")
+            byte = self.data[self.offset]
+            self.offset += 1
+            value |= (byte & 0x7F) << shift
+            shift += 7
+            if not byte & 0x80:
+                return value
+
+    def signed(self) -> int:
+        value = self.next()
+        return (value >> 1) ^ -(value & 1)
+
+
+class BinLog:
+    """Header of a binary log and the record layout it describes."""
+
+    def __init__(self, data: bytes):
+        if len(data) < FILE_HEADER.size:
+            raise ValueError("file shorter than its header")
+        (magic, version, self.header_size, self.record_size, self.block_size, message_count,
+         signal_count, self.created_us, firmware) = FILE_HEADER.unpack_from(data)
+        if magic != MAGIC:
+            raise ValueError("not a binary log (bad magic)")
+        if version not in VERSIONS:
+            raise ValueError(f"unsupported format version {version}")
+        (crc,) = CRC.unpack_from(data, self.header_size - CRC.size)
+        if zlib.crc32(data[:self.header_size - CRC.size]) != crc:
+            raise ValueError("file header CRC mismatch")
+        self.tag = crc & 0xFFFF if version >= 2 else 0  # binlog_file_tag
+
+        # BINLOG_COMMIT_OFFSET / BINLOG_DATA_OFFSET
+        self.commit = None
+        self.data_offset = self.header_size
+        if version >= 3:
+            slots = -(-self.header_size // COMMIT_SLOT_SIZE) * COMMIT_SLOT_SIZE
+            self.data_offset = slots + COMMIT_SLOTS * COMMIT_SLOT_SIZE
+            for i in range(COMMIT_SLOTS):
+                offset = slots + i * COMMIT_SLOT_SIZE
+                if offset + COMMIT.size > len(data):
+                    continue
+                magic, count, end, tag, _reserved, time_us, slot_crc = COMMIT.unpack_from(data, offset)
+                if (magic == COMMIT_MAGIC and tag == self.tag and
+                        slot_crc == zlib.crc32(data[offset:offset + COMMIT.size - CRC.size]) and
+                        (self.commit is None or count > self.commit["count"])):
+                    self.commit = {"count": count, "end": end, "time_us": time_us}
+        self.firmware = cstr(firmware)
+
+        offset = FILE_HEADER.size
+        self.messages = []
+        for _ in range(message_count):
+            can_id, extd, dlc, name = MESSAGE_DESC.unpack_from(data, offset)
+            self.messages.append({"id": can_id, "extd": extd, "dlc": dlc, "name": cstr(name)})
+            offset += MESSAGE_DESC.size
+        self.signals = []
+        for _ in range(signal_count):
+            can_id, scale, sig_type, bit, width, _reserved, name, unit = SIGNAL_DESC.unpack_from(data, offset)
+            self.signals.append({"id": can_id, "scale": scale, "type": sig_type, "bit": bit, "width": width,
+                                 "name": cstr(name), "unit": cstr(unit)})
+            offset += SIGNAL_DESC.size
+
+        fmt = "<qQ" + "i" * message_count + "".join(SIGNAL_FORMATS[s["type"]] for s in self.signals)
+        self.record = struct.Struct(fmt)
+        if self.record.size != self.record_size:
+            raise ValueError(f"record layout mismatch: {self.record.size} != {self.record_size} bytes")
+
+    def decode_records(self, data: bytes, count: int) -> list:
+        """Restore count records encoded by record_codec_encode (keyframe, then deltas)."""
+        records = [list(self.record.unpack_from(data, 0))]
+        varints = Varints(data, self.record.size)
+        messages = len(self.messages)
+        deltas = [0] * (2 + messages)  # Delta of delta fields: timestamp_us, message_dt_us[]
+        for _ in range(1, count):
+            prev = records[-1]
+            cur = [0] * len(prev)
+            deltas[0] += varints.signed()
+            cur[0] = prev[0] + deltas[0]
+            cur[1] = prev[1] ^ varints.next()
+            for i in range(2, 2 + messages):
+                deltas[i] += varints.signed()
+                cur[i] = prev[i] + deltas[i]
+            for i, signal in enumerate(self.signals, 2 + messages):
+                if signal["type"] == 0:
+                    cur[i] = (prev[i] + varints.signed()) & 0xFFFF
+                elif signal["type"] == 1:
+                    cur[i] = (prev[i] + varints.signed()) & 0xFFFFFFFF
+                else:
+                    code = varints.next()
+                    bits = struct.unpack("<I", struct.pack("<f", prev[i]))[0] ^ ((code >> 2) << (8 * (code & 3)))
+                    cur[i] = struct.unpack("<f", struct.pack("<I", bits & 0xFFFFFFFF))[0]
+            records.append(cur)
+        return [tuple(r) for r in records]
+
+    def csv_header(self) -> str:
+        return ",".join(["Timestamp_UTC", "Label", "Fresh"] + [s["name"] for s in self.signals] +
+                        [f"{m['name']}_dt_us" for m in self.messages])
+
+    def csv_row(self, values: tuple, label: str, physical: bool) -> str:
+        timestamp_us, fresh = values[0], values[1]
+        dts = values[2:2 + len(self.messages)]
+        signals = values[2 + len(self.messages):]
+        stamp = datetime.fromtimestamp(timestamp_us // 1_000_000, tz=timezone.utc)
+        fields = [f"{stamp:%Y-%m-%d %H:%M:%S}.{timestamp_us % 1_000_000:06d}", label, f"{fresh:x}"]
+        for signal, value in zip(self.signals, signals):
+            if physical:
+                value = value * signal["scale"]
+            fields.append(f"{value:f}" if isinstance(value, float) else str(value))
+        fields += ["" if dt == DT_MISSING else str(dt) for dt in dts]
+        return ",".join(fields)
+
+
+def next_block(data: bytes, offset: int) -> int:
+    found = [i for i in (data.find(struct.pack("<I", m), offset) for m in (BLOCK_MAGIC, LZ_MAGIC)) if i >= 0]
+    return min(found) if found else -1
+
+
+def block_records(log: BinLog, magic: int, packed: int, body: bytes, count: int) -> list:
+    """Undo the stages of a block (binlog_block_decode), ValueError if one fails."""
+    raw = count * log.record_size
+    if magic == LZ_MAGIC:
+        if not packed & PACKED_STORED:
+            body = lzss_decompress(body, log.block_size if packed & PACKED_DELTA else raw)
+        if packed & PACKED_DELTA:
+            return log.decode_records(body, count)
+    if len(body) != raw:
+        raise ValueError(f"{len(body)} of {raw} bytes restored")
+    return [log.record.unpack_from(body, i * log.record_size) for i in range(count)]
+
+
+def blocks(log: BinLog, data: bytes, report, stats=None):
+    """Yield (sequence, records) of every valid block, reporting damaged or missing ones.
+
+    report(text, problem=True) is called for every gap, damaged block and appended session.
+    stats (dict) receives the plain and stored size of the blocks."""
+    offset = log.data_offset
+    expected = 0
+    while offset + BLOCK_HEADER.size <= len(data):
+        magic, sequence, count, tag = BLOCK_HEADER.unpack_from(data, offset)
+        raw = count * log.record_size
+        payload = offset + BLOCK_HEADER.size
+        end = payload + raw
+        body = payload
+        packed = 0
+        if magic == LZ_MAGIC and payload + LZ_PACKED.size <= len(data):
+            (packed,) = LZ_PACKED.unpack_from(data, payload)
+            body = payload + LZ_PACKED.size
+            end = body + min(packed & PACKED_SIZE_MASK, raw)
+        valid = (magic in (BLOCK_MAGIC, LZ_MAGIC) and tag == log.tag and 0 < count and end + CRC.size <= len(data) and
+                 payload + raw + CRC.size - offset <= log.block_size and
+                 CRC.unpack_from(data, end)[0] == zlib.crc32(data[offset:end]))
+        records = []
+        if valid:
+            try:
+                records = block_records(log, magic, packed, data[body:end], count)
+            except ValueError as err:
+                report(f"block at byte {offset} does not decode: {err}")
+                valid = False
+        if not valid:
+            following = next_block(data, offset + 1)
+            report(f"damaged block at byte {offset}, skipped {(following if following >= 0 else len(data)) - offset} bytes")
+            if following < 0:
+                return
+            offset = following
+            continue
+        if sequence == 0 and expected != 0:
+            report(f"session appended at byte {offset}", problem=False)
+        elif sequence != expected:
+            report(f"blocks {expected}..{sequence - 1} missing before byte {offset}")
+        if stats is not None:
+            stats["plain"] = stats.get("plain", 0) + BLOCK_HEADER.size + raw + CRC.size
+            stats["stored"] = stats.get("stored", 0) + end + CRC.size - offset
+        yield sequence, records
+        expected = sequence + 1
+        offset = end + CRC.size
+    if offset != len(data):
+        report(f"{len(data) - offset} trailing bytes (block cut by a power loss)")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("input", help="binary log (LOG_<n>.BIN)")
+    parser.add_argument("-o", "--output", help="CSV file (default: input with a .CSV suffix)")
+    parser.add_argument("--physical", action="store_true", help="apply the signal scales")
+    parser.add_argument("--check", action="store_true", help="only check the CRCs and block sequence")
+    args = parser.parse_args()
+
+    data = pathlib.Path(args.input).read_bytes()
+    try:
+        log = BinLog(data)
+    except ValueError as err:
+        raise SystemExit(f"{args.input}: {err}")
+    problems = []
+
+    def report(text, problem=True):
+        if problem:
+            problems.append(text)
+        print(f"{args.input}: {text}", file=sys.stderr)
+
+    rows = 0
+    if args.check:
+        stats = {}
+        for _, records in blocks(log, data, report, stats):
+            rows += len(records)
+        if stats.get("stored"):
+            print(f"{args.input}: {stats['plain']} bytes of blocks stored in {stats['stored']}, "
+                  f"ratio {stats['plain'] / stats['stored']:.2f}")
+        if log.commit is not None:
+            stamp = datetime.fromtimestamp(log.commit["time_us"] / 1e6, tz=timezone.utc)
+            print(f"{args.input}: commit {log.commit['count']} at {stamp:%Y-%m-%d %H:%M:%S} UTC, "
+                  f"{log.commit['end']} of {len(data)} bytes committed")
+    else:
+        output = pathlib.Path(args.output) if args.output else pathlib.Path(args.input).with_suffix(".CSV")
+        with open(output, "w", newline="") as out:
+            out.write(log.csv_header() + "\n")
+            for sequence, records in blocks(log, data, report):
+                for values in records:
+                    out.write(log.csv_row(values, f"B{sequence}", args.physical) + "\n")
+                rows += len(records)
+    print(f"{args.input}: firmware {log.firmware}, {len(log.signals)} signals, {rows} rows, "
+          f"{len(problems)} problems")
+    sys.exit(1 if problems and args.check else 0)
+
+
+if __name__ == "__main__":
+    main()
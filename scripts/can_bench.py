@@ -0,0 +1,191 @@
+"""End-to-end throughput and latency benchmark of the host build (host/README.md).
+
+Runs the host executable once per configuration, each run ends by writing its JSON results
+(TELE_HOST_BENCH) when the CAN source stops. The results of a suite are stored together so
+two branches can be compared.
+
+Usage:
+    python can_bench.py run --elf host/build/ASURT_DAC_TELE_host.elf --out main.json
+    python can_bench.py run --elf ... --rates 100,1000,5000 --seconds 20 --out fast.json
+    python can_bench.py run --elf ... --mix "0x006:2000,0x7FF:500" --out mix.json
+    python can_bench.py run --elf ... --replay drive.log --speed 0 --out replay.json
+    python can_bench.py run --elf ... --sdcard /mnt/fat --prealloc 0,64 --out prealloc.json
+    python can_bench.py compare main.json fast.json
+    python can_bench.py dispatch --elf ... --out dispatch.json
+
+The senders need the local broker of the host build (mosquitto -p 1883), without it the
+"net" stage stays empty and the telemetry sink falls behind.
+
+--sdcard points the log files of every run at a directory, e.g. a mounted FAT image (host/README.md),
+--prealloc repeats each run per log file preallocation (MiB, 0 = none) to compare the SD write
+latency of both modes.
+
+dispatch runs the CAN ID lookup benchmark (TELE_HOST_DISPATCH_BENCH) instead of the pipeline:
+ns per lookup of the dispatch table and of a switch on the same IDs, hits and misses.
+"""
+
+import argparse
+import json
+import os
+import pathlib
+import shutil
+import subprocess
+import sys
+import tempfile
+
+RUN_MARGIN_S = 30  # Drain (HOST_REPORT_DRAIN_MS) and start-up time on top of the source duration
+
+
+def run_one(elf: pathlib.Path, env: dict, timeout_s: float, sdcard: str | None = None) -> dict:
+    """Run the host build once and return its results.
+
+    With sdcard, the run logs into that directory (emptied first) instead of a fresh one."""
+    with tempfile.TemporaryDirectory() as work:
+        if sdcard:
+            for entry in pathlib.Path(sdcard).iterdir():
+                shutil.rmtree(entry) if entry.is_dir() else entry.unlink()
+            (pathlib.Path(work) / "sdcard").symlink_to(pathlib.Path(sdcard).resolve())
+        results = pathlib.Path(work) / "bench.json"
+        run_env = dict(os.environ, TELE_HOST_BENCH=str(results), **env)
+        proc = subprocess.run([str(elf)], cwd=work, env=run_env, timeout=timeout_s,
+                              stdout=subprocess.PIPE, stderr=subprocess.STDOUT, text=True)
+        if proc.returncode != 0 or not results.exists():
+            sys.stderr.write(proc.stdout[-4000:])
+            raise SystemExit(f"Run failed (exit {proc.returncode}): {env}")
+        return json.loads(results.read_text())
+
+
+def configs(args) -> list[dict]:
+    """Environment of every run of the suite."""
+    if args.replay:
+        runs = [{"TELE_HOST_REPLAY": str(pathlib.Path(args.replay).resolve()),
+                 "TELE_HOST_REPLAY_SPEED": str(speed)} for speed in args.speed.split(",")]
+    else:
+        base = {"TELE_HOST_CAN_RUN": str(args.seconds)}
+        if args.mix:
+            runs = [dict(base, TELE_HOST_CAN_MIX=mix) for mix in args.mix.split(";")]
+        else:
+            runs = [dict(base, TELE_HOST_CAN_HZ=str(rate)) for rate in args.rates.split(",")]
+    if args.prealloc:
+        runs = [dict(run, TELE_HOST_PREALLOC=mib) for run in runs for mib in args.prealloc.split(",")]
+    return runs
+
+
+def summary(result: dict) -> dict:
+    """Flat metrics of one run, used by the table and the comparison."""
+    row = {
+        "source_fps": result["source"]["fps"],
+        "rx_missed": result["twai"]["rx_missed"],
+        "rx_queue_hwm": result["twai"]["rx_queue_hwm"],
+        "sw_filtered": result["can_task"]["sw_filtered"],
+    }
+    for sink in result["sinks"]:
+        row[f"{sink['name']}_fps"] = sink["fps"]
+        row[f"{sink['name']}_overruns"] = sink["overruns"]
+        row[f"{sink['name']}_max_lag"] = sink["max_lag"]
+    for name, stage in result["stages"].items():
+        row[f"{name}_p50_us"] = stage["p50_us"]
+        row[f"{name}_p99_us"] = stage["p99_us"]
+        row[f"{name}_max_us"] = stage["max_us"]
+        row[f"{name}_bytes"] = stage["bytes"]
+    writer = result.get("sd_writer")
+    if writer is not None:
+        row["sd_mb_s"] = writer["mb_per_s"]
+        row["sd_max_write_us"] = writer["max_write_us"]
+        row["sd_max_stall_us"] = writer["max_stall_us"]
+        row["sd_dropped"] = writer["dropped"]
+    frames = result.get("frame_log")
+    if frames is not None:
+        row["frame_log_frames"] = frames["frames"]
+        row["frame_log_lost"] = frames["lost"]
+        row["frame_log_bytes"] = frames["bytes"]
+    return row
+
+
+def label(result: dict) -> str:
+    config = result["config"]
+    if config.get("replay"):
+        name = f"replay x{config.get('replay_speed') or 1}"
+    elif config.get("can_mix"):
+        name = f"mix {config['can_mix']}"
+    else:
+        name = f"{config.get('can_hz') or 100} Hz/ID"
+    if config.get("prealloc_mib") is not None:
+        name += f", prealloc {config['prealloc_mib']} MiB"
+    return name
+
+
+def cmd_run(args):
+    runs = []
+    for env in configs(args):
+        timeout = (args.seconds if not args.replay else args.timeout) + RUN_MARGIN_S
+        result = run_one(pathlib.Path(args.elf).resolve(), env, timeout, args.sdcard)
+        runs.append(result)
+        row = summary(result)
+        print(f"{label(result):>30}: " + ", ".join(f"{k} {v:g}" for k, v in row.items()))
+    pathlib.Path(args.out).write_text(json.dumps({"runs": runs}, indent=2))
+    print(f"{len(runs)} runs written to {args.out}")
+
+
+def cmd_compare(args):
+    base = {label(r): summary(r) for r in json.loads(pathlib.Path(args.base).read_text())["runs"]}
+    new = {label(r): summary(r) for r in json.loads(pathlib.Path(args.new).read_text())["runs"]}
+    for name in base.keys() & new.keys():
+        print(name)
+        for key, old in base[name].items():
+            value = new[name].get(key)
+            if value is None:
+                continue
+            change = f"{(value - old) / old * 100:+.1f}%" if old else "-"
+            print(f"  {key:>24}: {old:>12g} -> {value:<12g} {change}")
+    for name in base.keys() ^ new.keys():
+        print(f"{name}: only in {'base' if name in base else 'new'}")
+
+
+def cmd_dispatch(args):
+    result = run_one(pathlib.Path(args.elf).resolve(), {"TELE_HOST_DISPATCH_BENCH": str(args.calls)}, args.timeout)
+    dispatch = result["dispatch"]
+    print(f"{dispatch['std_ids']} standard + {dispatch['ext_ids']} extended IDs, {dispatch['calls']} calls, "
+          f"{dispatch['mismatches']} mismatches")
+    print(f"{'ns per lookup':>16} {'table':>8} {'switch':>8}")
+    for key in dispatch["table"]:
+        print(f"{key[:-3]:>16} {dispatch['table'][key]:>8.2f} {dispatch['switch'][key]:>8.2f}")
+    if args.out:
+        pathlib.Path(args.out).write_text(json.dumps(result, indent=2))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    sub = parser.add_subparsers(dest="command", required=True)
+
+    run = sub.add_parser("run", help="run a suite and store its results")
+    run.add_argument("--elf", required=True, help="host build executable")
+    run.add_argument("--out", required=True, help="results file (JSON)")
+    run.add_argument("--rates", default="100,500,1000,2000", help="generator rates per schema ID, comma separated")
+    run.add_argument("--mix", help="ID mixes \"id:hz,id:hz\", separated by ';' (replaces --rates)")
+    run.add_argument("--seconds", type=int, default=10, help="duration of every generator run")
+    run.add_argument("--replay", help="recorded log replayed instead of the generator")
+    run.add_argument("--speed", default="0", help="replay speeds, comma separated (0 = unthrottled)")
+    run.add_argument("--timeout", type=int, default=600, help="longest replay run in seconds")
+    run.add_argument("--prealloc", help="log file preallocations in MiB, comma separated (0 = none)")
+    run.add_argument("--sdcard", help="directory receiving the log files, e.g. a mounted FAT image")
+    run.set_defaults(func=cmd_run)
+
+    compare = sub.add_parser("compare", help="compare two results files run by run")
+    compare.add_argument("base")
+    compare.add_argument("new")
+    compare.set_defaults(func=cmd_compare)
+
+    dispatch = sub.add_parser("dispatch", help="time CAN ID lookups, dispatch table against a switch")
+    dispatch.add_argument("--elf", required=True, help="host build executable")
+    dispatch.add_argument("--calls", type=int, default=10000000, help="lookups per method and category")
+    dispatch.add_argument("--timeout", type=int, default=600, help="longest run in seconds")
+    dispatch.add_argument("--out", help="results file (JSON)")
+    dispatch.set_defaults(func=cmd_dispatch)
+
+    args = parser.parse_args()
+    args.func(args)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,118 @@
+"""Report the TWAI hardware acceptance filter false-accept rate for a set of CAN IDs.
+
+Mirrors src/can_filter/can_filter.c: the same cube model and split search are used, and
+every standard ID (or a sample of extended IDs) is run through the filter model.
+
+Usage:
+    python can_filter_report.py                      # IDs from src/Logging/can_schema.h
+    python can_filter_report.py 0x100 0x101 0x7DF    # explicit standard IDs
+    python can_filter_report.py --extended 0x18FF0001 0x18FF0003
+"""
+
+import argparse
+import itertools
+import pathlib
+import re
+
+SCHEMA = pathlib.Path(__file__).resolve().parent.parent / "src" / "Logging" / "can_schema.h"
+
+STD_BITS = 11
+EXT_BITS = 29
+EXHAUSTIVE_MAX_IDS = 12  # CAN_FILTER_EXHAUSTIVE_MAX_IDS
+
+
+def schema_ids() -> tuple[list[int], bool]:
+    """Return the IDs of COMM_MESSAGE_TABLE and whether they are extended."""
+    rows = re.findall(r"X\(P,\s*\w+,\s*(0x[0-9A-Fa-f]+|\d+),\s*(true|false)", SCHEMA.read_text())
+    ids = [int(i, 0) for i, _ in rows]
+    extd = {e for _, e in rows}
+    if len(extd) > 1:
+        raise SystemExit("Mixed standard / extended IDs: the firmware accepts all frames")
+    return ids, extd == {"true"}
+
+
+def cube(ids):
+    """Smallest code / don't care pair covering ids (None for an empty set)."""
+    if not ids:
+        return None
+    code, dont_care = ids[0], 0
+    for i in ids[1:]:
+        dont_care |= code ^ i
+        code &= i
+    return code, dont_care
+
+
+def cube_size(c) -> int:
+    return 0 if c is None else 1 << bin(c[1]).count("1")
+
+
+def union_size(a, b) -> int:
+    size = cube_size(a) + cube_size(b)
+    if a and b and ((a[0] ^ b[0]) & ~(a[1] | b[1])) == 0:
+        size -= 1 << bin(a[1] & b[1]).count("1")
+    return size
+
+
+def best_dual(ids):
+    """Best split of ids over the two filters, same search as the firmware."""
+    if len(ids) <= EXHAUSTIVE_MAX_IDS:
+        # The first ID always stays in filter 1, every other subset goes to filter 2
+        candidates = (
+            ([i for k, i in enumerate(ids) if not (m >> k) & 1], [i for k, i in enumerate(ids) if (m >> k) & 1])
+            for m in range(0, 1 << len(ids), 2)
+        )
+    else:
+        candidates = itertools.chain(
+            (([i for i in ids if i < t], [i for i in ids if i >= t]) for t in ids),
+            (([i for i in ids if not (i >> b) & 1], [i for i in ids if (i >> b) & 1]) for b in range(STD_BITS)),
+        )
+    best = (cube(ids), None)
+    for first, second in candidates:
+        pair = (cube(first), cube(second))
+        if union_size(*pair) < union_size(*best):
+            best = pair
+    return best
+
+
+def accepts(cubes, identifier: int) -> bool:
+    return any(c is not None and ((identifier ^ c[0]) & ~c[1]) == 0 for c in cubes)
+
+
+def report(name: str, cubes, ids, bits: int) -> None:
+    space = 1 << bits
+    if bits == STD_BITS:
+        accepted = sum(accepts(cubes, i) for i in range(space))
+    else:
+        accepted = union_size(*cubes) if len(cubes) == 2 else cube_size(cubes[0])
+    missed = [hex(i) for i in ids if not accepts(cubes, i)]
+    assert not missed, f"{name} filter rejects registered IDs {missed}"
+    false_accepts = accepted - len(set(ids))
+    print(f"{name:6} filter: accepts {accepted} IDs, {false_accepts} false accepts "
+          f"({100.0 * false_accepts / accepted:.1f}% of accepted, {100.0 * false_accepts / space:.4f}% of ID space)")
+    for n, c in enumerate(cubes, 1):
+        if c is not None:
+            print(f"        filter {n}: code 0x{c[0]:0{(bits + 3) // 4}X}  don't care 0x{c[1]:0{(bits + 3) // 4}X}")
+
+
+def main() -> None:
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("ids", nargs="*", help="CAN IDs (default: COMM_MESSAGE_TABLE)")
+    parser.add_argument("--extended", action="store_true", help="IDs are 29-bit identifiers")
+    args = parser.parse_args()
+
+    if args.ids:
+        ids, extended = [int(i, 0) for i in args.ids], args.extended
+    else:
+        ids, extended = schema_ids()
+    ids = sorted(set(ids))
+    bits = EXT_BITS if extended else STD_BITS
+    print(f"{len(ids)} {'extended' if extended else 'standard'} IDs: {' '.join(hex(i) for i in ids)}")
+
+    report("Single", [cube(ids)], ids, bits)
+    if not extended:
+        # The firmware uses dual mode only when it accepts fewer IDs than single mode
+        report("Dual", list(best_dual(ids)), ids, bits)
+
+
+if __name__ == "__main__":
+    main()
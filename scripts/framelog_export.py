@@ -0,0 +1,193 @@
+"""Export a raw CAN frame log (LOG_<n>.CAN, src/framelog/framelog.h) as candump or Vector ASC.
+
+The frame log holds every frame the logger took from the CAN ring, as received. The candump
+log output is read back by the host build (TELE_HOST_REPLAY, src/host/host_replay.c), so a
+session can be replayed through the decoder; the ASC output opens in CANalyzer / CANoe and most
+bus analysers. Blocks with a bad CRC are skipped and reported, the exporter resynchronises on
+the next block header. Frames the logger lost (ring overruns, card too slow) are counted in the
+block that follows them and reported. --check only prints the frame, loss and commit counts.
+
+Usage:
+    python framelog_export.py LOG_0.CAN                # writes LOG_0.log (candump -l format)
+    python framelog_export.py LOG_0.CAN --asc          # writes LOG_0.asc
+    python framelog_export.py LOG_0.CAN --check        # CRC, sequence and loss check only
+"""
+
+import argparse
+import pathlib
+import struct
+import sys
+import zlib
+from datetime import datetime, timezone
+
+# Mirrors src/framelog/framelog.h
+MAGIC = b"ASURTCAN"
+VERSIONS = (1,)
+FILE_HEADER = struct.Struct("<8sHHHHIIq32s")
+BLOCK_MAGIC = 0x4D524641
+BLOCK_HEADER = struct.Struct("<IIHHHHq")
+FRAME = struct.Struct("<IIB")
+INFO_DLC = 0x0F
+INFO_EXTD = 0x10
+INFO_RTR = 0x20
+CRC = struct.Struct("<I")
+# Commit slots of src/binlog/binlog.h
+COMMIT_MAGIC = 0x4D4F4341
+COMMIT = struct.Struct("<IIIHHqI")
+COMMIT_SLOT_SIZE = 512
+COMMIT_SLOTS = 2
+
+
+def cstr(raw: bytes) -> str:
+    return raw.split(b"\0", 1)[0].decode("ascii", "replace")
+
+
+class FrameLog:
+    """File header and latest commit of a frame log, ValueError if it is not one."""
+
+    def __init__(self, data: bytes):
+        if len(data) < FILE_HEADER.size + CRC.size:
+            raise ValueError("file shorter than its header")
+        (magic, version, self.header_size, self.block_size, _reserved, self.bitrate, self.schema,
+         self.created_us, firmware) = FILE_HEADER.unpack_from(data)
+        if magic != MAGIC:
+            raise ValueError("not a frame log (bad magic)")
+        if version not in VERSIONS:
+            raise ValueError(f"unsupported format version {version}")
+        (crc,) = CRC.unpack_from(data, self.header_size - CRC.size)
+        if zlib.crc32(data[:self.header_size - CRC.size]) != crc:
+            raise ValueError("file header CRC mismatch")
+        self.tag = crc & 0xFFFF  # framelog_file_tag
+        self.firmware = cstr(firmware)
+
+        # BINLOG_COMMIT_OFFSET / BINLOG_DATA_OFFSET
+        self.commit = None
+        slots = -(-self.header_size // COMMIT_SLOT_SIZE) * COMMIT_SLOT_SIZE
+        self.data_offset = slots + COMMIT_SLOTS * COMMIT_SLOT_SIZE
+        for i in range(COMMIT_SLOTS):
+            offset = slots + i * COMMIT_SLOT_SIZE
+            if offset + COMMIT.size > len(data):
+                continue
+            magic, count, end, tag, _reserved, time_us, slot_crc = COMMIT.unpack_from(data, offset)
+            if (magic == COMMIT_MAGIC and tag == self.tag and
+                    slot_crc == zlib.crc32(data[offset:offset + COMMIT.size - CRC.size]) and
+                    (self.commit is None or count > self.commit["count"])):
+                self.commit = {"count": count, "end": end, "time_us": time_us}
+
+
+def frames(log: FrameLog, data: bytes, report, stats: dict):
+    """Yield (time_us, id, extd, rtr, dlc, payload) of every frame of the valid blocks.
+
+    report(text, problem=True) is called for every gap, damaged block and lost frame count.
+    stats (dict) receives the block, frame and lost frame counts."""
+    offset = log.data_offset
+    expected = 0
+    magic_bytes = struct.pack("<I", BLOCK_MAGIC)
+    while offset + BLOCK_HEADER.size <= len(data):
+        magic, sequence, count, tag, size, lost, base_us = BLOCK_HEADER.unpack_from(data, offset)
+        end = offset + BLOCK_HEADER.size + size
+        valid = (magic == BLOCK_MAGIC and tag == log.tag and 0 < count and end + CRC.size <= len(data) and
+                 end + CRC.size - offset <= log.block_size and
+                 CRC.unpack_from(data, end)[0] == zlib.crc32(data[offset:end]))
+        if not valid:
+            following = data.find(magic_bytes, offset + 1)
+            report(f"damaged block at byte {offset}, skipped {(following if following >= 0 else len(data)) - offset} bytes")
+            if following < 0:
+                return
+            offset = following
+            continue
+        if sequence == 0 and expected != 0:
+            report(f"session appended at byte {offset}", problem=False)
+        elif sequence != expected:
+            report(f"blocks {expected}..{sequence - 1} missing before byte {offset}")
+        if lost:
+            report(f"{lost} frames lost by the logger before block {sequence}", problem=False)
+        stats["blocks"] = stats.get("blocks", 0) + 1
+        stats["lost"] = stats.get("lost", 0) + lost
+
+        p = offset + BLOCK_HEADER.size
+        for _ in range(count):
+            dt_us, can_id, info = FRAME.unpack_from(data, p)
+            p += FRAME.size
+            dlc = info & INFO_DLC
+            rtr = bool(info & INFO_RTR)
+            length = 0 if rtr else min(dlc, 8)
+            yield base_us + dt_us, can_id, bool(info & INFO_EXTD), rtr, dlc, data[p:p + length]
+            p += length
+        stats["frames"] = stats.get("frames", 0) + count
+        expected = sequence + 1
+        offset = end + CRC.size
+    if offset != len(data):
+        report(f"{len(data) - offset} trailing bytes (block cut by a power loss)")
+
+
+def candump_line(time_us: int, can_id: int, extd: bool, rtr: bool, dlc: int, payload: bytes) -> str:
+    ident = f"{can_id:08X}" if extd else f"{can_id:03X}"
+    body = "R" if rtr else payload.hex().upper()
+    return f"({time_us // 1000000}.{time_us % 1000000:06d}) can0 {ident}#{body}"
+
+
+def asc_line(seconds: float, can_id: int, extd: bool, rtr: bool, dlc: int, payload: bytes) -> str:
+    ident = f"{can_id:X}x" if extd else f"{can_id:X}"
+    body = "r" if rtr else f"d {dlc} " + " ".join(f"{b:02X}" for b in payload)
+    return f"{seconds:11.6f} 1  {ident:<15} Rx   {body}"
+
+
+def asc_date(time_us: int) -> str:
+    stamp = datetime.fromtimestamp(time_us / 1e6, tz=timezone.utc)
+    return stamp.strftime("%a %b %d %I:%M:%S.") + f"{stamp.microsecond // 1000:03d} " + stamp.strftime("%p %Y").lower()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("input", help="raw frame log (LOG_<n>.CAN)")
+    parser.add_argument("-o", "--output", help="output file (default: input with a .log or .asc suffix)")
+    parser.add_argument("--asc", action="store_true", help="write Vector ASC instead of a candump log")
+    parser.add_argument("--check", action="store_true", help="only check the CRCs, block sequence and losses")
+    args = parser.parse_args()
+
+    data = pathlib.Path(args.input).read_bytes()
+    try:
+        log = FrameLog(data)
+    except ValueError as err:
+        raise SystemExit(f"{args.input}: {err}")
+    problems = []
+    stats = {}
+
+    def report(text, problem=True):
+        if problem:
+            problems.append(text)
+        print(f"{args.input}: {text}", file=sys.stderr)
+
+    if args.check:
+        for _ in frames(log, data, report, stats):
+            pass
+        if log.commit is not None:
+            stamp = datetime.fromtimestamp(log.commit["time_us"] / 1e6, tz=timezone.utc)
+            print(f"{args.input}: commit {log.commit['count']} at {stamp:%Y-%m-%d %H:%M:%S} UTC, "
+                  f"{log.commit['end']} of {len(data)} bytes committed")
+    else:
+        output = pathlib.Path(args.output) if args.output else \
+            pathlib.Path(args.input).with_suffix(".asc" if args.asc else ".log")
+        with open(output, "w", newline="\n") as out:
+            if args.asc:
+                start_us = None
+                for time_us, can_id, extd, rtr, dlc, payload in frames(log, data, report, stats):
+                    if start_us is None:
+                        start_us = time_us
+                        out.write(f"date {asc_date(time_us)}\nbase hex  timestamps absolute\n"
+                                  f"internal events logged\n// bitrate {log.bitrate}, firmware {log.firmware}\n"
+                                  f"Begin Triggerblock {asc_date(time_us)}\n   0.000000 Start of measurement\n")
+                    out.write(asc_line((time_us - start_us) / 1e6, can_id, extd, rtr, dlc, payload) + "\n")
+                if start_us is not None:
+                    out.write("End TriggerBlock\n")
+            else:
+                for frame in frames(log, data, report, stats):
+                    out.write(candump_line(*frame) + "\n")
+    print(f"{args.input}: firmware {log.firmware}, {log.bitrate} bit/s, {stats.get('frames', 0)} frames in "
+          f"{stats.get('blocks', 0)} blocks, {stats.get('lost', 0)} lost, {len(problems)} problems")
+    sys.exit(1 if problems and args.check else 0)
+
+
+if __name__ == "__main__":
+    main()
@@ -1,24 +1,167 @@
+import argparse
 import threading
 import socket
 import ssl
+import struct
+import zlib
+from datetime import datetime, timezone
 import tkinter as tk
 from tkinter.scrolledtext import ScrolledText
 
 import paho.mqtt.client as mqtt
 
+from binlog_to_csv import BinLog, CRC, FILE_HEADER
+
 # MQTT configuration - mirrors telemetry_config.h
 MQTT_HOST = "5aeaff002e7c423299c2d92361292d54.s1.eu.hivemq.cloud"
 MQTT_PORT = 8883
 MQTT_USER = "yousef"
 MQTT_PASS = "Yousef123"
 MQTT_TOPIC = "com/yousef/esp32/data"
+MQTT_STATS_TOPIC = MQTT_TOPIC + "/stats"
+MQTT_RECORD_TOPIC = MQTT_TOPIC + "/records"
+MQTT_SCHEMA_TOPIC = MQTT_TOPIC + "/schema"
+
+# Host build (host/README.md): local broker without TLS
+LOCAL_MQTT_HOST = "127.0.0.1"
+LOCAL_MQTT_PORT = 1883
 
 # UDP configuration - listen on all interfaces
 UDP_PORT = 19132
 
 
+# Frame packet - mirrors telemetry_frame_t (src/telemetry_config.h): UTC receive time + twai_message_t
+FRAME_PACKET = struct.Struct("<qIIB8s3x")
+TWAI_FLAG_EXTD = 0x1
+TWAI_FLAG_RTR = 0x2
+
+
+def format_frame(data: bytes) -> str:
+    """Return a readable CAN frame, or an empty string if data is not a frame packet."""
+    if len(data) != FRAME_PACKET.size:
+        return ""
+    time_us, flags, can_id, dlc, payload = FRAME_PACKET.unpack(data)
+    stamp = datetime.fromtimestamp(time_us / 1e6, tz=timezone.utc).strftime("%H:%M:%S.%f")
+    id_text = f"0x{can_id:08X}" if flags & TWAI_FLAG_EXTD else f"0x{can_id:03X}"
+    rtr = " RTR" if flags & TWAI_FLAG_RTR else ""
+    return f"{stamp} {id_text} [{dlc}]{rtr} {payload[:min(dlc, 8)].hex(' ')}"
+
+
+# Bus statistics packet - mirrors can_stats_report_t (src/can_stats/can_stats.h)
+STATS_MAGIC = 0x41545343
+STATS_HEADER = struct.Struct("<IBBHIII")
+STATS_ENTRY = struct.Struct("<IBBHIIII8I")
+JITTER_LABELS = ("<64us", "<128us", "<256us", "<512us", "<1ms", "<2ms", "<4ms", ">=4ms")
+
+
+def format_stats(data: bytes) -> str:
+    """Return a readable bus statistics report, or an empty string if data is not one."""
+    if len(data) < STATS_HEADER.size:
+        return ""
+    magic, version, count, load, uptime, frames, untracked = STATS_HEADER.unpack_from(data)
+    if magic != STATS_MAGIC or len(data) != STATS_HEADER.size + count * STATS_ENTRY.size:
+        return ""
+    lines = [f"Bus stats v{version} @ {uptime / 1000:.1f}s: load {load / 10:.1f}%, "
+             f"{frames} frames, {untracked} untracked"]
+    for i in range(count):
+        (can_id, extd, dlc, rate, total, dlc_bad, age, period,
+         *jitter) = STATS_ENTRY.unpack_from(data, STATS_HEADER.size + i * STATS_ENTRY.size)
+        age_text = "never" if age == 0xFFFFFFFF else f"{age} ms"
+        histogram = " ".join(f"{label}:{n}" for label, n in zip(JITTER_LABELS, jitter) if n)
+        lines.append(f"  0x{can_id:0{8 if extd else 3}X} {rate / 10:.1f} Hz, {total} frames, "
+                     f"DLC mismatch {dlc_bad}, age {age_text}, period {period} us, jitter {histogram or '-'}")
+    return "\n".join(lines)
+
+
+# Card health packet - mirrors sd_health_report_t (src/sd_health/sd_health.h)
+HEALTH_MAGIC = 0x4C484453
+HEALTH_PACKET = struct.Struct("<IBBBBI" + "5I" * 3 + "4I" + "Q5I" + "4I" + "16I" + "12I")
+HEALTH_FLAGS = ("qualified", "untested", "slow", "dropping", "errors", "recovering")
+HEALTH_RECOVERY = ("up", "lost", "remounting", "mounted")  # sd_recovery_state_t
+HEALTH_LABELS = tuple(f"<{64 << k}us" for k in range(15)) + (f">={64 << 15}us",)
+
+
+def format_health(data: bytes) -> str:
+    """Return a readable card health report, or an empty string if data is not one."""
+    if len(data) != HEALTH_PACKET.size:
+        return ""
+    magic, version, status, recovery, _, uptime, *fields = HEALTH_PACKET.unpack(data)
+    if magic != HEALTH_MAGIC:
+        return ""
+    sizes = [fields[i * 5:i * 5 + 5] for i in range(3)]
+    (sync_max, write_size, sync_bytes, sync_ms, written, writes, syncs, errors, stalls, dropped,
+     p50, p99, p999, worst, *rest) = fields[15:]
+    hist = rest[:16]
+    (outages, attempts, down_ms, rows, spilled, replayed, spill_dropped, spill_pending,
+     row_dropped, row_torn, unverified, frames_lost) = rest[16:]
+    flags = ", ".join(name for bit, name in enumerate(HEALTH_FLAGS) if status & (1 << bit)) or "not qualified"
+    lines = [f"SD health v{version} @ {uptime / 1000:.1f}s: {flags}; policy {write_size} B writes, "
+             f"sync every {sync_bytes} bytes or {sync_ms} ms"]
+    for size, write_kbps, read_kbps, size_p99, size_max in sizes:
+        lines.append(f"  test {size} B: write {write_kbps} kB/s, read {read_kbps} kB/s, "
+                     f"p99 {size_p99} us, max {size_max} us")
+    histogram = " ".join(f"{label}:{n}" for label, n in zip(HEALTH_LABELS, hist) if n)
+    lines.append(f"  session: {written} bytes, {writes} writes, {syncs} syncs, {errors} errors, {stalls} stalls, "
+                 f"{dropped} bytes dropped; p50 {p50} us, p99 {p99} us, p99.9 {p999} us, max {worst} us "
+                 f"(slowest qualification fsync {sync_max} us)")
+    lines.append(f"  latency {histogram or '-'}")
+    state = HEALTH_RECOVERY[recovery] if recovery < len(HEALTH_RECOVERY) else str(recovery)
+    lines.append(f"  card {state}: {outages} outages, {attempts} remount attempts, down {down_ms} ms; "
+                 f"{rows} rows, {spilled} spilled ({replayed} written back, {spill_pending} pending, "
+                 f"{spill_dropped} overwritten), {row_dropped} dropped, {row_torn} torn ({unverified} unverified); "
+                 f"{frames_lost} frames lost")
+    return "\n".join(lines)
+
+
+# Record packet - mirrors record_codec_packet_t (src/record_codec/record_codec.h), the rows are
+# described by the binlog file header retained on MQTT_SCHEMA_TOPIC
+RECORD_MAGIC = 0x43455241
+RECORD_HEADER = struct.Struct("<IIIHH")
+
+
+class RecordStream:
+    """Decoder of the record packets, set up by the schema message."""
+
+    def __init__(self):
+        self.log = None
+        self.schema = 0
+        self.sequence = None
+
+    def set_schema(self, data: bytes) -> str:
+        try:
+            self.log = BinLog(data)
+        except ValueError as error:
+            self.log = None
+            return f"Bad record schema: {error}"
+        self.schema = zlib.crc32(data[FILE_HEADER.size:self.log.header_size - CRC.size])  # binlog_schema_id
+        return (f"Record schema 0x{self.schema:08X}: {len(self.log.messages)} messages, "
+                f"{len(self.log.signals)} signals, firmware {self.log.firmware}")
+
+    def format(self, data: bytes) -> str:
+        """Return the packet summary and its latest row, or an empty string if data is not a packet."""
+        if len(data) < RECORD_HEADER.size:
+            return ""
+        magic, schema, sequence, count, size = RECORD_HEADER.unpack_from(data)
+        if magic != RECORD_MAGIC or len(data) != RECORD_HEADER.size + size:
+            return ""
+        if self.log is None or schema != self.schema:
+            return f"Records #{sequence}: schema 0x{schema:08X} unknown, waiting for {MQTT_SCHEMA_TOPIC}"
+        lost = "" if self.sequence is None or sequence <= self.sequence + 1 else f", {sequence - self.sequence - 1} lost"
+        self.sequence = sequence
+        try:
+            records = self.log.decode_records(data[RECORD_HEADER.size:], count)
+        except (ValueError, struct.error):
+            return f"Records #{sequence}: corrupt packet"
+        ratio = count * self.log.record_size / len(data)
+        return (f"Records #{sequence}: {count} rows in {len(data)} bytes (ratio {ratio:.2f}){lost}\n"
+                f"  {self.log.csv_row(records[-1], '', False)}")
+
+
 def format_data(data: bytes) -> str:
     """Return a readable representation of received data."""
+    decoded = format_stats(data) or format_health(data) or format_frame(data)
+    if decoded:
+        return decoded
     try:
         text = data.decode().strip()
         if text:
@@ -41,20 +184,32 @@ class ReceiverGUI:
 
 
 class MqttListener:
-    def __init__(self, gui: ReceiverGUI):
+    def __init__(self, gui: ReceiverGUI, local: bool = False):
         self.gui = gui
         self.client = mqtt.Client()
         self.client.username_pw_set(MQTT_USER, MQTT_PASS)
-        self.client.tls_set_context(ssl.create_default_context())
+        if local:
+            self.client.connect(LOCAL_MQTT_HOST, LOCAL_MQTT_PORT)
+        else:
+            self.client.tls_set_context(ssl.create_default_context())
+            self.client.connect(MQTT_HOST, MQTT_PORT)
         self.client.on_connect = self.on_connect
         self.client.on_message = self.on_message
-        self.client.connect(MQTT_HOST, MQTT_PORT)
+        self.records = RecordStream()
 
     def on_connect(self, client, userdata, flags, rc, properties=None):
         client.subscribe(MQTT_TOPIC)
+        client.subscribe(MQTT_STATS_TOPIC)
+        client.subscribe(MQTT_SCHEMA_TOPIC)
+        client.subscribe(MQTT_RECORD_TOPIC)
 
     def on_message(self, client, userdata, msg):
-        text = format_data(msg.payload)
+        if msg.topic == MQTT_SCHEMA_TOPIC:
+            text = self.records.set_schema(msg.payload)
+        elif msg.topic == MQTT_RECORD_TOPIC:
+            text = self.records.format(msg.payload) or format_data(msg.payload)
+        else:
+            text = format_data(msg.payload)
         self.gui.display("MQTT", text)
 
     def start(self):
@@ -76,9 +231,13 @@ class UdpListener(threading.Thread):
 
 
 def main():
+    parser = argparse.ArgumentParser(description="Telemetry receiver (UDP + MQTT)")
+    parser.add_argument("--local", action="store_true", help="use the local broker of the host build")
+    args = parser.parse_args()
+
     root = tk.Tk()
     gui = ReceiverGUI(root)
-    mqtt_listener = MqttListener(gui)
+    mqtt_listener = MqttListener(gui, args.local)
     mqtt_listener.start()
     udp_listener = UdpListener(gui)
     udp_listener.start()
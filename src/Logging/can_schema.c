@@ -0,0 +1,133 @@
+/*
+ * can_schema.c
+ *
+ *  Description: Code generated from the CAN schema tables (can_schema.h):
+ *               decoders, wire encoders, signal descriptors and compile time layout checks.
+ *      Note: Payloads are little-endian, a signal at BIT/WIDTH is (payload >> BIT) & ((1 << WIDTH) - 1).
+ *            This is the layout the former uint64_t bit-field structs had with GCC on the ESP32.
+ */
+
+#include "can_schema.h"
+#include <string.h>
+
+/*
+ * ================================================================
+ * 							Compile Time Checks
+ * ================================================================
+ *
+ * */
+#define COMM_SIGNAL_MASK(BIT, WIDTH) ((((uint64_t)1 << (WIDTH)) - 1) << (BIT))
+#define COMM_IS_F32_U16 0
+#define COMM_IS_F32_U32 0
+#define COMM_IS_F32_F32 1
+
+// Every signal fits its payload and its C type, floats are exactly 32 bits wide
+#define COMM_X_CHECK_SIGNAL(P, FIELD, CSV, TYPE, BIT, WIDTH, SCALE, UNIT)                          \
+    _Static_assert((BIT) + (WIDTH) <= (P) * 8, "Signal " CSV " exceeds its payload");              \
+    _Static_assert((WIDTH) <= sizeof(COMM_CTYPE_##TYPE) * 8, "Signal " CSV " does not fit its type"); \
+    _Static_assert(!COMM_IS_F32_##TYPE || ((WIDTH) == 32), "Float signal " CSV " must be 32 bits wide");
+
+// Signals of a message never overlap: the sum of their masks equals their union
+#define COMM_X_MASK_SUM(P, FIELD, CSV, TYPE, BIT, WIDTH, SCALE, UNIT) +COMM_SIGNAL_MASK(BIT, WIDTH)
+#define COMM_X_MASK_OR(P, FIELD, CSV, TYPE, BIT, WIDTH, SCALE, UNIT) | COMM_SIGNAL_MASK(BIT, WIDTH)
+#define COMM_X_CHECK_MESSAGE(P, NAME, ID, EXTD, ELEMENT, DLC)                                    \
+    _Static_assert((DLC) <= TWAI_FRAME_MAX_DLC, #NAME " payload is longer than a CAN frame");    \
+    _Static_assert((EXTD) ? ((ID) <= TWAI_EXTD_ID_MASK) : ((ID) <= TWAI_STD_ID_MASK), #NAME " identifier out of range"); \
+    _Static_assert(sizeof(COMM_message_##NAME##_t) <= UINT8_MAX, #NAME " decoded struct is too large"); \
+    _Static_assert((0 COMM_SIGNALS_##NAME(COMM_X_MASK_SUM, _)) == (0 COMM_SIGNALS_##NAME(COMM_X_MASK_OR, _)), \
+                   #NAME " has overlapping signals");                                            \
+    COMM_SIGNALS_##NAME(COMM_X_CHECK_SIGNAL, DLC)
+
+COMM_MESSAGE_TABLE(COMM_X_CHECK_MESSAGE, _)
+
+/*
+ * ================================================================
+ * 							Local Functions Definition
+ * ================================================================
+ *
+ * */
+static inline uint64_t COMM_load_payload(const twai_message_t *msg)
+{
+    uint64_t raw = 0;
+    uint8_t dlc = (msg->data_length_code < TWAI_FRAME_MAX_DLC) ? msg->data_length_code : TWAI_FRAME_MAX_DLC;
+    for (uint8_t i = 0; i < dlc; i++)
+    {
+        raw |= (uint64_t)msg->data[i] << (8 * i);
+    }
+    return raw;
+}
+
+static inline void COMM_store_payload(uint64_t raw, twai_message_t *msg)
+{
+    for (uint8_t i = 0; i < TWAI_FRAME_MAX_DLC; i++)
+    {
+        msg->data[i] = (uint8_t)(raw >> (8 * i));
+    }
+}
+
+static inline float COMM_u32_to_f32(uint32_t bits)
+{
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+static inline uint32_t COMM_f32_to_u32(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+/*
+ * ================================================================
+ * 							Generated Decoders & Encoders
+ * ================================================================
+ *
+ * */
+#define COMM_DECODE_U16(RAW, BIT, WIDTH) ((uint16_t)(((RAW) >> (BIT)) & COMM_SIGNAL_MASK(0, WIDTH)))
+#define COMM_DECODE_U32(RAW, BIT, WIDTH) ((uint32_t)(((RAW) >> (BIT)) & COMM_SIGNAL_MASK(0, WIDTH)))
+#define COMM_DECODE_F32(RAW, BIT, WIDTH) COMM_u32_to_f32((uint32_t)((RAW) >> (BIT)))
+
+#define COMM_ENCODE_U16(VALUE, BIT, WIDTH) (((uint64_t)(VALUE) & COMM_SIGNAL_MASK(0, WIDTH)) << (BIT))
+#define COMM_ENCODE_U32(VALUE, BIT, WIDTH) (((uint64_t)(VALUE) & COMM_SIGNAL_MASK(0, WIDTH)) << (BIT))
+#define COMM_ENCODE_F32(VALUE, BIT, WIDTH) ((uint64_t)COMM_f32_to_u32(VALUE) << (BIT))
+
+#define COMM_X_DECODE_SIGNAL(P, FIELD, CSV, TYPE, BIT, WIDTH, SCALE, UNIT) out->FIELD = COMM_DECODE_##TYPE(raw, BIT, WIDTH);
+#define COMM_X_ENCODE_SIGNAL(P, FIELD, CSV, TYPE, BIT, WIDTH, SCALE, UNIT) raw |= COMM_ENCODE_##TYPE(in->FIELD, BIT, WIDTH);
+
+#define COMM_X_CODEC(P, NAME, ID, EXTD, ELEMENT, DLC)                                  \
+    void COMM_decode_##NAME(const twai_message_t *msg, void *dest, uint8_t size)       \
+    {                                                                                  \
+        COMM_message_##NAME##_t *out = (COMM_message_##NAME##_t *)dest;                \
+        uint64_t raw = COMM_load_payload(msg);                                         \
+        (void)size;                                                                    \
+        COMM_SIGNALS_##NAME(COMM_X_DECODE_SIGNAL, _)                                   \
+    }                                                                                  \
+    void COMM_encode_##NAME(const COMM_message_##NAME##_t *in, twai_message_t *msg)    \
+    {                                                                                  \
+        uint64_t raw = 0;                                                              \
+        COMM_SIGNALS_##NAME(COMM_X_ENCODE_SIGNAL, _)                                   \
+        memset(msg, 0, sizeof(*msg));                                                  \
+        msg->identifier = (ID);                                                        \
+        msg->extd = (EXTD);                                                            \
+        msg->data_length_code = (DLC);                                                 \
+        COMM_store_payload(raw, msg);                                                  \
+    }
+
+COMM_MESSAGE_TABLE(COMM_X_CODEC, _)
+
+/*
+ * ================================================================
+ * 							Generated Signal Descriptors
+ * ================================================================
+ *
+ * */
+#define COMM_X_SIGNAL_INFO(P, FIELD, CSV, TYPE, BIT, WIDTH, SCALE, UNIT) \
+    {.can_id = (P), .name = CSV, .type = COMM_TYPE_##TYPE, .bit = (BIT), .width = (WIDTH), .scale = (SCALE), .unit = UNIT},
+#define COMM_X_MESSAGE_INFO(P, NAME, ID, EXTD, ELEMENT, DLC) COMM_SIGNALS_##NAME(COMM_X_SIGNAL_INFO, ID)
+
+const COMM_signal_info_t COMM_signals[] = {
+    COMM_MESSAGE_TABLE(COMM_X_MESSAGE_INFO, _)};
+const uint16_t COMM_signal_count = sizeof(COMM_signals) / sizeof(COMM_signals[0]);
+_Static_assert(sizeof(COMM_signals) / sizeof(COMM_signals[0]) == COMM_SIGNAL_COUNT, "COMM_SIGNAL_COUNT out of sync");
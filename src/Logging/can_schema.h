@@ -0,0 +1,205 @@
+/*
+ * can_schema.h
+ *
+ *  Description: Single source of truth for every logged CAN message and its signals.
+ *               The X-macro tables below generate the CAN ID enum, the decoded message structs,
+ *               the SDIO_TxBuffer record layout, the decoders / wire encoders (can_schema.c),
+ *               the dispatch table (logging.c), the .CSV header / row format and the compile time
+ *               size and overlap checks. Adding a message = one COMM_MESSAGE_TABLE row + its
+ *               COMM_SIGNALS_<NAME> list, nothing else has to be edited.
+ */
+
+#ifndef CAN_SCHEMA_H
+#define CAN_SCHEMA_H
+
+//==================================Standard Libraries Includes=======================//
+#include <stdint.h>
+#include <stdbool.h>
+#include <inttypes.h>
+
+//==================================ESP32 Libraries Includes==========================//
+#include "driver/twai.h"
+
+//===============================================
+// Schema Tables
+//===============================================
+
+/*
+ * COMM_MESSAGE_TABLE(X, P): X(P, NAME, ID, EXTD, ELEMENT, DLC)
+ *   P       - Pass-through argument of the generator
+ *   NAME    - Generates COMM_CAN_ID_<NAME>, COMM_message_<NAME>_t, COMM_decode_<NAME>, COMM_encode_<NAME>
+ *   ID      - CAN identifier
+ *   EXTD    - true for a 29-bit identifier
+ *   ELEMENT - Element holding the message inside SDIO_TxBuffer
+ *   DLC     - Payload length in bytes
+ *   Table order = order of the columns in the .CSV file
+ */
+#define COMM_MESSAGE_TABLE(X, P)                                \
+	X(P, ADC, 0x006, false, adc, 8)                             \
+	X(P, PROX_ENCODER, 0x007, false, prox_encoder, 8)           \
+	X(P, IMU_ANGLE, 0x004, false, imu_ang, 6)                   \
+	X(P, IMU_ACCEL, 0x005, false, imu_accel, 6)                 \
+	X(P, TEMP, 0x009, false, temp, 8)                           \
+	X(P, GPS_LATLONG, 0x008, false, gps, 8)
+
+/*
+ * COMM_SIGNALS_<NAME>(S, P): S(P, FIELD, CSV, TYPE, BIT, WIDTH, SCALE, UNIT)
+ *   FIELD - Element inside COMM_message_<NAME>_t
+ *   CSV   - Column name in the .CSV header
+ *   TYPE  - U16 / U32 (unsigned bit-field) or F32 (IEEE-754 float, WIDTH must be 32)
+ *   BIT   - Offset of the LSB inside the little-endian payload
+ *   WIDTH - Width in bits
+ *   SCALE - Physical value = raw * SCALE (metadata for host tools, the .CSV holds raw values)
+ *   UNIT  - Physical unit
+ */
+#define COMM_SIGNALS_ADC(S, P)                                  \
+	S(P, SUS_1, "SUS_1", U16, 0, 10, 1.0f, "")                  \
+	S(P, SUS_2, "SUS_2", U16, 10, 10, 1.0f, "")                 \
+	S(P, SUS_3, "SUS_3", U16, 20, 10, 1.0f, "")                 \
+	S(P, SUS_4, "SUS_4", U16, 30, 10, 1.0f, "")                 \
+	S(P, PRESSURE_1, "PRESSURE_1", U16, 40, 10, 1.0f, "")       \
+	S(P, PRESSURE_2, "PRESSURE_2", U16, 50, 10, 1.0f, "")
+
+#define COMM_SIGNALS_PROX_ENCODER(S, P)                         \
+	S(P, RPM_front_left, "RPM_FL", U16, 0, 11, 1.0f, "rpm")     \
+	S(P, RPM_front_right, "RPM_FR", U16, 11, 11, 1.0f, "rpm")   \
+	S(P, RPM_rear_left, "RPM_RL", U16, 22, 11, 1.0f, "rpm")     \
+	S(P, RPM_rear_right, "RPM_RR", U16, 33, 11, 1.0f, "rpm")    \
+	S(P, ENCODER_angle, "ENC_ANGLE", U16, 44, 10, 1.0f, "")     \
+	S(P, Speedkmh, "SPEED_KMH", U16, 54, 8, 1.0f, "km/h")
+
+#define COMM_SIGNALS_IMU_ANGLE(S, P)                            \
+	S(P, x, "IMU_Ang_X", U16, 0, 16, 1.0f, "")                  \
+	S(P, y, "IMU_Ang_Y", U16, 16, 16, 1.0f, "")                 \
+	S(P, z, "IMU_Ang_Z", U16, 32, 16, 1.0f, "")
+
+#define COMM_SIGNALS_IMU_ACCEL(S, P)                            \
+	S(P, x, "IMU_Accel_X", U16, 0, 16, 1.0f, "")                \
+	S(P, y, "IMU_Accel_Y", U16, 16, 16, 1.0f, "")               \
+	S(P, z, "IMU_Accel_Z", U16, 32, 16, 1.0f, "")
+
+#define COMM_SIGNALS_TEMP(S, P)                                 \
+	S(P, Temp_front_left, "Temp_FL", U16, 0, 16, 1.0f, "")      \
+	S(P, Temp_front_right, "Temp_FR", U16, 16, 16, 1.0f, "")    \
+	S(P, Temp_rear_left, "Temp_RL", U16, 32, 16, 1.0f, "")      \
+	S(P, Temp_rear_right, "Temp_RR", U16, 48, 16, 1.0f, "")
+
+#define COMM_SIGNALS_GPS_LATLONG(S, P)                          \
+	S(P, longitude, "GPS_Long", F32, 0, 32, 1.0f, "deg")        \
+	S(P, latitude, "GPS_Lat", F32, 32, 32, 1.0f, "deg")
+
+//===============================================
+// Generated: Types
+//===============================================
+
+// Signal type tokens -> C types
+#define COMM_CTYPE_U16 uint16_t
+#define COMM_CTYPE_U32 uint32_t
+#define COMM_CTYPE_F32 float
+
+// CAN IDs
+#define COMM_X_ID(P, NAME, ID, EXTD, ELEMENT, DLC) COMM_CAN_ID_##NAME = (ID),
+typedef enum
+{
+	COMM_MESSAGE_TABLE(COMM_X_ID, _)
+} COMM_CAN_ID_t;
+#undef COMM_X_ID
+
+// Decoded message structures: COMM_message_<NAME>_t
+#define COMM_X_FIELD(P, FIELD, CSV, TYPE, BIT, WIDTH, SCALE, UNIT) COMM_CTYPE_##TYPE FIELD;
+#define COMM_X_STRUCT(P, NAME, ID, EXTD, ELEMENT, DLC) \
+	typedef struct                                     \
+	{                                                  \
+		COMM_SIGNALS_##NAME(COMM_X_FIELD, _)           \
+	} COMM_message_##NAME##_t;
+COMM_MESSAGE_TABLE(COMM_X_STRUCT, _)
+#undef COMM_X_STRUCT
+#undef COMM_X_FIELD
+
+// Number of messages, table order gives each one its index (= dispatch slot)
+#define COMM_X_COUNT(P, NAME, ID, EXTD, ELEMENT, DLC) +1
+#define COMM_MESSAGE_COUNT (0 COMM_MESSAGE_TABLE(COMM_X_COUNT, _))
+#define COMM_X_SIGNAL_ONE(P, FIELD, CSV, TYPE, BIT, WIDTH, SCALE, UNIT) +1
+#define COMM_X_SIGNAL_COUNT(P, NAME, ID, EXTD, ELEMENT, DLC) COMM_SIGNALS_##NAME(COMM_X_SIGNAL_ONE, _)
+#define COMM_SIGNAL_COUNT (0 COMM_MESSAGE_TABLE(COMM_X_SIGNAL_COUNT, _)) // Entries of COMM_signals
+
+// Record layout: one element per message, expanded inside SDIO_TxBuffer
+#define COMM_X_RECORD_ELEMENT(P, NAME, ID, EXTD, ELEMENT, DLC) COMM_message_##NAME##_t ELEMENT;
+#define COMM_RECORD_ELEMENTS COMM_MESSAGE_TABLE(COMM_X_RECORD_ELEMENT, _)
+
+// Signal descriptors (self-describing logs / host tools)
+typedef enum
+{
+	COMM_TYPE_U16,
+	COMM_TYPE_U32,
+	COMM_TYPE_F32,
+} COMM_signal_type_t;
+
+typedef struct
+{
+	uint32_t can_id;	// Identifier of the message carrying the signal
+	const char *name;	// .CSV column name
+	uint8_t type;		// @ref COMM_signal_type_t
+	uint8_t bit;		// Offset of the LSB inside the payload
+	uint8_t width;		// Width in bits
+	float scale;		// Physical value = raw * scale
+	const char *unit;	// Physical unit
+} COMM_signal_info_t;
+
+//===============================================
+// Generated: .CSV Header & Row Format
+//===============================================
+
+#define COMM_X_CSV_NAME(P, FIELD, CSV, TYPE, BIT, WIDTH, SCALE, UNIT) "," CSV
+#define COMM_X_CSV_MESSAGE_NAMES(P, NAME, ID, EXTD, ELEMENT, DLC) COMM_SIGNALS_##NAME(COMM_X_CSV_NAME, _)
+#define COMM_CSV_HEADER COMM_MESSAGE_TABLE(COMM_X_CSV_MESSAGE_NAMES, _) // ",SUS_1,SUS_2,..."
+
+// Receive time of each message relative to the row timestamp, in table order
+#define COMM_X_CSV_TIME_NAME(P, NAME, ID, EXTD, ELEMENT, DLC) "," #NAME "_dt_us"
+#define COMM_CSV_TIME_HEADER COMM_MESSAGE_TABLE(COMM_X_CSV_TIME_NAME, _) // ",ADC_dt_us,PROX_ENCODER_dt_us,..."
+
+#define COMM_CSV_FMT_U16 ",%u"
+#define COMM_CSV_FMT_U32 ",%" PRIu32
+#define COMM_CSV_FMT_F32 ",%f"
+#define COMM_X_CSV_FMT(P, FIELD, CSV, TYPE, BIT, WIDTH, SCALE, UNIT) COMM_CSV_FMT_##TYPE
+#define COMM_X_CSV_MESSAGE_FMT(P, NAME, ID, EXTD, ELEMENT, DLC) COMM_SIGNALS_##NAME(COMM_X_CSV_FMT, _)
+#define COMM_CSV_FORMAT COMM_MESSAGE_TABLE(COMM_X_CSV_MESSAGE_FMT, _) // ",%u,%u,...,%f"
+
+// Arguments matching COMM_CSV_FORMAT, taken from a pointer to SDIO_TxBuffer
+#define COMM_CSV_ARG_U16(VALUE) , (unsigned int)(VALUE)
+#define COMM_CSV_ARG_U32(VALUE) , (uint32_t)(VALUE)
+#define COMM_CSV_ARG_F32(VALUE) , (double)(VALUE)
+#define COMM_X_CSV_ARG(P, FIELD, CSV, TYPE, BIT, WIDTH, SCALE, UNIT) COMM_CSV_ARG_##TYPE((P).FIELD)
+#define COMM_X_CSV_MESSAGE_ARGS(P, NAME, ID, EXTD, ELEMENT, DLC) COMM_SIGNALS_##NAME(COMM_X_CSV_ARG, (P)->ELEMENT)
+#define COMM_CSV_ARGS(BUF) COMM_MESSAGE_TABLE(COMM_X_CSV_MESSAGE_ARGS, BUF)
+
+// Same columns appended to a row_builder_t (row_builder.h) without printf: statements, P = (ROW, BUF)
+#define COMM_CSV_F32_DECIMALS 6 // Precision of "%f"
+#define COMM_CSV_PUT_U16(ROW, VALUE) row_builder_u32(ROW, (VALUE))
+#define COMM_CSV_PUT_U32(ROW, VALUE) row_builder_u32(ROW, (VALUE))
+#define COMM_CSV_PUT_F32(ROW, VALUE) row_builder_f32(ROW, (VALUE), COMM_CSV_F32_DECIMALS)
+#define COMM_CSV_ROW(ROW, BUF) (ROW)
+#define COMM_CSV_BUF(ROW, BUF) (BUF)
+#define COMM_X_CSV_PUT(P, FIELD, CSV, TYPE, BIT, WIDTH, SCALE, UNIT) \
+	row_builder_char(COMM_CSV_ROW P, ',');                            \
+	COMM_CSV_PUT_##TYPE(COMM_CSV_ROW P, (COMM_CSV_BUF P).FIELD);
+#define COMM_X_CSV_MESSAGE_PUT(P, NAME, ID, EXTD, ELEMENT, DLC) \
+	COMM_SIGNALS_##NAME(COMM_X_CSV_PUT, (COMM_CSV_ROW P, (COMM_CSV_BUF P)->ELEMENT))
+#define COMM_CSV_PUT(ROW, BUF) COMM_MESSAGE_TABLE(COMM_X_CSV_MESSAGE_PUT, (ROW, BUF))
+
+//===============================================
+// APIs Generated by "CAN SCHEMA"
+//===============================================
+
+// void COMM_decode_<NAME>(const twai_message_t *msg, void *dest, uint8_t size): matches can_dispatch_handler_t
+// void COMM_encode_<NAME>(const COMM_message_<NAME>_t *in, twai_message_t *msg): builds the wire frame
+#define COMM_X_PROTOTYPES(P, NAME, ID, EXTD, ELEMENT, DLC)                        \
+	void COMM_decode_##NAME(const twai_message_t *msg, void *dest, uint8_t size); \
+	void COMM_encode_##NAME(const COMM_message_##NAME##_t *in, twai_message_t *msg);
+COMM_MESSAGE_TABLE(COMM_X_PROTOTYPES, _)
+#undef COMM_X_PROTOTYPES
+
+extern const COMM_signal_info_t COMM_signals[];
+extern const uint16_t COMM_signal_count;
+
+#endif // CAN_SCHEMA_H
@@ -9,7 +9,9 @@
  */
 
 #include "logging.h"
-#include "..\RTC_Time_Sync\rtc_time_sync.h"
+#include "../RTC_Time_Sync/rtc_time_sync.h"
+#include "../log_stream/log_stream.h"
+#include "../row_builder/row_builder.h"
 
 /*
  * ================================================================
@@ -19,7 +21,6 @@
  * */
 sdmmc_card_t *card;                     /* Holds Mounted SD Card infromation*/
 const char mount_point[] = MOUNT_POINT; /* Holds the data path of the SD card*/
-FILE *f = NULL;                         /* File object for SD */
 
 /*
  * ================================================================
@@ -27,10 +28,117 @@ FILE *f = NULL;                         /* File object for SD */
  * ================================================================
  *
  * */
-static esp_err_t ret;           /* Fatfas functions common result code */
-static char *open_file = NULL;  /* Holds the name of Currently opened file */
-uint32_t bytewritten, byteread; /* File Write/Read counters */
-uint8_t writes_Num = 0;
+// stdio file of the debug helpers (SDIO_SD_Create_Write_File / Add_Data / Read_Data), one at a time.
+// The session logs are log_stream_t handles (log_stream.h) and never share this state
+static FILE *f = NULL;                 /* File object for SD */
+static const char *open_file = NULL;   /* Holds the name of Currently opened file */
+static uint8_t writes_Num = 0;
+/*
+ * ================================================================
+ * 							CAN ID Dispatch Table
+ * ================================================================
+ *
+ * */
+// Generated from COMM_MESSAGE_TABLE (can_schema.h): one entry per logged message
+#define SDIO_X_LOG_MESSAGE(P, NAME, ID, EXTD, ELEMENT, DLC) \
+    {.id = (ID), .extd = (EXTD), .handler = COMM_decode_##NAME, .offset = offsetof(SDIO_TxBuffer, ELEMENT), .size = sizeof(COMM_message_##NAME##_t), .dlc = (DLC)},
+
+const can_dispatch_entry_t SDIO_log_messages[] = {
+    COMM_MESSAGE_TABLE(SDIO_X_LOG_MESSAGE, _)};
+const uint16_t SDIO_log_message_count = sizeof(SDIO_log_messages) / sizeof(SDIO_log_messages[0]);
+
+// Built from SDIO_log_messages by app_main, read by every row sink (SD log, MQTT records)
+can_dispatch_t SDIO_log_dispatch;
+
+// Dispatch slots index SDIO_TxBuffer.message_us
+_Static_assert(sizeof(SDIO_log_messages) / sizeof(SDIO_log_messages[0]) == COMM_MESSAGE_COUNT,
+               "SDIO_log_messages must hold one entry per schema message");
+
+/*
+ * ================================================================
+ * 					Local Functions Definition
+ * ================================================================
+ *
+ * */
+
+// .CSV header and row format generated from the schema tables (can_schema.h)
+const char SDIO_CSV_HEADER[] = "Timestamp_UTC,Label,Fresh" COMM_CSV_HEADER COMM_CSV_TIME_HEADER "\n";
+
+// One freshness flag per signal column
+_Static_assert(COMM_SIGNAL_COUNT <= 64, "SDIO_TxBuffer.fresh holds at most 64 signals");
+
+/**================================================================
+ * @Fn				- SDIO_SD_Format_Row_Time
+ * @breif			- Converts the receive time of a row to UTC (microsecond resolution)
+ * @param [in]		- pTxBuffer: Row to be written
+ * @param [in]		- stamp: Cached second of the previous row
+ * @param [out]		- time_buffer: Formatted timestamp
+ * @param [in]		- len: Size of time_buffer
+ * @retval			- None
+ * Note				- Rows without a receive time get the time of writing
+ */
+static void SDIO_SD_Format_Row_Time(const SDIO_TxBuffer *pTxBuffer, Time_Sync_stamp_t *stamp, char *time_buffer, uint8_t len)
+{
+    int64_t timestamp_us = (pTxBuffer->timestamp_us != 0) ? pTxBuffer->timestamp_us : esp_timer_get_time();
+    if (Time_Sync_stamp_format(stamp, Time_Sync_epoch_us(timestamp_us), TIME_SYNC_STAMP_US, time_buffer, len) < 0)
+    {
+        ESP_LOGE("RTC", "Failed to get time.");
+        strcpy(time_buffer, "XXXX-XX-XX XX:XX:XX");
+    }
+}
+
+/**================================================================
+ * @Fn				- SDIO_SD_Format_CSV_Row
+ * @breif			- Formats one .CSV row: timestamp, label, freshness flags (hex, bit i = signal
+ * 					  column i), every schema signal and the receive time of each message relative
+ * 					  to the row timestamp (empty if missing)
+ * @param [out]		- buf: Formatted row, newline included
+ * @param [in]		- len: Size of buf (SDIO_CSV_ROW_MAX)
+ * @param [in]		- pTxBuffer: Readings to be stored
+ * @param [in]		- stamp: Timestamp cache of the calling task (Time_Sync_stamp_format)
+ * @retval			- Length of the row, -1 if it does not fit buf
+ * Note				- Only touches buf, stamp and the stack, may be called by any task with its own stamp
+ */
+int SDIO_SD_Format_CSV_Row(char *buf, size_t len, const SDIO_TxBuffer *pTxBuffer, Time_Sync_stamp_t *stamp)
+{
+    // Row timestamp: receive time of the readings, in UTC
+    char time_buffer[TIME_SYNC_STAMP_SIZE];
+    SDIO_SD_Format_Row_Time(pTxBuffer, stamp, time_buffer, sizeof(time_buffer));
+
+    row_builder_t row;
+    row_builder_init(&row, buf, len);
+    row_builder_str(&row, time_buffer);
+    row_builder_char(&row, ',');
+    row_builder_str(&row, pTxBuffer->string);
+    row_builder_char(&row, ',');
+    row_builder_hex(&row, pTxBuffer->fresh, 1, false);
+    COMM_CSV_PUT(&row, pTxBuffer)
+    for (uint8_t i = 0; i < COMM_MESSAGE_COUNT; i++)
+    {
+        row_builder_char(&row, ',');
+        if (pTxBuffer->message_us[i] != 0)
+        {
+            row_builder_i64(&row, pTxBuffer->message_us[i] - pTxBuffer->timestamp_us);
+        }
+    }
+    row_builder_char(&row, '\n');
+    return row_builder_end(&row);
+}
+
+/**================================================================
+ * @Fn				- SDIO_SD_Write_CSV_Row
+ * @breif			- Writes one .CSV row (SDIO_SD_Format_CSV_Row) to a stdio file
+ * @param [in]		- f: Opened file
+ * @param [in]		- pTxBuffer: Readings to be stored
+ * @retval			- Number of bytes written, 0 on error
+ */
+static int SDIO_SD_Write_CSV_Row(FILE *f, const SDIO_TxBuffer *pTxBuffer)
+{
+    static Time_Sync_stamp_t stamp; // stdio files are written by one task
+    char row[SDIO_CSV_ROW_MAX];
+    int len = SDIO_SD_Format_CSV_Row(row, sizeof(row), pTxBuffer, &stamp);
+    return (len > 0) ? (int)fwrite(row, 1, len, f) : 0;
+}
 
 /*
  * ================================================================
@@ -40,15 +148,15 @@ uint8_t writes_Num = 0;
  * */
 
 /**================================================================
- * @Fn				- SDIO_SD_Init
- * @breif			- Initializes SD Cards & prints card Info
+ * @Fn				- SDIO_SD_Mount
+ * @breif			- Mounts the card once
  * @param [in]		- None
- * @retval			- Value indicates the States of SD Card (Anything other that ESP_OK is an Error)
- * Note				- None
+ * @retval			- esp_vfs_fat_sdmmc_mount result
+ * Note				- card is only set (and its properties printed) once mounted, NULL otherwise
  */
-esp_err_t SDIO_SD_Init(void)
+static esp_err_t SDIO_SD_Mount(void)
 {
-    ret = ESP_OK;
+    esp_err_t ret = ESP_OK;
 
     // Options for mounting the filesystem.
     esp_vfs_fat_sdmmc_mount_config_t mount_config = {
@@ -58,7 +166,7 @@ esp_err_t SDIO_SD_Init(void)
         .format_if_mount_failed = false,
 #endif // EXAMPLE_FORMAT_IF_MOUNT_FAILED
         .max_files = 5,
-        .allocation_unit_size = 16 * 1024};
+        .allocation_unit_size = SDIO_ALLOCATION_UNIT_SIZE};
 
     // By default, SD card frequency is initialized to SDMMC_FREQ_DEFAULT (20MHz)
     // For setting a specific frequency, use host.max_freq_khz (range 400kHz - 40MHz for SDMMC)
@@ -88,17 +196,55 @@ esp_err_t SDIO_SD_Init(void)
     // are insufficient however, 10k external pullups are recommended.
     slot_config.flags |= SDMMC_SLOT_FLAG_INTERNAL_PULLUP;
 
-    ret = esp_vfs_fat_sdmmc_mount(mount_point, &host, &slot_config, &mount_config, &card);
+    sdmmc_card_t *mounted = NULL;
+    ret = esp_vfs_fat_sdmmc_mount(mount_point, &host, &slot_config, &mount_config, &mounted);
+    if (ret != ESP_OK)
+    {
+        card = NULL; // Never the card of a previous mount, freed by its unmount
+        return ret;
+    }
+    card = mounted;
+
+    // Card has been initialized, print its properties
+    sdmmc_card_print_info(stdout, card);
+    return ESP_OK;
+}
+
+/**================================================================
+ * @Fn				- SDIO_SD_Init
+ * @breif			- Initializes SD Cards & prints card Info
+ * @param [in]		- None
+ * @retval			- Value indicates the States of SD Card (Anything other that ESP_OK is an Error)
+ * Note				- Boot only: the card is mounted, unmounted and mounted again to start from a
+ * 					  reset card; returns as soon as a mount fails
+ */
+esp_err_t SDIO_SD_Init(void)
+{
+    esp_err_t ret = SDIO_SD_Mount();
+    if (ret != ESP_OK)
+    {
+        return ret;
+    }
 
     // Set the log level for the GPIO driver to WARN to reduce Messages
     esp_log_level_set("gpio", ESP_LOG_WARN);
     esp_vfs_fat_sdcard_unmount(mount_point, card);
+    card = NULL;
 
-    ret = esp_vfs_fat_sdmmc_mount(mount_point, &host, &slot_config, &mount_config, &card);
+    return SDIO_SD_Mount();
+}
 
-    // Card has been initialized, print its properties
-    sdmmc_card_print_info(stdout, card);
-    return ret;
+/**================================================================
+ * @Fn				- SDIO_SD_Remount
+ * @breif			- Mounts the card again after SDIO_SD_DeInit
+ * @param [in]		- None
+ * @retval			- Value indicates the States of SD Card (Anything other that ESP_OK is an Error)
+ * Note				- One mount attempt (sd_recovery retries with backoff), a failed attempt leaves
+ * 					  the card unmounted
+ */
+esp_err_t SDIO_SD_Remount(void)
+{
+    return SDIO_SD_Mount();
 }
 
 /**================================================================
@@ -106,14 +252,20 @@ esp_err_t SDIO_SD_Init(void)
  * @breif			- De-Initializes SD Cards
  * @param [in]		- None
  * @retval			- Value indicates the States of SD Card (Anything other that ESP_OK is an Error)
- * Note				- None
+ * Note				- Does nothing if the card is not mounted
  */
 esp_err_t SDIO_SD_DeInit(void)
 {
-    ret = ESP_OK;
+    esp_err_t ret = ESP_OK;
     if(open_file != NULL)
         fclose(f);
+    open_file = NULL;
+    if (card == NULL)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
     ret = esp_vfs_fat_sdcard_unmount(mount_point, card);
+    card = NULL;
     return ret;
 }
 
@@ -123,12 +275,21 @@ esp_err_t SDIO_SD_DeInit(void)
  * @param [in]		- file: To select the name and extenstion of File
  * @param [in]		- pTxBuffer: Pointer to buffer storing data to be stored
  * @retval			- Value indicates the States of SD Card (Anything other that ESP_OK is an Error)
+ * 					  ESP_ERR_NOT_SUPPORTED for .BIN / .CAN files (log_stream_open)
  * Note				- For pTxBuffer: .TXT File Types Config -> String only
  * 									 .CSV File Types Config -> f_printf format
+ * 					- Debug files only: opening another file closes this one, the session logs
+ * 					  are written through log_stream_t handles
  */
 esp_err_t SDIO_SD_Create_Write_File(SDIO_FileConfig *file, SDIO_TxBuffer *pTxBuffer)
 {
-    ret = ESP_OK;
+    esp_err_t ret = ESP_OK;
+    uint32_t bytewritten;
+
+    if ((file->type != TXT) && (file->type != CSV))
+    {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
     // Check if another file is already opened
     if (open_file != NULL)
     {
@@ -137,18 +298,15 @@ esp_err_t SDIO_SD_Create_Write_File(SDIO_FileConfig *file, SDIO_TxBuffer *pTxBuf
     }
     snprintf(file->path, sizeof(file->path), "%s/%s", MOUNT_POINT, file->name);
 
-    // Get current Time
-    char time_buffer[32];
-    if (Time_Sync_get_rtc_time_str(time_buffer, sizeof(time_buffer)) != true)
-    {
-        ESP_LOGE("RTC", "Failed to get time.");
-        strcpy(time_buffer, "XXXX-XX-XX XX:XX:XX");
-    }
-
     // Check if the files exists and Modification Time less than 2 days
     struct stat st;
     if ((stat(file->path, &st) == 0) && (compare_file_time_days(file->path) <= MAX_DAYS_MODIFIED))
     {
+        // A session cut by a power loss left a torn tail
+        if (log_stream_recover(NULL, file) != ESP_OK)
+        {
+            ESP_LOGE("SDIO", "Error in %s Recovery!", file->name);
+        }
         // Add to the file and don't create new one
         if (SDIO_SD_Add_Data(file, pTxBuffer) != ESP_OK)
         {
@@ -157,7 +315,6 @@ esp_err_t SDIO_SD_Create_Write_File(SDIO_FileConfig *file, SDIO_TxBuffer *pTxBuf
     }
     else // Create new file
     {
-
         f = fopen(file->path, "w");
         if (f == NULL)
         {
@@ -172,7 +329,7 @@ esp_err_t SDIO_SD_Create_Write_File(SDIO_FileConfig *file, SDIO_TxBuffer *pTxBuf
         {
             // Write string to file
             bytewritten = fprintf(f, "%s\n", pTxBuffer->string);
-            if ((bytewritten == 0) || ret != ESP_OK)
+            if (bytewritten == 0)
             {
                 ret = ESP_ERR_NOT_FINISHED;
                 ESP_LOGE("SDIO", "ESP_ERR_NOT_FINISHED in Writing %s file!", file->name);
@@ -181,62 +338,13 @@ esp_err_t SDIO_SD_Create_Write_File(SDIO_FileConfig *file, SDIO_TxBuffer *pTxBuf
         }
         else if (file->type == CSV)
         {
-
             // Write CSV header to file
-            fprintf(f, "Timestamp,Label,"
-                       "SUS_1,SUS_2,SUS_3,SUS_4,"
-                       "PRESSURE_1,PRESSURE_2,"
-                       "RPM_FL,RPM_FR,RPM_RL,RPM_RR,"
-                       "ENC_ANGLE,"
-                       "IMU_Ang_X,IMU_Ang_Y,IMU_Ang_Z,"
-                       "IMU_Accel_X,IMU_Accel_Y,IMU_Accel_Z,"
-                       "Temp_FL,Temp_FR,Temp_RL,Temp_RR,"
-                       "GPS_Long, GPS_Lat\n");
+            fprintf(f, "%s", SDIO_CSV_HEADER);
 
             // Write formatted data to file
-            bytewritten = fprintf(f, "%s,%s,"
-                                     "%u,%u,%u,%u,"
-                                     "%u,%u,"
-                                     "%u,%u,%u,%u,"
-                                     "%u,"
-                                     "%u,%u,%u,"
-                                     "%u,%u,%u,"
-                                     "%u,%u,%u,%u,"
-                                     "%f,%f\n",
-
-                                  time_buffer,
-                                  pTxBuffer->string,
-
-                                  pTxBuffer->adc.SUS_1,
-                                  pTxBuffer->adc.SUS_2,
-                                  pTxBuffer->adc.SUS_3,
-                                  pTxBuffer->adc.SUS_4,
-                                  pTxBuffer->adc.PRESSURE_1,
-                                  pTxBuffer->adc.PRESSURE_2,
-
-                                  pTxBuffer->prox_encoder.RPM_front_left,
-                                  pTxBuffer->prox_encoder.RPM_front_right,
-                                  pTxBuffer->prox_encoder.RPM_rear_left,
-                                  pTxBuffer->prox_encoder.RPM_rear_right,
-                                  pTxBuffer->prox_encoder.ENCODER_angle,
-
-                                  pTxBuffer->imu_ang.x,
-                                  pTxBuffer->imu_ang.y,
-                                  pTxBuffer->imu_ang.z,
-
-                                  pTxBuffer->imu_accel.x,
-                                  pTxBuffer->imu_accel.y,
-                                  pTxBuffer->imu_accel.z,
-
-                                  pTxBuffer->temp.Temp_front_left,
-                                  pTxBuffer->temp.Temp_front_right,
-                                  pTxBuffer->temp.Temp_rear_left,
-                                  pTxBuffer->temp.Temp_rear_right,
-
-                                  pTxBuffer->gps.longitude,
-                                  pTxBuffer->gps.latitude);
-
-            if ((bytewritten == 0) || ret != ESP_OK)
+            bytewritten = SDIO_SD_Write_CSV_Row(f, pTxBuffer);
+
+            if (bytewritten == 0)
             {
                 ESP_LOGE("SDIO", "Error in Writing .CSV File");
                 ret = ESP_ERR_NOT_FINISHED;
@@ -247,6 +355,7 @@ esp_err_t SDIO_SD_Create_Write_File(SDIO_FileConfig *file, SDIO_TxBuffer *pTxBuf
 
     fclose(f);        // Close the file after writing
     open_file = NULL; // Reset the open file name
+    file->valid = (stat(file->path, &st) == 0) ? (uint32_t)st.st_size : 0;
     return ret;
 }
 
@@ -256,6 +365,7 @@ esp_err_t SDIO_SD_Create_Write_File(SDIO_FileConfig *file, SDIO_TxBuffer *pTxBuf
  * @param [in]		- file: To select the name and extenstion of File
  * @param [in]		- pTxBuffer: Pointer to buffer storing data to be stored
  * @retval			- Value indicates the States of SD Card (Anything other that ESP_OK is an Error)
+ * 					  ESP_ERR_NOT_SUPPORTED for .BIN / .CAN files (log_stream_row / log_stream_frame)
  * Note				- For pTxBuffer: .TXT File Types Config -> String only
  * 									 .CSV File Types Config -> f_printf format
  * Warning!			- Function close file to allow for continous Data Storing preiodicly after 7 writes
@@ -263,14 +373,22 @@ esp_err_t SDIO_SD_Create_Write_File(SDIO_FileConfig *file, SDIO_TxBuffer *pTxBuf
  */
 esp_err_t SDIO_SD_Add_Data(SDIO_FileConfig *file, SDIO_TxBuffer *pTxBuffer)
 {
-    ret = ESP_OK;
+    esp_err_t ret = ESP_OK;
+    uint32_t bytewritten = 0;
 
+    if ((file->type != TXT) && (file->type != CSV))
+    {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
     struct stat st;
     if (stat(file->path, &st) == 0) // Check if the files exists
     {
         if (open_file != file->name)
         {
-            fclose(f);        // close the previously opened file
+            if (open_file != NULL)
+            {
+                fclose(f); // close the previously opened file
+            }
             open_file = NULL; // Reset the open file name
             f = fopen(file->path, "a");
         }
@@ -281,14 +399,6 @@ esp_err_t SDIO_SD_Add_Data(SDIO_FileConfig *file, SDIO_TxBuffer *pTxBuffer)
         }
         else
         {
-            // Get current Time
-            char time_buffer[32];
-            if (Time_Sync_get_rtc_time_str(time_buffer, sizeof(time_buffer)) != true)
-            {
-                ESP_LOGE("RTC", "Failed to get time.");
-                strcpy(time_buffer, "XXXXXXXX");
-            }
-
             open_file = file->name; // Assign the name of the opened file
 
             // Check if file type is .TXT or .CSV
@@ -296,62 +406,16 @@ esp_err_t SDIO_SD_Add_Data(SDIO_FileConfig *file, SDIO_TxBuffer *pTxBuffer)
             {
                 // Write string to file
                 bytewritten = fprintf(f, "%s\n", pTxBuffer->string);
-                if ((bytewritten == 0) || ret != ESP_OK)
-                {
-                    ret = ESP_ERR_NOT_FINISHED;
-                    return ret; // Failed to write to file
-                }
             }
             else if (file->type == CSV)
             {
                 // Write formatted data to file
-                bytewritten = fprintf(f, "%s,%s,"
-                                         "%u,%u,%u,%u,"
-                                         "%u,%u,"
-                                         "%u,%u,%u,%u,"
-                                         "%u,"
-                                         "%u,%u,%u,"
-                                         "%u,%u,%u,"
-                                         "%u,%u,%u,%u,"
-                                         "%f,%f\n",
-
-                                      time_buffer,
-                                      pTxBuffer->string,
-
-                                      pTxBuffer->adc.SUS_1,
-                                      pTxBuffer->adc.SUS_2,
-                                      pTxBuffer->adc.SUS_3,
-                                      pTxBuffer->adc.SUS_4,
-                                      pTxBuffer->adc.PRESSURE_1,
-                                      pTxBuffer->adc.PRESSURE_2,
-
-                                      pTxBuffer->prox_encoder.RPM_front_left,
-                                      pTxBuffer->prox_encoder.RPM_front_right,
-                                      pTxBuffer->prox_encoder.RPM_rear_left,
-                                      pTxBuffer->prox_encoder.RPM_rear_right,
-                                      pTxBuffer->prox_encoder.ENCODER_angle,
-
-                                      pTxBuffer->imu_ang.x,
-                                      pTxBuffer->imu_ang.y,
-                                      pTxBuffer->imu_ang.z,
-
-                                      pTxBuffer->imu_accel.x,
-                                      pTxBuffer->imu_accel.y,
-                                      pTxBuffer->imu_accel.z,
-
-                                      pTxBuffer->temp.Temp_front_left,
-                                      pTxBuffer->temp.Temp_front_right,
-                                      pTxBuffer->temp.Temp_rear_left,
-                                      pTxBuffer->temp.Temp_rear_right,
-
-                                      pTxBuffer->gps.longitude,
-                                      pTxBuffer->gps.latitude);
-
-                if ((bytewritten == 0) || ret != ESP_OK)
-                {
-                    ret = ESP_ERR_NOT_FINISHED;
-                    return ret; // Failed to write to file
-                }
+                bytewritten = SDIO_SD_Write_CSV_Row(f, pTxBuffer);
+            }
+            if (bytewritten == 0)
+            {
+                ret = ESP_ERR_NOT_FINISHED;
+                return ret; // Failed to write to file
             }
 
             if (writes_Num >= MAX_WRITES)
@@ -383,6 +447,8 @@ esp_err_t SDIO_SD_Add_Data(SDIO_FileConfig *file, SDIO_TxBuffer *pTxBuffer)
  */
 esp_err_t SDIO_SD_Read_Data(SDIO_FileConfig *file)
 {
+    esp_err_t ret = ESP_OK;
+
     if (open_file != NULL)
     {
         fclose(f);        // close the previously opened file
@@ -434,7 +500,7 @@ esp_err_t SDIO_SD_Read_Data(SDIO_FileConfig *file)
  */
 esp_err_t SDIO_SD_Close_file(void)
 {
-    ret = ESP_OK;
+    esp_err_t ret = ESP_OK;
     // Close the file if it is open
     if (fclose(f) == 0)
         open_file = NULL; // Reset the open file name
@@ -448,7 +514,7 @@ esp_err_t SDIO_SD_Close_file(void)
  * @breif			- Creates New .txt File Called SDIO_CAN_txt and last 10 received msgs
  * @param [in]		- rx_msg: pointer to Buffer storing Received Msg
  * @retval			- Value indicates the States of SD Card (Anything other that ESP_OK is an Error)
- * Note				-
+ * Note				- Debug capture only, every frame of a session is in LOG_<n>.CAN (log_stream_frame)
  */
 esp_err_t SDIO_SD_LOG_CAN_Message(twai_message_t *rx_msg)
 {
@@ -459,9 +525,10 @@ esp_err_t SDIO_SD_LOG_CAN_Message(twai_message_t *rx_msg)
     twai_status_info_t s;
 
     SDIO_FileConfig SDIO_CAN_txt;
-    SDIO_TxBuffer buffer;
+    SDIO_TxBuffer buffer = {0};
     static const char *TAG = "SDIO_CAN_DEBUG";
     char time_buffer[32];
+    esp_err_t ret;
 
     SDIO_CAN_txt.name = "SDIO_CAN.TXT";
     SDIO_CAN_txt.type = TXT;
@@ -497,7 +564,7 @@ esp_err_t SDIO_SD_LOG_CAN_Message(twai_message_t *rx_msg)
             snprintf(sd_write_buffer, sizeof(sd_write_buffer),
                      "TimeStamp: %s ID: 0x%03lX Data[0]: 0x%02X Data[1]: 0x%02X Data[2]: 0x%02X Data[3]: 0x%02X "
                      "Data[4]: 0x%02X Data[5]: 0x%02X Data[6]: 0x%02X Data[7]: 0x%02X\r",
-                     time_buffer, rx_msg->identifier,
+                     time_buffer, (unsigned long)rx_msg->identifier,
                      rx_msg->data[0], rx_msg->data[1], rx_msg->data[2], rx_msg->data[3],
                      rx_msg->data[4], rx_msg->data[5], rx_msg->data[6], rx_msg->data[7]);
 
@@ -515,11 +582,12 @@ esp_err_t SDIO_SD_LOG_CAN_Message(twai_message_t *rx_msg)
             ret = twai_read_alerts(&alerts, 0);
             if (ret == ESP_OK)
             {
-                ESP_LOGI("CAN", "TWAI alert: %08ld", alerts);
+                ESP_LOGI("CAN", "TWAI alert: %08lu", (unsigned long)alerts);
             }
             twai_get_status_info(&s);
-            ESP_LOGI("CAN", "RX errors: %ld, bus errors: %ld, RX queue full: %ld",
-                     s.rx_error_counter, s.bus_error_count, s.rx_missed_count);
+            ESP_LOGI("CAN", "RX errors: %lu, bus errors: %lu, RX queue full: %lu",
+                     (unsigned long)s.rx_error_counter, (unsigned long)s.bus_error_count,
+                     (unsigned long)s.rx_missed_count);
 
             return ESP_FAIL; // No message received
         }
@@ -564,6 +632,8 @@ uint16_t compare_file_time_days(const char *path)
     return (diff_days);
 }
 
+// One file open / close per frame: kept for SDIO_CAN.CSV captures (TELE_HOST_REPLAY reads them),
+// full-rate logging goes to LOG_<n>.CAN (log_stream_frame)
 esp_err_t SDIO_SD_log_can_message_to_csv(twai_message_t *msg)
 {
     static const char *TAG = "CAN_LOG";
@@ -594,7 +664,7 @@ esp_err_t SDIO_SD_log_can_message_to_csv(twai_message_t *msg)
     // Format and log the message
     fprintf(f, "%s,0x%03lX,%s,%s,%d",
             time_buffer,
-            msg->identifier,
+            (unsigned long)msg->identifier,
             msg->extd ? "YES" : "NO",
             msg->rtr ? "YES" : "NO",
             msg->data_length_code);
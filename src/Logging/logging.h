@@ -19,7 +19,11 @@
 #include <driver/sdmmc_host.h>
 #include "sdmmc_cmd.h"
 
+#include "sdkconfig.h"
 #include "driver/twai.h"
+#include "can_dispatch/can_dispatch.h"
+#include "can_schema.h"
+#include "RTC_Time_Sync/rtc_time_sync.h"
 
 //==================================Status Libraries Includes==========================//
 #include <sys/unistd.h>
@@ -40,36 +44,23 @@
 
 #define SDMMC_BUS_WIDTH_4
 
-#define EMPTY_SDIO_BUFFER(...) 	__VA_ARGS__.string = "Empty Read";\
-								__VA_ARGS__.timestamp = "XXXX-XX-XX XX:XX:XX";\
-								__VA_ARGS__.adc.SUS_1 = 0;\
-								__VA_ARGS__.adc.SUS_2 = 0;\
-								__VA_ARGS__.adc.SUS_3 = 0;\
-								__VA_ARGS__.adc.SUS_4 = 0;\
-								__VA_ARGS__.adc.PRESSURE_1 = 0;\
-								__VA_ARGS__.adc.PRESSURE_2 = 0;\
-								__VA_ARGS__.prox_encoder.RPM_front_left = 0;\
-								__VA_ARGS__.prox_encoder.RPM_front_right = 0;\
-								__VA_ARGS__.prox_encoder.RPM_rear_left = 0;\
-								__VA_ARGS__.prox_encoder.RPM_rear_right = 0;\
-								__VA_ARGS__.prox_encoder.ENCODER_angle = 0;\
-								__VA_ARGS__.imu_accel.x = 0;\
-								__VA_ARGS__.imu_accel.y = 0;\
-								__VA_ARGS__.imu_accel.z = 0;\
-
+// Assign Zero to all signals and receive times of an SDIO_TxBuffer (layout generated from can_schema.h)
+#define EMPTY_SDIO_BUFFER(...) 	memset(&(__VA_ARGS__), 0, sizeof(SDIO_TxBuffer));\
+								(__VA_ARGS__).string = "Empty Read";
 
 #define MAX_CHAR_SIZE 64
+#if CONFIG_IDF_TARGET_LINUX
+#define MOUNT_POINT "sdcard" // Host build: directory in the working directory (host_sdmmc.c)
+#else
 #define MOUNT_POINT "/sdcard"
+#endif
 #define MAX_WRITES 	5
 #define EXAMPLE_IS_UHS1 (CONFIG_EXAMPLE_SDMMC_SPEED_UHS_I_SDR50 || CONFIG_EXAMPLE_SDMMC_SPEED_UHS_I_DDR50)
 
 #define MAX_DAYS_MODIFIED 2
-
-//----------------------------
-// CAN Macros
-//----------------------------
-#define COMM_CAN_ID_COUNT 6
-#define COMM_CAN_ID_FISRT COMM_CAN_ID_IMU_ANGLE
+#define SDIO_ALLOCATION_UNIT_SIZE (16 * 1024) // FAT cluster size, also the write size of sd_writer
+#define SDIO_CSV_ROW_MAX 512 // Longest formatted .CSV row
+#define SDIO_PATH_MAX 50 // Size of SDIO_FileConfig.path
 
 //===============================================
 // User type definitions (structures)
@@ -79,78 +70,10 @@
 // Sensor Readings Structures
 //----------------------------
 
-/* Warning!!! In case adding more IDs to be logged, there is parameters that needed to be updated!
-
-* 1) (Logging.h) COMM_CAN_ID_COUNT: Should be Updated to total No. of IDs
-* 2) (Logging.h) Add new struct for decoding received ID
-* 3) (logging.h) SDIO_TxBuffer: Add new element for New Sturct
-* 4) (Logging.c) Format in .CSV file @ SDIO_SD_Add_Data & SDIO_SD_Add_Data SDIO_SD_Create_Write_File
-* 6) (main.c)	 Switch case ID filter @ SDIO_Log_Task_init: Similar Case should be added for New ID
-
-*/
-typedef enum	
-{
-	COMM_CAN_ID_IMU_ANGLE = 0x004,
-	COMM_CAN_ID_IMU_ACCEL = 0x005,
-	COMM_CAN_ID_ADC = 0x006,
-	COMM_CAN_ID_PROX_ENCODER = 0x007,
-	COMM_CAN_ID_GPS_LATLONG = 0x008,
-	COMM_CAN_ID_TEMP = 0x009,
-} COMM_CAN_ID_t;
-
-// ADC Readings Structures
-typedef struct
-{
-	uint64_t SUS_1 : 10;
-	uint64_t SUS_2 : 10;
-	uint64_t SUS_3 : 10;
-	uint64_t SUS_4 : 10;
-
-	uint64_t PRESSURE_1 : 10;
-	uint64_t PRESSURE_2 : 10;
-
-} COMM_message_ADC_t;
-
-//----------------------------
-
-// Proximity Encoder Readings Structures
-typedef struct
-{
-	uint64_t RPM_front_left : 11;
-	uint64_t RPM_front_right : 11;
-	uint64_t RPM_rear_left : 11;
-	uint64_t RPM_rear_right : 11;
-
-	uint64_t ENCODER_angle : 10;
-	uint64_t Speedkmh : 8;
-
-} COMM_message_PROX_encoder_t;
-
-//----------------------------
-
-// IMU Readings Structures
-typedef struct
-{
-	uint16_t x; /* X-axis Value */
-	uint16_t y; /* Y-axis Value */
-	uint16_t z; /* Z-axis Value */
-} COMM_message_IMU_t;
-
-typedef struct
-{
-
-	uint16_t Temp_front_left;
-	uint16_t Temp_front_right;
-	uint16_t Temp_rear_left;
-	uint16_t Temp_rear_right;
-
-} COMM_message_Temp_t;
-
-typedef struct
-{
-	float longitude;
-	float latitude;
-} COMM_message_GPS_t;
+/* CAN IDs (COMM_CAN_ID_t), decoded message structures (COMM_message_<NAME>_t), decoders and .CSV
+ * columns are all generated from the schema tables in can_schema.h.
+ * In case adding more IDs to be logged: add one row to COMM_MESSAGE_TABLE and its COMM_SIGNALS_<NAME> list.
+ */
 
 //----------------------------
 // SDIO File Configuration Structures
@@ -159,11 +82,20 @@ typedef struct
 {
 	char *name; // Specifies the File name to be configured.
 
-	char path[50]; // Specifies the path where the file will be created.
+	char path[SDIO_PATH_MAX]; // Specifies the path where the file will be created.
 
 	uint8_t type; // Specifies the file type to be configured.
 				  // This parameter must be based on @ref SDIO_File_Types
 
+	uint32_t preallocate; // Bytes reserved as one contiguous region when the file is created
+						  // (.BIN / .CAN only, see log_stream_open), 0 = grown cluster by cluster
+
+	uint32_t valid; // Set by log_stream_open / SDIO_SD_Create_Write_File: bytes of data, a preallocated file is longer
+
+	uint8_t codec; // .BIN only: @ref binlog_codec stages of the blocks, kept when a block shrinks (binlog.h)
+
+	uint32_t bitrate; // .CAN only: bus bit rate recorded in the header of a new file (framelog.h)
+
 } SDIO_FileConfig;
 
 //----------------------------
@@ -173,28 +105,25 @@ typedef struct
 	const char *string; // String to be Stored in File
 						// Used mostly in .TXT files and First column in .CSV files
 
-	const char *timestamp; // Timestamp of the Readings to be stored
-
-	COMM_message_ADC_t adc; // ADC Readings to be stored
-							// Used mostly in .CSV files
-
-	COMM_message_PROX_encoder_t prox_encoder; // Proximity Encoder Readings to be stored
-											  // Used mostly in .CSV files
+	int64_t timestamp_us; // Receive time of the first frame of the row (esp_timer_get_time)
+						  // 0: the time of writing is used. Converted to UTC when the row is written
 
-	COMM_message_IMU_t imu_ang; // IMU Angle Readings to be stored
-								// Used mostly in .CSV files
+	int64_t message_us[COMM_MESSAGE_COUNT]; // Receive time of each message (index = dispatch slot), 0 if missing
 
-	COMM_message_IMU_t imu_accel; // IMU Acceleration Readings to be stored
-								  // Used mostly in .CSV files
+	uint64_t fresh; // Freshness flags: bit i set if COMM_signals[i] was received since the previous row
 
-	COMM_message_Temp_t temp; // Temperature Readings to be stored
-							  // Used mostly in .CSV files
-
-	COMM_message_GPS_t gps; // GPS Readings to be stored
-							// Used mostly in .CSV files
+	COMM_RECORD_ELEMENTS // One element per logged message (adc, prox_encoder, imu_ang, ...)
+						 // Used mostly in .CSV files
 
 } SDIO_TxBuffer;
 
+//----------------------------
+// CAN ID Dispatch Table
+//----------------------------
+extern const can_dispatch_entry_t SDIO_log_messages[]; // Registered IDs decoded into SDIO_TxBuffer
+extern const uint16_t SDIO_log_message_count;
+extern can_dispatch_t SDIO_log_dispatch;					// Slots of SDIO_log_messages
+
 //----------------------------
 // Macros Configuration References
 //---------------------------
@@ -202,15 +131,22 @@ typedef struct
 //@ref SDIO_File_Types
 #define CSV 0
 #define TXT 1
+#define BIN 2 // Binary rows in CRC protected blocks (binlog.h), converted by scripts/binlog_to_csv.py
+#define FRAMES 3 // Raw CAN frames in CRC protected blocks (framelog.h), exported by scripts/framelog_export.py
+
+// .CSV header line generated from the schema tables (can_schema.h)
+extern const char SDIO_CSV_HEADER[];
 
 //===============================================
 // APIs Supported by "LOGGING DRIVER"
 //===============================================
 
 esp_err_t SDIO_SD_Init(void);
+esp_err_t SDIO_SD_Remount(void);
 esp_err_t SDIO_SD_DeInit(void);
 esp_err_t SDIO_SD_Create_Write_File(SDIO_FileConfig *file, SDIO_TxBuffer *pTxBuffer);
 esp_err_t SDIO_SD_Add_Data(SDIO_FileConfig *file, SDIO_TxBuffer *pTxBuffer);
+int SDIO_SD_Format_CSV_Row(char *buf, size_t len, const SDIO_TxBuffer *pTxBuffer, Time_Sync_stamp_t *stamp);
 esp_err_t SDIO_SD_Read_Data(SDIO_FileConfig *file);
 esp_err_t SDIO_SD_Close_file(void);
 esp_err_t SDIO_SD_LOG_CAN_Message(twai_message_t *rx_msg);
@@ -10,6 +10,8 @@
  */
 
 #include "rtc_time_sync.h"  
+#include <stdio.h>
+#include <string.h>
 
 static const char *TAG = "rtc_time";
 
@@ -47,3 +49,68 @@ uint8_t Time_Sync_get_rtc_time_str(char *buffer, uint8_t max_len)
     return true;
 } 
 
+// Receive timestamps are esp_timer_get_time() values (monotonic, microseconds since boot).
+// They are converted to wall clock time only where they leave the device (SD rows, telemetry).
+int64_t Time_Sync_epoch_offset_us(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return ((int64_t)tv.tv_sec * 1000000 + tv.tv_usec) - esp_timer_get_time();
+}
+
+// Converts an esp_timer timestamp to microseconds since 1970-01-01 UTC (binary records, packets)
+int64_t Time_Sync_epoch_us(int64_t timer_us)
+{
+    return timer_us + Time_Sync_epoch_offset_us();
+}
+
+// Formats epoch microseconds as UTC "YYYY-MM-DD HH:MM:SS" followed by digits (0, 3 or 6) fraction
+// digits. gmtime_r + strftime only run when the second differs from the one cached in stamp, the
+// fraction is written digit by digit. Returns the length, -1 if buffer is too small.
+// stamp belongs to the caller (one per task), a zeroed stamp is empty.
+int Time_Sync_stamp_format(Time_Sync_stamp_t *stamp, int64_t epoch_us, uint8_t digits, char *buffer, size_t max_len)
+{
+    int64_t second = epoch_us / 1000000;
+    int32_t fraction = (int32_t)(epoch_us % 1000000);
+    if (fraction < 0) // Before 1970: floor, the fraction counts up from the second
+    {
+        fraction += 1000000;
+        second--;
+    }
+    if ((stamp->prefix[0] == '\0') || (second != stamp->second))
+    {
+        time_t seconds = (time_t)second;
+        struct tm timeinfo;
+        if (!gmtime_r(&seconds, &timeinfo) ||
+            (strftime(stamp->prefix, sizeof(stamp->prefix), "%Y-%m-%d %H:%M:%S", &timeinfo) != TIME_SYNC_PREFIX_LEN))
+        {
+            stamp->prefix[0] = '\0';
+            return -1;
+        }
+        stamp->second = second;
+    }
+
+    if (digits > TIME_SYNC_STAMP_US) digits = TIME_SYNC_STAMP_US;
+    size_t len = TIME_SYNC_PREFIX_LEN + ((digits != 0) ? 1 + digits : 0);
+    if (len >= max_len) return -1;
+    memcpy(buffer, stamp->prefix, TIME_SYNC_PREFIX_LEN);
+    if (digits != 0)
+    {
+        buffer[TIME_SYNC_PREFIX_LEN] = '.';
+        for (uint8_t i = digits; i < TIME_SYNC_STAMP_US; i++) fraction /= 10; // Truncated, as the seconds
+        for (size_t i = len - 1; i > TIME_SYNC_PREFIX_LEN; i--)
+        {
+            buffer[i] = (char)('0' + fraction % 10);
+            fraction /= 10;
+        }
+    }
+    buffer[len] = '\0';
+    return (int)len;
+}
+
+// Formats an esp_timer timestamp as UTC: "YYYY-MM-DD HH:MM:SS.uuuuuu" (no cache, see Time_Sync_stamp_format)
+uint8_t Time_Sync_format_utc_us(int64_t timer_us, char *buffer, uint8_t max_len)
+{
+    Time_Sync_stamp_t stamp = {0};
+    return Time_Sync_stamp_format(&stamp, Time_Sync_epoch_us(timer_us), TIME_SYNC_STAMP_US, buffer, max_len) > 0;
+}
@@ -20,6 +20,25 @@
 #include "nvs_flash.h"
 #include "esp_event.h"
 #include "esp_netif.h"
+#include "esp_timer.h"
+
+//--------------------------------
+// Macros
+//--------------------------------
+#define TIME_SYNC_PREFIX_LEN 19 // "YYYY-MM-DD HH:MM:SS"
+#define TIME_SYNC_STAMP_MS 3	// Fraction digits of Time_Sync_stamp_format
+#define TIME_SYNC_STAMP_US 6
+#define TIME_SYNC_STAMP_SIZE (TIME_SYNC_PREFIX_LEN + 1 + TIME_SYNC_STAMP_US + 1) // Longest stamp, terminator included
+
+//--------------------------------
+// User type definitions
+//--------------------------------
+// Formatted second of the last timestamp, owned by one task (zeroed = empty)
+typedef struct
+{
+	int64_t second;							 // Epoch second of prefix
+	char prefix[TIME_SYNC_PREFIX_LEN + 1]; // "YYYY-MM-DD HH:MM:SS" (UTC), "" if not formatted yet
+} Time_Sync_stamp_t;
 
 //===============================================
 // APIs Supported by "RTC_Time_Sync DRIVER"
@@ -27,5 +46,9 @@
 void Time_Sync_init_sntp(void);
 void Time_Sync_obtain_time(void);
 uint8_t Time_Sync_get_rtc_time_str(char *buffer, uint8_t max_len);  
+int64_t Time_Sync_epoch_offset_us(void);
+int64_t Time_Sync_epoch_us(int64_t timer_us);
+int Time_Sync_stamp_format(Time_Sync_stamp_t *stamp, int64_t epoch_us, uint8_t digits, char *buffer, size_t max_len);
+uint8_t Time_Sync_format_utc_us(int64_t timer_us, char *buffer, uint8_t max_len);
 void wifi_connect(void);
 #endif // RTC_TIME_SYNC_H
\ No newline at end of file
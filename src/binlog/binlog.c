@@ -0,0 +1,477 @@
+/*
+ * binlog.c
+ *
+ *  Description: Implementation of the binary SD log format.
+ *      Note: Records are packed straight into the block buffer, the block header and CRC are only
+ *            written when the block is sealed, so a row costs one copy of its decoded values.
+ *            Coded blocks are built in a second buffer at seal time, the CRC covers the coded
+ *            bytes so recovery checks them without decoding.
+ */
+
+#include "binlog.h"
+#include "record_codec/record_codec.h"
+#include "RTC_Time_Sync/rtc_time_sync.h"
+#include "esp_timer.h"
+#include <string.h>
+#if !CONFIG_IDF_TARGET_LINUX
+#include "esp_app_desc.h"
+#endif
+
+_Static_assert(BINLOG_HEADER_SIZE <= UINT16_MAX, "binlog file header too large");
+_Static_assert(BINLOG_BLOCK_RECORDS >= 1, "BINLOG_BLOCK_SIZE holds no record");
+_Static_assert(BINLOG_BLOCK_RECORDS <= UINT16_MAX, "binlog_block_header_t.records overflows");
+_Static_assert(sizeof(binlog_commit_t) <= BINLOG_COMMIT_SLOT_SIZE, "binlog_commit_t larger than its slot");
+
+/*
+ * ================================================================
+ * 					Local Functions Definition
+ * ================================================================
+ *
+ * */
+
+// Message names in table order (= dispatch slot, SDIO_log_messages order)
+#define BINLOG_X_MESSAGE_NAME(P, NAME, ID, EXTD, ELEMENT, DLC) #NAME,
+static const char *const binlog_message_names[] = {
+    COMM_MESSAGE_TABLE(BINLOG_X_MESSAGE_NAME, _)};
+
+// Decoded values of a row -> packed record
+#define BINLOG_X_COPY_SIGNAL(P, FIELD, CSV, TYPE, BIT, WIDTH, SCALE, UNIT) record->P.FIELD = row->P.FIELD;
+#define BINLOG_X_COPY_MESSAGE(P, NAME, ID, EXTD, ELEMENT, DLC) COMM_SIGNALS_##NAME(BINLOG_X_COPY_SIGNAL, ELEMENT)
+
+static void binlog_copy_name(char *dest, size_t len, const char *name)
+{
+    memset(dest, 0, len);
+    strncpy(dest, name, len - 1);
+}
+
+static int32_t binlog_dt_us(int64_t message_us, int64_t timestamp_us)
+{
+    if (message_us == 0)
+    {
+        return BINLOG_DT_MISSING;
+    }
+    int64_t dt = message_us - timestamp_us;
+    if (dt <= INT32_MIN)
+    {
+        return INT32_MIN + 1;
+    }
+    return (dt > INT32_MAX) ? INT32_MAX : (int32_t)dt;
+}
+
+/*
+ * ================================================================
+ * 					API Functions Definition
+ * ================================================================
+ *
+ * */
+
+/**================================================================
+ * @Fn				- binlog_header_build
+ * @breif			- Builds the self-describing file header from the schema tables
+ * @param [out]		- out: Header bytes, written at the start of the file
+ * @param [in]		- len: Size of out, at least BINLOG_HEADER_SIZE
+ * @param [in]		- created_us: Creation time, UTC microseconds since the epoch
+ * @retval			- Size of the header, 0 if out is too small
+ */
+size_t binlog_header_build(uint8_t *out, size_t len, int64_t created_us)
+{
+    if (len < BINLOG_HEADER_SIZE)
+    {
+        return 0;
+    }
+    memset(out, 0, BINLOG_HEADER_SIZE);
+
+    binlog_file_header_t *header = (binlog_file_header_t *)out;
+    memcpy(header->magic, BINLOG_MAGIC, sizeof(header->magic));
+    header->version = BINLOG_VERSION;
+    header->header_size = BINLOG_HEADER_SIZE;
+    header->record_size = sizeof(binlog_record_t);
+    header->block_size = BINLOG_BLOCK_SIZE;
+    header->message_count = COMM_MESSAGE_COUNT;
+    header->signal_count = COMM_SIGNAL_COUNT;
+    header->created_us = created_us;
+#if CONFIG_IDF_TARGET_LINUX
+    binlog_copy_name(header->firmware, sizeof(header->firmware), "host");
+#else
+    binlog_copy_name(header->firmware, sizeof(header->firmware), esp_app_get_description()->version);
+#endif
+
+    binlog_message_desc_t *messages = (binlog_message_desc_t *)(out + sizeof(*header));
+    for (uint16_t i = 0; i < COMM_MESSAGE_COUNT; i++)
+    {
+        messages[i].can_id = SDIO_log_messages[i].id;
+        messages[i].extd = SDIO_log_messages[i].extd;
+        messages[i].dlc = SDIO_log_messages[i].dlc;
+        binlog_copy_name(messages[i].name, sizeof(messages[i].name), binlog_message_names[i]);
+    }
+
+    binlog_signal_desc_t *signals = (binlog_signal_desc_t *)(messages + COMM_MESSAGE_COUNT);
+    for (uint16_t i = 0; i < COMM_SIGNAL_COUNT; i++)
+    {
+        signals[i].can_id = COMM_signals[i].can_id;
+        signals[i].scale = COMM_signals[i].scale;
+        signals[i].type = COMM_signals[i].type;
+        signals[i].bit = COMM_signals[i].bit;
+        signals[i].width = COMM_signals[i].width;
+        binlog_copy_name(signals[i].name, sizeof(signals[i].name), COMM_signals[i].name);
+        binlog_copy_name(signals[i].unit, sizeof(signals[i].unit), COMM_signals[i].unit);
+    }
+
+    uint32_t crc = binlog_crc32(0, out, BINLOG_HEADER_SIZE - sizeof(crc));
+    memcpy(out + BINLOG_HEADER_SIZE - sizeof(crc), &crc, sizeof(crc));
+    return BINLOG_HEADER_SIZE;
+}
+
+/**================================================================
+ * @Fn				- binlog_file_tag
+ * @breif			- Tag of a file, carried by each of its blocks
+ * @param [in]		- header: File header (binlog_header_build, or read back from the file)
+ * @param [in]		- header_size: binlog_file_header_t.header_size
+ * @retval			- Low 16 bits of the header CRC, 0 for version 1 files (untagged blocks)
+ */
+uint16_t binlog_file_tag(const uint8_t *header, size_t header_size)
+{
+    uint32_t crc;
+    if (((const binlog_file_header_t *)header)->version < 2)
+    {
+        return 0;
+    }
+    memcpy(&crc, header + header_size - sizeof(crc), sizeof(crc));
+    return (uint16_t)crc;
+}
+
+/**================================================================
+ * @Fn				- binlog_schema_id
+ * @breif			- Identifier of the logged schema (messages and signals of can_schema.h)
+ * @retval			- CRC32 of the message and signal descriptors of the file header
+ * Note				- Changes with any ID, layout, scale, name or unit, not with the firmware
+ * 					  version or the time; computed once
+ */
+uint32_t binlog_schema_id(void)
+{
+    static uint8_t header[BINLOG_HEADER_SIZE];
+    static uint32_t id;
+
+    if (id == 0)
+    {
+        size_t size = binlog_header_build(header, sizeof(header), 0);
+        id = binlog_crc32(0, header + sizeof(binlog_file_header_t), size - sizeof(binlog_file_header_t) - sizeof(uint32_t));
+    }
+    return id;
+}
+
+/**================================================================
+ * @Fn				- binlog_block_init
+ * @breif			- Starts the first block of a file, or of a session appended to it
+ * @param [out]		- block: Block object
+ * @param [in]		- tag: binlog_file_tag of the file
+ * @param [in]		- codec: @ref binlog_codec stages allowed by the version of the file
+ * @retval			- None
+ */
+void binlog_block_init(binlog_block_t *block, uint16_t tag, uint8_t codec)
+{
+    block->records = 0;
+    block->sequence = 0;
+    block->tag = tag;
+    block->codec = codec;
+    block->first_us = 0;
+    block->sealed = block->data;
+}
+
+/**================================================================
+ * @Fn				- binlog_record_fill
+ * @breif			- Packs one row into a record
+ * @param [out]		- record: Record (in a block, or in a telemetry packet)
+ * @param [in]		- row: Decoded row (snapshot_take)
+ * @param [in]		- now_us: Current esp_timer time, the row time if row->timestamp_us is 0
+ * @retval			- None
+ */
+void binlog_record_fill(binlog_record_t *record, const SDIO_TxBuffer *row, int64_t now_us)
+{
+    int64_t timestamp_us = (row->timestamp_us != 0) ? row->timestamp_us : now_us;
+
+    record->timestamp_us = Time_Sync_epoch_us(timestamp_us);
+    record->fresh = row->fresh;
+    for (uint8_t i = 0; i < COMM_MESSAGE_COUNT; i++)
+    {
+        record->message_dt_us[i] = binlog_dt_us(row->message_us[i], timestamp_us);
+    }
+    COMM_MESSAGE_TABLE(BINLOG_X_COPY_MESSAGE, _)
+}
+
+/**================================================================
+ * @Fn				- binlog_block_add
+ * @breif			- Packs one row into the current block
+ * @param [in]		- block: Block object
+ * @param [in]		- row: Decoded row (snapshot_take)
+ * @param [in]		- now_us: Current esp_timer time
+ * @retval			- true if the block has to be sealed and written (full or older than
+ * 					  BINLOG_BLOCK_MAX_AGE_US)
+ */
+bool binlog_block_add(binlog_block_t *block, const SDIO_TxBuffer *row, int64_t now_us)
+{
+    binlog_record_fill((binlog_record_t *)(block->data + sizeof(binlog_block_header_t)) + block->records, row, now_us);
+
+    if (block->records++ == 0)
+    {
+        block->first_us = now_us;
+    }
+    return (block->records >= BINLOG_BLOCK_RECORDS) || ((now_us - block->first_us) >= BINLOG_BLOCK_MAX_AGE_US);
+}
+
+/**================================================================
+ * @Fn				- binlog_block_seal
+ * @breif			- Completes the block header and CRC (coding the records with the stages
+ * 					  of block->codec if they shrink), then starts the next block
+ * @param [in]		- block: Block object
+ * @retval			- Bytes of block->sealed to be written, 0 if the block is empty
+ * Note				- block->sealed stays valid until the next binlog_block_add
+ */
+size_t binlog_block_seal(binlog_block_t *block)
+{
+    if (block->records == 0)
+    {
+        return 0;
+    }
+    binlog_block_header_t header = {
+        .magic = BINLOG_BLOCK_MAGIC,
+        .sequence = block->sequence,
+        .records = block->records,
+        .tag = block->tag,
+    };
+    memcpy(block->data, &header, sizeof(header));
+
+    size_t size = sizeof(header) + block->records * sizeof(binlog_record_t);
+    uint32_t crc;
+    block->sealed = block->data;
+    block->stats.blocks++;
+    block->stats.raw_bytes += size + sizeof(crc);
+    if (block->codec != BINLOG_CODEC_NONE)
+    {
+        // records -> record_codec -> LZSS, only kept if the coded block is no larger than the plain one
+        uint32_t packed = 0;
+        uint32_t flags = BINLOG_PACKED_STORED;
+        const uint8_t *payload = block->data + sizeof(header);
+        size_t len = size - sizeof(header);
+        size_t limit = len - sizeof(packed);
+        uint8_t *out = block->packed + sizeof(header) + sizeof(packed);
+        int64_t start_us = esp_timer_get_time();
+        if (block->codec & BINLOG_CODEC_DELTA)
+        {
+            uint8_t *coded = (block->codec & BINLOG_CODEC_LZSS) ? block->coded : out;
+            size_t coded_len = record_codec_encode((const binlog_record_t *)payload, block->records, coded, limit);
+            if (coded_len != 0)
+            {
+                payload = coded;
+                len = coded_len;
+                flags |= BINLOG_PACKED_DELTA;
+            }
+        }
+        if (block->codec & BINLOG_CODEC_LZSS)
+        {
+            packed = (uint32_t)lzss_compress(&block->lzss, payload, len, out, limit);
+            flags = (packed != 0) ? (flags & ~BINLOG_PACKED_STORED) : flags;
+        }
+        if ((packed == 0) && (flags & BINLOG_PACKED_DELTA))
+        {
+            if (payload != out)
+            {
+                memcpy(out, payload, len);
+            }
+            packed = (uint32_t)len;
+        }
+        block->stats.compress_us += esp_timer_get_time() - start_us;
+        if (packed != 0)
+        {
+            size = sizeof(header) + sizeof(packed) + packed;
+            packed |= flags;
+            header.magic = BINLOG_LZ_MAGIC;
+            memcpy(block->packed, &header, sizeof(header));
+            memcpy(block->packed + sizeof(header), &packed, sizeof(packed));
+            block->sealed = block->packed;
+            block->stats.packed++;
+        }
+    }
+    crc = binlog_crc32(0, block->sealed, size);
+    memcpy(block->sealed + size, &crc, sizeof(crc));
+    block->stats.stored_bytes += size + sizeof(crc);
+
+    block->sequence++;
+    block->records = 0;
+    return size + sizeof(crc);
+}
+
+/**================================================================
+ * @Fn				- binlog_block_check
+ * @breif			- Checks a block read back from a file
+ * @param [in]		- data: Bytes from the start of the block
+ * @param [in]		- len: Number of bytes available, BINLOG_BLOCK_SIZE is always enough
+ * @param [in]		- tag: binlog_file_tag of the file
+ * @retval			- Size of the block (CRC included), 0 if it is not a complete valid block
+ * 					  of this file
+ * Note				- A block cut by the end of data is invalid: pass BINLOG_BLOCK_SIZE bytes,
+ * 					  or every byte up to the end of the file
+ */
+size_t binlog_block_check(const uint8_t *data, size_t len, uint16_t tag)
+{
+    binlog_block_header_t header;
+    uint32_t crc;
+
+    if (len < sizeof(header))
+    {
+        return 0;
+    }
+    memcpy(&header, data, sizeof(header));
+    if (((header.magic != BINLOG_BLOCK_MAGIC) && (header.magic != BINLOG_LZ_MAGIC)) || (header.tag != tag) ||
+        (header.records == 0) || (header.records > BINLOG_BLOCK_RECORDS))
+    {
+        return 0;
+    }
+    size_t size = sizeof(header) + header.records * sizeof(binlog_record_t);
+    if (header.magic == BINLOG_LZ_MAGIC)
+    {
+        // The coded bytes are checked, not decoded: never larger than the plain block
+        uint32_t packed;
+        if (len < sizeof(header) + sizeof(packed))
+        {
+            return 0;
+        }
+        memcpy(&packed, data + sizeof(header), sizeof(packed));
+        uint32_t payload = packed & BINLOG_PACKED_SIZE_MASK;
+        if ((payload == 0) || (payload > size - sizeof(header) - sizeof(packed)) ||
+            ((packed & ~(BINLOG_PACKED_SIZE_MASK | BINLOG_PACKED_DELTA | BINLOG_PACKED_STORED)) != 0) ||
+            ((packed & (BINLOG_PACKED_DELTA | BINLOG_PACKED_STORED)) == BINLOG_PACKED_STORED))
+        {
+            return 0;
+        }
+        size = sizeof(header) + sizeof(packed) + payload;
+    }
+    if (len < size + sizeof(crc))
+    {
+        return 0;
+    }
+    memcpy(&crc, data + size, sizeof(crc));
+    return (binlog_crc32(0, data, size) == crc) ? size + sizeof(crc) : 0;
+}
+
+/**================================================================
+ * @Fn				- binlog_block_decode
+ * @breif			- Restores the records of a block checked by binlog_block_check
+ * @param [in]		- data: Block
+ * @param [out]		- records: Records of the block, BINLOG_BLOCK_RECORDS entries
+ * @param [in]		- scratch: BINLOG_BLOCK_SIZE bytes, holds the output of LZSS before record_codec
+ * @retval			- Number of records, 0 if a stage fails (corrupt block)
+ */
+uint16_t binlog_block_decode(const uint8_t *data, binlog_record_t *records, uint8_t *scratch)
+{
+    binlog_block_header_t header;
+    uint32_t packed;
+
+    memcpy(&header, data, sizeof(header));
+    size_t raw = header.records * sizeof(binlog_record_t);
+    if (header.magic == BINLOG_BLOCK_MAGIC)
+    {
+        memcpy(records, data + sizeof(header), raw);
+        return header.records;
+    }
+    memcpy(&packed, data + sizeof(header), sizeof(packed));
+    const uint8_t *payload = data + sizeof(header) + sizeof(packed);
+    size_t len = packed & BINLOG_PACKED_SIZE_MASK;
+    if ((packed & BINLOG_PACKED_STORED) == 0)
+    {
+        uint8_t *out = (packed & BINLOG_PACKED_DELTA) ? scratch : (uint8_t *)records;
+        len = lzss_decompress(payload, len, out, (packed & BINLOG_PACKED_DELTA) ? BINLOG_BLOCK_SIZE : raw);
+        payload = out;
+        if ((len == 0) || (((packed & BINLOG_PACKED_DELTA) == 0) && (len != raw)))
+        {
+            return 0;
+        }
+    }
+    if (packed & BINLOG_PACKED_DELTA)
+    {
+        return (record_codec_decode(payload, len, records, header.records) != 0) ? header.records : 0;
+    }
+    return header.records;
+}
+
+/**================================================================
+ * @Fn				- binlog_commit_build
+ * @breif			- Fills the commit record of the blocks written up to end
+ * @param [out]		- commit: Record, written to its slot as is
+ * @param [in]		- count: Commit number, from 1
+ * @param [in]		- end: File offset after the last complete block
+ * @param [in]		- tag: binlog_file_tag of the file
+ * @param [in]		- time_us: Commit time, UTC microseconds since the epoch
+ * @retval			- Offset of its slot from BINLOG_COMMIT_OFFSET (slots alternate)
+ */
+uint32_t binlog_commit_build(binlog_commit_t *commit, uint32_t count, uint32_t end, uint16_t tag, int64_t time_us)
+{
+    memset(commit, 0, sizeof(*commit));
+    commit->magic = BINLOG_COMMIT_MAGIC;
+    commit->count = count;
+    commit->end = end;
+    commit->tag = tag;
+    commit->time_us = time_us;
+    commit->crc = binlog_crc32(0, commit, offsetof(binlog_commit_t, crc));
+    return (count % BINLOG_COMMIT_SLOTS) * BINLOG_COMMIT_SLOT_SIZE;
+}
+
+/**================================================================
+ * @Fn				- binlog_commit_latest
+ * @breif			- Picks the latest valid commit of the slots read back from a file
+ * @param [in]		- slots: First bytes of each slot, BINLOG_COMMIT_SLOTS entries
+ * @param [in]		- tag: binlog_file_tag of the file
+ * @param [out]		- latest: Latest valid commit
+ * @retval			- false if no slot holds a valid commit of this file
+ */
+bool binlog_commit_latest(const binlog_commit_t *slots, uint16_t tag, binlog_commit_t *latest)
+{
+    bool found = false;
+
+    for (uint8_t i = 0; i < BINLOG_COMMIT_SLOTS; i++)
+    {
+        const binlog_commit_t *slot = &slots[i];
+        if ((slot->magic == BINLOG_COMMIT_MAGIC) && (slot->tag == tag) &&
+            (slot->crc == binlog_crc32(0, slot, offsetof(binlog_commit_t, crc))) &&
+            (!found || (slot->count > latest->count)))
+        {
+            *latest = *slot;
+            found = true;
+        }
+    }
+    return found;
+}
+
+/**================================================================
+ * @Fn				- binlog_crc32
+ * @breif			- CRC-32 (IEEE 802.3, same result as zlib.crc32)
+ * @param [in]		- crc: 0, or the result of the previous chunk
+ * @param [in]		- data: Bytes to add
+ * @param [in]		- len: Number of bytes
+ * @retval			- CRC of every byte so far
+ */
+uint32_t binlog_crc32(uint32_t crc, const void *data, size_t len)
+{
+    static uint32_t table[256];
+    const uint8_t *bytes = (const uint8_t *)data;
+
+    if (table[1] == 0)
+    {
+        for (uint32_t i = 0; i < 256; i++)
+        {
+            uint32_t c = i;
+            for (uint8_t k = 0; k < 8; k++)
+            {
+                c = (c & 1u) ? (0xEDB88320u ^ (c >> 1)) : (c >> 1);
+            }
+            table[i] = c;
+        }
+    }
+
+    crc = ~crc;
+    while (len--)
+    {
+        crc = table[(crc ^ *bytes++) & 0xFFu] ^ (crc >> 8);
+    }
+    return ~crc;
+}
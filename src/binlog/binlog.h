@@ -0,0 +1,187 @@
+/*
+ * binlog.h
+ *
+ *  Description: Binary format of the SD log, the compact alternative to the .CSV rows.
+ *               A file starts with a self-describing header (firmware version, message and signal
+ *               descriptors generated from can_schema.h, CRC), followed by blocks of fixed-size
+ *               packed records, each block closed by its own CRC. Records hold the decoded signal
+ *               values, so writing a row is a copy instead of ~30 printf conversions.
+ *               scripts/binlog_to_csv.py converts the files back into the .CSV layout.
+ *      Layout (little-endian, packed):
+ *               binlog_file_header_t, message descriptors, signal descriptors, CRC32
+ *               commit slots A and B (BINLOG_COMMIT_SLOT_SIZE each, from the first multiple of
+ *               BINLOG_COMMIT_SLOT_SIZE after the header, see BINLOG_DATA_OFFSET)
+ *               { binlog_block_header_t, binlog_record_t x records, CRC32 } ...
+ *               or, for a coded block (version 4, magic BINLOG_LZ_MAGIC):
+ *               { binlog_block_header_t, uint32_t packed, payload, CRC32 }
+ *               packed holds the payload size (BINLOG_PACKED_SIZE_MASK) and, from version 5, the
+ *               stages to undo: LZSS (lzss.h) unless BINLOG_PACKED_STORED, then record_codec
+ *               (record_codec.h) if BINLOG_PACKED_DELTA, giving the records of the block.
+ *               CRC32 is the IEEE / zlib polynomial, computed over every byte before it.
+ *               After every durability sync the end of the complete blocks is committed to the
+ *               older slot, so recovery after a power cut reads two slots and walks only the
+ *               blocks written since the last commit instead of the whole file.
+ *               Every block carries the tag of its file (low half of the header CRC), so blocks
+ *               left on the card by a deleted file are not taken for data of a new one.
+ *               The codec is chosen per file (SDIO_FileConfig.codec) and applied per block, a
+ *               block that does not shrink is stored as is; both kinds mix freely in a file.
+ */
+
+#ifndef BINLOG_H
+#define BINLOG_H
+
+//==================================Standard Libraries Includes=======================//
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+//==================================ESP32 Libraries Includes==========================//
+#include "Logging/logging.h"
+#include "lzss/lzss.h"
+
+//----------------------------
+// Format Macros
+//----------------------------
+#define BINLOG_MAGIC "ASURTLOG"		  // First 8 bytes of a file, no terminator
+#define BINLOG_VERSION 5			  // 2: block tag, 3: commit slots, 4: LZSS blocks, 5: delta blocks
+#define BINLOG_BLOCK_MAGIC 0x4B4C4241u // "ABLK": first word of a block
+#define BINLOG_LZ_MAGIC 0x5A4C4241u	  // "ABLZ": first word of a coded block
+#define BINLOG_PACKED_SIZE_MASK 0x00FFFFFFu
+#define BINLOG_PACKED_DELTA 0x80000000u	 // The payload restores record_codec bytes instead of records
+#define BINLOG_PACKED_STORED 0x40000000u // The payload is not LZSS compressed
+#define BINLOG_BLOCK_SIZE 4096		  // Largest block on the card, one FAT sector multiple
+#define BINLOG_BLOCK_MAX_AGE_US 1000000 // Partial blocks are written once their first row is this old
+#define BINLOG_DT_MISSING INT32_MIN	  // message_dt_us of a message never received
+#define BINLOG_COMMIT_MAGIC 0x4D4F4341u // "ACOM": first word of a commit slot
+#define BINLOG_COMMIT_SLOT_SIZE 512	  // One sector per slot, a torn write damages one slot only
+#define BINLOG_COMMIT_SLOTS 2
+
+//@ref binlog_codec (SDIO_FileConfig.codec): stages applied to the records of a block
+#define BINLOG_CODEC_NONE 0
+#define BINLOG_CODEC_LZSS 0x01	// Version 4 files and later
+#define BINLOG_CODEC_DELTA 0x02 // record_codec, version 5 files and later
+
+//===============================================
+// User type definitions (structures)
+//===============================================
+
+// Packed copy of the decoded signals of each message, in COMM_signals order
+#define BINLOG_X_VALUE(P, FIELD, CSV, TYPE, BIT, WIDTH, SCALE, UNIT) COMM_CTYPE_##TYPE FIELD;
+#define BINLOG_X_ELEMENT(P, NAME, ID, EXTD, ELEMENT, DLC) \
+	struct __attribute__((packed))                         \
+	{                                                      \
+		COMM_SIGNALS_##NAME(BINLOG_X_VALUE, _)             \
+	} ELEMENT;
+
+typedef struct __attribute__((packed))
+{
+	int64_t timestamp_us;					   // Row time, UTC microseconds since the epoch
+	uint64_t fresh;							   // Freshness flags (SDIO_TxBuffer.fresh)
+	int32_t message_dt_us[COMM_MESSAGE_COUNT]; // Receive time of each message - timestamp_us
+	COMM_MESSAGE_TABLE(BINLOG_X_ELEMENT, _)	   // Signal values (raw, as in the .CSV)
+} binlog_record_t;
+
+typedef struct __attribute__((packed))
+{
+	char magic[8];			// BINLOG_MAGIC
+	uint16_t version;		// BINLOG_VERSION
+	uint16_t header_size;	// Whole file header: this struct, descriptors and CRC
+	uint16_t record_size;	// sizeof(binlog_record_t)
+	uint16_t block_size;	// Largest block, BINLOG_BLOCK_SIZE
+	uint16_t message_count; // binlog_message_desc_t entries
+	uint16_t signal_count;	// binlog_signal_desc_t entries
+	int64_t created_us;		// File creation, UTC microseconds since the epoch
+	char firmware[32];		// Application version, zero padded
+} binlog_file_header_t;
+
+typedef struct __attribute__((packed))
+{
+	uint32_t can_id;
+	uint8_t extd;
+	uint8_t dlc;
+	char name[16]; // COMM_MESSAGE_TABLE name, zero padded
+} binlog_message_desc_t;
+
+typedef struct __attribute__((packed))
+{
+	uint32_t can_id; // Message carrying the signal
+	float scale;	 // Physical value = raw * scale
+	uint8_t type;	 // @ref COMM_signal_type_t, gives the size of the value in the record
+	uint8_t bit;
+	uint8_t width;
+	uint8_t reserved;
+	char name[20]; // .CSV column name, zero padded
+	char unit[8];  // Zero padded
+} binlog_signal_desc_t;
+
+typedef struct __attribute__((packed))
+{
+	uint32_t magic;	   // BINLOG_BLOCK_MAGIC
+	uint32_t sequence; // Block number in the file, from 0
+	uint16_t records;  // Records in the block
+	uint16_t tag;	   // binlog_file_tag of the file
+} binlog_block_header_t;
+
+#define BINLOG_HEADER_SIZE (sizeof(binlog_file_header_t) + COMM_MESSAGE_COUNT * sizeof(binlog_message_desc_t) + \
+							COMM_SIGNAL_COUNT * sizeof(binlog_signal_desc_t) + sizeof(uint32_t))
+#define BINLOG_BLOCK_RECORDS ((BINLOG_BLOCK_SIZE - sizeof(binlog_block_header_t) - sizeof(uint32_t)) / sizeof(binlog_record_t))
+
+typedef struct __attribute__((packed))
+{
+	uint32_t magic;	   // BINLOG_COMMIT_MAGIC
+	uint32_t count;	   // Commit number, the valid slot with the larger one is the latest
+	uint32_t end;	   // File offset after the last committed block
+	uint16_t tag;	   // binlog_file_tag of the file
+	uint16_t reserved;
+	int64_t time_us;   // Commit time, UTC microseconds since the epoch
+	uint32_t crc;	   // CRC32 of the bytes above
+} binlog_commit_t;
+
+// File offset of the commit slots and of the first block, from binlog_file_header_t.header_size
+#define BINLOG_COMMIT_OFFSET(HEADER_SIZE) ((((HEADER_SIZE) + BINLOG_COMMIT_SLOT_SIZE - 1) / BINLOG_COMMIT_SLOT_SIZE) * BINLOG_COMMIT_SLOT_SIZE)
+#define BINLOG_DATA_OFFSET(HEADER_SIZE) (BINLOG_COMMIT_OFFSET(HEADER_SIZE) + BINLOG_COMMIT_SLOTS * BINLOG_COMMIT_SLOT_SIZE)
+
+// Compression counters of the sealed blocks
+typedef struct
+{
+	uint32_t blocks;	   // Blocks sealed
+	uint32_t packed;	   // Blocks stored coded
+	uint64_t raw_bytes;	   // Size the blocks would have had uncoded
+	uint64_t stored_bytes; // Size written
+	int64_t compress_us;   // Time spent in record_codec_encode and lzss_compress
+} binlog_codec_stats_t;
+
+// Block being assembled: rows are packed in place, the header and CRC are added when it is sealed
+typedef struct
+{
+	uint8_t data[BINLOG_BLOCK_SIZE];
+	uint8_t packed[BINLOG_BLOCK_SIZE]; // Coded block (codec only)
+	uint8_t coded[BINLOG_BLOCK_SIZE];  // record_codec output before LZSS (both stages only)
+	uint8_t *sealed;				   // data or packed: bytes returned by binlog_block_seal
+	uint16_t records;				   // Records packed so far
+	uint32_t sequence;				   // Number of the block
+	uint16_t tag;					   // binlog_file_tag of the file
+	uint8_t codec;					   // @ref binlog_codec, blocks are kept coded when they shrink
+	int64_t first_us;				   // esp_timer time of the first record
+	lzss_state_t lzss;
+	binlog_codec_stats_t stats;
+} binlog_block_t;
+
+//===============================================
+// APIs Supported by "BINLOG"
+//===============================================
+
+size_t binlog_header_build(uint8_t *out, size_t len, int64_t created_us);
+uint16_t binlog_file_tag(const uint8_t *header, size_t header_size);
+uint32_t binlog_schema_id(void);
+void binlog_record_fill(binlog_record_t *record, const SDIO_TxBuffer *row, int64_t now_us);
+void binlog_block_init(binlog_block_t *block, uint16_t tag, uint8_t codec);
+bool binlog_block_add(binlog_block_t *block, const SDIO_TxBuffer *row, int64_t now_us);
+size_t binlog_block_seal(binlog_block_t *block);
+size_t binlog_block_check(const uint8_t *data, size_t len, uint16_t tag);
+uint16_t binlog_block_decode(const uint8_t *data, binlog_record_t *records, uint8_t *scratch);
+uint32_t binlog_commit_build(binlog_commit_t *commit, uint32_t count, uint32_t end, uint16_t tag, int64_t time_us);
+bool binlog_commit_latest(const binlog_commit_t *slots, uint16_t tag, binlog_commit_t *latest);
+uint32_t binlog_crc32(uint32_t crc, const void *data, size_t len);
+
+#endif // BINLOG_H
@@ -0,0 +1,153 @@
+/*
+ * can_dispatch.c
+ *
+ *  Description: Implementation of the table-driven CAN ID dispatch.
+ *      Note: Tables are built once at start-up (can_dispatch_init) and are read-only afterwards,
+ *            so lookups can run from several tasks without locking.
+ */
+
+#include "can_dispatch.h"
+#include <string.h>
+
+/*
+ * ================================================================
+ * 					Local Functions Definition
+ * ================================================================
+ *
+ * */
+
+// Multiplicative (Fibonacci) hash of a 29-bit identifier into CAN_DISPATCH_EXT_SLOTS
+static inline uint32_t can_dispatch_ext_hash(uint32_t id)
+{
+    return (id * 2654435761u) & (CAN_DISPATCH_EXT_SLOTS - 1);
+}
+
+/*
+ * ================================================================
+ * 					API Functions Definition
+ * ================================================================
+ *
+ * */
+
+/**================================================================
+ * @Fn				- can_dispatch_init
+ * @breif			- Builds the O(1) lookup indexes of a dispatch table
+ * @param [out]		- dispatch: Dispatch object to build
+ * @param [in]		- table: Registered messages (must stay valid while dispatch is used)
+ * @param [in]		- count: Number of entries in table
+ * @retval			- ESP_OK, ESP_ERR_INVALID_SIZE if the table is too large,
+ * 					  ESP_ERR_INVALID_ARG for out of range or duplicated identifiers
+ */
+esp_err_t can_dispatch_init(can_dispatch_t *dispatch, const can_dispatch_entry_t *table, uint16_t count)
+{
+    if (count > CAN_DISPATCH_MAX_ENTRIES)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    dispatch->table = table;
+    dispatch->count = count;
+    memset(dispatch->std_index, 0xFF, sizeof(dispatch->std_index));
+    memset(dispatch->ext_index, 0xFF, sizeof(dispatch->ext_index));
+
+    for (uint16_t i = 0; i < count; i++)
+    {
+        if (can_dispatch_lookup(dispatch, table[i].id, table[i].extd) != CAN_DISPATCH_NO_SLOT)
+        {
+            return ESP_ERR_INVALID_ARG; // Same identifier registered twice
+        }
+
+        if (!table[i].extd)
+        {
+            if (table[i].id >= CAN_DISPATCH_STD_IDS)
+            {
+                return ESP_ERR_INVALID_ARG;
+            }
+            dispatch->std_index[table[i].id] = i;
+        }
+        else
+        {
+            if (table[i].id > TWAI_EXTD_ID_MASK)
+            {
+                return ESP_ERR_INVALID_ARG;
+            }
+            // Linear probing, the table is at most half full so a free slot always exists
+            uint32_t h = can_dispatch_ext_hash(table[i].id);
+            while (dispatch->ext_index[h] != CAN_DISPATCH_NO_SLOT)
+            {
+                h = (h + 1) & (CAN_DISPATCH_EXT_SLOTS - 1);
+            }
+            dispatch->ext_index[h] = i;
+        }
+    }
+    return ESP_OK;
+}
+
+/**================================================================
+ * @Fn				- can_dispatch_lookup
+ * @breif			- Finds the table slot registered for an identifier
+ * @param [in]		- dispatch: Built dispatch object
+ * @param [in]		- id: Received identifier
+ * @param [in]		- extd: true if id is a 29-bit identifier
+ * @retval			- Index of the entry in the table, CAN_DISPATCH_NO_SLOT if not registered
+ */
+uint16_t can_dispatch_lookup(const can_dispatch_t *dispatch, uint32_t id, bool extd)
+{
+    if (!extd)
+    {
+        return (id < CAN_DISPATCH_STD_IDS) ? dispatch->std_index[id] : CAN_DISPATCH_NO_SLOT;
+    }
+
+    uint32_t h = can_dispatch_ext_hash(id);
+    uint16_t slot;
+    while ((slot = dispatch->ext_index[h]) != CAN_DISPATCH_NO_SLOT)
+    {
+        if (dispatch->table[slot].id == id)
+        {
+            return slot;
+        }
+        h = (h + 1) & (CAN_DISPATCH_EXT_SLOTS - 1);
+    }
+    return CAN_DISPATCH_NO_SLOT;
+}
+
+/**================================================================
+ * @Fn				- can_dispatch_decode
+ * @breif			- Decodes a frame with the entry found by can_dispatch_lookup
+ * @param [in]		- dispatch: Built dispatch object
+ * @param [in]		- slot: Entry index returned by can_dispatch_lookup (must be valid)
+ * @param [in]		- msg: Received frame
+ * @param [out]		- record: Destination record, the entry offset selects the slot inside it
+ * @retval			- None
+ */
+void can_dispatch_decode(const can_dispatch_t *dispatch, uint16_t slot, const twai_message_t *msg, void *record)
+{
+    const can_dispatch_entry_t *entry = &dispatch->table[slot];
+    void *dest = (uint8_t *)record + entry->offset;
+    if (entry->handler != NULL)
+    {
+        entry->handler(msg, dest, entry->size);
+    }
+    else
+    {
+        memcpy(dest, msg->data, (entry->size < TWAI_FRAME_MAX_DLC) ? entry->size : TWAI_FRAME_MAX_DLC);
+    }
+}
+
+/**================================================================
+ * @Fn				- can_dispatch_frame
+ * @breif			- Decodes a received frame into its destination slot
+ * @param [in]		- dispatch: Built dispatch object
+ * @param [in]		- msg: Received frame
+ * @param [out]		- record: Destination record, the entry offset selects the slot inside it
+ * @retval			- Index of the entry that handled the frame, CAN_DISPATCH_NO_SLOT if not registered
+ */
+uint16_t can_dispatch_frame(const can_dispatch_t *dispatch, const twai_message_t *msg, void *record)
+{
+    uint16_t slot = can_dispatch_lookup(dispatch, msg->identifier, msg->extd);
+    if (slot != CAN_DISPATCH_NO_SLOT)
+    {
+        can_dispatch_decode(dispatch, slot, msg, record);
+    }
+    return slot;
+}
@@ -0,0 +1,64 @@
+/*
+ * can_dispatch.h
+ *
+ *  Description: Table-driven CAN ID dispatch. A table of registered messages maps an 11-bit or
+ *               29-bit identifier to a decoder, a destination slot inside a record and a size.
+ *               Lookup is O(1): standard IDs index a dense 2048-entry array, extended IDs go
+ *               through a small open-addressing hash.
+ */
+
+#ifndef CAN_DISPATCH_H
+#define CAN_DISPATCH_H
+
+//==================================Standard Libraries Includes=======================//
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+//==================================ESP32 Libraries Includes==========================//
+#include "esp_err.h"
+#include "driver/twai.h"
+
+//----------------------------
+// Dispatch Macros
+//----------------------------
+#define CAN_DISPATCH_MAX_ENTRIES 512  // Registered messages supported by one table
+#define CAN_DISPATCH_STD_IDS 2048	  // Dense index size for 11-bit identifiers
+#define CAN_DISPATCH_EXT_SLOTS 1024	  // Hash slots for 29-bit identifiers, power of two
+#define CAN_DISPATCH_NO_SLOT 0xFFFF	  // Returned for identifiers that are not registered
+
+//===============================================
+// User type definitions (structures)
+//===============================================
+
+// Decodes msg into dest (size bytes), NULL in the table means a plain copy of the payload
+typedef void (*can_dispatch_handler_t)(const twai_message_t *msg, void *dest, uint8_t size);
+
+typedef struct
+{
+	uint32_t id;					// 11-bit or 29-bit identifier
+	bool extd;						// true for 29-bit identifiers
+	can_dispatch_handler_t handler; // Decoder, NULL to copy the payload as-is
+	size_t offset;					// Destination slot: offset inside the destination record
+	uint8_t size;					// Size of the destination slot in bytes
+	uint8_t dlc;					// Expected payload length, 0 if not checked
+} can_dispatch_entry_t;
+
+typedef struct
+{
+	const can_dispatch_entry_t *table; // Registered messages
+	uint16_t count;					   // Number of entries in table
+	uint16_t std_index[CAN_DISPATCH_STD_IDS];	  // Standard ID -> table slot, CAN_DISPATCH_NO_SLOT if unused
+	uint16_t ext_index[CAN_DISPATCH_EXT_SLOTS]; // Hashed extended ID -> table slot
+} can_dispatch_t;
+
+//===============================================
+// APIs Supported by "CAN DISPATCH"
+//===============================================
+
+esp_err_t can_dispatch_init(can_dispatch_t *dispatch, const can_dispatch_entry_t *table, uint16_t count);
+uint16_t can_dispatch_lookup(const can_dispatch_t *dispatch, uint32_t id, bool extd);
+void can_dispatch_decode(const can_dispatch_t *dispatch, uint16_t slot, const twai_message_t *msg, void *record);
+uint16_t can_dispatch_frame(const can_dispatch_t *dispatch, const twai_message_t *msg, void *record);
+
+#endif // CAN_DISPATCH_H
@@ -0,0 +1,248 @@
+/*
+ * can_filter.c
+ *
+ *  Description: Implementation of the acceptance filter computation.
+ *      Note: A filter matches a "cube" of identifiers: bits fixed to a value (code) and don't care
+ *            bits (mask). The smallest cube covering a set of IDs has code = AND of the IDs and
+ *            don't care = AND ^ OR. Dual filter mode (standard IDs) covers the set with two cubes,
+ *            the split with the fewest accepted IDs is kept.
+ *            Bit layouts follow the ESP32 TWAI acceptance filter (mask bit = 1 means don't care):
+ *              Single, standard : ID[10:0] @ bits 31:21, RTR @ 20, data bytes @ 15:0
+ *              Single, extended : ID[28:0] @ bits 31:3,  RTR @ 2
+ *              Dual,   standard : Filter 1 ID[10:0] @ bits 31:21, Filter 2 ID[10:0] @ bits 15:5
+ */
+
+#include "can_filter.h"
+
+//----------------------------
+// Local Macros
+//----------------------------
+#define CAN_FILTER_STD_BITS 11
+#define CAN_FILTER_EXT_BITS 29
+
+//===============================================
+// Local type definitions (structures)
+//===============================================
+typedef struct
+{
+    uint32_t code;      // Value of the fixed bits
+    uint32_t dont_care; // Bits ignored by the filter
+    bool used;          // false while no ID was added
+} can_filter_cube_t;
+
+typedef enum
+{
+    CAN_FILTER_SPLIT_INDEX_MASK, // arg: bit i set = entry i goes to the second filter
+    CAN_FILTER_SPLIT_THRESHOLD,  // arg: IDs >= arg go to the second filter
+    CAN_FILTER_SPLIT_BIT,        // arg: IDs with bit arg set go to the second filter
+} can_filter_split_t;
+
+/*
+ * ================================================================
+ * 					Local Functions Definition
+ * ================================================================
+ *
+ * */
+static void can_filter_cube_add(can_filter_cube_t *cube, uint32_t id)
+{
+    if (!cube->used)
+    {
+        cube->code = id;
+        cube->dont_care = 0;
+        cube->used = true;
+    }
+    else
+    {
+        cube->dont_care |= cube->code ^ id;
+        cube->code &= id;
+    }
+}
+
+static uint32_t can_filter_cube_size(const can_filter_cube_t *cube)
+{
+    return cube->used ? (1u << __builtin_popcount(cube->dont_care)) : 0;
+}
+
+// Number of identifiers accepted by two filters (inclusion-exclusion of the two cubes)
+static uint32_t can_filter_union_size(const can_filter_cube_t *a, const can_filter_cube_t *b)
+{
+    uint32_t size = can_filter_cube_size(a) + can_filter_cube_size(b);
+    if (a->used && b->used)
+    {
+        uint32_t fixed_in_both = ~(a->dont_care | b->dont_care);
+        if (((a->code ^ b->code) & fixed_in_both) == 0)
+        {
+            size -= 1u << __builtin_popcount(a->dont_care & b->dont_care);
+        }
+    }
+    return size;
+}
+
+static bool can_filter_in_second(uint32_t id, uint16_t index, can_filter_split_t split, uint32_t arg)
+{
+    switch (split)
+    {
+    case CAN_FILTER_SPLIT_INDEX_MASK:
+        return (arg >> index) & 1u;
+    case CAN_FILTER_SPLIT_THRESHOLD:
+        return id >= arg;
+    case CAN_FILTER_SPLIT_BIT:
+    default:
+        return (id >> arg) & 1u;
+    }
+}
+
+static void can_filter_split(const can_dispatch_entry_t *table, uint16_t count, can_filter_split_t split, uint32_t arg,
+                             can_filter_cube_t *first, can_filter_cube_t *second)
+{
+    first->used = false;
+    second->used = false;
+    for (uint16_t i = 0; i < count; i++)
+    {
+        can_filter_cube_add(can_filter_in_second(table[i].id, i, split, arg) ? second : first, table[i].id);
+    }
+}
+
+// Evaluates one split and keeps it if it accepts fewer IDs than the best one so far
+static void can_filter_try_split(const can_dispatch_entry_t *table, uint16_t count, can_filter_split_t split, uint32_t arg,
+                                 can_filter_cube_t best[2], uint32_t *best_size)
+{
+    can_filter_cube_t cube[2];
+    can_filter_split(table, count, split, arg, &cube[0], &cube[1]);
+    uint32_t size = can_filter_union_size(&cube[0], &cube[1]);
+    if (size < *best_size)
+    {
+        *best_size = size;
+        best[0] = cube[0];
+        best[1] = cube[1];
+    }
+}
+
+/*
+ * ================================================================
+ * 					API Functions Definition
+ * ================================================================
+ *
+ * */
+
+/**================================================================
+ * @Fn				- can_filter_from_table
+ * @breif			- Computes the tightest acceptance filter covering every registered ID
+ * @param [in]		- table: Registered messages (can_dispatch table)
+ * @param [in]		- count: Number of entries in table
+ * @param [out]		- result: Filter configuration and accepted / wanted ID counts
+ * @retval			- ESP_OK, ESP_ERR_NOT_SUPPORTED if standard and extended IDs are mixed
+ * 					  (result then holds an accept-all filter and software filtering does the job)
+ * Note				- Dual filter mode is only used for standard IDs, and only when it beats single mode
+ */
+esp_err_t can_filter_from_table(const can_dispatch_entry_t *table, uint16_t count, can_filter_result_t *result)
+{
+    twai_filter_config_t accept_all = TWAI_FILTER_CONFIG_ACCEPT_ALL();
+    bool has_std = false, has_ext = false;
+
+    for (uint16_t i = 0; i < count; i++)
+    {
+        has_std |= !table[i].extd;
+        has_ext |= table[i].extd;
+    }
+
+    result->wanted_ids = count;
+    result->config = accept_all;
+    result->accepted_ids = (1u << CAN_FILTER_STD_BITS) + (1u << CAN_FILTER_EXT_BITS);
+    if ((has_std && has_ext) || (count == 0))
+    {
+        return (count == 0) ? ESP_OK : ESP_ERR_NOT_SUPPORTED;
+    }
+
+    // Single filter: one cube over every ID
+    can_filter_cube_t single, none = {.used = false};
+    can_filter_split(table, count, CAN_FILTER_SPLIT_THRESHOLD, UINT32_MAX, &single, &none);
+
+    if (has_ext)
+    {
+        result->config.single_filter = true;
+        result->config.acceptance_code = single.code << 3;
+        result->config.acceptance_mask = (single.dont_care << 3) | 0x7;
+        result->accepted_ids = can_filter_cube_size(&single);
+        return ESP_OK;
+    }
+
+    // Dual filter: best split of the IDs over the two filters
+    can_filter_cube_t best[2] = {single, none};
+    uint32_t best_size = can_filter_cube_size(&single);
+
+    if (count <= CAN_FILTER_EXHAUSTIVE_MAX_IDS)
+    {
+        // Entry 0 always stays in the first filter, every other subset is tried
+        for (uint32_t subset = 1; subset < (1u << count); subset += 2)
+        {
+            can_filter_try_split(table, count, CAN_FILTER_SPLIT_INDEX_MASK, subset & ~1u, best, &best_size);
+        }
+    }
+    else
+    {
+        for (uint16_t i = 0; i < count; i++)
+        {
+            can_filter_try_split(table, count, CAN_FILTER_SPLIT_THRESHOLD, table[i].id, best, &best_size);
+        }
+        for (uint32_t bit = 0; bit < CAN_FILTER_STD_BITS; bit++)
+        {
+            can_filter_try_split(table, count, CAN_FILTER_SPLIT_BIT, bit, best, &best_size);
+        }
+    }
+
+    if (best[1].used)
+    {
+        result->config.single_filter = false;
+        result->config.acceptance_code = (best[0].code << 21) | (best[1].code << 5);
+        result->config.acceptance_mask = ~(((~best[0].dont_care & TWAI_STD_ID_MASK) << 21) |
+                                           ((~best[1].dont_care & TWAI_STD_ID_MASK) << 5));
+    }
+    else
+    {
+        result->config.single_filter = true;
+        result->config.acceptance_code = single.code << 21;
+        result->config.acceptance_mask = (single.dont_care << 21) | 0x001FFFFF;
+    }
+
+    // Count with the filter model itself, so the report reflects what the hardware does
+    result->accepted_ids = 0;
+    for (uint32_t id = 0; id <= TWAI_STD_ID_MASK; id++)
+    {
+        result->accepted_ids += can_filter_accepts(&result->config, id, false);
+    }
+    return ESP_OK;
+}
+
+/**================================================================
+ * @Fn				- can_filter_accepts
+ * @breif			- Software model of the hardware acceptance filter (identifier bits only)
+ * @param [in]		- config: Filter configuration
+ * @param [in]		- id: Identifier
+ * @param [in]		- extd: true for a 29-bit identifier
+ * @retval			- true if a frame with this identifier passes the hardware filter
+ */
+bool can_filter_accepts(const twai_filter_config_t *config, uint32_t id, bool extd)
+{
+    uint32_t care = ~config->acceptance_mask;
+    uint32_t code = config->acceptance_code;
+
+    if (config->single_filter)
+    {
+        if (extd)
+        {
+            return ((((id << 3) ^ code) & care & 0xFFFFFFF8) == 0);
+        }
+        return ((((id << 21) ^ code) & care & 0xFFE00000) == 0);
+    }
+
+    if (extd)
+    {
+        // Dual mode only compares ID[28:13] of extended frames
+        uint32_t msb = (id >> 13) & 0xFFFF;
+        return (((((msb << 16) ^ code) & care & 0xFFFF0000) == 0) ||
+                (((msb ^ code) & care & 0x0000FFFF) == 0));
+    }
+    return (((((id << 21) ^ code) & care & 0xFFE00000) == 0) ||
+            ((((id << 5) ^ code) & care & 0x0000FFE0) == 0));
+}
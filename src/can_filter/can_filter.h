@@ -0,0 +1,44 @@
+/*
+ * can_filter.h
+ *
+ *  Description: Computes the TWAI hardware acceptance filter (code / mask, single or dual filter mode)
+ *               from the table of registered CAN IDs, and models it in software so the number of
+ *               IDs it lets through without being registered (false accepts) can be reported.
+ *               Frames passing the hardware filter are still checked against the table (second stage).
+ */
+
+#ifndef CAN_FILTER_H
+#define CAN_FILTER_H
+
+//==================================Standard Libraries Includes=======================//
+#include <stdint.h>
+#include <stdbool.h>
+
+//==================================ESP32 Libraries Includes==========================//
+#include "esp_err.h"
+#include "driver/twai.h"
+#include "can_dispatch/can_dispatch.h"
+
+//----------------------------
+// Filter Macros
+//----------------------------
+#define CAN_FILTER_EXHAUSTIVE_MAX_IDS 12 // Up to this many IDs every dual filter split is evaluated
+
+//===============================================
+// User type definitions (structures)
+//===============================================
+typedef struct
+{
+	twai_filter_config_t config; // Filter to pass to twai_driver_install
+	uint32_t wanted_ids;		 // Registered identifiers
+	uint32_t accepted_ids;		 // Identifiers the hardware filter lets through (>= wanted_ids)
+} can_filter_result_t;
+
+//===============================================
+// APIs Supported by "CAN FILTER"
+//===============================================
+
+esp_err_t can_filter_from_table(const can_dispatch_entry_t *table, uint16_t count, can_filter_result_t *result);
+bool can_filter_accepts(const twai_filter_config_t *config, uint32_t id, bool extd);
+
+#endif // CAN_FILTER_H
@@ -0,0 +1,192 @@
+/*
+ * can_ring.c
+ *
+ *  Description: Implementation of the CAN frame broadcast ring.
+ *      Note: Every slot carries the index of the frame it holds (seqlock style).
+ *            The producer marks a slot busy (index + 1, never congruent to the slot) before
+ *            rewriting it, and publishes the final index afterwards. A consumer accepts a copy
+ *            only if the slot held the index it expected before and after copying, otherwise the
+ *            frame was overwritten and the consumer skips ahead counting the lost frames.
+ */
+
+#include "can_ring.h"
+#include <string.h>
+
+/*
+ * ================================================================
+ * 					API Functions Definition
+ * ================================================================
+ *
+ * */
+
+/**================================================================
+ * @Fn				- can_ring_init
+ * @breif			- Resets the ring and detaches all consumers
+ * @param [in]		- ring: Ring to be initialized
+ * @retval			- None
+ * Note				- Must be called before any consumer is added
+ */
+void can_ring_init(can_ring_t *ring)
+{
+    memset(ring, 0, sizeof(*ring));
+    for (uint32_t i = 0; i < CAN_RING_SIZE; i++)
+    {
+        // No slot may look valid before it is written for the first time
+        atomic_init(&ring->slots[i].seq, i + 1);
+    }
+    atomic_init(&ring->head, 0);
+}
+
+/**================================================================
+ * @Fn				- can_ring_add_consumer
+ * @breif			- Attaches a consumer, it starts reading from the current head
+ * @param [in]		- ring: Ring to read from
+ * @param [in]		- consumer: Consumer state (owned by the caller, must outlive the ring usage)
+ * @param [in]		- name: Consumer name used in logs
+ * @retval			- ESP_OK, or ESP_ERR_NO_MEM if CAN_RING_MAX_CONSUMERS are already attached
+ * Note				- Call before the producer task is started
+ */
+esp_err_t can_ring_add_consumer(can_ring_t *ring, can_ring_consumer_t *consumer, const char *name)
+{
+    if (ring->consumer_count >= CAN_RING_MAX_CONSUMERS)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+
+    memset(consumer, 0, sizeof(*consumer));
+    consumer->ring = ring;
+    consumer->name = name;
+    consumer->cursor = atomic_load_explicit(&ring->head, memory_order_acquire);
+    ring->consumers[ring->consumer_count++] = consumer;
+    return ESP_OK;
+}
+
+/**================================================================
+ * @Fn				- can_ring_publish
+ * @breif			- Writes one frame into the ring, overwriting the oldest one
+ * @param [in]		- ring: Ring to write to
+ * @param [in]		- msg: Received frame
+ * @param [in]		- timestamp_us: Receive time (esp_timer_get_time)
+ * @retval			- None
+ * Note				- Never blocks. Consumers are woken by can_ring_notify (once per burst)
+ */
+void can_ring_publish(can_ring_t *ring, const twai_message_t *msg, int64_t timestamp_us)
+{
+    uint32_t index = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    can_ring_slot_t *slot = &ring->slots[index & CAN_RING_MASK];
+
+    // Mark the slot busy before touching the payload
+    atomic_store_explicit(&slot->seq, index + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    slot->frame.msg = *msg;
+    slot->frame.timestamp_us = timestamp_us;
+
+    atomic_store_explicit(&slot->seq, index, memory_order_release);
+    atomic_store_explicit(&ring->head, index + 1, memory_order_release);
+}
+
+/**================================================================
+ * @Fn				- can_ring_notify
+ * @breif			- Wakes every consumer task blocked in can_ring_wait
+ * @param [in]		- ring: Ring that received new frames
+ * @retval			- None
+ */
+void can_ring_notify(can_ring_t *ring)
+{
+    for (uint8_t i = 0; i < ring->consumer_count; i++)
+    {
+        TaskHandle_t waiter = atomic_load_explicit(&ring->consumers[i]->waiter, memory_order_relaxed);
+        if (waiter != NULL)
+        {
+            xTaskNotifyGive(waiter);
+        }
+    }
+}
+
+/**================================================================
+ * @Fn				- can_ring_read
+ * @breif			- Copies the next unread frame of a consumer
+ * @param [in]		- consumer: Consumer reading the frame
+ * @param [out]		- frame: Copy of the frame
+ * @retval			- true if a frame was copied, false if the consumer is up to date
+ * Note				- Frames overwritten before being read are skipped and counted in consumer->overruns
+ */
+bool can_ring_read(can_ring_consumer_t *consumer, can_frame_t *frame)
+{
+    can_ring_t *ring = consumer->ring;
+
+    while (1)
+    {
+        uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+        uint32_t lag = head - consumer->cursor;
+
+        if (lag == 0)
+        {
+            return false;
+        }
+        if (lag > consumer->max_lag)
+        {
+            consumer->max_lag = lag;
+        }
+
+        if (lag <= CAN_RING_SIZE)
+        {
+            const can_ring_slot_t *slot = &ring->slots[consumer->cursor & CAN_RING_MASK];
+            uint32_t seq_before = atomic_load_explicit(&slot->seq, memory_order_acquire);
+
+            if (seq_before == consumer->cursor)
+            {
+                *frame = slot->frame;
+                atomic_thread_fence(memory_order_acquire);
+                if (atomic_load_explicit(&slot->seq, memory_order_relaxed) == consumer->cursor)
+                {
+                    consumer->cursor++;
+                    return true;
+                }
+            }
+        }
+
+        // Overwritten while we were behind: resume half a ring behind the producer
+        head = atomic_load_explicit(&ring->head, memory_order_acquire);
+        uint32_t resume = head - (CAN_RING_SIZE / 2);
+        atomic_store_explicit(&consumer->overruns,
+                              atomic_load_explicit(&consumer->overruns, memory_order_relaxed) + (resume - consumer->cursor),
+                              memory_order_relaxed);
+        consumer->cursor = resume;
+    }
+}
+
+/**================================================================
+ * @Fn				- can_ring_wait
+ * @breif			- Blocks the calling task until the consumer has unread frames
+ * @param [in]		- consumer: Consumer owned by the calling task
+ * @param [in]		- timeout: Maximum time to block
+ * @retval			- true if frames are available
+ */
+bool can_ring_wait(can_ring_consumer_t *consumer, TickType_t timeout)
+{
+    atomic_store_explicit(&consumer->waiter, xTaskGetCurrentTaskHandle(), memory_order_relaxed);
+    if (can_ring_pending(consumer) == 0)
+    {
+        ulTaskNotifyTake(pdTRUE, timeout);
+    }
+    return (can_ring_pending(consumer) != 0);
+}
+
+/**================================================================
+ * @Fn				- can_ring_pending
+ * @breif			- Number of frames published but not yet read by the consumer
+ * @param [in]		- consumer: Consumer to check
+ * @retval			- Unread frames (may exceed CAN_RING_SIZE if the consumer already lost frames)
+ */
+uint32_t can_ring_pending(const can_ring_consumer_t *consumer)
+{
+    return atomic_load_explicit(&consumer->ring->head, memory_order_acquire) - consumer->cursor;
+}
+
+// Frames the consumer lost by falling behind, safe to read from any task
+uint32_t can_ring_overruns(const can_ring_consumer_t *consumer)
+{
+    return atomic_load_explicit(&consumer->overruns, memory_order_relaxed);
+}
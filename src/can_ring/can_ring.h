@@ -0,0 +1,90 @@
+/*
+ * can_ring.h
+ *
+ *  Description: Single-producer / multi-consumer broadcast ring for received CAN frames.
+ *               CAN_Receive_Task writes every frame once, each sink (SD logger, UDP/MQTT sender, ...)
+ *               reads it through its own cursor. A consumer that falls more than CAN_RING_SIZE frames
+ *               behind loses the oldest frames and counts them in its own overrun counter,
+ *               so a slow sink can never stall the producer or starve the other sinks.
+ */
+
+#ifndef CAN_RING_H
+#define CAN_RING_H
+
+//==================================Standard Libraries Includes=======================//
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+//==================================ESP32 Libraries Includes==========================//
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include "esp_err.h"
+#include "driver/twai.h"
+
+//----------------------------
+// Ring Macros
+//----------------------------
+#define CAN_RING_SIZE 512 // Frames kept in the ring, must be a power of two
+#define CAN_RING_MASK (CAN_RING_SIZE - 1)
+#define CAN_RING_MAX_CONSUMERS 4
+
+_Static_assert((CAN_RING_SIZE & CAN_RING_MASK) == 0, "CAN_RING_SIZE must be a power of two");
+
+//===============================================
+// User type definitions (structures)
+//===============================================
+
+// Frame as stored in the ring and handed to every consumer
+typedef struct
+{
+	twai_message_t msg;
+	int64_t timestamp_us; // esp_timer_get_time() when CAN_Receive_Task took the frame from the driver
+} can_frame_t;
+
+typedef struct
+{
+	_Atomic uint32_t seq; // Index of the frame held by the slot, any other value while it is rewritten
+	can_frame_t frame;
+} can_ring_slot_t;
+
+typedef struct can_ring can_ring_t;
+
+typedef struct
+{
+	can_ring_t *ring;			   // Ring the consumer is attached to
+	const char *name;			   // Used in logs only
+	uint32_t cursor;			   // Index of the next frame to read
+	_Atomic uint32_t overruns;	   // Frames lost because this consumer fell behind (read by reports)
+	uint32_t max_lag;			   // High-water mark of unread frames seen by this consumer
+	_Atomic(TaskHandle_t) waiter; // Task blocked in can_ring_wait, read by can_ring_notify
+} can_ring_consumer_t;
+
+struct can_ring
+{
+	can_ring_slot_t slots[CAN_RING_SIZE];
+	_Atomic uint32_t head; // Index of the next frame to be written
+	can_ring_consumer_t *consumers[CAN_RING_MAX_CONSUMERS];
+	uint8_t consumer_count;
+};
+
+//===============================================
+// APIs Supported by "CAN RING"
+//===============================================
+
+void can_ring_init(can_ring_t *ring);
+esp_err_t can_ring_add_consumer(can_ring_t *ring, can_ring_consumer_t *consumer, const char *name);
+
+// Producer side (single task only)
+void can_ring_publish(can_ring_t *ring, const twai_message_t *msg, int64_t timestamp_us);
+void can_ring_notify(can_ring_t *ring);
+
+// Consumer side (one task per consumer)
+bool can_ring_read(can_ring_consumer_t *consumer, can_frame_t *frame);
+bool can_ring_wait(can_ring_consumer_t *consumer, TickType_t timeout);
+uint32_t can_ring_pending(const can_ring_consumer_t *consumer);
+
+// Any task (reports)
+uint32_t can_ring_overruns(const can_ring_consumer_t *consumer);
+
+#endif // CAN_RING_H
@@ -0,0 +1,247 @@
+/*
+ * can_stats.c
+ *
+ *  Description: Implementation of the per-ID CAN bus statistics.
+ *      Note: can_stats_record runs on the receive path for every frame: no locks, no division,
+ *            every shared counter has a single writer and is read with relaxed atomics.
+ *            Bus load uses the nominal frame length without stuff bits, and only sees the
+ *            frames that pass the acceptance filter, so it is a lower bound of the real load.
+ */
+
+#include "can_stats.h"
+#include <string.h>
+#include "esp_timer.h"
+#include "../row_builder/row_builder.h"
+
+//----------------------------
+// Local Macros
+//----------------------------
+#define CAN_STATS_STD_FRAME_BITS 47 // SOF..EOF + interframe space of a standard frame, no payload
+#define CAN_STATS_EXT_FRAME_BITS 67 // Same for an extended frame
+#define CAN_STATS_PERIOD_SHIFT 3	// Mean period: period += (interval - period) / 8
+
+can_stats_t CAN_bus_stats;
+
+/*
+ * ================================================================
+ * 					Local Functions Definition
+ * ================================================================
+ *
+ * */
+
+// Single writer increment: plain load / store, no read-modify-write needed
+static inline void can_stats_inc(_Atomic uint32_t *counter, uint32_t value)
+{
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + value, memory_order_relaxed);
+}
+
+static inline uint8_t can_stats_jitter_bucket(uint32_t deviation_us)
+{
+    uint32_t scaled = deviation_us / CAN_STATS_JITTER_BASE_US;
+    uint8_t bucket = (scaled == 0) ? 0 : (uint8_t)(32 - __builtin_clz(scaled));
+    return (bucket < CAN_STATS_JITTER_BUCKETS) ? bucket : (CAN_STATS_JITTER_BUCKETS - 1);
+}
+
+/*
+ * ================================================================
+ * 					API Functions Definition
+ * ================================================================
+ *
+ * */
+
+/**================================================================
+ * @Fn				- can_stats_init
+ * @breif			- Clears the counters and binds the first CAN_STATS_MAX_IDS dispatch slots
+ * @param [out]		- stats: Statistics object
+ * @param [in]		- dispatch: Built dispatch object (slot numbers are shared with it)
+ * @param [in]		- bitrate: Bus bit rate in bit/s, used for the bus load
+ * @retval			- None
+ * Note				- Must be called before CAN_Receive_Task starts
+ */
+void can_stats_init(can_stats_t *stats, const can_dispatch_t *dispatch, uint32_t bitrate)
+{
+    memset(stats, 0, sizeof(*stats));
+    stats->bitrate = bitrate;
+    stats->count = (dispatch->count < CAN_STATS_MAX_IDS) ? dispatch->count : CAN_STATS_MAX_IDS;
+    for (uint16_t i = 0; i < stats->count; i++)
+    {
+        stats->ids[i].id = dispatch->table[i].id;
+        stats->ids[i].extd = dispatch->table[i].extd;
+        stats->ids[i].dlc = dispatch->table[i].dlc;
+    }
+}
+
+/**================================================================
+ * @Fn				- can_stats_record
+ * @breif			- Accounts one received frame
+ * @param [in]		- stats: Statistics object
+ * @param [in]		- slot: Dispatch slot of the frame (CAN_DISPATCH_NO_SLOT if unregistered)
+ * @param [in]		- msg: Received frame
+ * @param [in]		- now_us: Arrival time (esp_timer_get_time)
+ * @retval			- None
+ * Note				- Single writer: only CAN_Receive_Task may call it
+ */
+void can_stats_record(can_stats_t *stats, uint16_t slot, const twai_message_t *msg, int64_t now_us)
+{
+    uint32_t payload_bits = msg->rtr ? 0 : 8u * msg->data_length_code;
+    can_stats_inc(&stats->bus_bits, (msg->extd ? CAN_STATS_EXT_FRAME_BITS : CAN_STATS_STD_FRAME_BITS) + payload_bits);
+    can_stats_inc(&stats->frames, 1);
+
+    if (slot >= stats->count)
+    {
+        can_stats_inc(&stats->untracked, 1);
+        return;
+    }
+
+    can_stats_id_t *entry = &stats->ids[slot];
+    uint32_t frames = atomic_load_explicit(&entry->frames, memory_order_relaxed);
+    if (frames != 0)
+    {
+        uint32_t interval = (uint32_t)(now_us - entry->last_us);
+        uint32_t period = atomic_load_explicit(&entry->period_us, memory_order_relaxed);
+        if (frames == 1)
+        {
+            period = interval; // First interval seeds the mean period
+        }
+        else
+        {
+            int32_t error = (int32_t)(interval - period);
+            can_stats_inc(&entry->jitter[can_stats_jitter_bucket((error < 0) ? (uint32_t)-error : (uint32_t)error)], 1);
+            period = (uint32_t)((int32_t)period + (error >> CAN_STATS_PERIOD_SHIFT));
+        }
+        atomic_store_explicit(&entry->period_us, period, memory_order_relaxed);
+    }
+
+    if ((entry->dlc != 0) && (msg->data_length_code != entry->dlc))
+    {
+        can_stats_inc(&entry->dlc_mismatch, 1);
+    }
+
+    entry->last_us = now_us;
+    atomic_store_explicit(&entry->last_seen_ms, (uint32_t)(now_us / 1000), memory_order_relaxed);
+    atomic_store_explicit(&entry->frames, frames + 1, memory_order_relaxed);
+}
+
+/**================================================================
+ * @Fn				- can_stats_snapshot
+ * @breif			- Builds a report of the counters and the rates since the previous snapshot
+ * @param [in]		- stats: Statistics object
+ * @param [in/out]	- window: Reader state, zero it before the first snapshot
+ * @param [out]		- report: Report in wire format
+ * @retval			- None
+ * Note				- Each reader keeps its own window, so readers do not disturb each other
+ */
+void can_stats_snapshot(const can_stats_t *stats, can_stats_window_t *window, can_stats_report_t *report)
+{
+    int64_t now_us = esp_timer_get_time();
+    uint32_t now_ms = (uint32_t)(now_us / 1000);
+    uint64_t elapsed_us = (window->time_us != 0) ? (uint64_t)(now_us - window->time_us) : 0;
+    uint32_t bus_bits = atomic_load_explicit(&stats->bus_bits, memory_order_relaxed);
+
+    memset(report, 0, sizeof(*report));
+    report->magic = CAN_STATS_MAGIC;
+    report->version = CAN_STATS_VERSION;
+    report->count = (uint8_t)stats->count;
+    report->uptime_ms = now_ms;
+    report->frames = atomic_load_explicit(&stats->frames, memory_order_relaxed);
+    report->untracked = atomic_load_explicit(&stats->untracked, memory_order_relaxed);
+    if ((elapsed_us != 0) && (stats->bitrate != 0))
+    {
+        uint64_t permille = ((uint64_t)(bus_bits - window->bus_bits) * 1000000000ull) / (elapsed_us * stats->bitrate);
+        report->bus_load_permille = (permille > 1000) ? 1000 : (uint16_t)permille;
+    }
+
+    for (uint16_t i = 0; i < stats->count; i++)
+    {
+        const can_stats_id_t *entry = &stats->ids[i];
+        can_stats_id_report_t *out = &report->ids[i];
+        uint32_t frames = atomic_load_explicit(&entry->frames, memory_order_relaxed);
+
+        out->id = entry->id;
+        out->extd = entry->extd;
+        out->dlc = entry->dlc;
+        out->frames = frames;
+        out->dlc_mismatch = atomic_load_explicit(&entry->dlc_mismatch, memory_order_relaxed);
+        out->period_us = atomic_load_explicit(&entry->period_us, memory_order_relaxed);
+        out->age_ms = (frames != 0) ? (now_ms - atomic_load_explicit(&entry->last_seen_ms, memory_order_relaxed)) : UINT32_MAX;
+        for (uint8_t b = 0; b < CAN_STATS_JITTER_BUCKETS; b++)
+        {
+            out->jitter[b] = atomic_load_explicit(&entry->jitter[b], memory_order_relaxed);
+        }
+        if (elapsed_us != 0)
+        {
+            uint64_t rate = ((uint64_t)(frames - window->frames[i]) * 10000000ull) / elapsed_us;
+            out->rate_hz_x10 = (rate > UINT16_MAX) ? UINT16_MAX : (uint16_t)rate;
+        }
+        window->frames[i] = frames;
+    }
+
+    window->time_us = now_us;
+    window->bus_bits = bus_bits;
+}
+
+/**================================================================
+ * @Fn				- can_stats_report_size
+ * @breif			- Number of bytes of a report to send (header + valid entries)
+ * @param [in]		- report: Report built by can_stats_snapshot
+ * @retval			- Size in bytes
+ */
+size_t can_stats_report_size(const can_stats_report_t *report)
+{
+    return offsetof(can_stats_report_t, ids) + (size_t)report->count * sizeof(can_stats_id_report_t);
+}
+
+/**================================================================
+ * @Fn				- can_stats_format_csv
+ * @breif			- Formats a report as .CSV rows (one per ID, columns of CAN_STATS_CSV_HEADER)
+ * @param [in]		- report: Report built by can_stats_snapshot
+ * @param [out]		- buf: Destination string
+ * @param [in]		- len: Size of buf
+ * @retval			- Length of the string, truncated at the last complete row if buf is too small
+ * Note				- Every row ends with '\n': the string is appended to the file as it is
+ */
+int can_stats_format_csv(const can_stats_report_t *report, char *buf, size_t len)
+{
+    row_builder_t row;
+    row_builder_init(&row, buf, len);
+    for (uint8_t i = 0; i < report->count; i++)
+    {
+        const can_stats_id_report_t *e = &report->ids[i];
+        size_t start = row.used;
+        row_builder_u32(&row, report->uptime_ms);
+        row_builder_char(&row, ',');
+        row_builder_u32(&row, report->bus_load_permille / 10);
+        row_builder_char(&row, '.');
+        row_builder_u32(&row, report->bus_load_permille % 10);
+        row_builder_char(&row, ',');
+        row_builder_u32(&row, report->untracked);
+        row_builder_str(&row, ",0x");
+        row_builder_hex(&row, e->id, 3, true);
+        row_builder_char(&row, ',');
+        row_builder_u32(&row, e->rate_hz_x10 / 10);
+        row_builder_char(&row, '.');
+        row_builder_u32(&row, e->rate_hz_x10 % 10);
+        row_builder_char(&row, ',');
+        row_builder_u32(&row, e->frames);
+        row_builder_char(&row, ',');
+        row_builder_u32(&row, e->dlc_mismatch);
+        row_builder_char(&row, ',');
+        row_builder_u32(&row, e->age_ms);
+        row_builder_char(&row, ',');
+        row_builder_u32(&row, e->period_us);
+        for (uint8_t j = 0; j < CAN_STATS_JITTER_BUCKETS; j++)
+        {
+            row_builder_char(&row, ',');
+            row_builder_u32(&row, e->jitter[j]);
+        }
+        row_builder_char(&row, '\n');
+        if (row.overflow)
+        {
+            row.used = start; // Drop the partial row
+            row.overflow = false;
+            break;
+        }
+    }
+    int used = row_builder_end(&row);
+    return (used < 0) ? 0 : used;
+}
@@ -0,0 +1,114 @@
+/*
+ * can_stats.h
+ *
+ *  Description: Always-on per-ID CAN bus statistics: frame rate, inter-arrival jitter histogram,
+ *               DLC mismatches, last-seen age and bus load. Counters are fixed-size and written by
+ *               CAN_Receive_Task only (single writer, relaxed atomics), so readers never lock the
+ *               receive path. Readers take periodic snapshots (can_stats_snapshot) that are sent
+ *               as-is over UDP / MQTT and written to the SD card as .CSV rows.
+ */
+
+#ifndef CAN_STATS_H
+#define CAN_STATS_H
+
+//==================================Standard Libraries Includes=======================//
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdatomic.h>
+
+//==================================ESP32 Libraries Includes==========================//
+#include "driver/twai.h"
+#include "can_dispatch/can_dispatch.h"
+
+//----------------------------
+// Statistics Macros
+//----------------------------
+#define CAN_STATS_MAX_IDS 16		 // Dispatch slots with their own counters, others go to "untracked"
+#define CAN_STATS_JITTER_BUCKETS 8	 // Bucket k: |interval - mean period| < CAN_STATS_JITTER_BASE_US << k
+#define CAN_STATS_JITTER_BASE_US 64	 // Upper bound of bucket 0, the last bucket is open-ended
+#define CAN_STATS_PERIOD_MS 1000	 // Snapshot period of the telemetry channel and the SD file
+#define CAN_STATS_MAGIC 0x41545343u	 // "CSTA": first word of a statistics packet
+#define CAN_STATS_VERSION 1
+
+#define CAN_STATS_CSV_HEADER "Uptime_ms,Bus_Load_%,Untracked,ID,Rate_Hz,Frames,DLC_Mismatch,Age_ms,Period_us," \
+							 "J_64us,J_128us,J_256us,J_512us,J_1ms,J_2ms,J_4ms,J_Over"
+
+//===============================================
+// User type definitions (structures)
+//===============================================
+typedef struct
+{
+	uint32_t id;				  // Identifier (copied from the dispatch table)
+	bool extd;					  // true for 29-bit identifiers
+	uint8_t dlc;				  // Expected payload length
+	int64_t last_us;			  // Arrival of the previous frame (writer only)
+	_Atomic uint32_t frames;	  // Frames received
+	_Atomic uint32_t dlc_mismatch; // Frames whose DLC differs from dlc
+	_Atomic uint32_t period_us;	  // Running mean of the inter-arrival time
+	_Atomic uint32_t last_seen_ms; // Arrival of the last frame (esp_timer ms)
+	_Atomic uint32_t jitter[CAN_STATS_JITTER_BUCKETS]; // Inter-arrival deviation histogram
+} can_stats_id_t;
+
+typedef struct
+{
+	can_stats_id_t ids[CAN_STATS_MAX_IDS]; // Indexed by dispatch slot
+	uint16_t count;						   // Slots in use
+	uint32_t bitrate;					   // Bus bit rate (bit/s)
+	_Atomic uint32_t frames;			   // Every frame seen by the receive path
+	_Atomic uint32_t untracked;			   // Unregistered IDs and slots >= CAN_STATS_MAX_IDS
+	_Atomic uint32_t bus_bits;			   // Nominal bits on the bus (wraps, only deltas are used)
+} can_stats_t;
+
+// Reader side state: counters of the previous snapshot, used to compute rates
+typedef struct
+{
+	int64_t time_us;
+	uint32_t bus_bits;
+	uint32_t frames[CAN_STATS_MAX_IDS];
+} can_stats_window_t;
+
+//----------------------------
+// Wire format (little-endian, packed), decoded by scripts/telemetry_receiver.py
+//----------------------------
+typedef struct __attribute__((packed))
+{
+	uint32_t id;
+	uint8_t extd;
+	uint8_t dlc;
+	uint16_t rate_hz_x10;	   // Frames per second over the last window, x10
+	uint32_t frames;
+	uint32_t dlc_mismatch;
+	uint32_t age_ms;		   // Time since the last frame, UINT32_MAX if never seen
+	uint32_t period_us;
+	uint32_t jitter[CAN_STATS_JITTER_BUCKETS];
+} can_stats_id_report_t;
+
+typedef struct __attribute__((packed))
+{
+	uint32_t magic;				// CAN_STATS_MAGIC
+	uint8_t version;			// CAN_STATS_VERSION
+	uint8_t count;				// Valid entries in ids
+	uint16_t bus_load_permille; // Load of the accepted traffic over the last window
+	uint32_t uptime_ms;
+	uint32_t frames;
+	uint32_t untracked;
+	can_stats_id_report_t ids[CAN_STATS_MAX_IDS];
+} can_stats_report_t;
+
+//===============================================
+// Bus statistics instance (updated by CAN_Receive_Task)
+//===============================================
+extern can_stats_t CAN_bus_stats;
+
+//===============================================
+// APIs Supported by "CAN STATS"
+//===============================================
+
+void can_stats_init(can_stats_t *stats, const can_dispatch_t *dispatch, uint32_t bitrate);
+void can_stats_record(can_stats_t *stats, uint16_t slot, const twai_message_t *msg, int64_t now_us);
+void can_stats_snapshot(const can_stats_t *stats, can_stats_window_t *window, can_stats_report_t *report);
+size_t can_stats_report_size(const can_stats_report_t *report);
+int can_stats_format_csv(const can_stats_report_t *report, char *buf, size_t len);
+
+#endif // CAN_STATS_H
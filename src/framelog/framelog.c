@@ -0,0 +1,208 @@
+/*
+ * framelog.c
+ *
+ *  Description: Implementation of the raw CAN frame log format.
+ *      Note: Frames are packed straight into the block buffer, the block header and CRC are only
+ *            written when the block is sealed, so a frame costs one copy of at most 17 bytes.
+ */
+
+#include "framelog.h"
+#include "binlog/binlog.h"
+#include "RTC_Time_Sync/rtc_time_sync.h"
+#include <string.h>
+#if !CONFIG_IDF_TARGET_LINUX
+#include "esp_app_desc.h"
+#endif
+
+_Static_assert(FRAMELOG_BLOCK_SIZE - sizeof(framelog_block_header_t) - sizeof(uint32_t) <= UINT16_MAX,
+               "framelog_block_header_t.size overflows");
+
+/*
+ * ================================================================
+ * 					API Functions Definition
+ * ================================================================
+ *
+ * */
+
+/**================================================================
+ * @Fn				- framelog_header_build
+ * @breif			- Builds the file header
+ * @param [out]		- out: Header bytes, written at the start of the file
+ * @param [in]		- len: Size of out, at least FRAMELOG_HEADER_SIZE
+ * @param [in]		- created_us: Creation time, UTC microseconds since the epoch
+ * @param [in]		- bitrate: Bus bit rate
+ * @retval			- Size of the header, 0 if out is too small
+ */
+size_t framelog_header_build(uint8_t *out, size_t len, int64_t created_us, uint32_t bitrate)
+{
+    if (len < FRAMELOG_HEADER_SIZE)
+    {
+        return 0;
+    }
+    memset(out, 0, FRAMELOG_HEADER_SIZE);
+
+    framelog_file_header_t *header = (framelog_file_header_t *)out;
+    memcpy(header->magic, FRAMELOG_MAGIC, sizeof(header->magic));
+    header->version = FRAMELOG_VERSION;
+    header->header_size = FRAMELOG_HEADER_SIZE;
+    header->block_size = FRAMELOG_BLOCK_SIZE;
+    header->bitrate = bitrate;
+    header->schema = binlog_schema_id();
+    header->created_us = created_us;
+#if CONFIG_IDF_TARGET_LINUX
+    strncpy(header->firmware, "host", sizeof(header->firmware) - 1);
+#else
+    strncpy(header->firmware, esp_app_get_description()->version, sizeof(header->firmware) - 1);
+#endif
+
+    uint32_t crc = binlog_crc32(0, out, sizeof(*header));
+    memcpy(out + sizeof(*header), &crc, sizeof(crc));
+    return FRAMELOG_HEADER_SIZE;
+}
+
+/**================================================================
+ * @Fn				- framelog_file_tag
+ * @breif			- Tag of a file, carried by each of its blocks and commits
+ * @param [in]		- header: File header (framelog_header_build, or read back from the file)
+ * @param [in]		- header_size: framelog_file_header_t.header_size
+ * @retval			- Low 16 bits of the header CRC
+ */
+uint16_t framelog_file_tag(const uint8_t *header, size_t header_size)
+{
+    uint32_t crc;
+    memcpy(&crc, header + header_size - sizeof(crc), sizeof(crc));
+    return (uint16_t)crc;
+}
+
+/**================================================================
+ * @Fn				- framelog_block_init
+ * @breif			- Starts the first block of a file, or of a session appended to it
+ * @param [out]		- block: Block object
+ * @param [in]		- tag: framelog_file_tag of the file
+ * @retval			- None
+ */
+void framelog_block_init(framelog_block_t *block, uint16_t tag)
+{
+    block->used = 0;
+    block->frames = 0;
+    block->sequence = 0;
+    block->tag = tag;
+    block->first_us = 0;
+    block->base_us = 0;
+}
+
+/**================================================================
+ * @Fn				- framelog_block_add
+ * @breif			- Packs one frame into the current block
+ * @param [in]		- block: Block object
+ * @param [in]		- msg: Received frame
+ * @param [in]		- timestamp_us: Receive time (esp_timer time, can_frame_t.timestamp_us)
+ * @retval			- true if the block has to be sealed and written (no room for another frame,
+ * 					  or older than FRAMELOG_BLOCK_MAX_AGE_US)
+ */
+bool framelog_block_add(framelog_block_t *block, const twai_message_t *msg, int64_t timestamp_us)
+{
+    if (block->frames == 0)
+    {
+        block->used = sizeof(framelog_block_header_t);
+        block->first_us = timestamp_us;
+        block->base_us = Time_Sync_epoch_us(timestamp_us);
+    }
+    int64_t dt_us = timestamp_us - block->first_us;
+    framelog_frame_t frame = {
+        .dt_us = (dt_us > 0) ? (uint32_t)dt_us : 0,
+        .id = msg->identifier,
+        .info = (uint8_t)((msg->data_length_code & FRAMELOG_INFO_DLC) | (msg->extd ? FRAMELOG_INFO_EXTD : 0) |
+                          (msg->rtr ? FRAMELOG_INFO_RTR : 0)),
+    };
+    uint8_t payload = msg->rtr ? 0 : ((msg->data_length_code > TWAI_FRAME_MAX_DLC) ? TWAI_FRAME_MAX_DLC : msg->data_length_code);
+
+    memcpy(block->data + block->used, &frame, sizeof(frame));
+    memcpy(block->data + block->used + sizeof(frame), msg->data, payload);
+    block->used += sizeof(frame) + payload;
+    block->frames++;
+
+    return (block->used + FRAMELOG_FRAME_MAX + sizeof(uint32_t) > FRAMELOG_BLOCK_SIZE) || (block->frames == UINT16_MAX) ||
+           (dt_us >= FRAMELOG_BLOCK_MAX_AGE_US);
+}
+
+/**================================================================
+ * @Fn				- framelog_block_due
+ * @breif			- Checks whether a partial block is old enough to be written while the bus is idle
+ * @param [in]		- block: Block object
+ * @param [in]		- now_us: Current esp_timer time
+ * @retval			- true if the block holds frames older than FRAMELOG_BLOCK_MAX_AGE_US
+ */
+bool framelog_block_due(const framelog_block_t *block, int64_t now_us)
+{
+    return (block->frames != 0) && ((now_us - block->first_us) >= FRAMELOG_BLOCK_MAX_AGE_US);
+}
+
+/**================================================================
+ * @Fn				- framelog_block_seal
+ * @breif			- Completes the block header and CRC, then starts the next block
+ * @param [in]		- block: Block object
+ * @retval			- Bytes of block->data to be written, 0 if the block is empty
+ * Note				- block->data stays valid until the next framelog_block_add; lost frames
+ * 					  beyond what the header holds are carried to the next block
+ */
+size_t framelog_block_seal(framelog_block_t *block)
+{
+    if (block->frames == 0)
+    {
+        return 0;
+    }
+    uint16_t lost = (block->lost > UINT16_MAX) ? UINT16_MAX : (uint16_t)block->lost;
+    framelog_block_header_t header = {
+        .magic = FRAMELOG_BLOCK_MAGIC,
+        .sequence = block->sequence,
+        .frames = block->frames,
+        .tag = block->tag,
+        .size = (uint16_t)(block->used - sizeof(framelog_block_header_t)),
+        .lost = lost,
+        .base_us = block->base_us,
+    };
+    memcpy(block->data, &header, sizeof(header));
+
+    uint32_t crc = binlog_crc32(0, block->data, block->used);
+    memcpy(block->data + block->used, &crc, sizeof(crc));
+    size_t size = block->used + sizeof(crc);
+
+    block->stats.blocks++;
+    block->stats.frames += block->frames;
+    block->stats.lost += lost;
+    block->stats.bytes += size;
+    block->lost -= lost;
+    block->sequence++;
+    block->frames = 0;
+    return size;
+}
+
+/**================================================================
+ * @Fn				- framelog_block_check
+ * @breif			- Checks a block read back from a file
+ * @param [in]		- data: Bytes from the start of the block
+ * @param [in]		- len: Number of bytes available, FRAMELOG_BLOCK_SIZE is always enough
+ * @param [in]		- tag: framelog_file_tag of the file
+ * @retval			- Size of the block (CRC included), 0 if it is not a complete valid block
+ * 					  of this file
+ */
+size_t framelog_block_check(const uint8_t *data, size_t len, uint16_t tag)
+{
+    framelog_block_header_t header;
+    uint32_t crc;
+
+    if (len < sizeof(header))
+    {
+        return 0;
+    }
+    memcpy(&header, data, sizeof(header));
+    size_t size = sizeof(header) + header.size;
+    if ((header.magic != FRAMELOG_BLOCK_MAGIC) || (header.tag != tag) || (header.frames == 0) ||
+        (size + sizeof(crc) > FRAMELOG_BLOCK_SIZE) || (size + sizeof(crc) > len))
+    {
+        return 0;
+    }
+    memcpy(&crc, data + size, sizeof(crc));
+    return (crc == binlog_crc32(0, data, size)) ? size + sizeof(crc) : 0;
+}
@@ -0,0 +1,118 @@
+/*
+ * framelog.h
+ *
+ *  Description: Binary format of the raw CAN frame log (LOG_<n>.CAN), written next to the decoded
+ *               snapshot log of the same session. Every frame taken from the CAN ring is kept as
+ *               received: time, identifier, flags, DLC and payload, so the file is the ground truth
+ *               that is replayed (scripts/framelog_export.py -> candump -> TELE_HOST_REPLAY) when
+ *               decoded data looks wrong.
+ *      Layout (little-endian, packed):
+ *               framelog_file_header_t, CRC32
+ *               commit slots A and B (binlog_commit_t, at BINLOG_COMMIT_OFFSET of the header size)
+ *               { framelog_block_header_t, framelog_frame_t + payload x frames, CRC32 } ...
+ *               A frame holds its time relative to base_us of its block and only the payload
+ *               bytes its DLC gives (none for remote frames): 9 to 17 bytes.
+ *               CRC32, the tag of the blocks and the commit journal are those of binlog.h, so a
+ *               power cut costs one sync interval of frames and recovery reads a few KiB.
+ */
+
+#ifndef FRAMELOG_H
+#define FRAMELOG_H
+
+//==================================Standard Libraries Includes=======================//
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+//==================================ESP32 Libraries Includes==========================//
+#include "driver/twai.h"
+
+//----------------------------
+// Format Macros
+//----------------------------
+#define FRAMELOG_MAGIC "ASURTCAN"			 // First 8 bytes of a file, no terminator
+#define FRAMELOG_VERSION 1
+#define FRAMELOG_BLOCK_MAGIC 0x4D524641u	 // "AFRM": first word of a block
+#define FRAMELOG_BLOCK_SIZE 4096			 // Largest block on the card
+#define FRAMELOG_BLOCK_MAX_AGE_US 1000000	 // Partial blocks are written once their first frame is this old
+#define FRAMELOG_FRAME_MAX (sizeof(framelog_frame_t) + TWAI_FRAME_MAX_DLC)
+
+//@ref framelog_info: framelog_frame_t.info
+#define FRAMELOG_INFO_DLC 0x0F	// Data length code as received (up to 15 with dlc_non_comp)
+#define FRAMELOG_INFO_EXTD 0x10 // 29-bit identifier
+#define FRAMELOG_INFO_RTR 0x20	// Remote frame, no payload
+
+//===============================================
+// User type definitions (structures)
+//===============================================
+
+typedef struct __attribute__((packed))
+{
+	char magic[8];		  // FRAMELOG_MAGIC
+	uint16_t version;	  // FRAMELOG_VERSION
+	uint16_t header_size; // Whole file header: this struct and CRC
+	uint16_t block_size;  // Largest block, FRAMELOG_BLOCK_SIZE
+	uint16_t reserved;
+	uint32_t bitrate;	  // Bus bit rate, for the .ASC export
+	uint32_t schema;	  // binlog_schema_id of the snapshot log of the same session
+	int64_t created_us;	  // File creation, UTC microseconds since the epoch
+	char firmware[32];	  // Application version, zero padded
+} framelog_file_header_t;
+
+typedef struct __attribute__((packed))
+{
+	uint32_t magic;	   // FRAMELOG_BLOCK_MAGIC
+	uint32_t sequence; // Block number in the file, from 0
+	uint16_t frames;   // Frames in the block
+	uint16_t tag;	   // framelog_file_tag of the file
+	uint16_t size;	   // Bytes of frames after this header
+	uint16_t lost;	   // Frames the logger lost (CAN ring overruns) since the previous block
+	int64_t base_us;   // Receive time of the first frame, UTC microseconds since the epoch
+} framelog_block_header_t;
+
+typedef struct __attribute__((packed))
+{
+	uint32_t dt_us; // Receive time - framelog_block_header_t.base_us
+	uint32_t id;	// 11-bit or 29-bit identifier
+	uint8_t info;	// @ref framelog_info
+					// followed by min(DLC, 8) payload bytes, none for a remote frame
+} framelog_frame_t;
+
+#define FRAMELOG_HEADER_SIZE (sizeof(framelog_file_header_t) + sizeof(uint32_t))
+
+// Counters of the sealed blocks
+typedef struct
+{
+	uint32_t blocks; // Blocks sealed
+	uint32_t frames; // Frames in them
+	uint32_t lost;	 // Frames reported lost by the producer
+	uint64_t bytes;	 // Size written, headers and CRCs included
+} framelog_stats_t;
+
+// Block being assembled: frames are packed in place, the header and CRC are added when it is sealed
+typedef struct
+{
+	uint8_t data[FRAMELOG_BLOCK_SIZE];
+	size_t used;	   // Bytes of data in use, header included
+	uint16_t frames;   // Frames packed so far
+	uint32_t sequence; // Number of the block
+	uint16_t tag;	   // framelog_file_tag of the file
+	uint32_t lost;	   // Frames lost not yet recorded in a block header
+	int64_t first_us;  // esp_timer time of the first frame
+	int64_t base_us;   // UTC time of the first frame
+	framelog_stats_t stats;
+} framelog_block_t;
+
+//===============================================
+// APIs Supported by "FRAMELOG"
+//===============================================
+
+size_t framelog_header_build(uint8_t *out, size_t len, int64_t created_us, uint32_t bitrate);
+uint16_t framelog_file_tag(const uint8_t *header, size_t header_size);
+void framelog_block_init(framelog_block_t *block, uint16_t tag);
+bool framelog_block_add(framelog_block_t *block, const twai_message_t *msg, int64_t timestamp_us);
+bool framelog_block_due(const framelog_block_t *block, int64_t now_us);
+size_t framelog_block_seal(framelog_block_t *block);
+size_t framelog_block_check(const uint8_t *data, size_t len, uint16_t tag);
+
+#endif // FRAMELOG_H
@@ -0,0 +1,130 @@
+/*
+ * host_bench.c
+ *
+ *  Description: Machine-readable results of a host build run, written when the CAN source ends
+ *               and TELE_HOST_BENCH names the output file. One JSON object per run: source
+ *               configuration, frames/s, drops and high-water marks per stage, latency
+ *               percentiles and bytes per pipeline stage, SD writer throughput and stalls (snapshot log and
+ *               raw frame log). Collected and compared by scripts/can_bench.py.
+ */
+
+#include "host_port.h"
+#include "pipeline_stats/pipeline_stats.h"
+#include "log_stream/log_stream.h"
+#include "esp_log.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+static const char *TAG = "host_bench";
+
+// Counters of one SD writer as a JSON member
+static void host_bench_writer(FILE *f, const char *key, const sd_writer_t *writer, const char *separator)
+{
+    const sd_writer_stats_t *w = &writer->stats;
+    fprintf(f, "  \"%s\": {\"mb_per_s\": %.3f, \"bytes\": %llu, \"written\": %llu, \"writes\": %lu, "
+               "\"syncs\": %lu, \"max_write_us\": %lld, \"max_stall_us\": %lld, \"stalls\": %lu, "
+               "\"dropped\": %lu, \"errors\": %lu, \"commits\": %lu}%s\n",
+            key, (w->write_us > 0) ? (double)w->written / w->write_us : 0.0, (unsigned long long)w->bytes,
+            (unsigned long long)w->written, (unsigned long)w->writes, (unsigned long)w->syncs,
+            (long long)w->max_write_us, (long long)w->max_stall_us, (unsigned long)w->stalls,
+            (unsigned long)w->dropped, (unsigned long)w->errors, (unsigned long)w->commits, separator);
+}
+
+// Environment value as a JSON string, null when unset
+static void host_bench_env(FILE *f, const char *key, const char *name, const char *separator)
+{
+    const char *value = getenv(name);
+
+    fprintf(f, "    \"%s\": ", key);
+    if (value == NULL)
+    {
+        fprintf(f, "null%s\n", separator);
+        return;
+    }
+    fputc('"', f);
+    for (; *value != '\0'; value++)
+    {
+        if ((*value == '"') || (*value == '\\'))
+        {
+            fputc('\\', f);
+        }
+        fputc(*value, f);
+    }
+    fprintf(f, "\"%s\n", separator);
+}
+
+esp_err_t host_bench_write(const char *path, const host_bench_result_t *result)
+{
+    static const uint16_t percentiles[] = {500, 900, 990, 999};
+    static const char *const percentile_keys[] = {"p50_us", "p90_us", "p99_us", "p999_us"};
+    const host_twai_counters_t *twai = &result->twai;
+    FILE *f = fopen(path, "w");
+
+    if (f == NULL)
+    {
+        ESP_LOGE(TAG, "Unable to write %s", path);
+        return ESP_FAIL;
+    }
+
+    fprintf(f, "{\n  \"config\": {\n");
+    host_bench_env(f, "can_hz", "TELE_HOST_CAN_HZ", ",");
+    host_bench_env(f, "can_mix", "TELE_HOST_CAN_MIX", ",");
+    host_bench_env(f, "can_run_s", "TELE_HOST_CAN_RUN", ",");
+    host_bench_env(f, "replay", "TELE_HOST_REPLAY", ",");
+    host_bench_env(f, "replay_speed", "TELE_HOST_REPLAY_SPEED", ",");
+    host_bench_env(f, "prealloc_mib", "TELE_HOST_PREALLOC", "");
+    fprintf(f, "  },\n");
+
+    fprintf(f, "  \"source\": {\"frames\": %lu, \"seconds\": %.6f, \"fps\": %.1f},\n",
+            (unsigned long)result->sent, result->source_s, result->sent / result->source_s);
+    fprintf(f, "  \"twai\": {\"queued\": %lu, \"hw_filtered\": %lu, \"rx_missed\": %lu, \"rx_queue_hwm\": %lu},\n",
+            (unsigned long)twai->queued, (unsigned long)twai->hw_filtered, (unsigned long)twai->rx_missed,
+            (unsigned long)twai->rx_hwm);
+    fprintf(f, "  \"can_task\": {\"published\": %lu, \"sw_filtered\": %lu},\n",
+            (unsigned long)result->published, (unsigned long)(twai->queued - twai->msgs_to_rx - result->published));
+
+    fprintf(f, "  \"sinks\": [");
+    for (uint8_t i = 0; i < result->ring->consumer_count; i++)
+    {
+        const can_ring_consumer_t *consumer = result->ring->consumers[i];
+        uint32_t delivered = consumer->cursor - can_ring_overruns(consumer);
+        fprintf(f, "%s\n    {\"name\": \"%s\", \"frames\": %lu, \"fps\": %.1f, \"overruns\": %lu, \"max_lag\": %lu, \"pending\": %lu}",
+                (i == 0) ? "" : ",", consumer->name, (unsigned long)delivered, delivered / result->sink_s,
+                (unsigned long)can_ring_overruns(consumer), (unsigned long)consumer->max_lag,
+                (unsigned long)can_ring_pending(consumer));
+    }
+    fprintf(f, "\n  ],\n  \"sink_seconds\": %.6f,\n", result->sink_s);
+
+    fprintf(f, "  \"stages\": {");
+    for (pipeline_stage_t stage = 0; stage < PIPELINE_STAGE_COUNT; stage++)
+    {
+        const pipeline_stage_stats_t *s = &CAN_pipeline_stats.stages[stage];
+        fprintf(f, "%s\n    \"%s\": {\"samples\": %lu, \"bytes\": %llu, \"max_us\": %lu",
+                (stage == 0) ? "" : ",", pipeline_stats_stage_name(stage), (unsigned long)s->count,
+                (unsigned long long)s->bytes, (unsigned long)s->max_us);
+        for (uint8_t p = 0; p < sizeof(percentiles) / sizeof(percentiles[0]); p++)
+        {
+            fprintf(f, ", \"%s\": %lu", percentile_keys[p],
+                    (unsigned long)pipeline_stats_percentile(&CAN_pipeline_stats, stage, percentiles[p]));
+        }
+        fprintf(f, "}");
+    }
+    fprintf(f, "\n  },\n");
+
+    host_bench_writer(f, "sd_writer", &SDIO_log_stream.writer, ",");
+    host_bench_writer(f, "sd_frame_writer", &SDIO_frame_stream.writer, ",");
+
+    // Raw frame log: frames of the sealed blocks (the pending block is not counted) and frames lost
+    const framelog_stats_t *frames = &SDIO_frame_stream.frames->stats;
+    fprintf(f, "  \"frame_log\": {\"frames\": %lu, \"blocks\": %lu, \"bytes\": %llu, \"lost\": %lu}\n}\n",
+            (unsigned long)frames->frames, (unsigned long)frames->blocks, (unsigned long long)frames->bytes,
+            (unsigned long)frames->lost);
+
+    if (fclose(f) != 0)
+    {
+        ESP_LOGE(TAG, "Unable to write %s", path);
+        return ESP_FAIL;
+    }
+    ESP_LOGI(TAG, "Results written to %s", path);
+    return ESP_OK;
+}
@@ -0,0 +1,266 @@
+/*
+ * host_can_source.c
+ *
+ *  Description: CAN source of the host build. The generator sends every schema message
+ *               (can_schema.h) at TELE_HOST_CAN_HZ with ramping signal values, encoded with
+ *               the generated COMM_encode_<NAME> functions, through the mock TWAI driver.
+ *               TELE_HOST_CAN_MIX replaces it with an explicit ID mix, "0x006:1000,0x7FF:200":
+ *               schema IDs are encoded as above, other IDs carry a counter (filter and
+ *               unregistered traffic). TELE_HOST_REPLAY selects the replay of a recorded log
+ *               instead (host_replay.c). Both end with the same report of rates and drops per
+ *               pipeline stage and sink, also written as JSON when TELE_HOST_BENCH is set.
+ */
+
+#include "host_port.h"
+#include "Logging/can_schema.h"
+#include "pipeline_stats/pipeline_stats.h"
+#include "log_stream/log_stream.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include <stdlib.h>
+#include <string.h>
+
+static const char *TAG = "host_can";
+
+// Ramp value of a signal: integers wrap at their width when encoded, floats move slowly
+#define HOST_RAMP_U16(COUNTER, BIT) ((uint16_t)((COUNTER) + (BIT)))
+#define HOST_RAMP_U32(COUNTER, BIT) ((uint32_t)((COUNTER) + (BIT)))
+#define HOST_RAMP_F32(COUNTER, BIT) ((float)(COUNTER) * 0.001f + (float)(BIT))
+
+#define HOST_X_SCHEMA_INDEX(P, NAME, ID, EXTD, ELEMENT, DLC) HOST_SCHEMA_##NAME,
+#define HOST_X_SCHEMA_ID(P, NAME, ID, EXTD, ELEMENT, DLC) {ID, EXTD},
+#define HOST_X_RAMP_SIGNAL(P, FIELD, CSV, TYPE, BIT, WIDTH, SCALE, UNIT) in.FIELD = HOST_RAMP_##TYPE(P, BIT);
+#define HOST_X_ENCODE_CASE(P, NAME, ID, EXTD, ELEMENT, DLC) \
+    case HOST_SCHEMA_##NAME:                                \
+    {                                                       \
+        COMM_message_##NAME##_t in;                         \
+        memset(&in, 0, sizeof(in));                         \
+        COMM_SIGNALS_##NAME(HOST_X_RAMP_SIGNAL, P)          \
+        COMM_encode_##NAME(&in, msg);                       \
+        break;                                              \
+    }
+
+typedef enum
+{
+    COMM_MESSAGE_TABLE(HOST_X_SCHEMA_INDEX, _)
+    HOST_SCHEMA_NONE,
+} host_schema_index_t;
+
+static const struct
+{
+    uint32_t id;
+    bool extd;
+} host_schema_ids[] = {COMM_MESSAGE_TABLE(HOST_X_SCHEMA_ID, _)};
+
+// One periodic frame of the generator
+typedef struct
+{
+    uint32_t id;
+    bool extd;
+    host_schema_index_t schema;
+    uint32_t period_us;
+    int64_t next_us;
+    uint32_t counter;
+} host_can_stream_t;
+
+static host_can_stream_t host_streams[HOST_CAN_MIX_MAX];
+static uint8_t host_stream_count;
+
+/*
+ * ================================================================
+ * 					Generator
+ * ================================================================
+ *
+ * */
+static uint32_t host_env_u32(const char *name, uint32_t fallback)
+{
+    const char *value = getenv(name);
+    return ((value != NULL) && (value[0] != '\0')) ? (uint32_t)strtoul(value, NULL, 0) : fallback;
+}
+
+static void host_can_add_stream(uint32_t id, bool extd, uint32_t hz)
+{
+    host_can_stream_t *stream = &host_streams[host_stream_count++];
+
+    stream->id = id;
+    stream->extd = extd;
+    stream->schema = HOST_SCHEMA_NONE;
+    stream->period_us = 1000000 / ((hz != 0) ? hz : 1);
+    for (uint8_t i = 0; i < COMM_MESSAGE_COUNT; i++)
+    {
+        if ((host_schema_ids[i].id == id) && (host_schema_ids[i].extd == extd))
+        {
+            stream->schema = (host_schema_index_t)i;
+        }
+    }
+}
+
+// TELE_HOST_CAN_MIX "id:hz,id:hz", IDs above 0x7FF are extended
+static void host_can_parse_mix(const char *mix)
+{
+    char *end;
+
+    while ((*mix != '\0') && (host_stream_count < HOST_CAN_MIX_MAX))
+    {
+        uint32_t id = strtoul(mix, &end, 0);
+        if ((end == mix) || (*end != ':'))
+        {
+            ESP_LOGE(TAG, "Bad TELE_HOST_CAN_MIX entry at \"%s\"", mix);
+            return;
+        }
+        mix = end + 1;
+        uint32_t hz = strtoul(mix, &end, 0);
+        host_can_add_stream(id, (id > 0x7FF), hz);
+        mix = (*end == ',') ? end + 1 : end;
+    }
+}
+
+static void host_can_build_frame(host_can_stream_t *stream, twai_message_t *msg)
+{
+    switch (stream->schema)
+    {
+        COMM_MESSAGE_TABLE(HOST_X_ENCODE_CASE, stream->counter)
+    default:
+        memset(msg, 0, sizeof(*msg));
+        msg->identifier = stream->id;
+        msg->extd = stream->extd;
+        msg->data_length_code = TWAI_FRAME_MAX_DLC;
+        memcpy(msg->data, &stream->counter, sizeof(stream->counter));
+        break;
+    }
+    stream->counter++;
+}
+
+static void host_can_generator_task(void *pvParameters)
+{
+    can_ring_t *ring = (can_ring_t *)pvParameters;
+    uint32_t run_s = host_env_u32("TELE_HOST_CAN_RUN", 0);
+    int64_t start_us = esp_timer_get_time();
+    int64_t now_us = start_us;
+    twai_message_t msg;
+    uint32_t sent = 0, dropped = 0;
+
+    for (uint8_t i = 0; i < host_stream_count; i++)
+    {
+        host_streams[i].next_us = start_us;
+        ESP_LOGI(TAG, "Generator: 0x%03lX%s every %lu us%s", (unsigned long)host_streams[i].id,
+                 host_streams[i].extd ? " (extd)" : "", (unsigned long)host_streams[i].period_us,
+                 (host_streams[i].schema == HOST_SCHEMA_NONE) ? ", not in the schema" : "");
+    }
+
+    while ((run_s == 0) || ((now_us - start_us) < (int64_t)run_s * 1000000))
+    {
+        // Every frame due since the last tick, as the bus would have delivered them meanwhile
+        for (uint8_t i = 0; i < host_stream_count; i++)
+        {
+            while (host_streams[i].next_us <= now_us)
+            {
+                host_can_build_frame(&host_streams[i], &msg);
+                if (host_twai_inject(&msg, 0) != ESP_OK)
+                {
+                    dropped++;
+                }
+                sent++;
+                host_streams[i].next_us += host_streams[i].period_us;
+            }
+        }
+        vTaskDelay(1);
+        now_us = esp_timer_get_time();
+    }
+
+    ESP_LOGI(TAG, "Generator done: %lu frames, %lu dropped by the RX queue", (unsigned long)sent, (unsigned long)dropped);
+    host_can_source_report(ring, sent, start_us, esp_timer_get_time());
+    vTaskDelete(NULL);
+}
+
+void host_can_source_report(const can_ring_t *ring, uint32_t sent, int64_t start_us, int64_t end_us)
+{
+    host_twai_counters_t twai;
+    bool drained = false;
+
+    // The CAN task and the sinks are still busy with the last frames of the source
+    for (uint32_t waited = 0; !drained && (waited < HOST_REPORT_DRAIN_MS); waited += 10)
+    {
+        vTaskDelay(pdMS_TO_TICKS(10));
+        host_twai_get_counters(&twai);
+        drained = (twai.msgs_to_rx == 0);
+        for (uint8_t i = 0; drained && (i < ring->consumer_count); i++)
+        {
+            drained = (can_ring_pending(ring->consumers[i]) == 0);
+        }
+    }
+    host_twai_get_counters(&twai);
+
+    host_bench_result_t result = {
+        .ring = ring,
+        .twai = twai,
+        .sent = sent,
+        .published = atomic_load(&ring->head),
+        .source_s = (double)((end_us > start_us) ? (end_us - start_us) : 1) / 1e6,
+        .sink_s = (double)(esp_timer_get_time() - start_us) / 1e6,
+    };
+
+    ESP_LOGI(TAG, "Source: %lu frames in %.3f s, %.0f frames/s", (unsigned long)sent, result.source_s, sent / result.source_s);
+    ESP_LOGI(TAG, "TWAI: %lu queued (high-water %lu), %lu rejected by the acceptance filter, %lu lost on a full RX queue",
+             (unsigned long)twai.queued, (unsigned long)twai.rx_hwm, (unsigned long)twai.hw_filtered,
+             (unsigned long)twai.rx_missed);
+    ESP_LOGI(TAG, "CAN task: %lu published to the ring, %lu dropped by the software filter",
+             (unsigned long)result.published, (unsigned long)(twai.queued - twai.msgs_to_rx - result.published));
+    for (uint8_t i = 0; i < ring->consumer_count; i++)
+    {
+        const can_ring_consumer_t *consumer = ring->consumers[i];
+        uint32_t delivered = consumer->cursor - can_ring_overruns(consumer);
+        ESP_LOGI(TAG, "Sink %s: %lu frames in %.3f s, %.0f frames/s, %lu dropped, max lag %lu%s",
+                 consumer->name, (unsigned long)delivered, result.sink_s, delivered / result.sink_s,
+                 (unsigned long)can_ring_overruns(consumer), (unsigned long)consumer->max_lag,
+                 (can_ring_pending(consumer) != 0) ? ", still behind" : "");
+    }
+    for (pipeline_stage_t stage = 0; stage < PIPELINE_STAGE_COUNT; stage++)
+    {
+        const pipeline_stage_stats_t *s = &CAN_pipeline_stats.stages[stage];
+        ESP_LOGI(TAG, "Latency %s: %lu samples, p50 %lu us, p99 %lu us, max %lu us, %llu bytes",
+                 pipeline_stats_stage_name(stage), (unsigned long)s->count,
+                 (unsigned long)pipeline_stats_percentile(&CAN_pipeline_stats, stage, 500),
+                 (unsigned long)pipeline_stats_percentile(&CAN_pipeline_stats, stage, 990),
+                 (unsigned long)s->max_us, (unsigned long long)s->bytes);
+    }
+    const sd_writer_stats_t *w = &SDIO_log_stream.writer.stats;
+    ESP_LOGI(TAG, "SD writer: %.2f MB/s sustained, %llu bytes in %lu writes and %lu syncs, max write %lld us, "
+                  "max stall %lld us (%lu stalls), %lu bytes dropped, %lu errors",
+             (w->write_us > 0) ? (double)w->written / w->write_us : 0.0, (unsigned long long)w->written,
+             (unsigned long)w->writes, (unsigned long)w->syncs, (long long)w->max_write_us,
+             (long long)w->max_stall_us, (unsigned long)w->stalls, (unsigned long)w->dropped,
+             (unsigned long)w->errors);
+
+    // Benchmark run (scripts/can_bench.py): results to the file, then end the process
+    const char *bench = getenv("TELE_HOST_BENCH");
+    if ((bench != NULL) && (bench[0] != '\0'))
+    {
+        exit((host_bench_write(bench, &result) == ESP_OK) ? 0 : 1);
+    }
+}
+
+esp_err_t host_can_source_start(can_ring_t *ring)
+{
+    const char *replay = getenv("TELE_HOST_REPLAY");
+    if ((replay != NULL) && (replay[0] != '\0'))
+    {
+        return host_replay_start(replay, ring);
+    }
+
+    const char *mix = getenv("TELE_HOST_CAN_MIX");
+    if ((mix != NULL) && (mix[0] != '\0'))
+    {
+        host_can_parse_mix(mix);
+    }
+    else
+    {
+        uint32_t hz = host_env_u32("TELE_HOST_CAN_HZ", HOST_CAN_DEFAULT_HZ);
+        for (uint8_t i = 0; i < COMM_MESSAGE_COUNT; i++)
+        {
+            host_can_add_stream(host_schema_ids[i].id, host_schema_ids[i].extd, hz);
+        }
+    }
+    return (xTaskCreate(host_can_generator_task, "host_can_source", 4096, ring, 5, NULL) == pdPASS) ? ESP_OK : ESP_FAIL;
+}
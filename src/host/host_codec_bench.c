@@ -0,0 +1,242 @@
+/*
+ * host_codec_bench.c
+ *
+ *  Description: Block codec benchmark of a recorded session, run instead of the pipeline when
+ *               TELE_HOST_CODEC_BENCH names a log file. The records of every block of a .BIN log
+ *               (restored first if the file is coded) are sealed again with each codec of
+ *               @ref binlog_codec through binlog_block_seal, checked and restored with
+ *               binlog_block_decode, and compared. Any other file (.CSV session, candump log) is
+ *               cut into BINLOG_BLOCK_SIZE chunks for LZSS alone, the record codec needs records.
+ *               The ratio of every codec and its time per MB in both directions are written as JSON.
+ *      Note: Times are of the host CPU, CRC included. The SD task logs the time the codec takes
+ *            on the ESP32 ("SD codec" line), which is the figure to compare with the row budget.
+ */
+
+#include "host_port.h"
+#include "binlog/binlog.h"
+#include "lzss/lzss.h"
+#include "esp_log.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define HOST_CODEC_MIN_SECONDS 0.5 // Passes over the file are repeated up to this coding time
+
+static const char *TAG = "host_codec_bench";
+
+typedef struct
+{
+    const char *name;
+    uint8_t codec;         // @ref binlog_codec
+    uint32_t coded;        // Blocks kept coded
+    uint32_t errors;       // Blocks not restored identically
+    uint64_t stored_bytes; // Blocks as written
+    double encode_s;       // All passes
+    double decode_s;
+} host_codec_result_t;
+
+static host_codec_result_t host_codec_results[] = {
+    {.name = "none", .codec = BINLOG_CODEC_NONE},
+    {.name = "lzss", .codec = BINLOG_CODEC_LZSS},
+    {.name = "delta", .codec = BINLOG_CODEC_DELTA},
+    {.name = "delta_lzss", .codec = BINLOG_CODEC_DELTA | BINLOG_CODEC_LZSS},
+};
+#define HOST_CODEC_COUNT (sizeof(host_codec_results) / sizeof(host_codec_results[0]))
+
+static uint32_t host_codec_blocks;
+static uint64_t host_codec_raw_bytes;   // Records (or chunk bytes)
+static uint64_t host_codec_plain_bytes; // Blocks stored as is
+static binlog_block_t host_codec_block;
+static binlog_record_t host_codec_records[BINLOG_BLOCK_RECORDS];
+static binlog_record_t host_codec_restored[BINLOG_BLOCK_RECORDS];
+static uint8_t host_codec_scratch[BINLOG_BLOCK_SIZE];
+
+static double host_codec_now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+// Seals the records with one codec as the SD task does, then restores them
+static void host_codec_seal(host_codec_result_t *result, uint16_t tag, uint16_t count, bool first)
+{
+    binlog_block_t *block = &host_codec_block;
+    size_t raw = count * sizeof(binlog_record_t);
+
+    binlog_block_init(block, tag, result->codec);
+    memcpy(block->data + sizeof(binlog_block_header_t), host_codec_records, raw);
+    block->records = count;
+    double start = host_codec_now_s();
+    size_t size = binlog_block_seal(block);
+    double middle = host_codec_now_s();
+    bool ok = (binlog_block_check(block->sealed, size, tag) == size) &&
+              (binlog_block_decode(block->sealed, host_codec_restored, host_codec_scratch) == count) &&
+              (memcmp(host_codec_restored, host_codec_records, raw) == 0);
+    result->encode_s += middle - start;
+    result->decode_s += host_codec_now_s() - middle;
+    if (first)
+    {
+        result->coded += (block->sealed != block->data);
+        result->stored_bytes += size;
+        result->errors += !ok;
+    }
+}
+
+// One pass over the blocks of a .BIN log, false if data is not one
+static bool host_codec_bin_pass(const uint8_t *data, size_t len, bool first)
+{
+    const binlog_file_header_t *header = (const binlog_file_header_t *)data;
+
+    if ((len < sizeof(*header)) || (memcmp(header->magic, BINLOG_MAGIC, sizeof(header->magic)) != 0) ||
+        (header->header_size > len) || (header->record_size != sizeof(binlog_record_t)))
+    {
+        return false;
+    }
+    uint16_t tag = binlog_file_tag(data, header->header_size);
+    size_t offset = (header->version >= 3) ? BINLOG_DATA_OFFSET(header->header_size) : header->header_size;
+    size_t size;
+
+    while ((offset < len) && ((size = binlog_block_check(data + offset, len - offset, tag)) != 0))
+    {
+        uint16_t count = binlog_block_decode(data + offset, host_codec_records, host_codec_scratch);
+        offset += size;
+        if (count == 0)
+        {
+            continue;
+        }
+        if (first)
+        {
+            host_codec_blocks++;
+            host_codec_raw_bytes += count * sizeof(binlog_record_t);
+            host_codec_plain_bytes += sizeof(binlog_block_header_t) + count * sizeof(binlog_record_t) + sizeof(uint32_t);
+        }
+        for (size_t i = 0; i < HOST_CODEC_COUNT; i++)
+        {
+            host_codec_seal(&host_codec_results[i], tag, count, first);
+        }
+    }
+    return true;
+}
+
+// One pass of LZSS alone over BINLOG_BLOCK_SIZE chunks of any file
+static void host_codec_chunk_pass(const uint8_t *data, size_t len, bool first)
+{
+    static lzss_state_t state;
+    static uint8_t packed[BINLOG_BLOCK_SIZE];
+    static uint8_t restored[BINLOG_BLOCK_SIZE];
+    host_codec_result_t *result = &host_codec_results[1];
+
+    for (size_t offset = 0; offset + sizeof(uint32_t) < len; offset += BINLOG_BLOCK_SIZE)
+    {
+        size_t chunk = (len - offset < BINLOG_BLOCK_SIZE) ? len - offset : BINLOG_BLOCK_SIZE;
+        double start = host_codec_now_s();
+        size_t size = lzss_compress(&state, data + offset, chunk, packed, chunk - sizeof(uint32_t));
+        double middle = host_codec_now_s();
+        bool ok = (size == 0) || ((lzss_decompress(packed, size, restored, sizeof(restored)) == chunk) &&
+                                  (memcmp(restored, data + offset, chunk) == 0));
+        result->encode_s += middle - start;
+        result->decode_s += host_codec_now_s() - middle;
+        if (first)
+        {
+            host_codec_blocks++;
+            host_codec_raw_bytes += chunk;
+            host_codec_plain_bytes += chunk;
+            host_codec_results[0].stored_bytes += chunk;
+            result->coded += (size != 0);
+            result->stored_bytes += (size != 0) ? size + sizeof(uint32_t) : chunk;
+            result->errors += !ok;
+        }
+    }
+}
+
+/**================================================================
+ * @Fn				- host_codec_bench_run
+ * @breif			- Runs the codec benchmark if TELE_HOST_CODEC_BENCH is set
+ * @param [in]		- None
+ * @retval			- None, exits the process once the results are written
+ */
+void host_codec_bench_run(void)
+{
+    const char *path = getenv("TELE_HOST_CODEC_BENCH");
+    if ((path == NULL) || (path[0] == '\0'))
+    {
+        return;
+    }
+    FILE *in = fopen(path, "rb");
+    long len = -1;
+    if ((in == NULL) || (fseek(in, 0, SEEK_END) != 0) || ((len = ftell(in)) <= 0))
+    {
+        ESP_LOGE(TAG, "Unable to read %s", path);
+        exit(1);
+    }
+    uint8_t *data = malloc((size_t)len);
+    rewind(in);
+    if ((data == NULL) || (fread(data, 1, (size_t)len, in) != (size_t)len))
+    {
+        ESP_LOGE(TAG, "Unable to read %s", path);
+        exit(1);
+    }
+    fclose(in);
+
+    bool bin = host_codec_bin_pass(data, (size_t)len, true);
+    if (!bin)
+    {
+        host_codec_chunk_pass(data, (size_t)len, true);
+    }
+    uint32_t passes = 1;
+    for (; (host_codec_results[HOST_CODEC_COUNT - 1].encode_s + host_codec_results[1].encode_s < HOST_CODEC_MIN_SECONDS) &&
+           (host_codec_raw_bytes != 0);
+         passes++)
+    {
+        if (bin)
+        {
+            host_codec_bin_pass(data, (size_t)len, false);
+        }
+        else
+        {
+            host_codec_chunk_pass(data, (size_t)len, false);
+        }
+    }
+    free(data);
+
+    const char *out_path = getenv("TELE_HOST_BENCH");
+    FILE *out = ((out_path != NULL) && (out_path[0] != '\0')) ? fopen(out_path, "w") : stdout;
+    if (out == NULL)
+    {
+        ESP_LOGE(TAG, "Unable to write %s", out_path);
+        exit(1);
+    }
+    double mb = host_codec_raw_bytes / 1e6;
+    uint32_t errors = 0;
+    fprintf(out, "{\n  \"codec\": {\n    \"file\": \"%s\",\n    \"format\": \"%s\",\n", path, bin ? "bin" : "chunks");
+    fprintf(out, "    \"blocks\": %lu,\n    \"raw_bytes\": %llu,\n    \"plain_bytes\": %llu,\n    \"passes\": %lu,\n",
+            (unsigned long)host_codec_blocks, (unsigned long long)host_codec_raw_bytes,
+            (unsigned long long)host_codec_plain_bytes, (unsigned long)passes);
+    fprintf(out, "    \"codecs\": {\n");
+    for (size_t i = 0; i < HOST_CODEC_COUNT; i++)
+    {
+        const host_codec_result_t *r = &host_codec_results[i];
+        double ratio = (r->stored_bytes != 0) ? (double)host_codec_plain_bytes / r->stored_bytes : 0.0;
+        double encode_us = (mb > 0) ? r->encode_s / passes * 1e6 / mb : 0.0;
+        double decode_us = (mb > 0) ? r->decode_s / passes * 1e6 / mb : 0.0;
+        errors += r->errors;
+        if (r->stored_bytes != 0)
+        {
+            ESP_LOGI(TAG, "%s %s: %lu of %lu blocks coded, ratio %.2f, encode %.0f us/MB, decode %.0f us/MB, %lu errors",
+                     path, r->name, (unsigned long)r->coded, (unsigned long)host_codec_blocks, ratio, encode_us,
+                     decode_us, (unsigned long)r->errors);
+        }
+        fprintf(out, "      \"%s\": {\"coded_blocks\": %lu, \"stored_bytes\": %llu, \"ratio\": %.3f, "
+                     "\"encode_us_per_mb\": %.1f, \"decode_us_per_mb\": %.1f, \"errors\": %lu}%s\n",
+                r->name, (unsigned long)r->coded, (unsigned long long)r->stored_bytes, ratio, encode_us, decode_us,
+                (unsigned long)r->errors, (i + 1 < HOST_CODEC_COUNT) ? "," : "");
+    }
+    fprintf(out, "    }\n  }\n}\n");
+    if (out != stdout)
+    {
+        fclose(out);
+    }
+    exit((errors == 0) ? 0 : 1);
+}
@@ -0,0 +1,243 @@
+/*
+ * host_dispatch_bench.c
+ *
+ *  Description: CAN ID lookup benchmark, run instead of the pipeline when
+ *               TELE_HOST_DISPATCH_BENCH gives a number of calls. A table of
+ *               HOST_DISPATCH_STD_COUNT standard and HOST_DISPATCH_EXT_COUNT extended IDs is
+ *               registered with can_dispatch_init, and the same IDs are compiled into a switch
+ *               as the receive task used before the dispatch table. Every query ID is first
+ *               checked to give the same slot from both, then the ns per lookup of each are
+ *               timed for registered IDs (hits) and unregistered ones (misses), standard and
+ *               extended apart. Results are written as JSON.
+ *      Note: The switch is built by the host compiler (jump table or compare tree), the figures
+ *            of the ESP32 differ but keep their order.
+ */
+
+#include "host_port.h"
+#include "can_dispatch/can_dispatch.h"
+#include "esp_log.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define HOST_DISPATCH_STD_COUNT 256
+#define HOST_DISPATCH_EXT_COUNT 128
+#define HOST_DISPATCH_STD_ID(n) (0x100u + 5u * (n)) // Spread over 0x100-0x5FB
+#define HOST_DISPATCH_EXT_ID(n) (0x18F00000u + 0x1011u * (n)) // J1939-like 29-bit IDs
+#define HOST_DISPATCH_QUERIES 4096 // IDs per category, cycled through by the timed loops
+
+// Compile-time lists of the registered IDs for the switch
+#define HOST_REPEAT_4(m, n) m(n) m((n) + 1) m((n) + 2) m((n) + 3)
+#define HOST_REPEAT_16(m, n) HOST_REPEAT_4(m, n) HOST_REPEAT_4(m, (n) + 4) HOST_REPEAT_4(m, (n) + 8) HOST_REPEAT_4(m, (n) + 12)
+#define HOST_REPEAT_64(m, n) HOST_REPEAT_16(m, n) HOST_REPEAT_16(m, (n) + 16) HOST_REPEAT_16(m, (n) + 32) HOST_REPEAT_16(m, (n) + 48)
+#define HOST_REPEAT_128(m, n) HOST_REPEAT_64(m, n) HOST_REPEAT_64(m, (n) + 64)
+#define HOST_REPEAT_256(m, n) HOST_REPEAT_128(m, n) HOST_REPEAT_128(m, (n) + 128)
+#define HOST_DISPATCH_STD_CASE(n) \
+    case HOST_DISPATCH_STD_ID(n): \
+        return (n);
+#define HOST_DISPATCH_EXT_CASE(n) \
+    case HOST_DISPATCH_EXT_ID(n): \
+        return HOST_DISPATCH_STD_COUNT + (n);
+
+_Static_assert(HOST_DISPATCH_STD_COUNT + HOST_DISPATCH_EXT_COUNT <= CAN_DISPATCH_MAX_ENTRIES, "Table too large");
+_Static_assert(HOST_DISPATCH_EXT_COUNT <= CAN_DISPATCH_EXT_SLOTS / 2, "Extended hash more than half full");
+
+typedef enum
+{
+    HOST_DISPATCH_STD_HIT,
+    HOST_DISPATCH_STD_MISS,
+    HOST_DISPATCH_EXT_HIT,
+    HOST_DISPATCH_EXT_MISS,
+    HOST_DISPATCH_CATEGORIES,
+} host_dispatch_category_t;
+
+static const char *TAG = "host_dispatch_bench";
+static const char *const host_dispatch_keys[HOST_DISPATCH_CATEGORIES] = {"std_hit_ns", "std_miss_ns", "ext_hit_ns",
+                                                                         "ext_miss_ns"};
+
+static can_dispatch_entry_t host_dispatch_table[HOST_DISPATCH_STD_COUNT + HOST_DISPATCH_EXT_COUNT];
+static can_dispatch_t host_dispatch;
+static uint32_t host_dispatch_queries[HOST_DISPATCH_CATEGORIES][HOST_DISPATCH_QUERIES];
+
+static double host_dispatch_now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+// The receive task before the dispatch table: one case per registered ID (not inlined, as a call)
+static __attribute__((noinline)) uint16_t host_dispatch_switch(uint32_t id, bool extd)
+{
+    if (!extd)
+    {
+        switch (id)
+        {
+            HOST_REPEAT_256(HOST_DISPATCH_STD_CASE, 0)
+        default:
+            return CAN_DISPATCH_NO_SLOT;
+        }
+    }
+    switch (id)
+    {
+        HOST_REPEAT_128(HOST_DISPATCH_EXT_CASE, 0)
+    default:
+        return CAN_DISPATCH_NO_SLOT;
+    }
+}
+
+static bool host_dispatch_registered(uint32_t id, bool extd)
+{
+    if (!extd)
+    {
+        return (id >= HOST_DISPATCH_STD_ID(0)) && ((id - HOST_DISPATCH_STD_ID(0)) % 5u == 0) &&
+               ((id - HOST_DISPATCH_STD_ID(0)) / 5u < HOST_DISPATCH_STD_COUNT);
+    }
+    return (id >= HOST_DISPATCH_EXT_ID(0)) && ((id - HOST_DISPATCH_EXT_ID(0)) % 0x1011u == 0) &&
+           ((id - HOST_DISPATCH_EXT_ID(0)) / 0x1011u < HOST_DISPATCH_EXT_COUNT);
+}
+
+// Random query IDs of every category
+static void host_dispatch_fill(void)
+{
+    srand(1);
+    for (uint32_t i = 0; i < HOST_DISPATCH_QUERIES; i++)
+    {
+        uint32_t id;
+        host_dispatch_queries[HOST_DISPATCH_STD_HIT][i] = HOST_DISPATCH_STD_ID((uint32_t)rand() % HOST_DISPATCH_STD_COUNT);
+        host_dispatch_queries[HOST_DISPATCH_EXT_HIT][i] = HOST_DISPATCH_EXT_ID((uint32_t)rand() % HOST_DISPATCH_EXT_COUNT);
+        do
+        {
+            id = (uint32_t)rand() & TWAI_STD_ID_MASK;
+        } while (host_dispatch_registered(id, false));
+        host_dispatch_queries[HOST_DISPATCH_STD_MISS][i] = id;
+        do
+        {
+            id = (uint32_t)rand() & TWAI_EXTD_ID_MASK;
+        } while (host_dispatch_registered(id, true));
+        host_dispatch_queries[HOST_DISPATCH_EXT_MISS][i] = id;
+    }
+}
+
+// Query IDs whose slot differs between the table and the switch, or is not the expected hit / miss
+static uint32_t host_dispatch_check(void)
+{
+    uint32_t mismatches = 0;
+    for (uint8_t c = 0; c < HOST_DISPATCH_CATEGORIES; c++)
+    {
+        bool extd = (c == HOST_DISPATCH_EXT_HIT) || (c == HOST_DISPATCH_EXT_MISS);
+        bool hit = (c == HOST_DISPATCH_STD_HIT) || (c == HOST_DISPATCH_EXT_HIT);
+        for (uint32_t i = 0; i < HOST_DISPATCH_QUERIES; i++)
+        {
+            uint32_t id = host_dispatch_queries[c][i];
+            uint16_t slot = can_dispatch_lookup(&host_dispatch, id, extd);
+            if ((slot != host_dispatch_switch(id, extd)) || ((slot != CAN_DISPATCH_NO_SLOT) != hit))
+            {
+                if (mismatches++ == 0)
+                {
+                    ESP_LOGE(TAG, "0x%08lx: slot %u, switch %u", (unsigned long)id, slot, host_dispatch_switch(id, extd));
+                }
+            }
+        }
+    }
+    return mismatches;
+}
+
+/**================================================================
+ * @Fn				- host_dispatch_bench_run
+ * @breif			- Runs the CAN ID lookup benchmark if TELE_HOST_DISPATCH_BENCH is set
+ * @param [in]		- None
+ * @retval			- None, exits the process once the results are written
+ */
+void host_dispatch_bench_run(void)
+{
+    const char *env = getenv("TELE_HOST_DISPATCH_BENCH");
+    if ((env == NULL) || (env[0] == '\0'))
+    {
+        return;
+    }
+    uint32_t calls = (uint32_t)strtoul(env, NULL, 0);
+    if (calls == 0)
+    {
+        calls = 10000000;
+    }
+
+    for (uint16_t i = 0; i < HOST_DISPATCH_STD_COUNT + HOST_DISPATCH_EXT_COUNT; i++)
+    {
+        bool extd = (i >= HOST_DISPATCH_STD_COUNT);
+        host_dispatch_table[i] = (can_dispatch_entry_t){
+            .id = extd ? HOST_DISPATCH_EXT_ID(i - HOST_DISPATCH_STD_COUNT) : HOST_DISPATCH_STD_ID(i),
+            .extd = extd,
+            .size = TWAI_FRAME_MAX_DLC,
+        };
+    }
+    esp_err_t err = can_dispatch_init(&host_dispatch, host_dispatch_table,
+                                      HOST_DISPATCH_STD_COUNT + HOST_DISPATCH_EXT_COUNT);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "can_dispatch_init: %s", esp_err_to_name(err));
+        exit(1);
+    }
+    host_dispatch_fill();
+    uint32_t mismatches = host_dispatch_check();
+
+    double table_ns[HOST_DISPATCH_CATEGORIES];
+    double switch_ns[HOST_DISPATCH_CATEGORIES];
+    uint64_t sink = 0; // Keeps the calls from being optimised out
+    for (uint8_t c = 0; c < HOST_DISPATCH_CATEGORIES; c++)
+    {
+        const uint32_t *ids = host_dispatch_queries[c];
+        bool extd = (c == HOST_DISPATCH_EXT_HIT) || (c == HOST_DISPATCH_EXT_MISS);
+
+        double start = host_dispatch_now_s();
+        for (uint32_t i = 0; i < calls; i++)
+        {
+            sink += can_dispatch_lookup(&host_dispatch, ids[i & (HOST_DISPATCH_QUERIES - 1)], extd);
+        }
+        table_ns[c] = (host_dispatch_now_s() - start) * 1e9 / calls;
+
+        start = host_dispatch_now_s();
+        for (uint32_t i = 0; i < calls; i++)
+        {
+            sink += host_dispatch_switch(ids[i & (HOST_DISPATCH_QUERIES - 1)], extd);
+        }
+        switch_ns[c] = (host_dispatch_now_s() - start) * 1e9 / calls;
+    }
+
+    ESP_LOGI(TAG, "%u std + %u ext IDs, %lu calls: table %.1f / %.1f / %.1f / %.1f ns, switch %.1f / %.1f / %.1f / %.1f ns "
+                  "(std hit / std miss / ext hit / ext miss), %lu mismatches (%llu)",
+             HOST_DISPATCH_STD_COUNT, HOST_DISPATCH_EXT_COUNT, (unsigned long)calls, table_ns[0], table_ns[1],
+             table_ns[2], table_ns[3], switch_ns[0], switch_ns[1], switch_ns[2], switch_ns[3],
+             (unsigned long)mismatches, (unsigned long long)(sink & 1));
+
+    const char *out_path = getenv("TELE_HOST_BENCH");
+    FILE *out = ((out_path != NULL) && (out_path[0] != '\0')) ? fopen(out_path, "w") : stdout;
+    if (out == NULL)
+    {
+        ESP_LOGE(TAG, "Unable to write %s", out_path);
+        exit(1);
+    }
+    fprintf(out, "{\n  \"dispatch\": {\n    \"std_ids\": %u,\n    \"ext_ids\": %u,\n    \"calls\": %lu,\n"
+                 "    \"checked\": %lu,\n    \"mismatches\": %lu,\n",
+            HOST_DISPATCH_STD_COUNT, HOST_DISPATCH_EXT_COUNT, (unsigned long)calls,
+            (unsigned long)(HOST_DISPATCH_CATEGORIES * HOST_DISPATCH_QUERIES), (unsigned long)mismatches);
+    const char *names[] = {"table", "switch"};
+    const double *results[] = {table_ns, switch_ns};
+    for (uint8_t m = 0; m < 2; m++)
+    {
+        fprintf(out, "    \"%s\": {", names[m]);
+        for (uint8_t c = 0; c < HOST_DISPATCH_CATEGORIES; c++)
+        {
+            fprintf(out, "\"%s\": %.2f%s", host_dispatch_keys[c], results[m][c],
+                    (c + 1 < HOST_DISPATCH_CATEGORIES) ? ", " : "");
+        }
+        fprintf(out, "}%s\n", (m == 0) ? "," : "");
+    }
+    fprintf(out, "  }\n}\n");
+    if (out != stdout)
+    {
+        fclose(out);
+    }
+    exit((mismatches == 0) ? 0 : 1);
+}
@@ -0,0 +1,216 @@
+/*
+ * host_format_bench.c
+ *
+ *  Description: .CSV row formatting benchmark, run instead of the pipeline when
+ *               TELE_HOST_FORMAT_BENCH gives a number of rows. Synthetic rows (random integer
+ *               signals of their bit width, GPS-like floats, receive times) are formatted with the
+ *               schema columns through the row builder (COMM_CSV_PUT) and through the snprintf
+ *               format the rows used to be written with (COMM_CSV_FORMAT / COMM_CSV_ARGS), and
+ *               every pair of rows is compared. The complete SDIO_SD_Format_CSV_Row (UTC
+ *               timestamp included) is timed as well. Times in ns per row are written as JSON.
+ *      Note: Times are of the host CPU and its libc. On the ESP32 "%f" goes through newlib's
+ *            _dtoa in software double precision, the gap is wider there.
+ */
+
+#include "host_port.h"
+#include "Logging/logging.h"
+#include "row_builder/row_builder.h"
+#include "esp_log.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define HOST_FORMAT_POOL 1024 // Distinct synthetic rows, formatted in turn
+
+static const char *TAG = "host_format_bench";
+
+static const char host_format_time[] = "2025-06-22 12:34:56.789012"; // Timestamp of the compared rows
+
+static SDIO_TxBuffer host_format_rows[HOST_FORMAT_POOL];
+static uint64_t host_format_seed = 0x9E3779B97F4A7C15ull;
+
+static uint32_t host_format_random(void)
+{
+    // xorshift64*
+    host_format_seed ^= host_format_seed >> 12;
+    host_format_seed ^= host_format_seed << 25;
+    host_format_seed ^= host_format_seed >> 27;
+    return (uint32_t)((host_format_seed * 0x2545F4914F6CDD1Dull) >> 32);
+}
+
+static double host_format_now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+// Random value of every schema signal: integers over their bit width, floats in degrees
+#define HOST_FORMAT_FILL_U16(VALUE, WIDTH) (VALUE) = host_format_random() & (uint32_t)((1ull << (WIDTH)) - 1);
+#define HOST_FORMAT_FILL_U32(VALUE, WIDTH) (VALUE) = host_format_random() & (uint32_t)((1ull << (WIDTH)) - 1);
+#define HOST_FORMAT_FILL_F32(VALUE, WIDTH) (VALUE) = ((float)host_format_random() / 4294967296.0f - 0.5f) * 360.0f;
+#define HOST_FORMAT_FILL(P, FIELD, CSV, TYPE, BIT, WIDTH, SCALE, UNIT) HOST_FORMAT_FILL_##TYPE((P).FIELD, WIDTH)
+#define HOST_FORMAT_FILL_MESSAGE(P, NAME, ID, EXTD, ELEMENT, DLC) COMM_SIGNALS_##NAME(HOST_FORMAT_FILL, (P)->ELEMENT)
+
+static void host_format_fill(SDIO_TxBuffer *row, int64_t timestamp_us)
+{
+    memset(row, 0, sizeof(*row));
+    row->string = "Bench";
+    row->timestamp_us = timestamp_us;
+    row->fresh = ((uint64_t)host_format_random() << 32) | host_format_random();
+    COMM_MESSAGE_TABLE(HOST_FORMAT_FILL_MESSAGE, row)
+    for (uint8_t i = 0; i < COMM_MESSAGE_COUNT; i++)
+    {
+        // One message in eight missing, the others received up to 10 ms before the row
+        row->message_us[i] = ((host_format_random() & 7) != 0) ? timestamp_us - (host_format_random() % 10000) : 0;
+    }
+}
+
+// The row as it was formatted before the row builder
+static int host_format_snprintf(char *buf, size_t len, const SDIO_TxBuffer *pTxBuffer)
+{
+    int written = snprintf(buf, len, "%s,%s,%" PRIx64 COMM_CSV_FORMAT,
+                           host_format_time,
+                           pTxBuffer->string,
+                           pTxBuffer->fresh
+                           COMM_CSV_ARGS(pTxBuffer));
+    for (uint8_t i = 0; (i < COMM_MESSAGE_COUNT) && (written >= 0) && ((size_t)written < len); i++)
+    {
+        if (pTxBuffer->message_us[i] != 0)
+        {
+            written += snprintf(buf + written, len - written, ",%ld", (long)(pTxBuffer->message_us[i] - pTxBuffer->timestamp_us));
+        }
+        else
+        {
+            written += snprintf(buf + written, len - written, ",");
+        }
+    }
+    if ((written >= 0) && ((size_t)written < len))
+    {
+        written += snprintf(buf + written, len - written, "\n");
+    }
+    return ((written >= 0) && ((size_t)written < len)) ? written : -1;
+}
+
+// Same row through the row builder, as SDIO_SD_Format_CSV_Row writes it
+static int host_format_builder(char *buf, size_t len, const SDIO_TxBuffer *pTxBuffer)
+{
+    row_builder_t row;
+    row_builder_init(&row, buf, len);
+    row_builder_str(&row, host_format_time);
+    row_builder_char(&row, ',');
+    row_builder_str(&row, pTxBuffer->string);
+    row_builder_char(&row, ',');
+    row_builder_hex(&row, pTxBuffer->fresh, 1, false);
+    COMM_CSV_PUT(&row, pTxBuffer)
+    for (uint8_t i = 0; i < COMM_MESSAGE_COUNT; i++)
+    {
+        row_builder_char(&row, ',');
+        if (pTxBuffer->message_us[i] != 0)
+        {
+            row_builder_i64(&row, pTxBuffer->message_us[i] - pTxBuffer->timestamp_us);
+        }
+    }
+    row_builder_char(&row, '\n');
+    return row_builder_end(&row);
+}
+
+// The complete row, UTC timestamp included
+static int host_format_csv_row(char *buf, size_t len, const SDIO_TxBuffer *pTxBuffer)
+{
+    static Time_Sync_stamp_t stamp;
+    return SDIO_SD_Format_CSV_Row(buf, len, pTxBuffer, &stamp);
+}
+
+// Formats rows rows with one formatter, returns the time taken in s and the bytes in *bytes
+static double host_format_time_rows(int (*format)(char *, size_t, const SDIO_TxBuffer *), uint32_t rows,
+                                    uint64_t *bytes)
+{
+    static char buf[SDIO_CSV_ROW_MAX];
+    uint64_t total = 0;
+    double start = host_format_now_s();
+    for (uint32_t i = 0; i < rows; i++)
+    {
+        total += (uint64_t)format(buf, sizeof(buf), &host_format_rows[i % HOST_FORMAT_POOL]);
+    }
+    double elapsed = host_format_now_s() - start;
+    *bytes = total;
+    return elapsed;
+}
+
+/**================================================================
+ * @Fn				- host_format_bench_run
+ * @breif			- Runs the row formatting benchmark if TELE_HOST_FORMAT_BENCH is set
+ * @param [in]		- None
+ * @retval			- None, exits the process once the results are written
+ */
+void host_format_bench_run(void)
+{
+    const char *env = getenv("TELE_HOST_FORMAT_BENCH");
+    if ((env == NULL) || (env[0] == '\0'))
+    {
+        return;
+    }
+    uint32_t rows = (uint32_t)strtoul(env, NULL, 0);
+    if (rows == 0)
+    {
+        rows = 1000000;
+    }
+
+    for (uint32_t i = 0; i < HOST_FORMAT_POOL; i++)
+    {
+        host_format_fill(&host_format_rows[i], 1000000 + (int64_t)i * 10000);
+    }
+
+    // Both formatters must give the same rows
+    uint32_t mismatches = 0;
+    for (uint32_t i = 0; i < HOST_FORMAT_POOL; i++)
+    {
+        char expected[SDIO_CSV_ROW_MAX];
+        char built[SDIO_CSV_ROW_MAX];
+        int expected_len = host_format_snprintf(expected, sizeof(expected), &host_format_rows[i]);
+        int built_len = host_format_builder(built, sizeof(built), &host_format_rows[i]);
+        if ((expected_len != built_len) || (strcmp(expected, built) != 0))
+        {
+            if (mismatches++ == 0)
+            {
+                ESP_LOGE(TAG, "Row %lu differs:\n%s%s", (unsigned long)i, expected, built);
+            }
+        }
+    }
+
+    uint64_t snprintf_bytes;
+    uint64_t builder_bytes;
+    uint64_t row_bytes;
+    double snprintf_s = host_format_time_rows(host_format_snprintf, rows, &snprintf_bytes);
+    double builder_s = host_format_time_rows(host_format_builder, rows, &builder_bytes);
+    double row_s = host_format_time_rows(host_format_csv_row, rows, &row_bytes);
+    double snprintf_ns = snprintf_s * 1e9 / rows;
+    double builder_ns = builder_s * 1e9 / rows;
+    double row_ns = row_s * 1e9 / rows;
+    ESP_LOGI(TAG, "%lu rows: snprintf %.0f ns/row, row builder %.0f ns/row (x%.1f), SDIO_SD_Format_CSV_Row %.0f ns/row, %lu mismatches",
+             (unsigned long)rows, snprintf_ns, builder_ns, (builder_ns > 0) ? snprintf_ns / builder_ns : 0.0, row_ns,
+             (unsigned long)mismatches);
+
+    const char *out_path = getenv("TELE_HOST_BENCH");
+    FILE *out = ((out_path != NULL) && (out_path[0] != '\0')) ? fopen(out_path, "w") : stdout;
+    if (out == NULL)
+    {
+        ESP_LOGE(TAG, "Unable to write %s", out_path);
+        exit(1);
+    }
+    fprintf(out, "{\n  \"format\": {\n    \"rows\": %lu,\n    \"columns\": %u,\n    \"mismatches\": %lu,\n",
+            (unsigned long)rows, (unsigned)(3 + COMM_SIGNAL_COUNT + COMM_MESSAGE_COUNT), (unsigned long)mismatches);
+    fprintf(out, "    \"snprintf\": {\"ns_per_row\": %.1f, \"bytes_per_row\": %.1f},\n", snprintf_ns,
+            (double)snprintf_bytes / rows);
+    fprintf(out, "    \"row_builder\": {\"ns_per_row\": %.1f, \"bytes_per_row\": %.1f},\n", builder_ns,
+            (double)builder_bytes / rows);
+    fprintf(out, "    \"csv_row\": {\"ns_per_row\": %.1f, \"bytes_per_row\": %.1f}\n  }\n}\n", row_ns,
+            (double)row_bytes / rows);
+    if (out != stdout)
+    {
+        fclose(out);
+    }
+    exit((mismatches == 0) ? 0 : 1);
+}
@@ -0,0 +1,382 @@
+/*
+ * host_replay.c
+ *
+ *  Description: Replay of recorded CAN traffic through the mock TWAI driver of the host build.
+ *               Formats, selected by the file extension:
+ *                 .csv - SDIO_CAN.CSV of SDIO_SD_log_can_message_to_csv (1 s resolution, rows of
+ *                        the same second are spread evenly over it)
+ *                 .bin - telemetry_frame_t records as sent by the UDP sender (epoch µs)
+ *                 else - candump text, log (-l) "(s.us) can0 123#11223344" or "(s.us) can0 123 [4] 11 22 33 44"
+ *               TELE_HOST_REPLAY_SPEED 1 keeps the recorded gaps, N divides them by N and 0 pushes
+ *               frames as fast as the CAN task takes them (blocking on the RX queue instead of
+ *               dropping, so only the sinks can lose frames).
+ */
+
+#include "host_port.h"
+#include "telemetry_config.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+static const char *TAG = "host_replay";
+
+typedef enum
+{
+    HOST_REPLAY_CANDUMP,
+    HOST_REPLAY_SDIO_CSV,
+    HOST_REPLAY_BINARY,
+} host_replay_format_t;
+
+typedef struct
+{
+    FILE *file;
+    host_replay_format_t format;
+    can_ring_t *ring;
+    double speed;
+    uint32_t bad_lines;
+    char line[256];
+
+    // SDIO_CAN.CSV rows of the current second, plus the first row of the next one
+    twai_message_t group[HOST_REPLAY_GROUP_MAX];
+    uint32_t group_count;
+    uint32_t group_next;
+    int64_t group_us;
+    twai_message_t pending;
+    int64_t pending_us;
+    bool pending_exact;
+    bool pending_valid;
+} host_replay_t;
+
+static host_replay_t host_replay;
+
+/*
+ * ================================================================
+ * 					Parsers
+ * ================================================================
+ *
+ * Return 1 for a frame, 0 for a line without frame (header, comment, CAN FD) and -1 for an
+ * unparsable line.
+ * */
+static int host_replay_parse_bytes(const char *text, twai_message_t *msg, bool packed)
+{
+    uint8_t count = 0;
+    char *end;
+
+    while (count < TWAI_FRAME_MAX_DLC)
+    {
+        while (!packed && (*text == ' '))
+        {
+            text++;
+        }
+        if (!((text[0] != '\0') && (text[1] != '\0') && (strchr("0123456789abcdefABCDEF", text[0]) != NULL)))
+        {
+            break;
+        }
+        char hex[3] = {text[0], text[1], '\0'};
+        msg->data[count++] = (uint8_t)strtoul(hex, &end, 16);
+        if (*end != '\0')
+        {
+            return -1;
+        }
+        text += 2;
+    }
+    return count;
+}
+
+static int host_replay_parse_candump(const char *line, twai_message_t *msg, int64_t *time_us)
+{
+    long long seconds;
+    char fraction[7];
+    int offset = 0;
+    char *end;
+
+    if (sscanf(line, " (%lld.%6[0-9]) %*s %n", &seconds, fraction, &offset) != 2 || offset == 0)
+    {
+        return ((line[strspn(line, " \t\r\n")] == '\0') || (line[0] == '#')) ? 0 : -1;
+    }
+    int64_t micros = strtol(fraction, NULL, 10);
+    for (size_t digits = strlen(fraction); digits < 6; digits++)
+    {
+        micros *= 10;
+    }
+    *time_us = (int64_t)seconds * 1000000 + micros;
+
+    const char *id = line + offset;
+    memset(msg, 0, sizeof(*msg));
+    msg->identifier = strtoul(id, &end, 16);
+    msg->extd = ((end - id) > 3);
+
+    if (end[0] == '#')
+    {
+        if (end[1] == '#')
+        {
+            return 0; // CAN FD, not on this bus
+        }
+        if ((end[1] == 'R') || (end[1] == 'r'))
+        {
+            msg->rtr = 1;
+            msg->data_length_code = (end[2] >= '0' && end[2] <= '8') ? (end[2] - '0') : 0;
+            return 1;
+        }
+        int count = host_replay_parse_bytes(end + 1, msg, true);
+        msg->data_length_code = (count > 0) ? count : 0;
+        return (count >= 0) ? 1 : -1;
+    }
+
+    int dlc, length = 0;
+    if ((sscanf(end, " [%d]%n", &dlc, &length) != 1) || (length == 0) || (dlc < 0) || (dlc > TWAI_FRAME_MAX_DLC))
+    {
+        return -1;
+    }
+    msg->data_length_code = dlc;
+    if (strstr(end + length, "remote request") != NULL)
+    {
+        msg->rtr = 1;
+        return 1;
+    }
+    return (host_replay_parse_bytes(end + length, msg, false) == dlc) ? 1 : -1;
+}
+
+static int host_replay_parse_csv(const char *line, twai_message_t *msg, int64_t *time_us, bool *exact)
+{
+    struct tm tm = {0};
+    unsigned long id;
+    char extd[4], rtr[4];
+    int dlc, offset = 0;
+
+    if ((strncmp(line, "Timestamp", 9) == 0) || (line[strspn(line, " \t\r\n")] == '\0'))
+    {
+        return 0; // SDIO_SD_log_can_message_to_csv repeats its header before every row
+    }
+    if (sscanf(line, "%d-%d-%d %d:%d:%d%n", &tm.tm_year, &tm.tm_mon, &tm.tm_mday,
+               &tm.tm_hour, &tm.tm_min, &tm.tm_sec, &offset) != 6)
+    {
+        return -1;
+    }
+    tm.tm_year -= 1900;
+    tm.tm_mon -= 1;
+    tm.tm_isdst = -1; // Written by Time_Sync_get_rtc_time_str in local time
+    *time_us = (int64_t)mktime(&tm) * 1000000;
+    *exact = false;
+
+    const char *p = line + offset;
+    if (*p == '.')
+    {
+        char *end;
+        *time_us += strtol(p + 1, &end, 10);
+        *exact = true;
+        p = end;
+    }
+
+    int length = 0;
+    if ((sscanf(p, ",%lx,%3[A-Z],%3[A-Z],%d%n", &id, extd, rtr, &dlc, &length) != 4) || (length == 0) ||
+        (dlc < 0) || (dlc > TWAI_FRAME_MAX_DLC))
+    {
+        return -1;
+    }
+    memset(msg, 0, sizeof(*msg));
+    msg->identifier = id;
+    msg->extd = (strcmp(extd, "YES") == 0);
+    msg->rtr = (strcmp(rtr, "YES") == 0);
+    msg->data_length_code = dlc;
+
+    p += length;
+    for (int i = 0; i < dlc; i++)
+    {
+        unsigned int byte;
+        if (sscanf(p, ",0x%2x%n", &byte, &length) != 1)
+        {
+            return -1;
+        }
+        msg->data[i] = (uint8_t)byte;
+        p += length;
+    }
+    return 1;
+}
+
+/*
+ * ================================================================
+ * 					Readers
+ * ================================================================
+ *
+ * */
+static bool host_replay_read_line(host_replay_t *replay, twai_message_t *msg, int64_t *time_us, bool *exact)
+{
+    while (fgets(replay->line, sizeof(replay->line), replay->file) != NULL)
+    {
+        int result = (replay->format == HOST_REPLAY_SDIO_CSV) ? host_replay_parse_csv(replay->line, msg, time_us, exact)
+                                                               : host_replay_parse_candump(replay->line, msg, time_us);
+        if (result > 0)
+        {
+            return true;
+        }
+        if (result < 0)
+        {
+            replay->bad_lines++;
+        }
+    }
+    return false;
+}
+
+// SDIO_CAN.CSV only stamps whole seconds: rows of one second are spread evenly over it
+static bool host_replay_next_csv(host_replay_t *replay, twai_message_t *msg, int64_t *time_us)
+{
+    if (replay->group_next < replay->group_count)
+    {
+        *msg = replay->group[replay->group_next];
+        *time_us = replay->group_us + (int64_t)replay->group_next * 1000000 / replay->group_count;
+        replay->group_next++;
+        return true;
+    }
+
+    replay->group_count = 0;
+    replay->group_next = 0;
+    if (!replay->pending_valid &&
+        !host_replay_read_line(replay, &replay->pending, &replay->pending_us, &replay->pending_exact))
+    {
+        return false;
+    }
+    replay->pending_valid = false;
+    if (replay->pending_exact)
+    {
+        // Rows with µs timestamps are replayed as stamped
+        *msg = replay->pending;
+        *time_us = replay->pending_us;
+        return true;
+    }
+    replay->group_us = replay->pending_us;
+    replay->group[replay->group_count++] = replay->pending;
+
+    while (replay->group_count < HOST_REPLAY_GROUP_MAX)
+    {
+        if (!host_replay_read_line(replay, &replay->pending, &replay->pending_us, &replay->pending_exact))
+        {
+            break;
+        }
+        if (replay->pending_exact || (replay->pending_us != replay->group_us))
+        {
+            replay->pending_valid = true;
+            break;
+        }
+        replay->group[replay->group_count++] = replay->pending;
+    }
+    return host_replay_next_csv(replay, msg, time_us);
+}
+
+static bool host_replay_next(host_replay_t *replay, twai_message_t *msg, int64_t *time_us)
+{
+    bool exact;
+
+    switch (replay->format)
+    {
+    case HOST_REPLAY_BINARY:
+    {
+        telemetry_frame_t record;
+        if (fread(&record, sizeof(record), 1, replay->file) != 1)
+        {
+            return false;
+        }
+        *msg = record.msg;
+        *time_us = record.time_us;
+        return true;
+    }
+    case HOST_REPLAY_SDIO_CSV:
+        return host_replay_next_csv(replay, msg, time_us);
+    default:
+        return host_replay_read_line(replay, msg, time_us, &exact);
+    }
+}
+
+/*
+ * ================================================================
+ * 					Replay Task
+ * ================================================================
+ *
+ * */
+static void host_replay_task(void *pvParameters)
+{
+    host_replay_t *replay = (host_replay_t *)pvParameters;
+    twai_message_t msg;
+    int64_t record_us, first_record_us = 0;
+    int64_t start_us = esp_timer_get_time();
+    uint32_t sent = 0;
+
+    while (host_replay_next(replay, &msg, &record_us))
+    {
+        if (replay->speed > 0)
+        {
+            if (sent == 0)
+            {
+                first_record_us = record_us;
+            }
+            // Gaps below one tick are sent back to back, as the TWAI ISR would queue them
+            int64_t due_us = start_us + (int64_t)((double)(record_us - first_record_us) / replay->speed);
+            int64_t wait_us = due_us - esp_timer_get_time();
+            if (wait_us >= 1000)
+            {
+                vTaskDelay(pdMS_TO_TICKS(wait_us / 1000));
+            }
+            (void)host_twai_inject(&msg, 0); // A full RX queue loses the frame, as on the bus
+        }
+        else
+        {
+            (void)host_twai_inject(&msg, portMAX_DELAY);
+        }
+        sent++;
+    }
+    int64_t end_us = esp_timer_get_time();
+
+    ESP_LOGI(TAG, "Replay done: %lu frames, %lu unparsable lines", (unsigned long)sent, (unsigned long)replay->bad_lines);
+    fclose(replay->file);
+    host_can_source_report(replay->ring, sent, start_us, end_us);
+    vTaskDelete(NULL);
+}
+
+esp_err_t host_replay_start(const char *path, can_ring_t *ring)
+{
+    host_replay_t *replay = &host_replay;
+    const char *extension = strrchr(path, '.');
+    const char *speed = getenv("TELE_HOST_REPLAY_SPEED");
+
+    memset(replay, 0, sizeof(*replay));
+    replay->ring = ring;
+    replay->speed = ((speed != NULL) && (speed[0] != '\0')) ? strtod(speed, NULL) : HOST_REPLAY_DEFAULT_SPEED;
+    replay->format = HOST_REPLAY_CANDUMP;
+    if ((extension != NULL) && (strcasecmp(extension, ".csv") == 0))
+    {
+        replay->format = HOST_REPLAY_SDIO_CSV;
+    }
+    else if ((extension != NULL) && (strcasecmp(extension, ".bin") == 0))
+    {
+        replay->format = HOST_REPLAY_BINARY;
+    }
+
+    replay->file = fopen(path, (replay->format == HOST_REPLAY_BINARY) ? "rb" : "r");
+    if (replay->file == NULL)
+    {
+        ESP_LOGE(TAG, "Unable to open %s", path);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    static const char *const format_names[] = {"candump", "SDIO_CAN.CSV", "binary"};
+    if (replay->speed > 0)
+    {
+        ESP_LOGI(TAG, "Replaying %s (%s) at %.2fx", path, format_names[replay->format], replay->speed);
+    }
+    else
+    {
+        ESP_LOGI(TAG, "Replaying %s (%s) unthrottled", path, format_names[replay->format]);
+    }
+
+    if (xTaskCreate(host_replay_task, "host_replay", 4096, replay, 5, NULL) != pdPASS)
+    {
+        fclose(replay->file);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
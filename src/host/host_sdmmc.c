@@ -0,0 +1,117 @@
+/*
+ * host_sdmmc.c
+ *
+ *  Description: Directory-backed SD card of the host build. Mounting creates the directory
+ *               named by the mount point (relative to the working directory, see MOUNT_POINT),
+ *               logging.c then uses regular files in it. Mount a FAT image on that directory to
+ *               measure the file system itself (host/README.md).
+ */
+
+#include "esp_vfs_fat.h"
+#include "host_port.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+static const char *TAG = "host_sdmmc";
+static sdmmc_card_t host_card;
+
+esp_err_t esp_vfs_fat_sdmmc_mount(const char *base_path, const sdmmc_host_t *host_config, const void *slot_config,
+                                  const esp_vfs_fat_sdmmc_mount_config_t *mount_config, sdmmc_card_t **out_card)
+{
+    (void)host_config;
+    (void)slot_config;
+    (void)mount_config;
+
+    if (host_sdmmc_fault())
+    {
+        ESP_LOGE(TAG, "Injected fault: no card");
+        return ESP_FAIL;
+    }
+    if ((mkdir(base_path, 0775) != 0) && (errno != EEXIST))
+    {
+        ESP_LOGE(TAG, "Unable to create %s (errno %d)", base_path, errno);
+        return ESP_FAIL;
+    }
+
+    host_card.path = base_path;
+    host_card.csd.sector_size = 512;
+    host_card.csd.capacity = 0;
+    if (out_card != NULL)
+    {
+        *out_card = &host_card;
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_vfs_fat_sdcard_unmount(const char *base_path, sdmmc_card_t *card)
+{
+    (void)base_path;
+    (void)card;
+    return ESP_OK;
+}
+
+esp_err_t esp_vfs_fat_create_contiguous_file(const char *base_path, const char *full_path, uint64_t size, bool alloc_now)
+{
+    (void)base_path;
+
+    int fd = open(full_path, O_WRONLY | O_CREAT | O_TRUNC, 0664);
+    if (fd < 0)
+    {
+        return ESP_FAIL;
+    }
+    // As f_expand: the file is size bytes long once allocated
+    int err = alloc_now ? posix_fallocate(fd, 0, (off_t)size) : 0;
+    if ((err != 0) && (ftruncate(fd, (off_t)size) == 0))
+    {
+        ESP_LOGW(TAG, "posix_fallocate: error %d, %s extended without reservation", err, full_path);
+        err = 0;
+    }
+    close(fd);
+    return (err == 0) ? ESP_OK : ESP_FAIL;
+}
+
+uint32_t host_sdmmc_preallocate(uint32_t firmware_default)
+{
+    const char *mib = getenv("TELE_HOST_PREALLOC");
+    return ((mib != NULL) && (mib[0] != '\0')) ? (uint32_t)strtoul(mib, NULL, 0) * 1024u * 1024u : firmware_default;
+}
+
+uint8_t host_sdmmc_codec(uint8_t firmware_default)
+{
+    const char *codec = getenv("TELE_HOST_CODEC");
+    return ((codec != NULL) && (codec[0] != '\0')) ? (uint8_t)strtoul(codec, NULL, 0) : firmware_default;
+}
+
+bool host_sdmmc_fault(void)
+{
+    static int64_t start_us = -1; // Fault window in esp_timer time, parsed on the first call
+    static int64_t end_us = -1;
+    static bool parsed;
+
+    if (!parsed)
+    {
+        const char *fault = getenv("TELE_HOST_SD_FAULT");
+        char *rest;
+        parsed = true;
+        if ((fault != NULL) && (fault[0] != '\0'))
+        {
+            double at_s = strtod(fault, &rest);
+            double for_s = (*rest == ':') ? strtod(rest + 1, NULL) : 1.0;
+            start_us = (int64_t)(at_s * 1e6);
+            end_us = start_us + (int64_t)(for_s * 1e6);
+            ESP_LOGW(TAG, "Card fault from %.1f s to %.1f s", at_s, at_s + for_s);
+        }
+    }
+    int64_t now_us = esp_timer_get_time();
+    return (now_us >= start_us) && (now_us < end_us);
+}
+
+void sdmmc_card_print_info(FILE *stream, const sdmmc_card_t *card)
+{
+    fprintf(stream, "Name: host directory\nPath: %s\n", (card != NULL) ? card->path : "-");
+}
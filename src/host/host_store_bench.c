@@ -0,0 +1,203 @@
+/*
+ * host_store_bench.c
+ *
+ *  Description: Reader / writer contention benchmark of signal_store, run instead of the pipeline
+ *               when TELE_HOST_STORE_BENCH sets its duration. The writer runs pinned to CPU 0 like
+ *               CAN_Receive_Task on core 1, the readers alternate between CPU 1 and CPU 0, so both
+ *               the cross-core and the same-core cases are covered. The writer first runs alone,
+ *               then with the readers, and the write rates of both phases are compared.
+ *      Note: The FreeRTOS port of the linux target runs one task at a time, so the threads of
+ *            this benchmark are plain pthreads: only they make the seqlock race for real.
+ *            Every written frame carries its write count in every data byte and in the
+ *            timestamp, so a torn copy is detected by the readers (must stay 0).
+ */
+
+#define _GNU_SOURCE
+#include "host_port.h"
+#include "signal_store/signal_store.h"
+#include "esp_log.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static const char *TAG = "host_store_bench";
+
+typedef struct
+{
+    pthread_t thread;
+    int cpu;
+    uint64_t reads;   // Consistent copies
+    uint64_t busy;    // Reads abandoned after SIGNAL_STORE_MAX_RETRIES
+    uint64_t retries; // Copies discarded because the writer was active
+    uint64_t torn;    // Copies whose payload mixes two writes
+} host_store_reader_t;
+
+typedef struct
+{
+    uint64_t writes;
+    double seconds;
+} host_store_phase_t;
+
+static signal_store_t host_store;
+static atomic_bool host_store_running;
+
+static double host_store_now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void host_store_pin(int cpu)
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+    {
+        ESP_LOGW(TAG, "Unable to pin thread to CPU %d", cpu);
+    }
+}
+
+static void *host_store_reader(void *arg)
+{
+    host_store_reader_t *reader = (host_store_reader_t *)arg;
+    signal_store_value_t value;
+
+    host_store_pin(reader->cpu);
+    while (atomic_load_explicit(&host_store_running, memory_order_relaxed))
+    {
+        for (uint16_t slot = 0; slot < host_store.count; slot++)
+        {
+            bool ok = signal_store_read(&host_store, slot, &value);
+            reader->retries += value.retries;
+            if (!ok)
+            {
+                reader->busy += (value.retries >= SIGNAL_STORE_MAX_RETRIES);
+                continue;
+            }
+            reader->reads++;
+
+            uint8_t expected = (uint8_t)value.timestamp_us;
+            bool torn = (value.msg.identifier != slot) || (value.msg.data_length_code != 8);
+            for (uint8_t i = 0; i < 8; i++)
+            {
+                torn |= (value.msg.data[i] != expected);
+            }
+            reader->torn += torn;
+        }
+    }
+    return NULL;
+}
+
+// Writes every slot in turn for seconds, like a bus carrying every registered message
+static void host_store_write_phase(double seconds, host_store_phase_t *phase)
+{
+    twai_message_t msg = {.data_length_code = 8};
+    uint64_t count = 0;
+    double start = host_store_now_s();
+    double end = start + seconds;
+
+    do
+    {
+        for (uint32_t n = 0; n < 4096; n++)
+        {
+            uint16_t slot = (uint16_t)(count % host_store.count);
+            msg.identifier = slot;
+            memset(msg.data, (uint8_t)count, sizeof(msg.data));
+            signal_store_write(&host_store, slot, &msg, (int64_t)count);
+            count++;
+        }
+    } while (host_store_now_s() < end);
+
+    phase->writes = count;
+    phase->seconds = host_store_now_s() - start;
+}
+
+static void host_store_write_json(FILE *f, const host_store_phase_t *alone, const host_store_phase_t *contended,
+                                  const host_store_reader_t *readers, int reader_count)
+{
+    fprintf(f, "{\n  \"store_bench\": {\n");
+    fprintf(f, "    \"slots\": %u,\n    \"readers\": %d,\n", (unsigned)host_store.count, reader_count);
+    fprintf(f, "    \"writes_per_s_alone\": %.0f,\n", alone->writes / alone->seconds);
+    fprintf(f, "    \"writes_per_s_contended\": %.0f,\n", contended->writes / contended->seconds);
+    fprintf(f, "    \"reader\": [\n");
+    for (int i = 0; i < reader_count; i++)
+    {
+        const host_store_reader_t *r = &readers[i];
+        fprintf(f, "      {\"cpu\": %d, \"reads_per_s\": %.0f, \"retries\": %llu, \"busy\": %llu, \"torn\": %llu}%s\n",
+                r->cpu, r->reads / contended->seconds, (unsigned long long)r->retries,
+                (unsigned long long)r->busy, (unsigned long long)r->torn, (i + 1 < reader_count) ? "," : "");
+    }
+    fprintf(f, "    ]\n  }\n}\n");
+}
+
+/**================================================================
+ * @Fn				- host_store_bench_run
+ * @breif			- Runs the signal store contention benchmark if TELE_HOST_STORE_BENCH is set
+ * @param [in]		- None
+ * @retval			- None, exits the process once the results are written
+ */
+void host_store_bench_run(void)
+{
+    const char *duration = getenv("TELE_HOST_STORE_BENCH");
+    if (duration == NULL)
+    {
+        return;
+    }
+    double seconds = atof(duration);
+    const char *env = getenv("TELE_HOST_STORE_READERS");
+    int reader_count = (env != NULL) ? atoi(env) : HOST_STORE_BENCH_READERS;
+    if ((seconds <= 0) || (reader_count < 1) || (reader_count > HOST_STORE_BENCH_MAX_READERS))
+    {
+        ESP_LOGE(TAG, "Invalid TELE_HOST_STORE_BENCH / TELE_HOST_STORE_READERS");
+        exit(1);
+    }
+
+    static host_store_reader_t readers[HOST_STORE_BENCH_MAX_READERS];
+    host_store_phase_t alone, contended;
+    signal_store_init(&host_store, SIGNAL_STORE_MAX_SLOTS);
+    host_store_pin(0);
+
+    host_store_write_phase(seconds, &alone);
+
+    atomic_store(&host_store_running, true);
+    for (int i = 0; i < reader_count; i++)
+    {
+        readers[i].cpu = (i % 2 == 0) ? 1 : 0;
+        pthread_create(&readers[i].thread, NULL, host_store_reader, &readers[i]);
+    }
+    host_store_write_phase(seconds, &contended);
+    atomic_store(&host_store_running, false);
+    for (int i = 0; i < reader_count; i++)
+    {
+        pthread_join(readers[i].thread, NULL);
+    }
+
+    uint64_t torn = 0;
+    for (int i = 0; i < reader_count; i++)
+    {
+        torn += readers[i].torn;
+    }
+    ESP_LOGI(TAG, "Writes/s alone: %.0f, with %d readers: %.0f, torn copies: %llu",
+             alone.writes / alone.seconds, reader_count, contended.writes / contended.seconds,
+             (unsigned long long)torn);
+
+    const char *path = getenv("TELE_HOST_BENCH");
+    FILE *f = (path != NULL) ? fopen(path, "w") : stdout;
+    if (f == NULL)
+    {
+        ESP_LOGE(TAG, "Unable to write %s", path);
+        exit(1);
+    }
+    host_store_write_json(f, &alone, &contended, readers, reader_count);
+    if (f != stdout)
+    {
+        fclose(f);
+    }
+    exit((torn == 0) ? 0 : 1);
+}
@@ -0,0 +1,161 @@
+/*
+ * host_time_bench.c
+ *
+ *  Description: Row timestamp benchmark, run instead of the pipeline when TELE_HOST_TIME_BENCH
+ *               gives a number of calls. Times per call of Time_Sync_get_rtc_time_str (time +
+ *               localtime_r with the firmware TZ + strftime, 1 s resolution),
+ *               Time_Sync_format_utc_us (gmtime_r + strftime on every call) and
+ *               Time_Sync_stamp_format with its cached second, for rows 1 ms apart and for the
+ *               worst case of a new second on every row. The cached stamps are first checked
+ *               against gmtime_r + strftime + snprintf over random steps (backward jumps
+ *               included). Results in ns per call are written as JSON.
+ *      Note: Times are of the host CPU and glibc; newlib's localtime_r parses TZ on every call.
+ */
+
+#include "host_port.h"
+#include "RTC_Time_Sync/rtc_time_sync.h"
+#include "esp_log.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define HOST_TIME_EPOCH_US 1750595696000000ll // 2025-06-22 12:34:56 UTC
+#define HOST_TIME_ROW_US 1000 // Row period of the cached case
+#define HOST_TIME_CHECKS 1000000 // Random timestamps compared with the reference
+
+static const char *TAG = "host_time_bench";
+
+static double host_time_now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+// Reference: the stamp formatted from scratch
+static void host_time_reference(int64_t epoch_us, uint8_t digits, char *buffer, size_t max_len)
+{
+    time_t seconds = (time_t)(epoch_us / 1000000);
+    long fraction = (long)(epoch_us % 1000000);
+    struct tm timeinfo;
+    gmtime_r(&seconds, &timeinfo);
+    size_t len = strftime(buffer, max_len, "%Y-%m-%d %H:%M:%S", &timeinfo);
+    if (digits == TIME_SYNC_STAMP_US)
+    {
+        snprintf(buffer + len, max_len - len, ".%06ld", fraction);
+    }
+    else if (digits == TIME_SYNC_STAMP_MS)
+    {
+        snprintf(buffer + len, max_len - len, ".%03ld", fraction / 1000);
+    }
+}
+
+// Cached stamps of random timestamps (steps of up to 2 s forward, one in 64 backward)
+static uint32_t host_time_check(void)
+{
+    Time_Sync_stamp_t stamp = {0};
+    uint32_t mismatches = 0;
+    int64_t epoch_us = HOST_TIME_EPOCH_US;
+    srand(1);
+    for (uint32_t i = 0; i < HOST_TIME_CHECKS; i++)
+    {
+        int64_t step = (int64_t)(rand() % 2000000);
+        epoch_us += ((rand() & 63) == 0) ? -step : step;
+        uint8_t digits = (i % 3 == 0) ? 0 : ((i % 3 == 1) ? TIME_SYNC_STAMP_MS : TIME_SYNC_STAMP_US);
+        char cached[TIME_SYNC_STAMP_SIZE];
+        char expected[TIME_SYNC_STAMP_SIZE];
+        int len = Time_Sync_stamp_format(&stamp, epoch_us, digits, cached, sizeof(cached));
+        host_time_reference(epoch_us, digits, expected, sizeof(expected));
+        if ((len != (int)strlen(expected)) || (strcmp(cached, expected) != 0))
+        {
+            if (mismatches++ == 0)
+            {
+                ESP_LOGE(TAG, "%lld: %s instead of %s", (long long)epoch_us, cached, expected);
+            }
+        }
+    }
+    return mismatches;
+}
+
+/**================================================================
+ * @Fn				- host_time_bench_run
+ * @breif			- Runs the timestamp benchmark if TELE_HOST_TIME_BENCH is set
+ * @param [in]		- None
+ * @retval			- None, exits the process once the results are written
+ */
+void host_time_bench_run(void)
+{
+    const char *env = getenv("TELE_HOST_TIME_BENCH");
+    if ((env == NULL) || (env[0] == '\0'))
+    {
+        return;
+    }
+    uint32_t calls = (uint32_t)strtoul(env, NULL, 0);
+    if (calls == 0)
+    {
+        calls = 1000000;
+    }
+    setenv("TZ", "GMT-3", 1); // As Time_Sync_obtain_time
+    tzset();
+
+    uint32_t mismatches = host_time_check();
+    char buffer[TIME_SYNC_STAMP_SIZE];
+    uint64_t sink = 0; // Keeps the calls from being optimised out
+
+    double start = host_time_now_s();
+    for (uint32_t i = 0; i < calls; i++)
+    {
+        sink += Time_Sync_get_rtc_time_str(buffer, sizeof(buffer));
+    }
+    double rtc_ns = (host_time_now_s() - start) * 1e9 / calls;
+
+    start = host_time_now_s();
+    for (uint32_t i = 0; i < calls; i++)
+    {
+        sink += Time_Sync_format_utc_us((int64_t)i * HOST_TIME_ROW_US, buffer, sizeof(buffer));
+    }
+    double utc_ns = (host_time_now_s() - start) * 1e9 / calls;
+
+    Time_Sync_stamp_t stamp = {0};
+    start = host_time_now_s();
+    for (uint32_t i = 0; i < calls; i++)
+    {
+        sink += Time_Sync_stamp_format(&stamp, HOST_TIME_EPOCH_US + (int64_t)i * HOST_TIME_ROW_US, TIME_SYNC_STAMP_US,
+                                       buffer, sizeof(buffer));
+    }
+    double cached_ns = (host_time_now_s() - start) * 1e9 / calls;
+
+    memset(&stamp, 0, sizeof(stamp));
+    start = host_time_now_s();
+    for (uint32_t i = 0; i < calls; i++)
+    {
+        sink += Time_Sync_stamp_format(&stamp, HOST_TIME_EPOCH_US + (int64_t)i * 1000000, TIME_SYNC_STAMP_US,
+                                       buffer, sizeof(buffer));
+    }
+    double rollover_ns = (host_time_now_s() - start) * 1e9 / calls;
+
+    ESP_LOGI(TAG, "%lu calls: rtc_time_str %.0f ns, format_utc_us %.0f ns, cached stamp %.0f ns (new second %.0f ns), %lu mismatches (%llu)",
+             (unsigned long)calls, rtc_ns, utc_ns, cached_ns, rollover_ns, (unsigned long)mismatches,
+             (unsigned long long)(sink & 1));
+
+    const char *out_path = getenv("TELE_HOST_BENCH");
+    FILE *out = ((out_path != NULL) && (out_path[0] != '\0')) ? fopen(out_path, "w") : stdout;
+    if (out == NULL)
+    {
+        ESP_LOGE(TAG, "Unable to write %s", out_path);
+        exit(1);
+    }
+    fprintf(out, "{\n  \"time\": {\n    \"calls\": %lu,\n    \"checked\": %lu,\n    \"mismatches\": %lu,\n",
+            (unsigned long)calls, (unsigned long)HOST_TIME_CHECKS, (unsigned long)mismatches);
+    fprintf(out, "    \"rtc_time_str\": {\"ns_per_call\": %.1f, \"resolution_us\": 1000000},\n", rtc_ns);
+    fprintf(out, "    \"format_utc_us\": {\"ns_per_call\": %.1f, \"resolution_us\": 1},\n", utc_ns);
+    fprintf(out, "    \"stamp_cached\": {\"ns_per_call\": %.1f, \"resolution_us\": 1, \"row_us\": %d},\n", cached_ns,
+            HOST_TIME_ROW_US);
+    fprintf(out, "    \"stamp_new_second\": {\"ns_per_call\": %.1f, \"resolution_us\": 1}\n  }\n}\n", rollover_ns);
+    if (out != stdout)
+    {
+        fclose(out);
+    }
+    exit((mismatches == 0) ? 0 : 1);
+}
@@ -0,0 +1,175 @@
+/*
+ * host_twai.c
+ *
+ *  Description: Mock TWAI driver of the host build. The RX queue has the configured
+ *               rx_queue_len and the acceptance filter is applied with the same model the
+ *               firmware uses to compute it (can_filter_accepts), so queue overflows and
+ *               filtering behave as on the target. Queued frames carry their injection time,
+ *               twai_receive records the RX queue latency (PIPELINE_STAGE_RX_QUEUE).
+ */
+
+#include "driver/twai.h"
+#include "host_port.h"
+#include "freertos/queue.h"
+#include "can_filter/can_filter.h"
+#include "pipeline_stats/pipeline_stats.h"
+#include "esp_timer.h"
+#include <stdatomic.h>
+
+typedef struct
+{
+    twai_message_t msg;
+    int64_t queued_us;
+} host_twai_item_t;
+
+static QueueHandle_t host_twai_rx_queue = NULL;
+static twai_filter_config_t host_twai_filter;
+static _Atomic twai_state_t host_twai_state = TWAI_STATE_STOPPED;
+static _Atomic uint32_t host_twai_rx_missed;
+static _Atomic uint32_t host_twai_hw_filtered;
+static _Atomic uint32_t host_twai_queued;
+static _Atomic uint32_t host_twai_rx_hwm;
+
+/*
+ * ================================================================
+ * 					Host Bus Side
+ * ================================================================
+ *
+ * */
+esp_err_t host_twai_inject(const twai_message_t *msg, TickType_t ticks_to_wait)
+{
+    if ((host_twai_rx_queue == NULL) || (host_twai_state != TWAI_STATE_RUNNING))
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (!can_filter_accepts(&host_twai_filter, msg->identifier, msg->extd))
+    {
+        atomic_fetch_add(&host_twai_hw_filtered, 1);
+        return ESP_OK; // Rejected by the hardware filter, invisible to the firmware
+    }
+    host_twai_item_t item = {.msg = *msg, .queued_us = esp_timer_get_time()};
+    if (xQueueSend(host_twai_rx_queue, &item, ticks_to_wait) != pdPASS)
+    {
+        atomic_fetch_add(&host_twai_rx_missed, 1);
+        return ESP_ERR_TIMEOUT;
+    }
+    atomic_fetch_add(&host_twai_queued, 1);
+
+    uint32_t waiting = uxQueueMessagesWaiting(host_twai_rx_queue);
+    if (waiting > host_twai_rx_hwm)
+    {
+        host_twai_rx_hwm = waiting; // Single injecting task
+    }
+    return ESP_OK;
+}
+
+void host_twai_get_counters(host_twai_counters_t *counters)
+{
+    counters->queued = host_twai_queued;
+    counters->hw_filtered = host_twai_hw_filtered;
+    counters->rx_missed = host_twai_rx_missed;
+    counters->rx_hwm = host_twai_rx_hwm;
+    counters->msgs_to_rx = (host_twai_rx_queue != NULL) ? uxQueueMessagesWaiting(host_twai_rx_queue) : 0;
+}
+
+/*
+ * ================================================================
+ * 					TWAI Driver API
+ * ================================================================
+ *
+ * */
+esp_err_t twai_driver_install(const twai_general_config_t *g_config, const twai_timing_config_t *t_config,
+                              const twai_filter_config_t *f_config)
+{
+    (void)t_config;
+    if (host_twai_rx_queue != NULL)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    host_twai_rx_queue = xQueueCreate(g_config->rx_queue_len, sizeof(host_twai_item_t));
+    if (host_twai_rx_queue == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    host_twai_filter = *f_config;
+    host_twai_rx_missed = 0;
+    host_twai_hw_filtered = 0;
+    host_twai_queued = 0;
+    host_twai_rx_hwm = 0;
+    host_twai_state = TWAI_STATE_STOPPED;
+    return ESP_OK;
+}
+
+esp_err_t twai_driver_uninstall(void)
+{
+    if ((host_twai_rx_queue == NULL) || (host_twai_state != TWAI_STATE_STOPPED))
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    vQueueDelete(host_twai_rx_queue);
+    host_twai_rx_queue = NULL;
+    return ESP_OK;
+}
+
+esp_err_t twai_start(void)
+{
+    if ((host_twai_rx_queue == NULL) || (host_twai_state != TWAI_STATE_STOPPED))
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    host_twai_state = TWAI_STATE_RUNNING;
+    return ESP_OK;
+}
+
+esp_err_t twai_stop(void)
+{
+    if (host_twai_state != TWAI_STATE_RUNNING)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    host_twai_state = TWAI_STATE_STOPPED;
+    return ESP_OK;
+}
+
+esp_err_t twai_transmit(const twai_message_t *message, TickType_t ticks_to_wait)
+{
+    // Self reception requests loop back, every other frame is "sent" on an ideal bus
+    return message->self ? host_twai_inject(message, ticks_to_wait) : ESP_OK;
+}
+
+esp_err_t twai_receive(twai_message_t *message, TickType_t ticks_to_wait)
+{
+    if (host_twai_rx_queue == NULL)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    host_twai_item_t item;
+    if (xQueueReceive(host_twai_rx_queue, &item, ticks_to_wait) != pdPASS)
+    {
+        return ESP_ERR_TIMEOUT;
+    }
+    *message = item.msg;
+    pipeline_stats_record(&CAN_pipeline_stats, PIPELINE_STAGE_RX_QUEUE, esp_timer_get_time() - item.queued_us);
+    return ESP_OK;
+}
+
+esp_err_t twai_read_alerts(uint32_t *alerts, TickType_t ticks_to_wait)
+{
+    *alerts = 0;
+    vTaskDelay(ticks_to_wait); // No bus errors on the mock bus
+    return ESP_ERR_TIMEOUT;
+}
+
+esp_err_t twai_get_status_info(twai_status_info_t *status_info)
+{
+    if (host_twai_rx_queue == NULL)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    *status_info = (twai_status_info_t){
+        .state = host_twai_state,
+        .msgs_to_rx = uxQueueMessagesWaiting(host_twai_rx_queue),
+        .rx_missed_count = host_twai_rx_missed,
+    };
+    return ESP_OK;
+}
@@ -0,0 +1,44 @@
+/*
+ * host_wifi.c
+ *
+ *  Description: wifi_manager API of the host build. The host network is always up:
+ *               WIFI_CONNECTED_BIT is set by wifi_init and reconnect requests are only logged.
+ */
+
+#include "wifi_manager/wifi_manager.h"
+#include "esp_log.h"
+
+static const char *TAG = "host_wifi";
+static EventGroupHandle_t s_wifi_event_group;
+
+esp_err_t wifi_init(const char *ssid, const char *password)
+{
+    (void)password;
+    if (!s_wifi_event_group) {
+        s_wifi_event_group = xEventGroupCreate();
+        if (!s_wifi_event_group) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    ESP_LOGI(TAG, "Host network used instead of \"%s\"", ssid);
+    xEventGroupSetBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
+    return ESP_OK;
+}
+
+EventGroupHandle_t wifi_event_group(void)
+{
+    return s_wifi_event_group;
+}
+
+esp_netif_ip_info_t wifi_get_ip_info(void)
+{
+    esp_netif_ip_info_t info = {0};
+    info.ip.addr = esp_netif_htonl(0x7F000001); // 127.0.0.1
+    info.netmask.addr = esp_netif_htonl(0xFF000000);
+    return info;
+}
+
+void wifi_force_reconnect(void)
+{
+    ESP_LOGW(TAG, "Reconnect requested, the host network has no link to restore");
+}
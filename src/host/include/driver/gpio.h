@@ -0,0 +1,24 @@
+/*
+ * gpio.h (host build)
+ *
+ *  Description: GPIO numbers used in the configuration structures, there is no GPIO on the host.
+ */
+
+#ifndef HOST_DRIVER_GPIO_H
+#define HOST_DRIVER_GPIO_H
+
+typedef enum
+{
+	GPIO_NUM_NC = -1,
+	GPIO_NUM_0 = 0,
+	GPIO_NUM_2 = 2,
+	GPIO_NUM_4 = 4,
+	GPIO_NUM_12 = 12,
+	GPIO_NUM_13 = 13,
+	GPIO_NUM_14 = 14,
+	GPIO_NUM_15 = 15,
+	GPIO_NUM_21 = 21,
+	GPIO_NUM_22 = 22,
+} gpio_num_t;
+
+#endif // HOST_DRIVER_GPIO_H
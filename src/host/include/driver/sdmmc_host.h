@@ -0,0 +1,38 @@
+/*
+ * sdmmc_host.h (host build)
+ *
+ *  Description: SDMMC host and slot configuration, accepted and ignored by the directory-backed
+ *               card of host_sdmmc.c.
+ */
+
+#ifndef HOST_DRIVER_SDMMC_HOST_H
+#define HOST_DRIVER_SDMMC_HOST_H
+
+#include <stdint.h>
+
+#define SDMMC_HOST_SLOT_0 0
+#define SDMMC_HOST_SLOT_1 1
+#define SDMMC_FREQ_DEFAULT 20000
+#define SDMMC_FREQ_HIGHSPEED 40000
+#define SDMMC_FREQ_SDR50 100000
+#define SDMMC_FREQ_DDR50 50000
+#define SDMMC_HOST_FLAG_DDR (1 << 3)
+#define SDMMC_SLOT_FLAG_INTERNAL_PULLUP (1 << 0)
+
+typedef struct
+{
+	uint32_t flags;
+	int slot;
+	int max_freq_khz;
+} sdmmc_host_t;
+
+typedef struct
+{
+	uint8_t width;
+	uint32_t flags;
+} sdmmc_slot_config_t;
+
+#define SDMMC_HOST_DEFAULT() {.flags = 0, .slot = SDMMC_HOST_SLOT_1, .max_freq_khz = SDMMC_FREQ_DEFAULT}
+#define SDMMC_SLOT_CONFIG_DEFAULT() {.width = 0, .flags = 0}
+
+#endif // HOST_DRIVER_SDMMC_HOST_H
@@ -0,0 +1,37 @@
+/*
+ * esp_heap_caps.h (host build)
+ *
+ *  Description: Heap statistics used in the senders' periodic logs, and the allocations of the
+ *               SD writer pools. The host heap is not capability based: the free size is
+ *               reported as 0 (unknown) and the capabilities of an allocation are ignored.
+ */
+
+#ifndef HOST_ESP_HEAP_CAPS_H
+#define HOST_ESP_HEAP_CAPS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define MALLOC_CAP_8BIT (1 << 2)
+#define MALLOC_CAP_INTERNAL (1 << 11)
+#define MALLOC_CAP_DEFAULT (1 << 12)
+
+static inline size_t heap_caps_get_free_size(uint32_t caps)
+{
+	(void)caps;
+	return 0;
+}
+
+static inline void *heap_caps_malloc(size_t size, uint32_t caps)
+{
+	(void)caps;
+	return malloc(size);
+}
+
+static inline void heap_caps_free(void *ptr)
+{
+	free(ptr);
+}
+
+#endif // HOST_ESP_HEAP_CAPS_H
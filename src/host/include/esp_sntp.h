@@ -0,0 +1,29 @@
+/*
+ * esp_sntp.h (host build)
+ *
+ *  Description: SNTP API used by RTC_Time_Sync. The host clock is already synchronized,
+ *               so every call is a no-op and the status reports a completed sync.
+ */
+
+#ifndef HOST_ESP_SNTP_H
+#define HOST_ESP_SNTP_H
+
+typedef enum
+{
+	SNTP_OPMODE_POLL,
+	SNTP_OPMODE_LISTENONLY,
+} esp_sntp_operatingmode_t;
+
+typedef enum
+{
+	SNTP_SYNC_STATUS_RESET,
+	SNTP_SYNC_STATUS_COMPLETED,
+	SNTP_SYNC_STATUS_IN_PROGRESS,
+} sntp_sync_status_t;
+
+static inline void esp_sntp_setoperatingmode(esp_sntp_operatingmode_t operating_mode) { (void)operating_mode; }
+static inline void esp_sntp_setservername(unsigned char idx, const char *server) { (void)idx; (void)server; }
+static inline void esp_sntp_init(void) {}
+static inline sntp_sync_status_t sntp_get_sync_status(void) { return SNTP_SYNC_STATUS_COMPLETED; }
+
+#endif // HOST_ESP_SNTP_H
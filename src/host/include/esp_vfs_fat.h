@@ -0,0 +1,32 @@
+/*
+ * esp_vfs_fat.h (host build)
+ *
+ *  Description: FAT / SDMMC mount API of the directory-backed card (host_sdmmc.c). The mount point
+ *               is a plain host directory, files are accessed with the C library as on the target.
+ *               Contiguous files are reserved with posix_fallocate (f_expand on the target).
+ */
+
+#ifndef HOST_ESP_VFS_FAT_H
+#define HOST_ESP_VFS_FAT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "driver/sdmmc_host.h"
+#include "sdmmc_cmd.h"
+
+typedef struct
+{
+	bool format_if_mount_failed;
+	int max_files;
+	size_t allocation_unit_size;
+	bool disk_status_check_enable;
+} esp_vfs_fat_sdmmc_mount_config_t;
+
+esp_err_t esp_vfs_fat_sdmmc_mount(const char *base_path, const sdmmc_host_t *host_config, const void *slot_config,
+								  const esp_vfs_fat_sdmmc_mount_config_t *mount_config, sdmmc_card_t **out_card);
+esp_err_t esp_vfs_fat_sdcard_unmount(const char *base_path, sdmmc_card_t *card);
+esp_err_t esp_vfs_fat_create_contiguous_file(const char *base_path, const char *full_path, uint64_t size, bool alloc_now);
+
+#endif // HOST_ESP_VFS_FAT_H
@@ -0,0 +1,12 @@
+/*
+ * esp_wifi.h (host build)
+ *
+ *  Description: Wi-Fi is not used on the host, the wifi_manager API is provided by host_wifi.c.
+ */
+
+#ifndef HOST_ESP_WIFI_H
+#define HOST_ESP_WIFI_H
+
+#include "esp_err.h"
+
+#endif // HOST_ESP_WIFI_H
@@ -0,0 +1,16 @@
+/*
+ * ff.h (host build)
+ *
+ *  Description: FatFs integer types referenced by rtc_time_sync.h.
+ */
+
+#ifndef HOST_FF_H
+#define HOST_FF_H
+
+#include <stdint.h>
+
+typedef uint32_t DWORD;
+typedef uint16_t WORD;
+typedef uint8_t BYTE;
+
+#endif // HOST_FF_H
@@ -0,0 +1,127 @@
+/*
+ * host_port.h
+ *
+ *  Description: Host (linux target) stand-ins for the ESP32-only parts of the pipeline:
+ *               mock TWAI driver fed by a CAN source, directory-backed /sdcard and an always
+ *               connected Wi-Fi. Only compiled in the host build (see host/README.md).
+ *      Environment:
+ *               TELE_HOST_CAN_HZ  - Generator rate of every schema message in Hz (default: 100)
+ *               TELE_HOST_CAN_RUN - Generator duration in seconds, 0 = endless (default: 0)
+ *               TELE_HOST_CAN_MIX - Generator ID mix "id:hz,id:hz" instead of the schema messages
+ *               TELE_HOST_REPLAY  - Recorded log replayed instead of the generator (candump -l,
+ *                                   SDIO_CAN.CSV or .bin telemetry_frame_t records)
+ *               TELE_HOST_REPLAY_SPEED - Replay speed, 1 = real time, N = N times faster,
+ *                                   0 = unthrottled (default: 1)
+ *               TELE_HOST_BENCH   - JSON results file written when the source ends, the process
+ *                                   then exits (scripts/can_bench.py)
+ *               TELE_HOST_STORE_BENCH - Seconds per phase of the signal store contention benchmark,
+ *                                   run instead of the pipeline (results to TELE_HOST_BENCH or stdout)
+ *               TELE_HOST_STORE_READERS - Reader threads of that benchmark (default: 2)
+ *               TELE_HOST_PREALLOC - MiB preallocated for a new log file, 0 = none
+ *                                   (default: SDIO_LOG_PREALLOCATE)
+ *               TELE_HOST_CODEC   - Stages of the .BIN blocks: 0 = none, 1 = LZSS, 2 = record
+ *                                   deltas, 3 = both (default: SDIO_LOG_CODEC)
+ *               TELE_HOST_CODEC_BENCH - Recorded log (.BIN or any file) whose blocks are coded and
+ *                                   restored by every codec instead of running the pipeline
+ *                                   (results to TELE_HOST_BENCH or stdout)
+ *               TELE_HOST_FORMAT_BENCH - Synthetic .CSV rows formatted by the row builder and by
+ *                                   snprintf instead of running the pipeline (results to
+ *                                   TELE_HOST_BENCH or stdout)
+ *               TELE_HOST_TIME_BENCH - Calls of each row timestamp formatter timed instead of
+ *                                   running the pipeline (results to TELE_HOST_BENCH or stdout)
+ *               TELE_HOST_DISPATCH_BENCH - Calls of each CAN ID lookup (dispatch table and switch)
+ *                                   timed instead of running the pipeline (results to
+ *                                   TELE_HOST_BENCH or stdout)
+ *               TELE_HOST_SD_FAULT - "at_s:for_s": the card fails at_s seconds after start for
+ *                                   for_s seconds (writes, syncs and mounts fail)
+ */
+
+#ifndef HOST_PORT_H
+#define HOST_PORT_H
+
+//==================================Standard Libraries Includes=======================//
+#include <stdint.h>
+#include <stdbool.h>
+
+//==================================ESP32 Libraries Includes==========================//
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "driver/twai.h"
+#include "can_ring/can_ring.h"
+
+//----------------------------
+// Host Macros
+//----------------------------
+#define HOST_CAN_DEFAULT_HZ 100
+#define HOST_CAN_MIX_MAX 32 // Generator streams (IDs of TELE_HOST_CAN_MIX)
+#define HOST_REPLAY_DEFAULT_SPEED 1.0
+#define HOST_REPLAY_GROUP_MAX 4096 // SDIO_CAN.CSV rows sharing one second, spread evenly over it
+#define HOST_REPORT_DRAIN_MS 5000  // Longest wait for the sinks to catch up before the report
+#define HOST_STORE_BENCH_READERS 2
+#define HOST_STORE_BENCH_MAX_READERS 16
+
+//===============================================
+// User type definitions (structures)
+//===============================================
+
+typedef struct
+{
+    uint32_t queued;      // Frames accepted into the RX queue
+    uint32_t hw_filtered; // Frames rejected by the acceptance filter
+    uint32_t rx_missed;   // Frames lost on a full RX queue
+    uint32_t msgs_to_rx;  // Frames waiting in the RX queue
+    uint32_t rx_hwm;      // High-water mark of the RX queue
+} host_twai_counters_t;
+
+// End of source results, logged and written by host_bench_write
+typedef struct
+{
+    const can_ring_t *ring;
+    host_twai_counters_t twai;
+    uint32_t sent;      // Frames produced by the source
+    uint32_t published; // Frames written to the ring by CAN_Receive_Task
+    double source_s;    // Duration of the source
+    double sink_s;      // Source start until the sinks drained
+} host_bench_result_t;
+
+//===============================================
+// APIs Supported by "HOST PORT"
+//===============================================
+
+// Mock TWAI bus side: frames go through the installed acceptance filter into the RX queue
+esp_err_t host_twai_inject(const twai_message_t *msg, TickType_t ticks_to_wait);
+void host_twai_get_counters(host_twai_counters_t *counters);
+
+// Starts the CAN source task feeding host_twai_inject: replay of TELE_HOST_REPLAY if set, generator otherwise
+esp_err_t host_can_source_start(can_ring_t *ring);
+esp_err_t host_replay_start(const char *path, can_ring_t *ring);
+
+// Waits for the pipeline to drain, then logs rates and drops of every stage and sink of the ring
+void host_can_source_report(const can_ring_t *ring, uint32_t sent, int64_t start_us, int64_t end_us);
+esp_err_t host_bench_write(const char *path, const host_bench_result_t *result);
+
+// Signal store contention benchmark, returns only if TELE_HOST_STORE_BENCH is unset
+void host_store_bench_run(void);
+
+// Log file preallocation in bytes: TELE_HOST_PREALLOC if set, firmware_default otherwise
+uint32_t host_sdmmc_preallocate(uint32_t firmware_default);
+
+// Block codec of the log file (@ref binlog_codec): TELE_HOST_CODEC if set, firmware_default otherwise
+uint8_t host_sdmmc_codec(uint8_t firmware_default);
+
+// true while the card fault of TELE_HOST_SD_FAULT is active (checked by sd_writer and the mount)
+bool host_sdmmc_fault(void);
+
+// Codec benchmark of a recorded log, returns only if TELE_HOST_CODEC_BENCH is unset
+void host_codec_bench_run(void);
+
+// .CSV row formatting benchmark, returns only if TELE_HOST_FORMAT_BENCH is unset
+void host_format_bench_run(void);
+
+// Row timestamp benchmark, returns only if TELE_HOST_TIME_BENCH is unset
+void host_time_bench_run(void);
+
+// CAN ID lookup benchmark, returns only if TELE_HOST_DISPATCH_BENCH is unset
+void host_dispatch_bench_run(void);
+
+#endif // HOST_PORT_H
@@ -0,0 +1,12 @@
+/*
+ * inet.h (host build)
+ *
+ *  Description: Address helpers (inet_addr, htons) from the host C library.
+ */
+
+#ifndef HOST_LWIP_INET_H
+#define HOST_LWIP_INET_H
+
+#include <arpa/inet.h>
+
+#endif // HOST_LWIP_INET_H
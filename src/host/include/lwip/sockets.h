@@ -0,0 +1,16 @@
+/*
+ * sockets.h (host build)
+ *
+ *  Description: The senders use the BSD socket API of lwIP, the host build maps it to the
+ *               host sockets (real loopback / network traffic).
+ */
+
+#ifndef HOST_LWIP_SOCKETS_H
+#define HOST_LWIP_SOCKETS_H
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <unistd.h>
+
+#endif // HOST_LWIP_SOCKETS_H
@@ -0,0 +1,25 @@
+/*
+ * sdmmc_cmd.h (host build)
+ *
+ *  Description: Card information of the directory-backed card (host_sdmmc.c).
+ */
+
+#ifndef HOST_SDMMC_CMD_H
+#define HOST_SDMMC_CMD_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+typedef struct
+{
+	const char *path; // Host directory holding the card files
+	struct
+	{
+		uint32_t capacity;	  // Sectors
+		uint32_t sector_size; // Bytes
+	} csd;
+} sdmmc_card_t;
+
+void sdmmc_card_print_info(FILE *stream, const sdmmc_card_t *card);
+
+#endif // HOST_SDMMC_CMD_H
@@ -0,0 +1,701 @@
+/*
+ * log_stream.c
+ *
+ *  Description: Implementation of the handle-based SD log files.
+ *      Note: All the state of a file lives in its log_stream_t: the pending block and journal are
+ *            touched by the producer task of the stream, the journal also by the sd_writer task
+ *            through the commit hook, which only runs while the stream is open.
+ */
+
+#include "log_stream.h"
+#include "RTC_Time_Sync/rtc_time_sync.h"
+#include "pipeline_stats/pipeline_stats.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/stat.h>
+
+static const char *TAG = "log_stream";
+
+// Blocks read by the recovery and header of a new file, one stream at a time (log_stream_scratch_lock)
+#define LOG_STREAM_SCRATCH_SIZE ((BINLOG_BLOCK_SIZE > FRAMELOG_BLOCK_SIZE) ? BINLOG_BLOCK_SIZE : FRAMELOG_BLOCK_SIZE)
+_Static_assert((LOG_STREAM_SCRATCH_SIZE >= BINLOG_HEADER_SIZE) && (LOG_STREAM_SCRATCH_SIZE >= FRAMELOG_HEADER_SIZE),
+               "log_stream_scratch holds the file headers");
+static uint8_t log_stream_scratch[LOG_STREAM_SCRATCH_SIZE];
+static SemaphoreHandle_t log_stream_scratch_lock;
+
+static binlog_block_t SDIO_log_block;
+static framelog_block_t SDIO_frame_block;
+
+log_stream_t SDIO_log_stream = {.bin = &SDIO_log_block};
+log_stream_t SDIO_frame_stream = {.frames = &SDIO_frame_block};
+log_stream_t SDIO_stats_stream;
+
+/*
+ * ================================================================
+ * 					Local Functions Definition
+ * ================================================================
+ *
+ * */
+
+// The SD tasks open their streams concurrently; no lock before log_stream_init (debug helpers at boot)
+static void log_stream_scratch_take(void)
+{
+    if (log_stream_scratch_lock != NULL)
+    {
+        xSemaphoreTake(log_stream_scratch_lock, portMAX_DELAY);
+    }
+}
+
+static void log_stream_scratch_give(void)
+{
+    if (log_stream_scratch_lock != NULL)
+    {
+        xSemaphoreGive(log_stream_scratch_lock);
+    }
+}
+
+/**================================================================
+ * @Fn				- log_stream_commit
+ * @breif			- Commit hook of the BIN and FRAMES files (sd_writer_open): records the end of
+ * 					  the blocks already synced in the older commit slot
+ * @param [in]		- fd: Log file
+ * @param [in]		- end: File offset after the last complete block on the card
+ * @param [in]		- ctx: Journal of the stream
+ * @retval			- false if the slot could not be written
+ */
+static bool log_stream_commit(int fd, off_t end, void *ctx)
+{
+    log_stream_journal_t *journal = (log_stream_journal_t *)ctx;
+    binlog_commit_t commit;
+
+    journal->count++;
+    uint32_t slot = binlog_commit_build(&commit, journal->count, (uint32_t)end, journal->tag,
+                                        Time_Sync_epoch_us(esp_timer_get_time()));
+    return pwrite(fd, &commit, sizeof(commit), journal->offset + slot) == (ssize_t)sizeof(commit);
+}
+
+// Latest valid commit of a file, from the start of its data if there is none
+static off_t log_stream_committed(int fd, uint16_t header_size, uint16_t tag, off_t size, log_stream_journal_t *journal)
+{
+    binlog_commit_t slots[BINLOG_COMMIT_SLOTS];
+    binlog_commit_t latest;
+    off_t end = BINLOG_DATA_OFFSET(header_size);
+
+    memset(slots, 0, sizeof(slots));
+    for (uint8_t i = 0; i < BINLOG_COMMIT_SLOTS; i++)
+    {
+        pread(fd, &slots[i], sizeof(slots[i]), BINLOG_COMMIT_OFFSET(header_size) + i * BINLOG_COMMIT_SLOT_SIZE);
+    }
+    journal->tag = tag;
+    journal->offset = BINLOG_COMMIT_OFFSET(header_size);
+    journal->count = 0;
+    if (binlog_commit_latest(slots, tag, &latest) && (latest.end >= end) && (latest.end <= size))
+    {
+        end = latest.end;
+        journal->count = latest.count;
+    }
+    return end;
+}
+
+// Forgets the units the writer reports durable
+static void log_stream_units_trim(log_stream_t *stream)
+{
+    uint32_t durable = atomic_load_explicit(&stream->writer.durable, memory_order_acquire);
+    while ((stream->unit_count != 0) && (stream->units[stream->unit_first].end <= durable))
+    {
+        stream->unit_first = (stream->unit_first + 1) % LOG_STREAM_UNITS;
+        stream->unit_count--;
+    }
+}
+
+// Accounts the records of one append: tracked until durable, or dropped if the writer refused it
+static void log_stream_units_add(log_stream_t *stream, uint16_t records, esp_err_t err)
+{
+    if (err != ESP_OK)
+    {
+        stream->stats.dropped += records;
+        return;
+    }
+    uint32_t end = atomic_load_explicit(&stream->writer.boundary, memory_order_relaxed);
+    log_stream_units_trim(stream);
+    if (stream->unit_count == LOG_STREAM_UNITS)
+    {
+        // Ring full: merged into the newest unit, which is then compared as a whole
+        log_stream_unit_t *newest = &stream->units[(stream->unit_first + stream->unit_count - 1) % LOG_STREAM_UNITS];
+        newest->end = end;
+        newest->records += records;
+        newest->merged = true;
+        return;
+    }
+    stream->units[(stream->unit_first + stream->unit_count) % LOG_STREAM_UNITS] =
+        (log_stream_unit_t){.end = end, .records = records, .merged = false};
+    stream->unit_count++;
+}
+
+// Counts the units appended before the card was lost that the recovered file does not hold
+static void log_stream_units_settle(log_stream_t *stream, SDIO_FileConfig *file)
+{
+    bool same = (strcmp(stream->unit_path, file->path) == 0);
+    uint32_t torn = 0;
+
+    for (uint16_t i = 0; i < stream->unit_count; i++)
+    {
+        const log_stream_unit_t *unit = &stream->units[(stream->unit_first + i) % LOG_STREAM_UNITS];
+        if (!same || (unit->end > file->valid))
+        {
+            torn += unit->records;
+            stream->stats.unverified += (!same || unit->merged) ? unit->records : 0;
+        }
+    }
+    stream->unit_first = 0;
+    stream->unit_count = 0;
+    if (torn != 0)
+    {
+        stream->stats.torn += torn;
+        if (file->type == FRAMES)
+        {
+            stream->frames->stats.frames -= torn;
+            stream->frames->lost += torn; // Recorded in the next block
+        }
+        ESP_LOGW(TAG, "%s: %lu records appended before the card was lost are not in the file", file->name,
+                 (unsigned long)torn);
+    }
+}
+
+// Cuts what follows the valid data of a file
+static esp_err_t log_stream_cut(SDIO_FileConfig *file, int fd, off_t committed, off_t end, off_t size)
+{
+    if (end >= size)
+    {
+        return ESP_OK;
+    }
+    if (ftruncate(fd, end) != 0)
+    {
+        return ESP_FAIL;
+    }
+    ESP_LOGW(TAG, "%s was not closed: %ld bytes committed, %ld written after the commit, %ld cut",
+             file->name, (long)committed, (long)(end - committed), (long)(size - end));
+    return ESP_OK;
+}
+
+/**================================================================
+ * @Fn				- log_stream_recover_bin
+ * @breif			- Finds the end of the data of a .BIN file and prepares the session appended to it
+ * @param [in]		- stream: Stream appending to the file, NULL to check the file only
+ * @param [in]		- file: Existing .BIN file
+ * @param [in]		- fd: File opened for reading and writing
+ * @param [in]		- size: Size of the file on the card
+ * @param [out]		- valid: End of the last valid block
+ * @retval			- ESP_OK, ESP_ERR_INVALID_STATE if the file is not a binary log, ESP_FAIL if it
+ * 					  cannot be read or truncated
+ * Note				- Version 3 files: starts from the latest commit slot and walks only the blocks
+ * 					  written after it (one sync interval). Older files are only walked when still
+ * 					  as long as their preallocated region, from the first block
+ */
+static esp_err_t log_stream_recover_bin(log_stream_t *stream, SDIO_FileConfig *file, int fd, off_t size, off_t *valid)
+{
+    uint8_t *block = log_stream_scratch;
+    binlog_file_header_t header;
+    log_stream_journal_t journal = {0};
+
+    if (pread(fd, &header, sizeof(header), 0) != sizeof(header))
+    {
+        return ESP_FAIL;
+    }
+    if ((memcmp(header.magic, BINLOG_MAGIC, sizeof(header.magic)) != 0) || (header.header_size > LOG_STREAM_SCRATCH_SIZE))
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (pread(fd, block, header.header_size, 0) != header.header_size)
+    {
+        return ESP_FAIL;
+    }
+    uint16_t tag = binlog_file_tag(block, header.header_size);
+
+    off_t end = header.header_size;
+    bool walk = (file->preallocate != 0) && (size == (off_t)file->preallocate);
+    journal.tag = tag;
+    if (header.version >= 3)
+    {
+        end = log_stream_committed(fd, header.header_size, tag, size, &journal);
+        walk = true;
+    }
+
+    // Blocks written after the commit, up to the first torn or foreign one
+    off_t committed = end;
+    if (walk)
+    {
+        ssize_t n;
+        size_t len;
+        while (((n = pread(fd, block, BINLOG_BLOCK_SIZE, end)) > 0) && ((len = binlog_block_check(block, n, tag)) != 0))
+        {
+            end += len;
+        }
+    }
+    else
+    {
+        end = size;
+    }
+    if (log_stream_cut(file, fd, committed, end, size) != ESP_OK)
+    {
+        return ESP_FAIL;
+    }
+    *valid = end;
+
+    if (stream != NULL)
+    {
+        // Same file after a remount: the pending rows are kept and the block numbers continue
+        if (stream->bin->tag != tag)
+        {
+            binlog_block_init(stream->bin, tag, BINLOG_CODEC_NONE);
+        }
+        // Only the stages the version of the file declares, older readers skip the other blocks
+        stream->bin->codec = (header.version >= 5) ? file->codec
+                             : (header.version == 4) ? (file->codec & BINLOG_CODEC_LZSS) : BINLOG_CODEC_NONE;
+        stream->journal = journal;
+    }
+    return ESP_OK;
+}
+
+/**================================================================
+ * @Fn				- log_stream_recover_frames
+ * @breif			- Finds the end of the data of a raw frame log and prepares the session appended to it
+ * @param [in]		- stream: Stream appending to the file, NULL to check the file only
+ * @param [in]		- file: Existing frame log
+ * @param [in]		- fd: File opened for reading and writing
+ * @param [in]		- size: Size of the file on the card
+ * @param [out]		- valid: End of the last valid block
+ * @retval			- ESP_OK, ESP_ERR_INVALID_STATE if the file is not a frame log, ESP_FAIL if it
+ * 					  cannot be read or truncated
+ * Note				- Same journal as the .BIN log: latest commit slot, then the blocks written after it
+ */
+static esp_err_t log_stream_recover_frames(log_stream_t *stream, SDIO_FileConfig *file, int fd, off_t size, off_t *valid)
+{
+    uint8_t *block = log_stream_scratch;
+    framelog_file_header_t header;
+    log_stream_journal_t journal;
+    uint32_t crc;
+
+    if (pread(fd, block, FRAMELOG_HEADER_SIZE, 0) != FRAMELOG_HEADER_SIZE)
+    {
+        return ESP_FAIL;
+    }
+    memcpy(&header, block, sizeof(header));
+    memcpy(&crc, block + sizeof(header), sizeof(crc));
+    if ((memcmp(header.magic, FRAMELOG_MAGIC, sizeof(header.magic)) != 0) || (header.header_size != FRAMELOG_HEADER_SIZE) ||
+        (crc != binlog_crc32(0, block, sizeof(header))))
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    uint16_t tag = framelog_file_tag(block, header.header_size);
+    off_t end = log_stream_committed(fd, header.header_size, tag, size, &journal);
+
+    // Blocks written after the commit, up to the first torn or foreign one
+    off_t committed = end;
+    ssize_t n;
+    size_t len;
+    while (((n = pread(fd, block, FRAMELOG_BLOCK_SIZE, end)) > 0) && ((len = framelog_block_check(block, n, tag)) != 0))
+    {
+        end += len;
+    }
+    if (log_stream_cut(file, fd, committed, end, size) != ESP_OK)
+    {
+        return ESP_FAIL;
+    }
+    *valid = end;
+
+    // Same file after a remount: the pending frames are kept and the block numbers continue
+    if (stream != NULL)
+    {
+        if (stream->frames->tag != tag)
+        {
+            framelog_block_init(stream->frames, tag);
+        }
+        stream->journal = journal;
+    }
+    return ESP_OK;
+}
+
+/**================================================================
+ * @Fn				- log_stream_recover_text
+ * @breif			- Cuts the row torn by a power loss at the end of a .CSV / .TXT file
+ * @param [in]		- fd: File opened for reading and writing
+ * @param [in]		- size: Size of the file on the card
+ * @param [out]		- valid: End of the last complete line
+ * @retval			- ESP_OK, ESP_FAIL if the file cannot be read or truncated
+ */
+static esp_err_t log_stream_recover_text(int fd, off_t size, off_t *valid)
+{
+    char tail[SDIO_CSV_ROW_MAX];
+    off_t start = (size > (off_t)sizeof(tail)) ? size - (off_t)sizeof(tail) : 0;
+    ssize_t n = pread(fd, tail, size - start, start);
+
+    if (n != size - start)
+    {
+        return ESP_FAIL;
+    }
+    *valid = size;
+    while ((n > 0) && (tail[n - 1] != '\n'))
+    {
+        n--;
+    }
+    if ((n > 0) && (start + n < size))
+    {
+        *valid = start + n;
+        return (ftruncate(fd, *valid) == 0) ? ESP_OK : ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+/**================================================================
+ * @Fn				- log_stream_create
+ * @breif			- Creates a new log file: BIN / FRAMES header and empty commit slots, .CSV
+ * 					  header line, nothing for .TXT
+ * @param [in]		- stream: Stream of the file, its pending block and journal are reset
+ * @param [in]		- file: File to create (path set)
+ * @retval			- ESP_OK with file->valid set, ESP_FAIL if the file cannot be written
+ * Note				- BIN / FRAMES files get file->preallocate bytes as one contiguous region
+ * 					  (f_expand): appending never walks the FAT for a free cluster, and the
+ * 					  blocks tell where the data ends if the region is not trimmed on close
+ */
+static esp_err_t log_stream_create(log_stream_t *stream, SDIO_FileConfig *file)
+{
+    uint8_t *header = log_stream_scratch;
+    static const uint8_t empty_slots[BINLOG_COMMIT_SLOTS * BINLOG_COMMIT_SLOT_SIZE + BINLOG_COMMIT_SLOT_SIZE];
+    int64_t now_us = Time_Sync_epoch_us(esp_timer_get_time());
+    size_t header_size = 0;
+
+    if (file->type == BIN)
+    {
+        header_size = binlog_header_build(header, LOG_STREAM_SCRATCH_SIZE, now_us);
+        binlog_block_init(stream->bin, binlog_file_tag(header, header_size), file->codec);
+        stream->journal.tag = stream->bin->tag;
+    }
+    else if (file->type == FRAMES)
+    {
+        header_size = framelog_header_build(header, LOG_STREAM_SCRATCH_SIZE, now_us, file->bitrate);
+        framelog_block_init(stream->frames, framelog_file_tag(header, header_size));
+        stream->journal.tag = stream->frames->tag;
+    }
+    else if (file->type == CSV)
+    {
+        header_size = strlen(SDIO_CSV_HEADER);
+        memcpy(header, SDIO_CSV_HEADER, header_size);
+    }
+    bool blocks = (file->type == BIN) || (file->type == FRAMES);
+    size_t slots_size = blocks ? BINLOG_DATA_OFFSET(header_size) - header_size : 0;
+    stream->journal.offset = blocks ? BINLOG_COMMIT_OFFSET(header_size) : 0;
+    stream->journal.count = 0;
+
+    bool preallocated = blocks && (file->preallocate != 0);
+    if (preallocated &&
+        (esp_vfs_fat_create_contiguous_file(MOUNT_POINT, file->path, file->preallocate, true) != ESP_OK))
+    {
+        ESP_LOGW(TAG, "No contiguous %lu bytes for %s, growing it cluster by cluster",
+                 (unsigned long)file->preallocate, file->name);
+        preallocated = false;
+    }
+    int fd = open(file->path, preallocated ? O_RDWR : (O_WRONLY | O_CREAT | O_TRUNC), 0644);
+    if (fd < 0)
+    {
+        ESP_LOGE(TAG, "Unable to create %s", file->path);
+        return ESP_FAIL;
+    }
+    bool ok = (pwrite(fd, header, header_size, 0) == (ssize_t)header_size) &&
+              (pwrite(fd, empty_slots, slots_size, header_size) == (ssize_t)slots_size);
+    close(fd);
+    if (!ok)
+    {
+        ESP_LOGE(TAG, "Unable to write the header of %s", file->name);
+        return ESP_FAIL;
+    }
+    file->valid = (uint32_t)(header_size + slots_size);
+    return ESP_OK;
+}
+
+/*
+ * ================================================================
+ * 					API Functions Definition
+ * ================================================================
+ *
+ * */
+
+/**================================================================
+ * @Fn				- log_stream_init
+ * @breif			- Registers the writer of a stream with the sd_writer task
+ * @param [in]		- stream: Stream, with the storage of its pending block set for BIN / FRAMES
+ * @param [in]		- pool_size: RAM of its writer (sd_writer_init)
+ * @retval			- sd_writer_init result, ESP_ERR_NO_MEM if the recovery lock cannot be created
+ * Note				- Called once per stream before the producer tasks start
+ */
+esp_err_t log_stream_init(log_stream_t *stream, size_t pool_size)
+{
+    if (log_stream_scratch_lock == NULL)
+    {
+        log_stream_scratch_lock = xSemaphoreCreateMutex();
+        if (log_stream_scratch_lock == NULL)
+        {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    return sd_writer_init(&stream->writer, pool_size);
+}
+
+/**================================================================
+ * @Fn				- log_stream_recover
+ * @breif			- Finds the end of the valid data of an existing log file and cuts what follows
+ * @param [in]		- stream: Stream that will append to the file (its block numbers and journal
+ * 					  continue), NULL to check the file only
+ * @param [in]		- file: Existing file (name and path set)
+ * @retval			- ESP_OK with file->valid set, ESP_ERR_INVALID_STATE if the file does not hold
+ * 					  the format of file->type, ESP_FAIL if it cannot be read or truncated
+ * Note				- Called before appending to a file, and after SDIO_SD_Init when the card was
+ * 					  lost mid-session. .BIN / .CAN: latest commit slot, then the blocks written after
+ * 					  it; .CSV / .TXT: last complete line. Reads a few KiB whatever the file size
+ */
+esp_err_t log_stream_recover(log_stream_t *stream, SDIO_FileConfig *file)
+{
+    int64_t start_us = esp_timer_get_time();
+    struct stat st;
+    off_t valid = 0;
+    esp_err_t err;
+
+    if (stat(file->path, &st) != 0)
+    {
+        return ESP_FAIL;
+    }
+    int fd = open(file->path, O_RDWR);
+    if (fd < 0)
+    {
+        return ESP_FAIL;
+    }
+    if ((file->type == BIN) || (file->type == FRAMES))
+    {
+        log_stream_scratch_take();
+        err = (file->type == BIN) ? log_stream_recover_bin(stream, file, fd, st.st_size, &valid)
+                                  : log_stream_recover_frames(stream, file, fd, st.st_size, &valid);
+        log_stream_scratch_give();
+    }
+    else
+    {
+        err = log_stream_recover_text(fd, st.st_size, &valid);
+    }
+    close(fd);
+
+    file->valid = (uint32_t)valid;
+    ESP_LOGI(TAG, "%s: %ld valid bytes, recovered in %lld us", file->name, (long)valid,
+             (long long)(esp_timer_get_time() - start_us));
+    return err;
+}
+
+/**================================================================
+ * @Fn				- log_stream_open
+ * @breif			- Creates or recovers a log file and opens it in the writer of the stream
+ * @param [in]		- stream: Stream, closed
+ * @param [in]		- file: Log file (name, type, preallocate, codec / bitrate), its path is set here
+ * @retval			- ESP_OK with file->valid set, ESP_FAIL if the file cannot be recovered,
+ * 					  created or opened, ESP_ERR_INVALID_STATE if the stream is open
+ * Note				- An existing file is appended to (same session after a reboot or a remount),
+ * 					  a file that does not hold the format of file->type is replaced.
+ * 					  BIN files with commit slots and FRAMES files are journaled: every writer sync
+ * 					  commits the end of the synced blocks
+ */
+esp_err_t log_stream_open(log_stream_t *stream, SDIO_FileConfig *file)
+{
+    struct stat st;
+    if (atomic_load(&stream->writer.fd) >= 0)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    snprintf(file->path, sizeof(file->path), "%s/%s", MOUNT_POINT, file->name);
+    stream->file = file;
+
+    esp_err_t err = (stat(file->path, &st) == 0) ? log_stream_recover(stream, file) : ESP_ERR_NOT_FOUND;
+    if (err == ESP_ERR_INVALID_STATE)
+    {
+        ESP_LOGW(TAG, "%s does not hold the expected format, replacing it", file->name);
+    }
+    if ((err == ESP_ERR_NOT_FOUND) || (err == ESP_ERR_INVALID_STATE))
+    {
+        log_stream_scratch_take();
+        err = log_stream_create(stream, file);
+        log_stream_scratch_give();
+    }
+    if (err != ESP_OK)
+    {
+        return ESP_FAIL; // Not readable now: never replaced
+    }
+    log_stream_units_settle(stream, file);
+    strcpy(stream->unit_path, file->path);
+    bool journaled = (stream->journal.offset != 0) && ((file->type == BIN) || (file->type == FRAMES));
+    return sd_writer_open(&stream->writer, file->path, file->valid, journaled ? log_stream_commit : NULL,
+                          &stream->journal);
+}
+
+/**================================================================
+ * @Fn				- log_stream_close
+ * @breif			- Writes the pending block and bytes and closes the file of a stream (rotation)
+ * @param [in]		- stream: Stream opened with log_stream_open
+ * @retval			- sd_writer_close result, file->valid holds the final size
+ */
+esp_err_t log_stream_close(log_stream_t *stream)
+{
+    // Not open: nothing to write
+    if ((stream->file == NULL) || (atomic_load(&stream->writer.fd) < 0))
+    {
+        return ESP_OK;
+    }
+    // Card lost: the pending block is kept for the file reopened after the remount
+    if (!atomic_load(&stream->writer.failed))
+    {
+        log_stream_flush(stream, INT64_MAX);
+    }
+    esp_err_t err = sd_writer_close(&stream->writer);
+    stream->file->valid = (uint32_t)stream->writer.end;
+    log_stream_units_trim(stream);
+    return err;
+}
+
+/**================================================================
+ * @Fn				- log_stream_row
+ * @breif			- Appends one row of readings to a BIN or CSV stream
+ * @param [in]		- stream: Open stream
+ * @param [in]		- row: Readings to be stored
+ * @retval			- ESP_OK, ESP_ERR_INVALID_STATE if the writer has lost the card (the row is not
+ * 					  taken: keep it, remount and reopen), ESP_FAIL if the card was lost while the
+ * 					  pending block was written (its rows are dropped), ESP_ERR_TIMEOUT if rows were
+ * 					  dropped because the card fell behind,
+ * 					  ESP_ERR_INVALID_SIZE if the .CSV row does not fit SDIO_CSV_ROW_MAX
+ * Note				- .BIN rows are packed into the pending block, written once it is full or
+ * 					  old enough (BINLOG_BLOCK_MAX_AGE_US); .CSV rows are formatted in RAM.
+ * 					  A row taken is counted in stats.records, and in stats.dropped / .torn if lost
+ */
+esp_err_t log_stream_row(log_stream_t *stream, const SDIO_TxBuffer *row)
+{
+    esp_err_t err = ESP_OK;
+
+    if ((atomic_load(&stream->writer.fd) < 0) || atomic_load(&stream->writer.failed))
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    stream->stats.records++;
+    if (stream->file->type == BIN)
+    {
+        if (binlog_block_add(stream->bin, row, esp_timer_get_time()))
+        {
+            uint16_t records = stream->bin->records;
+            size_t size = binlog_block_seal(stream->bin);
+            err = sd_writer_append(&stream->writer, stream->bin->sealed, size);
+            log_stream_units_add(stream, records, err);
+            pipeline_stats_add_bytes(&CAN_pipeline_stats, PIPELINE_STAGE_SD, size);
+        }
+    }
+    else
+    {
+        char text[SDIO_CSV_ROW_MAX];
+        int len = SDIO_SD_Format_CSV_Row(text, sizeof(text), row, &stream->stamp);
+        if (len < 0)
+        {
+            stream->stats.dropped++;
+            return ESP_ERR_INVALID_SIZE;
+        }
+        err = sd_writer_append(&stream->writer, text, len);
+        if (err == ESP_FAIL)
+        {
+            stream->stats.records--; // Refused before any byte was copied
+            return ESP_ERR_INVALID_STATE;
+        }
+        log_stream_units_add(stream, 1, err);
+        pipeline_stats_add_bytes(&CAN_pipeline_stats, PIPELINE_STAGE_SD, len);
+    }
+    return err;
+}
+
+/**================================================================
+ * @Fn				- log_stream_frame
+ * @breif			- Appends one received frame to a FRAMES stream, the block is handed to the
+ * 					  writer once it is full or old enough (FRAMELOG_BLOCK_MAX_AGE_US)
+ * @param [in]		- stream: Open stream
+ * @param [in]		- msg: Received frame
+ * @param [in]		- timestamp_us: Receive time (can_frame_t.timestamp_us)
+ * @param [in]		- lost: Frames lost by the caller since the previous call (CAN ring overruns)
+ * @retval			- ESP_OK, ESP_FAIL if the writer lost the card (remount and reopen): this frame
+ * 					  and lost are handed back, the caller adds 1 + lost to the lost of its next call,
+ * 					  ESP_ERR_TIMEOUT if a block was dropped because the card fell behind
+ * Note				- The frames of a dropped block are recorded as lost in the next block
+ */
+esp_err_t log_stream_frame(log_stream_t *stream, const twai_message_t *msg, int64_t timestamp_us, uint32_t lost)
+{
+    stream->stats.records++;
+    stream->frames->lost += lost;
+    if (!framelog_block_add(stream->frames, msg, timestamp_us))
+    {
+        return ESP_OK;
+    }
+    esp_err_t err = log_stream_flush(stream, INT64_MAX);
+    if (err == ESP_FAIL)
+    {
+        stream->frames->lost -= 1 + lost; // Counted by the caller until the file is reopened
+    }
+    return err;
+}
+
+/**================================================================
+ * @Fn				- log_stream_text
+ * @breif			- Appends lines to a TXT stream
+ * @param [in]		- stream: Open stream
+ * @param [in]		- text: Whole lines, each one ending with '\n'
+ * @retval			- Same as sd_writer_append
+ * Note				- One append: a stalled write drops every line of text, never part of one
+ */
+esp_err_t log_stream_text(log_stream_t *stream, const char *text)
+{
+    return sd_writer_append(&stream->writer, text, strlen(text));
+}
+
+/**================================================================
+ * @Fn				- log_stream_flush
+ * @breif			- Hands the pending block of a FRAMES stream to the writer if it is due
+ * @param [in]		- stream: Open stream
+ * @param [in]		- now_us: Current esp_timer time, INT64_MAX to write any pending frame
+ * @retval			- Same as log_stream_frame, ESP_OK for the other formats
+ * Note				- Called periodically while the bus is idle, and before closing the file
+ */
+esp_err_t log_stream_flush(log_stream_t *stream, int64_t now_us)
+{
+    if (stream->file->type == BIN)
+    {
+        uint16_t records = stream->bin->records;
+        size_t size = (now_us == INT64_MAX) ? binlog_block_seal(stream->bin) : 0;
+        if (size == 0)
+        {
+            return ESP_OK;
+        }
+        esp_err_t err = sd_writer_append(&stream->writer, stream->bin->sealed, size);
+        log_stream_units_add(stream, records, err);
+        return err;
+    }
+    if ((stream->file->type != FRAMES) || !framelog_block_due(stream->frames, now_us))
+    {
+        return ESP_OK;
+    }
+    framelog_block_t *block = stream->frames;
+    uint16_t frames = block->frames;
+    uint32_t lost = block->lost;
+    size_t size = framelog_block_seal(block);
+    lost -= block->lost; // Recorded in the header of the block
+    esp_err_t err = sd_writer_append(&stream->writer, block->data, size);
+    log_stream_units_add(stream, frames, err);
+    if (err != ESP_OK)
+    {
+        block->stats.blocks--;
+        block->stats.frames -= frames;
+        block->stats.bytes -= size;
+        block->stats.lost -= lost;
+        block->lost += frames + lost;
+    }
+    return err;
+}
@@ -0,0 +1,111 @@
+/*
+ * log_stream.h
+ *
+ *  Description: Handle-based SD log files. Every open log is a log_stream_t with its own
+ *               write-behind writer (buffers, file descriptor, counters), pending block and commit
+ *               journal, so several logs are written at the same time by different tasks without
+ *               sharing any state or reopening files; the single sd_writer task multiplexes the
+ *               buffers of every stream onto the card.
+ *               What an append does depends on SDIO_FileConfig.type:
+ *                 BIN    - log_stream_row packs the row into the pending block (binlog.h)
+ *                 CSV    - log_stream_row formats one text row (SDIO_SD_Format_CSV_Row)
+ *                 FRAMES - log_stream_frame packs the frame into the pending block (framelog.h)
+ *                 TXT    - log_stream_text appends whole lines as they are
+ *               Appends only copy into RAM, never touch the file system, and may be called by one
+ *               task per stream.
+ *               Every record (row or frame) handed to a stream is accounted for: appended blocks /
+ *               rows are tracked until the writer reports them durable, so when the card is lost
+ *               the records missing from the file recovered at the next log_stream_open are
+ *               counted as torn (and as lost frames in the next block of a frame log).
+ */
+
+#ifndef LOG_STREAM_H
+#define LOG_STREAM_H
+
+//==================================Standard Libraries Includes=======================//
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+//==================================ESP32 Libraries Includes==========================//
+#include "esp_err.h"
+#include "driver/twai.h"
+#include "Logging/logging.h"
+#include "sd_writer/sd_writer.h"
+#include "binlog/binlog.h"
+#include "framelog/framelog.h"
+
+//----------------------------
+// Log Stream Macros
+//----------------------------
+#define LOG_STREAM_UNITS 128 // Appended blocks / .CSV rows tracked until durable
+
+//===============================================
+// User type definitions (structures)
+//===============================================
+
+// Commit slots of a BIN (version >= 3) or FRAMES file, written by the sd_writer task after every sync
+typedef struct
+{
+	uint16_t tag;	// binlog_file_tag / framelog_file_tag of the file
+	off_t offset;	// File offset of the slots, 0 = file without slots (BIN version < 3)
+	uint32_t count; // Latest commit number
+} log_stream_journal_t;
+
+// Block or .CSV row handed to the writer and not yet durable
+typedef struct
+{
+	uint32_t end;	  // File offset after the unit
+	uint16_t records; // Rows / frames it holds
+	bool merged;	  // Later appends were merged into it while the ring was full
+} log_stream_unit_t;
+
+// Record accounting, written by the producer task only
+typedef struct
+{
+	uint32_t records;	 // Rows / frames taken by the stream
+	uint32_t dropped;	 // Records of appends the writer refused (card lost, no free buffer in time)
+	uint32_t torn;		 // Records appended before the card was lost, missing from the recovered file
+	uint32_t unverified; // Of torn: records whose end could not be compared (ring full or another file)
+} log_stream_stats_t;
+
+typedef struct
+{
+	SDIO_FileConfig *file;		  // Set by log_stream_open
+	sd_writer_t writer;			  // Buffers, file descriptor and counters of the stream
+	log_stream_journal_t journal; // Set when the file is created or recovered
+	binlog_block_t *bin;		  // BIN: storage of the pending block, set before log_stream_open
+	framelog_block_t *frames;	  // FRAMES: storage of the pending block, set before log_stream_open
+	Time_Sync_stamp_t stamp;	  // CSV: formatted second of the previous row timestamp
+	log_stream_unit_t units[LOG_STREAM_UNITS]; // Oldest first from unit_first, not yet durable
+	uint16_t unit_first;
+	uint16_t unit_count;
+	char unit_path[SDIO_PATH_MAX];	  // File the units were appended to
+	log_stream_stats_t stats;
+} log_stream_t;
+
+//===============================================
+// Streams of the SD logs, opened by the SD tasks
+//===============================================
+extern log_stream_t SDIO_log_stream;   // Snapshot log LOG_<n>.BIN / .CSV (SDIO_Log_Task)
+extern log_stream_t SDIO_frame_stream; // Raw frame log LOG_<n>.CAN (SDIO_Frame_Log_Task)
+extern log_stream_t SDIO_stats_stream; // Bus statistics CAN_STAT.CSV (SDIO_Log_Task)
+
+//===============================================
+// APIs Supported by "LOG STREAM"
+//===============================================
+
+// Before the producer tasks start (sd_writer_init)
+esp_err_t log_stream_init(log_stream_t *stream, size_t pool_size);
+
+esp_err_t log_stream_recover(log_stream_t *stream, SDIO_FileConfig *file);
+esp_err_t log_stream_open(log_stream_t *stream, SDIO_FileConfig *file);
+esp_err_t log_stream_close(log_stream_t *stream);
+
+// Producer side (one task per stream)
+esp_err_t log_stream_row(log_stream_t *stream, const SDIO_TxBuffer *row);
+esp_err_t log_stream_frame(log_stream_t *stream, const twai_message_t *msg, int64_t timestamp_us, uint32_t lost);
+esp_err_t log_stream_text(log_stream_t *stream, const char *text);
+esp_err_t log_stream_flush(log_stream_t *stream, int64_t now_us);
+
+#endif // LOG_STREAM_H
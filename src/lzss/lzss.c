@@ -0,0 +1,174 @@
+/*
+ * lzss.c
+ *
+ *  Description: Implementation of the LZSS codec.
+ *      Note: One hash probe per position (the latest earlier occurrence of the next 3 bytes), as
+ *            records of a log block repeat at a fixed distance this finds most of the redundancy
+ *            at a few cycles per byte.
+ */
+
+#include "lzss.h"
+#include <string.h>
+
+/*
+ * ================================================================
+ * 					Local Functions Definition
+ * ================================================================
+ *
+ * */
+static inline uint32_t lzss_hash(const uint8_t *p)
+{
+    uint32_t v = (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16);
+    return (v * 2654435761u) >> (32 - LZSS_HASH_BITS);
+}
+
+/*
+ * ================================================================
+ * 					API Functions Definition
+ * ================================================================
+ *
+ * */
+
+/**================================================================
+ * @Fn				- lzss_compress
+ * @breif			- Compresses one block
+ * @param [in]		- state: Hash table, reset by every call
+ * @param [in]		- in: Block, LZSS_WINDOW bytes or less to reach every earlier byte
+ * @param [in]		- len: Size of in, at most 65535
+ * @param [out]		- out: Compressed bytes
+ * @param [in]		- out_len: Size of out
+ * @retval			- Compressed size, 0 if it does not fit out (store the block as is)
+ */
+size_t lzss_compress(lzss_state_t *state, const uint8_t *in, size_t len, uint8_t *out, size_t out_len)
+{
+    size_t pos = 0;
+    size_t o = 0;
+    size_t flags_at = 0;
+    uint8_t bit = 8;
+
+    memset(state->head, 0, sizeof(state->head));
+    while (pos < len)
+    {
+        // Flag byte of the next 8 items, + worst item (3 bytes) must fit
+        if (bit == 8)
+        {
+            if (o + 1 > out_len)
+            {
+                return 0;
+            }
+            flags_at = o;
+            out[o++] = 0;
+            bit = 0;
+        }
+        if (o + 3 > out_len)
+        {
+            return 0;
+        }
+
+        size_t match_len = 0;
+        size_t distance = 0;
+        if (pos + LZSS_MIN_MATCH <= len)
+        {
+            uint32_t h = lzss_hash(&in[pos]);
+            size_t candidate = state->head[h];
+            state->head[h] = (uint16_t)(pos + 1);
+            if ((candidate != 0) && ((pos - (candidate - 1)) <= LZSS_WINDOW))
+            {
+                const uint8_t *a = &in[candidate - 1];
+                size_t limit = len - pos;
+                if (limit > LZSS_MAX_MATCH)
+                {
+                    limit = LZSS_MAX_MATCH;
+                }
+                while ((match_len < limit) && (a[match_len] == in[pos + match_len]))
+                {
+                    match_len++;
+                }
+                distance = pos - (candidate - 1);
+            }
+        }
+
+        if (match_len >= LZSS_MIN_MATCH)
+        {
+            uint16_t code = (match_len >= 18) ? 15 : (uint16_t)(match_len - LZSS_MIN_MATCH);
+            uint16_t token = (uint16_t)(((distance - 1) << 4) | code);
+            out[o++] = (uint8_t)token;
+            out[o++] = (uint8_t)(token >> 8);
+            if (code == 15)
+            {
+                out[o++] = (uint8_t)(match_len - 18);
+            }
+            // Positions inside the match are hashed too, the next records match against them
+            for (size_t i = 1; (i < match_len) && (pos + i + LZSS_MIN_MATCH <= len); i++)
+            {
+                state->head[lzss_hash(&in[pos + i])] = (uint16_t)(pos + i + 1);
+            }
+            pos += match_len;
+        }
+        else
+        {
+            out[flags_at] |= (uint8_t)(1u << bit);
+            out[o++] = in[pos++];
+        }
+        bit++;
+    }
+    return o;
+}
+
+/**================================================================
+ * @Fn				- lzss_decompress
+ * @breif			- Restores one block
+ * @param [in]		- in: Compressed bytes
+ * @param [in]		- len: Size of in
+ * @param [out]		- out: Block
+ * @param [in]		- out_len: Size of out
+ * @retval			- Size of the block, 0 if the data is corrupt or does not fit out
+ */
+size_t lzss_decompress(const uint8_t *in, size_t len, uint8_t *out, size_t out_len)
+{
+    size_t i = 0;
+    size_t o = 0;
+
+    while (i < len)
+    {
+        uint8_t flags = in[i++];
+        for (uint8_t bit = 0; (bit < 8) && (i < len); bit++)
+        {
+            if (flags & (1u << bit))
+            {
+                if (o >= out_len)
+                {
+                    return 0;
+                }
+                out[o++] = in[i++];
+                continue;
+            }
+            if (i + 2 > len)
+            {
+                return 0;
+            }
+            uint16_t token = (uint16_t)(in[i] | (in[i + 1] << 8));
+            i += 2;
+            size_t distance = (size_t)(token >> 4) + 1;
+            size_t match_len = (size_t)(token & 0x0F) + LZSS_MIN_MATCH;
+            if ((token & 0x0F) == 15)
+            {
+                if (i >= len)
+                {
+                    return 0;
+                }
+                match_len = 18 + in[i++];
+            }
+            if ((distance > o) || (o + match_len > out_len))
+            {
+                return 0;
+            }
+            // Overlapping copies repeat the last distance bytes, byte by byte on purpose
+            for (size_t k = 0; k < match_len; k++, o++)
+            {
+                out[o] = out[o - distance];
+            }
+        }
+    }
+    return o;
+}
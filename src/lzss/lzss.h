@@ -0,0 +1,45 @@
+/*
+ * lzss.h
+ *
+ *  Description: Small LZSS codec of the SD log blocks. Every block is compressed on its own, the
+ *               window is the block itself, so a block stays an independent unit for the CRC,
+ *               the commit slots and the recovery scan. The compressor needs LZSS_HASH_SIZE
+ *               16-bit positions of state and no history; decompression needs none.
+ *      Format:  groups of one flag byte (LSB first, 1 = literal, 0 = match) and 8 items.
+ *               Literal: 1 byte. Match: 2 bytes, little-endian: bits 4..15 = distance - 1
+ *               (1..4096), bits 0..3 = length - 3; 15 means length 18 + the next byte (18..273).
+ *               scripts/binlog_to_csv.py holds the host decompressor.
+ */
+
+#ifndef LZSS_H
+#define LZSS_H
+
+//==================================Standard Libraries Includes=======================//
+#include <stdint.h>
+#include <stddef.h>
+
+//----------------------------
+// Codec Macros
+//----------------------------
+#define LZSS_WINDOW 4096	 // Longest match distance
+#define LZSS_MIN_MATCH 3
+#define LZSS_MAX_MATCH 273
+#define LZSS_HASH_BITS 10	 // 1024 positions: 2 KiB of state
+#define LZSS_HASH_SIZE (1u << LZSS_HASH_BITS)
+
+//===============================================
+// User type definitions (structures)
+//===============================================
+typedef struct
+{
+	uint16_t head[LZSS_HASH_SIZE]; // Latest position of each 3-byte hash, + 1 (0 = none)
+} lzss_state_t;
+
+//===============================================
+// APIs Supported by "LZSS"
+//===============================================
+
+size_t lzss_compress(lzss_state_t *state, const uint8_t *in, size_t len, uint8_t *out, size_t out_len);
+size_t lzss_decompress(const uint8_t *in, size_t len, uint8_t *out, size_t out_len);
+
+#endif // LZSS_H
@@ -3,16 +3,79 @@
 #include <freertos/task.h>
 #include "wifi_manager/wifi_manager.h"
 
-#include "logging/logging.h"
+#include "Logging/logging.h"
 #include "driver/twai.h"
 #include "RTC_Time_Sync/rtc_time_sync.h"
 #include "telemetry_config.h"
 #include "connectivity/connectivity.h"
 #include "udp_sender/udp_sender.h"
 #include "mqtt_sender/mqtt_sender.h"
+#include "can_ring/can_ring.h"
+#include "can_filter/can_filter.h"
+#include "can_stats/can_stats.h"
+#include "pipeline_stats/pipeline_stats.h"
+#include "snapshot/snapshot.h"
+#include "signal_store/signal_store.h"
+#include "log_stream/log_stream.h"
+#include "session_index/session_index.h"
+#include "binlog/binlog.h"
+#include "framelog/framelog.h"
+#include "sd_health/sd_health.h"
+#include "sd_recovery/sd_recovery.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "sdkconfig.h"
+#if CONFIG_IDF_TARGET_LINUX
+#include "host_port.h" // Host build: mock TWAI fed by a CAN source (src/host)
+#endif
 
 #define LED_GPIO 2 // GPIO pin for the LED
-#define Queue_Size 10
+
+// CAN RX buffering: the TWAI ISR pushes every frame into the driver RX queue (rx_queue_len).
+// It is sized to absorb CAN_RX_BURST_WINDOW_MS of back-to-back frames at the fastest bus rate
+// we support, so CAN_Receive_Task can be descheduled (SD writes, Wi-Fi) without losing frames.
+#define CAN_BUS_MAX_KBITS 1000          // Worst case bus rate the RX queue is sized for (kbit/s)
+#define CAN_MIN_FRAME_BITS 55           // Shortest standard frame incl. stuffing & interframe space
+#define CAN_RX_BURST_WINDOW_MS 20       // Longest time CAN_Receive_Task may be kept off the CPU
+#define CAN_RX_QUEUE_LEN ((CAN_BUS_MAX_KBITS * CAN_RX_BURST_WINDOW_MS) / CAN_MIN_FRAME_BITS)
+#define CAN_RX_MAX_BURST CAN_RX_QUEUE_LEN // Frames drained per wakeup before yielding the core
+#define CAN_RX_METRICS_PERIOD_MS 1000   // Period of the driver status / rx_missed_count report
+#define CAN_BUS_KBITS 125               // Bus rate of t_config, used for the bus load statistics
+
+// SD log rows are snapshots of the latest value of every signal, taken at a fixed rate
+#define SDIO_LOG_RATE_HZ 50 // Supported: 10, 50, 100, 200
+
+// SD log format: BIN (packed records in CRC blocks, scripts/binlog_to_csv.py) or CSV (text rows)
+#define SDIO_LOG_FORMAT BIN
+#if SDIO_LOG_FORMAT == BIN
+#define SDIO_LOG_EXTENSION "BIN"
+#else
+#define SDIO_LOG_EXTENSION "CSV"
+#endif
+
+// Contiguous region reserved for a new .BIN log (~4 h at 50 Hz), 0 = grown cluster by cluster.
+// Sessions longer than that keep appending past the region
+#define SDIO_LOG_PREALLOCATE (64UL * 1024 * 1024)
+
+// Coding of the .BIN blocks: record deltas (record_codec.h) then LZSS (lzss.h), a block is stored
+// as is when it does not shrink
+#define SDIO_LOG_CODEC (BINLOG_CODEC_DELTA | BINLOG_CODEC_LZSS)
+
+// Raw frame log LOG_<n>.CAN of every session (framelog.h): every frame of the CAN ring as received.
+// ~15 bytes per frame, so a busy 125 kbit/s bus adds ~50 MB per hour
+#define SDIO_FRAME_LOG_PREALLOCATE SDIO_LOG_PREALLOCATE
+#define SDIO_FRAME_LOG_IDLE_MS 100          // Longest wait for frames before checking the age of the pending block
+#define SDIO_FRAME_LOG_NO_SESSION UINT32_MAX // SDIO_frame_open while no frame log is open
+
+// Sessions (SESSIONS.IDX): a boot continues the last session if it was updated within
+// MAX_DAYS_MODIFIED days, a session is rotated once it reaches either limit, the oldest files
+// are deleted beyond the retention limits
+#define SDIO_SESSION_ROTATE_BYTES (256UL * 1024 * 1024)
+#define SDIO_SESSION_ROTATE_S (24 * 3600)
+#define SDIO_SESSION_RETAIN_COUNT (SESSION_INDEX_MAX - 1)
+#define SDIO_SESSION_RETAIN_BYTES (8ULL * 1024 * 1024 * 1024)
+#define SDIO_SESSION_SAVE_MS 30000 // Size / update time of the open session
+#define SDIO_SESSION_INDEX_PATH MOUNT_POINT "/" SESSION_INDEX_NAME
 
 /*
  * ================================================================
@@ -26,7 +89,18 @@
 SDIO_FileConfig SDIO_txt;
 SDIO_TxBuffer buffer;  */
 SDIO_FileConfig LOG_CSV;
+session_index_t SDIO_sessions;
+session_entry_t *SDIO_session; // Session of LOG_CSV
+char SDIO_log_name[16];
 SDIO_TxBuffer SDIO_buffer;
+SDIO_FileConfig STATS_CSV; // Per-ID bus statistics (can_stats), one row per ID every CAN_STATS_PERIOD_MS
+SDIO_FileConfig LOG_CAN;   // Raw frame log of the session, written by SDIO_Frame_Log_Task only
+char SDIO_frame_name[16];
+
+// Session numbers shared by the two SD tasks: set by SDIO_Session_Begin (SDIO_Log_Task, or app_main
+// before the tasks start), open frame log of SDIO_Frame_Log_Task
+static _Atomic uint32_t SDIO_frame_session;
+static _Atomic uint32_t SDIO_frame_open = SDIO_FRAME_LOG_NO_SESSION;
 
 /*
  * ================================================================
@@ -42,33 +116,175 @@ twai_general_config_t g_config = {
     .clkout_io = TWAI_IO_UNUSED,
     .bus_off_io = TWAI_IO_UNUSED,
     .tx_queue_len = 5,
-    .rx_queue_len = 5,
+    .rx_queue_len = CAN_RX_QUEUE_LEN,
     .alerts_enabled = TWAI_ALERT_ALL,
     .clkout_divider = 0};
 twai_timing_config_t t_config = TWAI_TIMING_CONFIG_125KBITS();
 
+// Replaced at start-up by the tightest filter covering SDIO_log_messages (can_filter_from_table)
 twai_filter_config_t f_config = TWAI_FILTER_CONFIG_ACCEPT_ALL();
 
+// CAN receive path metrics, updated by CAN_Receive_Task only
+typedef struct
+{
+    uint32_t frames;           // Frames pulled from the driver RX queue
+    uint32_t max_burst;        // Largest number of frames drained in a single wakeup
+    uint32_t rx_missed_count;  // Frames lost because the driver RX queue was full
+    uint32_t rx_overrun_count; // Frames lost because the hardware RX FIFO overran
+    uint32_t sw_filtered;      // Frames passed by the hardware filter but not registered (dropped)
+} CAN_RxMetrics_t;
+
+CAN_RxMetrics_t CAN_rx_metrics;
+
 /*
  * ================================================================
  * 							RTOS Config Variables
  * ================================================================
  *
  * */
-// Define Queue Handler
-QueueHandle_t CAN_SDIO_queue_Handler;
-QueueHandle_t telemetry_queue;
+// Broadcast ring: CAN_Receive_Task writes each frame once, every sink that needs every frame
+// reads it through its own consumer. Sinks of the latest values (SD rows, MQTT) read CAN_signal_store.
+can_ring_t CAN_frame_ring;
+can_ring_consumer_t telemetry_consumer;
+can_ring_consumer_t frame_log_consumer;
 
 // Define Tasks Handler to hold task ID
 TaskHandle_t CAN_Receive_TaskHandler;
 TaskHandle_t SDIO_Log_TaskHandler;
+TaskHandle_t SDIO_Frame_Log_TaskHandler;
 
 // Declare Tasks Entery point
 void CAN_Receive_Task_init(void *pvParameters);
 void SDIO_Log_Task_init(void *pvParameters);
+void SDIO_Frame_Log_Task_init(void *pvParameters);
+
+/**================================================================
+ * @Fn				- SDIO_Session_Path
+ * @breif			- Path of one file of a session
+ * @param [in]		- entry: Session
+ * @param [in]		- extension: "BIN", "CSV" or "CAN"
+ * @param [out]		- name: File name
+ * @param [out]		- path: Path on the card, sizeof(SDIO_FileConfig.path)
+ * @retval			- None
+ */
+static void SDIO_Session_Path(const session_entry_t *entry, const char *extension, char *name, char *path)
+{
+    session_index_name(entry, extension, name, 16);
+    snprintf(path, sizeof(LOG_CSV.path), "%s/%s", MOUNT_POINT, name);
+}
+
+/**================================================================
+ * @Fn				- SDIO_Session_Begin
+ * @breif			- Starts the next session: deletes the files beyond the retention limits, adds
+ * 					  the session to the index and names LOG_CSV after it
+ * @param [in]		- now_us: UTC microseconds since the epoch
+ * @retval			- None
+ * Note				- The index is saved by the caller
+ */
+static void SDIO_Session_Begin(int64_t now_us)
+{
+    session_entry_t expired;
+    char name[16];
+    char path[sizeof(LOG_CSV.path)];
+
+    // One slot is kept free for the new session
+    while (session_index_expire(&SDIO_sessions, SDIO_SESSION_RETAIN_COUNT, SDIO_SESSION_RETAIN_BYTES, &expired))
+    {
+        SDIO_Session_Path(&expired, (expired.format == BIN) ? "BIN" : "CSV", name, path);
+        ESP_LOGI("SDIO", "Retention: deleting %s (%lu bytes with its frame log)", name, (unsigned long)expired.size);
+        unlink(path);
+        SDIO_Session_Path(&expired, "CAN", name, path);
+        unlink(path);
+    }
+
+    SDIO_session = session_index_begin(&SDIO_sessions, SDIO_LOG_FORMAT, (SDIO_LOG_FORMAT == BIN) ? BINLOG_VERSION : 0,
+                                       binlog_schema_id(), now_us);
+    SDIO_Session_Path(SDIO_session, SDIO_LOG_EXTENSION, SDIO_log_name, LOG_CSV.path);
+
+    // Files the index does not know (no index yet, or a lost one) are never overwritten
+    struct stat st;
+    SDIO_Session_Path(SDIO_session, "CAN", name, path);
+    for (uint16_t i = 0; (i < SESSION_NAME_MODULO) && ((stat(LOG_CSV.path, &st) == 0) || (stat(path, &st) == 0)); i++)
+    {
+        SDIO_session->number = SDIO_sessions.next_number++;
+        SDIO_Session_Path(SDIO_session, SDIO_LOG_EXTENSION, SDIO_log_name, LOG_CSV.path);
+        SDIO_Session_Path(SDIO_session, "CAN", name, path);
+    }
+    atomic_store(&SDIO_frame_session, SDIO_session->number);
+    ESP_LOGI("SDIO", "Session %lu: %s", (unsigned long)SDIO_session->number, SDIO_log_name);
+}
 
+/**================================================================
+ * @Fn				- SDIO_Stats_Open
+ * @breif			- Opens STATS_CSV in SDIO_stats_stream, the header line starts a new file
+ * @param [in]		- None
+ * @retval			- log_stream_open / log_stream_text result
+ * Note				- A file last written more than MAX_DAYS_MODIFIED days ago is started again
+ */
+static esp_err_t SDIO_Stats_Open(void)
+{
+    struct stat st;
+    snprintf(STATS_CSV.path, sizeof(STATS_CSV.path), "%s/%s", MOUNT_POINT, STATS_CSV.name);
+    if ((stat(STATS_CSV.path, &st) == 0) && (compare_file_time_days(STATS_CSV.path) > MAX_DAYS_MODIFIED))
+    {
+        unlink(STATS_CSV.path);
+    }
+    esp_err_t err = log_stream_open(&SDIO_stats_stream, &STATS_CSV);
+    if ((err == ESP_OK) && (STATS_CSV.valid == 0))
+    {
+        err = log_stream_text(&SDIO_stats_stream, CAN_STATS_CSV_HEADER "\n");
+    }
+    return err;
+}
+
+/**================================================================
+ * @Fn				- SDIO_Log_Row
+ * @breif			- Appends one row to the snapshot log, a lost card starts the recovery
+ * @param [in]		- row: Readings to be stored
+ * @retval			- log_stream_row result, ESP_ERR_INVALID_STATE if the row was not taken
+ * Note				- SDIO_Log_Task only
+ */
+static esp_err_t SDIO_Log_Row(const SDIO_TxBuffer *row)
+{
+    esp_err_t err = log_stream_row(&SDIO_log_stream, row);
+    if ((err == ESP_ERR_INVALID_STATE) || (err == ESP_FAIL))
+    {
+        sd_recovery_lost(&SD_card_recovery);
+    }
+    return err;
+}
+
+/**================================================================
+ * @Fn				- SDIO_Replay_Rows
+ * @breif			- Writes back up to SD_RECOVERY_REPLAY_ROWS spilled rows, oldest first
+ * @param [in]		- None
+ * @retval			- true once the spill ring is empty
+ * Note				- SDIO_Log_Task only, while the card is UP
+ */
+static bool SDIO_Replay_Rows(void)
+{
+    const SDIO_TxBuffer *row;
+    for (uint16_t i = 0; (i < SD_RECOVERY_REPLAY_ROWS) && ((row = sd_recovery_spilled(&SD_card_recovery)) != NULL); i++)
+    {
+        if (SDIO_Log_Row(row) == ESP_ERR_INVALID_STATE)
+        {
+            return false; // Card lost again: kept for the next remount
+        }
+        sd_recovery_replayed(&SD_card_recovery);
+    }
+    return (sd_recovery_spilled(&SD_card_recovery) == NULL);
+}
+
+#ifndef PIO_UNIT_TESTING // The unit tests under test/ build this tree with their own app_main
 void app_main()
 {
+#if CONFIG_IDF_TARGET_LINUX
+    host_store_bench_run();
+    host_codec_bench_run();
+    host_format_bench_run();
+    host_time_bench_run();
+    host_dispatch_bench_run();
+#endif
     //==========================================WIFI Implementation (DONE)===========================================
     // ESP_ERROR_CHECK(wifi_init("Mi A2", "min@fathy2004"));
     ESP_ERROR_CHECK(wifi_init("Belal's A34", "password"));
@@ -104,29 +320,86 @@ void app_main()
     }
     ESP_LOGI(TAG, "Filesystem mounted");
 
-    char name_buffer[12] = "LOG_0.CSV";
-    LOG_CSV.name = name_buffer;
-    LOG_CSV.type = CSV;
+    LOG_CSV.name = SDIO_log_name;
+    LOG_CSV.type = SDIO_LOG_FORMAT;
+    LOG_CSV.preallocate = SDIO_LOG_PREALLOCATE;
+    LOG_CSV.codec = SDIO_LOG_CODEC;
+#if CONFIG_IDF_TARGET_LINUX
+    LOG_CSV.preallocate = host_sdmmc_preallocate(LOG_CSV.preallocate);
+    LOG_CSV.codec = host_sdmmc_codec(LOG_CSV.codec);
+#endif
+    LOG_CAN.name = SDIO_frame_name;
+    LOG_CAN.type = FRAMES;
+    LOG_CAN.preallocate = SDIO_FRAME_LOG_PREALLOCATE;
+    LOG_CAN.bitrate = CAN_BUS_KBITS * 1000;
+#if CONFIG_IDF_TARGET_LINUX
+    LOG_CAN.preallocate = host_sdmmc_preallocate(LOG_CAN.preallocate);
+#endif
+
+    // One read of the session index instead of probing LOG_<n> files:
+    // continue the last session if it is recent and compatible, start the next one otherwise
+    if (session_index_load(&SDIO_sessions, SDIO_SESSION_INDEX_PATH) != ESP_OK)
+    {
+        ESP_LOGW(TAG, "No valid %s, starting a new index", SESSION_INDEX_NAME);
+    }
+    int64_t now_us = Time_Sync_epoch_us(esp_timer_get_time());
+    session_entry_t *last = session_index_last(&SDIO_sessions);
+    if ((last != NULL) && (last->status == SESSION_OPEN))
+    {
+        last->cuts++; // Not closed by a rotation: the power was cut
+    }
+    if ((last != NULL) && (last->format == SDIO_LOG_FORMAT) && (last->schema == binlog_schema_id()) &&
+        (last->version == ((SDIO_LOG_FORMAT == BIN) ? BINLOG_VERSION : 0)) &&
+        ((now_us - last->update_us) <= (int64_t)MAX_DAYS_MODIFIED * 24 * 3600 * 1000000) &&
+        ((now_us - last->start_us) < (int64_t)SDIO_SESSION_ROTATE_S * 1000000) &&
+        (last->size < SDIO_SESSION_ROTATE_BYTES))
+    {
+        SDIO_session = last;
+        SDIO_session->status = SESSION_OPEN;
+        SDIO_session->boots++;
+        SDIO_Session_Path(SDIO_session, SDIO_LOG_EXTENSION, SDIO_log_name, LOG_CSV.path);
+        atomic_store(&SDIO_frame_session, SDIO_session->number);
+        ESP_LOGI(TAG, "Continuing session %lu: %s", (unsigned long)SDIO_session->number, SDIO_log_name);
+    }
+    else
+    {
+        if (last != NULL)
+        {
+            last->status = SESSION_CLOSED;
+        }
+        SDIO_Session_Begin(now_us);
+    }
+    if (session_index_save(&SDIO_sessions, SDIO_SESSION_INDEX_PATH) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Unable to write %s", SESSION_INDEX_NAME);
+    }
 
-    snprintf(LOG_CSV.path, sizeof(LOG_CSV.path), "%s/%s", MOUNT_POINT, LOG_CSV.name);
+    // Card qualification: write size and sync policy of the writers, the scratch buffer is given
+    // back to the heap before the writer pools are taken
+    uint8_t *scratch = heap_caps_malloc(SD_WRITER_BUFFER_SIZE, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (sd_health_qualify(MOUNT_POINT, scratch, (scratch != NULL) ? SD_WRITER_BUFFER_SIZE : 0, &SD_card_health) != ESP_OK)
+    {
+        ESP_LOGW(TAG, "SD card not qualified, default writer policy");
+    }
+    heap_caps_free(scratch);
+    if (sd_writer_configure(&SD_card_health.policy) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Unable to apply the SD writer policy");
+    }
 
-    // // Check if the files exists and Modification Time more than 2 days
-    // //if it exists and last modified was more than 2 days
-    // //      Increment the name of the file and check again
-    // // if it exists and last modified in less than 2 days           |
-    // //      Don't change name and add to the already existing file  |   This logic is implemented
-    // // if it doesn't exist                                          |   SDIO_SD_Create_Write_File()
-    // //      Create file                                             |
+    // One write-behind writer per SD file, all served by the sd_writer task; CAN_STAT.CSV only
+    // gets a few rows per CAN_STATS_PERIOD_MS
+    if ((log_stream_init(&SDIO_log_stream, SD_WRITER_POOL_SIZE) != ESP_OK) ||
+        (log_stream_init(&SDIO_frame_stream, SD_WRITER_POOL_SIZE) != ESP_OK) ||
+        (log_stream_init(&SDIO_stats_stream, SD_WRITER_SMALL_POOL_SIZE) != ESP_OK))
+    {
+        ESP_LOGE(TAG, "Unable to start the SD writer");
+    }
 
-    struct stat st;
-    uint8_t Session_Num = 0;
-    while ((stat(LOG_CSV.path, &st) == 0) && (compare_file_time_days(LOG_CSV.path) > MAX_DAYS_MODIFIED))
+    // A failed write or sync is recovered in the background (remount with backoff), the SD tasks keep running
+    if (sd_recovery_init(&SD_card_recovery) != ESP_OK)
     {
-        // it exists and last modified was more than 2 days
-        Session_Num++;
-        // Update Name and path
-        snprintf(name_buffer, sizeof(name_buffer), "LOG_%u.CSV", Session_Num);
-        snprintf(LOG_CSV.path, sizeof(LOG_CSV.path), "%s/%s", MOUNT_POINT, LOG_CSV.name);
+        ESP_LOGE(TAG, "Unable to start the SD recovery");
     }
 
     //@debug SDIO
@@ -142,7 +415,6 @@ void app_main()
         LOG_CSV.name = "LOG_1.CSV";
         LOG_CSV.type = CSV;
         SDIO_buffer.string = "LOG1";
-        SDIO_buffer.timestamp = "2023-10-01 12:00:00";
         SDIO_buffer.adc.SUS_1 = 15;
         SDIO_buffer.adc.SUS_2 = 20;
         SDIO_buffer.adc.SUS_3 = 25;
@@ -199,6 +471,26 @@ void app_main()
 
     //==========================================CAN Implementation (DONE)===========================================
 
+    // The acceptance filter is derived from the registered IDs, so the dispatch table is built first
+    if (can_dispatch_init(&SDIO_log_dispatch, SDIO_log_messages, SDIO_log_message_count) != ESP_OK)
+    {
+        ESP_LOGE("RTOS", "Invalid CAN ID dispatch table");
+    }
+    can_stats_init(&CAN_bus_stats, &SDIO_log_dispatch, CAN_BUS_KBITS * 1000);
+    signal_store_init(&CAN_signal_store, SDIO_log_dispatch.count);
+
+    can_filter_result_t filter;
+    if (can_filter_from_table(SDIO_log_messages, SDIO_log_message_count, &filter) != ESP_OK)
+    {
+        ESP_LOGW("CAN", "Mixed standard / extended IDs, hardware filter accepts all");
+    }
+    f_config = filter.config;
+    ESP_LOGI("CAN", "%s filter, code: 0x%08lx, mask: 0x%08lx, accepts %lu IDs for %lu wanted (%.1f%% false accepts)",
+             f_config.single_filter ? "Single" : "Dual", (unsigned long)f_config.acceptance_code,
+             (unsigned long)f_config.acceptance_mask, (unsigned long)filter.accepted_ids,
+             (unsigned long)filter.wanted_ids,
+             filter.accepted_ids ? 100.0 * (filter.accepted_ids - filter.wanted_ids) / filter.accepted_ids : 0.0);
+
     // Can Initialization
     if (twai_driver_install(&g_config, &t_config, &f_config) == ESP_OK)
     {
@@ -212,30 +504,32 @@ void app_main()
 
     //==========================================RTOS Implementation (Semaphore can be added)===========================================
 
-    //=======================Create Queue====================//
+    //=======================Create Frame Ring====================//
 
-    telemetry_queue = xQueueCreate(Queue_Size, sizeof(twai_message_t));
-    CAN_SDIO_queue_Handler = xQueueCreate(Queue_Size, sizeof(twai_message_t));
+    can_ring_init(&CAN_frame_ring);
 
-    if (telemetry_queue == NULL) // If there is no queue created
+#if !USE_MQTT
+    // UDP streams every frame, MQTT publishes the latest values of CAN_signal_store
+    if (can_ring_add_consumer(&CAN_frame_ring, &telemetry_consumer, "telemetry") != ESP_OK)
     {
-        ESP_LOGE("RTOS", "Unable to Create Structure Queue\r\n");
+        ESP_LOGE("RTOS", "Unable to attach CAN ring consumers");
         vTaskDelay(pdMS_TO_TICKS(1000));
     }
-
-    if (CAN_SDIO_queue_Handler == NULL) // If there is no queue created
+#endif
+    // Raw frame log: every frame of the ring, next to the snapshot log
+    if (can_ring_add_consumer(&CAN_frame_ring, &frame_log_consumer, "sd_frames") != ESP_OK)
     {
-        ESP_LOGE("RTOS", "Unable to Create Structure Queue");
-        vTaskDelay(pdMS_TO_TICKS(1000));
+        ESP_LOGE("RTOS", "Unable to attach CAN ring consumers");
     }
 
     //=============Define Tasks=================//
     BaseType_t result_SDIO = xTaskCreatePinnedToCore((TaskFunction_t)SDIO_Log_Task_init, "SDIO_Log_Task", 4096, NULL, (UBaseType_t)4, &SDIO_Log_TaskHandler, 0);
+    BaseType_t result_Frames = xTaskCreatePinnedToCore((TaskFunction_t)SDIO_Frame_Log_Task_init, "SDIO_Frame_Log_Task", 4096, &frame_log_consumer, (UBaseType_t)4, &SDIO_Frame_Log_TaskHandler, 0);
     BaseType_t result_CAN = xTaskCreatePinnedToCore((TaskFunction_t)CAN_Receive_Task_init, "CAN_Receive_Task", 4096, NULL, (UBaseType_t)3, &CAN_Receive_TaskHandler, 1);
 #if USE_MQTT
-    BaseType_t result_MQT = xTaskCreatePinnedToCore(mqtt_sender_task, "mqtt_sender", 4096, telemetry_queue, 3, NULL, 1);
+    BaseType_t result_MQT = xTaskCreatePinnedToCore(mqtt_sender_task, "mqtt_sender", 4096, &CAN_signal_store, 3, NULL, 1);
 #else
-    BaseType_t result_MQT = xTaskCreatePinnedToCore(udp_sender_task, "udp_sender", 4096, telemetry_queue, 3, NULL, 1);
+    BaseType_t result_MQT = xTaskCreatePinnedToCore(udp_sender_task, "udp_sender", 4096, &telemetry_consumer, 3, NULL, 1);
 #endif
     BaseType_t result_ConMon = xTaskCreatePinnedToCore(connectivity_monitor_task, "conn_monitor", 4096, NULL, 3, NULL, 1);
 
@@ -244,6 +538,11 @@ void app_main()
     else
         ESP_LOGE("SDIO_Log_Task", "Task creation failed");
 
+    if (result_Frames == pdPASS)
+        ESP_LOGI("SDIO_Frame_Log_Task", "Task created successfully");
+    else
+        ESP_LOGE("SDIO_Frame_Log_Task", "Task creation failed");
+
     if (result_CAN == pdPASS)
         ESP_LOGI("CAN_Receive_Task", "Task created successfully");
     else
@@ -259,12 +558,21 @@ void app_main()
     else
         ESP_LOGE("conn_monitor", "Task creation failed");
 
+#if CONFIG_IDF_TARGET_LINUX
+    // Bus traffic starts once every sink is attached, so the report covers every frame
+    if (host_can_source_start(&CAN_frame_ring) != ESP_OK)
+    {
+        ESP_LOGE("CAN", "Unable to start the host CAN source");
+    }
+#endif
+
     while (1)
     {
 
         vTaskDelay(pdMS_TO_TICKS(1000));
     }
 }
+#endif // PIO_UNIT_TESTING
 
 void CAN_Receive_Task_init(void *pvParameters) // DONE
 {
@@ -273,22 +581,51 @@ void CAN_Receive_Task_init(void *pvParameters) // DONE
     esp_err_t ret;
     uint32_t alerts = 0;
     twai_status_info_t s;
+    uint32_t burst;
+    uint32_t frames_last = 0;
+    TickType_t last_report = xTaskGetTickCount();
     ESP_LOGI("CAN_Receive_Task", "CAN IS WORKING");
     ESP_LOGI("CAN_Receive_Task", "Running on core %d", xPortGetCoreID());
     while (1)
     {
-        if (twai_receive(&rx_msg, pdMS_TO_TICKS(1000)) == ESP_OK)
+        // Block until the first frame arrives, then drain everything the ISR queued meanwhile
+        if (twai_receive(&rx_msg, pdMS_TO_TICKS(CAN_RX_METRICS_PERIOD_MS)) == ESP_OK)
         {
-
-            // Format the message into the string buffer
-            xQueueSend(telemetry_queue, &rx_msg, (TickType_t)10);
-
-            if (xQueueSend(CAN_SDIO_queue_Handler, &rx_msg, (TickType_t)10) != pdPASS)
+            burst = 0;
+            do
             {
-                if (SDIO_Log_TaskHandler != NULL)
+                // Stamped as soon as the frame leaves the driver, converted to UTC only at the edges
+                int64_t rx_time_us = esp_timer_get_time();
+                uint16_t slot = can_dispatch_lookup(&SDIO_log_dispatch, rx_msg.identifier, rx_msg.extd);
+                can_stats_record(&CAN_bus_stats, slot, &rx_msg, rx_time_us);
+
+                // Second stage: the hardware mask may let unregistered IDs through
+                if (slot == CAN_DISPATCH_NO_SLOT)
                 {
-                    xTaskNotifyGive(SDIO_Log_TaskHandler); // Notify SDIO task
+                    CAN_rx_metrics.sw_filtered++;
                 }
+                else
+                {
+                    // Written once, never blocks: slow sinks only lose their own oldest frames
+                    can_ring_publish(&CAN_frame_ring, &rx_msg, rx_time_us);
+                    signal_store_write(&CAN_signal_store, slot, &rx_msg, rx_time_us);
+                }
+                burst++;
+            } while ((burst < CAN_RX_MAX_BURST) && (twai_receive(&rx_msg, 0) == ESP_OK));
+
+            // One wakeup per burst for every waiting sink
+            can_ring_notify(&CAN_frame_ring);
+
+            CAN_rx_metrics.frames += burst;
+            if (burst > CAN_rx_metrics.max_burst)
+            {
+                CAN_rx_metrics.max_burst = burst;
+            }
+
+            // Burst limit reached with frames still pending: let same priority tasks run
+            if (burst >= CAN_RX_MAX_BURST)
+            {
+                taskYIELD();
             }
         }
         else
@@ -297,13 +634,33 @@ void CAN_Receive_Task_init(void *pvParameters) // DONE
             ret = twai_read_alerts(&alerts, 0);
             if (ret == ESP_OK)
             {
-                ESP_LOGI(TAG, "TWAI alert: %08ld", alerts);
+                ESP_LOGI(TAG, "TWAI alert: %08lu", (unsigned long)alerts);
+            }
+        }
+
+        // Periodic driver status report, independent of bus activity
+        if ((xTaskGetTickCount() - last_report) >= pdMS_TO_TICKS(CAN_RX_METRICS_PERIOD_MS))
+        {
+            last_report = xTaskGetTickCount();
+            if (twai_get_status_info(&s) == ESP_OK)
+            {
+                CAN_rx_metrics.rx_missed_count = s.rx_missed_count;
+                CAN_rx_metrics.rx_overrun_count = s.rx_overrun_count;
+                ESP_LOGI(TAG, "RX errors: %lu, bus errors: %lu, RX queue full: %lu, RX FIFO overrun: %lu",
+                         (unsigned long)s.rx_error_counter, (unsigned long)s.bus_error_count,
+                         (unsigned long)s.rx_missed_count, (unsigned long)s.rx_overrun_count);
+            }
+            ESP_LOGI(TAG, "Frames/s: %lu, max burst: %lu, filtered: %lu",
+                     (unsigned long)(CAN_rx_metrics.frames - frames_last),
+                     (unsigned long)CAN_rx_metrics.max_burst,
+                     (unsigned long)CAN_rx_metrics.sw_filtered);
+            for (uint8_t i = 0; i < CAN_frame_ring.consumer_count; i++)
+            {
+                ESP_LOGI(TAG, "Overruns %s: %lu", CAN_frame_ring.consumers[i]->name,
+                         (unsigned long)can_ring_overruns(CAN_frame_ring.consumers[i]));
             }
-            twai_get_status_info(&s);
-            ESP_LOGI(TAG, "RX errors: %ld, bus errors: %ld, RX queue full: %ld",
-                     s.rx_error_counter, s.bus_error_count, s.rx_missed_count);
+            frames_last = CAN_rx_metrics.frames;
         }
-        vTaskDelay(pdMS_TO_TICKS(10));
     }
 }
 void SDIO_Log_Task_init(void *pvParameters) // WORKS! Needs testing
@@ -312,170 +669,330 @@ void SDIO_Log_Task_init(void *pvParameters) // WORKS! Needs testing
     const char *TAG = "SDIO_Log_Task";
     ESP_LOGI(TAG, "SDO_LOG IS WORKING");
     ESP_LOGI("SDIO_Log_Task", "Running on core %d", xPortGetCoreID());
-    uint8_t prev_reset = 0;
 
     // Assign Zero to all elements of SDIO_buffer and Log initial Line
     EMPTY_SDIO_BUFFER(SDIO_buffer);
 
-    if (SDIO_SD_Create_Write_File(&LOG_CSV, &SDIO_buffer) == ESP_OK)
+    // Rows are appended by the write-behind writer task, this task never waits for the card
+    if ((log_stream_open(&SDIO_log_stream, &LOG_CSV) == ESP_OK) && (log_stream_row(&SDIO_log_stream, &SDIO_buffer) == ESP_OK))
         ESP_LOGI(TAG, "%s Written Successfully!", LOG_CSV.name);
+    else
+        ESP_LOGE(TAG, "Unable to start the SD writer of %s", LOG_CSV.name);
+    sd_writer_stats_t writer_last = {0};
+    binlog_codec_stats_t codec_last = {0};
+    static sd_health_report_t health_report;
+    uint8_t health_last = 0;
+    sd_recovery_state_t sd_state = SD_RECOVERY_UP;
 
     // if (SDIO_SD_Close_file() == ESP_OK)
     //     ESP_LOGI(TAG, "File Closed Successfully!");
 
-    twai_message_t buffer;
-    const uint8_t NUM_IDS = COMM_CAN_ID_COUNT;
-    uint8_t id_received[NUM_IDS];
-    TickType_t period = pdMS_TO_TICKS(50);
+    // Bus statistics file, rows are appended every CAN_STATS_PERIOD_MS
+    static char stats_rows[CAN_STATS_MAX_IDS * 128];
+    static can_stats_report_t stats_report;
+    can_stats_window_t stats_window = {0};
+    TickType_t last_stats = xTaskGetTickCount();
+
+    STATS_CSV.name = "CAN_STAT.CSV";
+    STATS_CSV.type = TXT; // Rows are formatted by can_stats, the file only stores the strings
+    if (SDIO_Stats_Open() == ESP_OK)
+        ESP_LOGI(TAG, "%s Written Successfully!", STATS_CSV.name);
+    can_stats_snapshot(&CAN_bus_stats, &stats_window, &stats_report);
+
+    int64_t row_us;
+    uint32_t missed_last = 0;
+    static snapshot_t snapshot;
+    TickType_t last_session_save = xTaskGetTickCount();
+
+    if (snapshot_init(&snapshot, &SDIO_log_dispatch, &CAN_signal_store, SDIO_LOG_RATE_HZ,
+                      xTaskGetCurrentTaskHandle()) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Unable to start the %d Hz row timer", SDIO_LOG_RATE_HZ);
+    }
 
     while (1)
     {
-        // Wait for notification
-        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
-
-        // 1. Clear buffer and flags
-        EMPTY_SDIO_BUFFER(SDIO_buffer);
-        memset(&buffer, 0, sizeof(twai_message_t));
+        // Woken by the row timer only, the latest frames are read from CAN_signal_store
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(CAN_STATS_PERIOD_MS));
 
-        TickType_t start = xTaskGetTickCount();
-        TickType_t now = start;
-        uint8_t received_count = 0;
-
-        while ((now - start) < period && received_count < NUM_IDS)
+        // Card recovery (sd_recovery): files closed while the card is away, reopened once it is mounted again
+        sd_state = sd_recovery_state(&SD_card_recovery);
+        if (sd_state == SD_RECOVERY_MOUNTED)
         {
-            TickType_t remaining = period - (now - start);
-            if (xQueueReceive(CAN_SDIO_queue_Handler, &buffer, remaining))
+            // The card may have kept a torn block, appending resumes after the last valid one
+            if (log_stream_open(&SDIO_log_stream, &LOG_CSV) == ESP_OK)
             {
-                //@debug SDIO
-                // To print the Message Received
-                /*  printf("ID = 0x%03lX ", buffer.identifier);
-                printf("Extended? %s ", buffer.extd ? "Yes" : "No");
-                printf("RTR? %s ", buffer.rtr ? "Yes" : "No");
-                printf("DLC = %d\n", buffer.data_length_code);
-                for (int i = 0; i < buffer.data_length_code; i++)
+                if (SDIO_Stats_Open() != ESP_OK)
                 {
-                    printf("byte[%d] = 0x%02X ", i, buffer.data[i]);
-                }
-                printf("\n");
-                */
-
-                switch (buffer.identifier) // Check the ID of the message
-                {
-                case COMM_CAN_ID_IMU_ANGLE:
-                    if (id_received[COMM_CAN_ID_IMU_ANGLE - COMM_CAN_ID_FISRT] == 0)
-                    {
-                        SDIO_buffer.imu_ang = *((COMM_message_IMU_t *)buffer.data);
-                        id_received[COMM_CAN_ID_IMU_ANGLE - COMM_CAN_ID_FISRT] = 1;
-                        received_count++;
-                    }
-                    break;
-
-                case COMM_CAN_ID_IMU_ACCEL:
-                    if (id_received[COMM_CAN_ID_IMU_ACCEL - COMM_CAN_ID_FISRT] == 0)
-                    {
-                        SDIO_buffer.imu_accel = *((COMM_message_IMU_t *)buffer.data);
-                        id_received[COMM_CAN_ID_IMU_ACCEL - COMM_CAN_ID_FISRT] = 1;
-                        received_count++;
-                    }
-                    break;
-
-                case COMM_CAN_ID_ADC:
-                    if (id_received[COMM_CAN_ID_ADC - COMM_CAN_ID_FISRT] == 0)
-                    {
-                        SDIO_buffer.adc = *((COMM_message_ADC_t *)buffer.data);
-                        id_received[COMM_CAN_ID_ADC - COMM_CAN_ID_FISRT] = 1;
-                        received_count++;
-                    }
-                    break;
-
-                case COMM_CAN_ID_PROX_ENCODER:
-                    if (id_received[COMM_CAN_ID_PROX_ENCODER - COMM_CAN_ID_FISRT] == 0)
-                    {
-                        SDIO_buffer.prox_encoder = *((COMM_message_PROX_encoder_t *)buffer.data);
-                        id_received[COMM_CAN_ID_PROX_ENCODER - COMM_CAN_ID_FISRT] = 1;
-                        received_count++;
-                    }
-                    break;
-
-                case COMM_CAN_ID_GPS_LATLONG:
-                    if (id_received[COMM_CAN_ID_GPS_LATLONG - COMM_CAN_ID_FISRT] == 0)
-                    {
-                        SDIO_buffer.gps = *((COMM_message_GPS_t *)buffer.data);
-                        id_received[COMM_CAN_ID_GPS_LATLONG - COMM_CAN_ID_FISRT] = 1;
-                        received_count++;
-                    }
-                    break;
-
-                case COMM_CAN_ID_TEMP:
-                    if (id_received[COMM_CAN_ID_TEMP - COMM_CAN_ID_FISRT] == 0)
-                    {
-                        SDIO_buffer.temp = *((COMM_message_Temp_t *)buffer.data);
-                        id_received[COMM_CAN_ID_TEMP - COMM_CAN_ID_FISRT] = 1;
-                        received_count++;
-                    }
-                    break;
-
-                default:
-                    break;
+                    ESP_LOGW(TAG, "Unable to reopen %s", STATS_CSV.name);
                 }
+                sd_recovery_resume(&SD_card_recovery);
+                ESP_LOGI(TAG, "%s reopened from byte %lu, %u spilled rows to write back", LOG_CSV.name,
+                         (unsigned long)LOG_CSV.valid, SD_card_recovery.count);
+            }
+            else
+            {
+                ESP_LOGE(TAG, "Unable to reopen %s", LOG_CSV.name);
+                sd_recovery_lost(&SD_card_recovery);
             }
-            now = xTaskGetTickCount();
+            sd_state = sd_recovery_state(&SD_card_recovery);
+        }
+        if (sd_state != SD_RECOVERY_UP)
+        {
+            log_stream_close(&SDIO_log_stream);
+            log_stream_close(&SDIO_stats_stream);
+            sd_recovery_release(&SD_card_recovery, SD_RECOVERY_USER_LOG);
         }
 
-        // Log the Buffer on SD card
-        //@debug SDIO
-        // SDIO_SD_log_can_message_to_csv(&buffer);
-
-        if (SDIO_SD_Add_Data(&LOG_CSV, &SDIO_buffer) != ESP_OK)
+        if ((xTaskGetTickCount() - last_stats) >= pdMS_TO_TICKS(CAN_STATS_PERIOD_MS))
         {
-            if (prev_reset < 2)
+            last_stats = xTaskGetTickCount();
+            can_stats_snapshot(&CAN_bus_stats, &stats_window, &stats_report);
+            if ((sd_state == SD_RECOVERY_UP) && (can_stats_format_csv(&stats_report, stats_rows, sizeof(stats_rows)) > 0))
             {
-                esp_err_t ret;
-                SDIO_SD_DeInit();
+                // One more writer buffer: the stats rows never delay the snapshot rows
+                if (log_stream_text(&SDIO_stats_stream, stats_rows) != ESP_OK)
+                {
+                    ESP_LOGW(TAG, "Unable to append %s", STATS_CSV.name);
+                }
+            }
 
-                vTaskDelay(pdMS_TO_TICKS(2000));
+            // Card throughput while writing, and the worst wait of this task for a free buffer;
+            // the write() / fsync() p99 is of every writer over the session
+            sd_health_snapshot(&SD_card_health, &health_report);
+            const sd_writer_stats_t *w = &SDIO_log_stream.writer.stats;
+            int64_t busy_us = w->write_us - writer_last.write_us;
+            ESP_LOGI(TAG, "SD writer: %.2f MB/s sustained, %llu bytes appended, %lu writes, %lu syncs (%lu commits), "
+                          "write p99 %lu us, max write %lld us, max stall %lld us, %lu bytes dropped",
+                     (busy_us > 0) ? (double)(w->written - writer_last.written) / busy_us : 0.0,
+                     (unsigned long long)(w->bytes - writer_last.bytes), (unsigned long)(w->writes - writer_last.writes),
+                     (unsigned long)(w->syncs - writer_last.syncs), (unsigned long)(w->commits - writer_last.commits),
+                     (unsigned long)health_report.p99_us, (long long)w->max_write_us,
+                     (long long)w->max_stall_us, (unsigned long)w->dropped);
+            writer_last = *w;
+
+            // Card health changes: slower than qualified, drops, errors
+            if ((health_report.status & ~SD_HEALTH_QUALIFIED) != (health_last & ~SD_HEALTH_QUALIFIED))
+            {
+                ESP_LOGW(TAG, "SD health 0x%02x: write p99 %lu us (qualified %lu us), max %lu us, %lu errors, %lu bytes dropped",
+                         health_report.status, (unsigned long)health_report.p99_us,
+                         (unsigned long)SD_card_health.sizes[SD_card_health.chosen].p99_us,
+                         (unsigned long)health_report.max_us, (unsigned long)health_report.errors,
+                         (unsigned long)health_report.dropped);
+            }
+            health_last = health_report.status;
 
-                ret = SDIO_SD_Init();
+            // Card outages: rows kept in RAM meanwhile, and every row that did not reach the card
+            const sd_recovery_t *rec = &SD_card_recovery;
+            const log_stream_stats_t *rows = &SDIO_log_stream.stats;
+            if ((rec->outages != 0) || (rows->dropped != 0) || (rows->torn != 0))
+            {
+                ESP_LOGW(TAG, "SD recovery: state %d, %lu outages, %lu remount attempts, down %lu ms, "
+                              "%lu rows spilled, %lu written back, %u pending, %lu overwritten, "
+                              "%lu rows dropped, %lu torn (%lu unverified)",
+                         sd_state, (unsigned long)rec->outages, (unsigned long)rec->attempts,
+                         (unsigned long)rec->down_ms, (unsigned long)rec->spilled, (unsigned long)rec->replayed,
+                         rec->count, (unsigned long)rec->dropped, (unsigned long)rows->dropped,
+                         (unsigned long)rows->torn, (unsigned long)rows->unverified);
+            }
 
-                if (ret != ESP_OK)
+            // Block coding: ratio and time this task spent coding, per MB of records
+            const binlog_codec_stats_t *z = &SDIO_log_stream.bin->stats;
+            if ((LOG_CSV.codec != BINLOG_CODEC_NONE) && (z->blocks != codec_last.blocks))
+            {
+                uint64_t raw = z->raw_bytes - codec_last.raw_bytes;
+                uint64_t stored = z->stored_bytes - codec_last.stored_bytes;
+                ESP_LOGI(TAG, "SD codec: %lu of %lu blocks coded, ratio %.2f, %.0f us per MB",
+                         (unsigned long)(z->packed - codec_last.packed), (unsigned long)(z->blocks - codec_last.blocks),
+                         (stored > 0) ? (double)raw / stored : 0.0,
+                         (raw > 0) ? (double)(z->compress_us - codec_last.compress_us) * 1e6 / raw : 0.0);
+            }
+            codec_last = *z;
+
+            // Session rotation by size or duration, the pending rows end the closed file
+            int64_t now_us = Time_Sync_epoch_us(esp_timer_get_time());
+            // Both files of the session count, the frame log once SDIO_Frame_Log_Task has switched to it
+            uint32_t frame_bytes = (atomic_load(&SDIO_frame_open) == SDIO_session->number)
+                                       ? atomic_load(&SDIO_frame_stream.writer.boundary)
+                                       : 0;
+            SDIO_session->size = atomic_load(&SDIO_log_stream.writer.boundary) + frame_bytes;
+            // Not while the card is away: the rows of the spill ring belong to the open session
+            bool rotate = (sd_state == SD_RECOVERY_UP) &&
+                          ((SDIO_session->size >= SDIO_SESSION_ROTATE_BYTES) ||
+                           ((now_us - SDIO_session->start_us) >= (int64_t)SDIO_SESSION_ROTATE_S * 1000000));
+            if (rotate)
+            {
+                log_stream_close(&SDIO_log_stream);
+                SDIO_session->size = LOG_CSV.valid + frame_bytes;
+                SDIO_session->status = SESSION_CLOSED;
+                SDIO_session->update_us = now_us;
+                SDIO_Session_Begin(now_us);
+
+                // Same first row as at boot
+                static SDIO_TxBuffer first_row;
+                EMPTY_SDIO_BUFFER(first_row);
+                if ((log_stream_open(&SDIO_log_stream, &LOG_CSV) != ESP_OK) || (SDIO_Log_Row(&first_row) != ESP_OK))
                 {
-                    prev_reset ++;
-                    ESP_LOGI(TAG, "ERROR! : %s is not Created // Appedended", LOG_CSV.name);
-                    if (ret == ESP_FAIL)
-                    {
-                        ESP_LOGE(TAG, "Failed to mount filesystem. "
-                                      "If you want the card to be formatted, set the EXAMPLE_FORMAT_IF_MOUNT_FAILED menuconfig option.");
-                    }
-                    else
-                    {
-                        ESP_LOGE(TAG, "Failed to initialize the card (%s). "
-                                      "Make sure SD card lines have pull-up resistors in place.",
-                                 esp_err_to_name(ret));
-                    }
+                    ESP_LOGE(TAG, "Unable to start %s", LOG_CSV.name);
+                    sd_recovery_lost(&SD_card_recovery);
                 }
-                else
+            }
+            if ((sd_state == SD_RECOVERY_UP) &&
+                (rotate || ((xTaskGetTickCount() - last_session_save) >= pdMS_TO_TICKS(SDIO_SESSION_SAVE_MS))))
+            {
+                last_session_save = xTaskGetTickCount();
+                SDIO_session->update_us = now_us;
+                if (session_index_save(&SDIO_sessions, SDIO_SESSION_INDEX_PATH) != ESP_OK)
                 {
-                    ESP_LOGI(TAG, "Filesystem mounted");
-                    prev_reset = 0;
+                    ESP_LOGW(TAG, "Unable to write %s", SESSION_INDEX_NAME);
                 }
-                    
-                
             }
-            else
+        }
+
+        if (!snapshot_due(&snapshot, &row_us))
+        {
+            continue; // Woken by the statistics period only
+        }
+        snapshot_take(&snapshot, &SDIO_buffer, row_us);
+        if (snapshot.missed != missed_last)
+        {
+            ESP_LOGW(TAG, "%lu rows missed, the SD task is slower than %d Hz",
+                     (unsigned long)(snapshot.missed - missed_last), SDIO_LOG_RATE_HZ);
+            missed_last = snapshot.missed;
+        }
+
+        // Spilled rows are written back first, so the log keeps the order of the rows
+        esp_err_t log_ret = ESP_ERR_INVALID_STATE;
+        if ((sd_state == SD_RECOVERY_UP) && SDIO_Replay_Rows())
+        {
+            log_ret = SDIO_Log_Row(&SDIO_buffer);
+        }
+        if (log_ret == ESP_ERR_INVALID_STATE)
+        {
+            // Not taken (card away, or rows still waiting): kept in RAM until the log is back
+            sd_recovery_spill(&SD_card_recovery, &SDIO_buffer);
+        }
+        else if (log_ret == ESP_OK)
+        {
+            // Latency of every frame that made it into this row (handed to the SD writer)
+            int64_t written_us = esp_timer_get_time();
+            for (uint16_t slot = 0; slot < COMM_MESSAGE_COUNT; slot++)
             {
-                SDIO_SD_DeInit();
-                while(1)
+                if (SDIO_buffer.fresh & snapshot.signal_mask[slot])
                 {
-                    ESP_LOGE(TAG, "SDIO_Logging is Down");
-                    vTaskDelay(pdMS_TO_TICKS(5000));
+                    pipeline_stats_record(&CAN_pipeline_stats, PIPELINE_STAGE_SD, written_us - SDIO_buffer.message_us[slot]);
                 }
             }
+            ESP_LOGD(TAG, "Logged CAN message to %s", LOG_CSV.name);
+        }
+    }
+}
+
+void SDIO_Frame_Log_Task_init(void *pvParameters)
+{
+    const char *TAG = "SDIO_Frame_Log_Task";
+    can_ring_consumer_t *frames = (can_ring_consumer_t *)pvParameters;
+    can_frame_t frame;
+    uint32_t open_session = SDIO_FRAME_LOG_NO_SESSION;
+    uint32_t overruns_last = can_ring_overruns(frames);
+    uint32_t unlogged = 0; // Frames read while no frame log was open, recorded as lost in the next block
+    TickType_t last_open = xTaskGetTickCount() - pdMS_TO_TICKS(CAN_STATS_PERIOD_MS);
+    TickType_t last_stats = xTaskGetTickCount();
+    framelog_stats_t stats_last = {0};
+    sd_writer_stats_t writer_last = {0};
+    ESP_LOGI(TAG, "Running on core %d", xPortGetCoreID());
+
+    while (1)
+    {
+        // Card away (sd_recovery): the frame log is closed for the unmount, reopened once the card is UP
+        bool sd_up = (sd_recovery_state(&SD_card_recovery) == SD_RECOVERY_UP);
+        if (!sd_up)
+        {
+            if (open_session != SDIO_FRAME_LOG_NO_SESSION)
+            {
+                log_stream_close(&SDIO_frame_stream);
+                atomic_store(&SDIO_frame_open, SDIO_FRAME_LOG_NO_SESSION);
+                open_session = SDIO_FRAME_LOG_NO_SESSION;
+            }
+            sd_recovery_release(&SD_card_recovery, SD_RECOVERY_USER_FRAMES);
+        }
+
+        // Follows the session of the snapshot log (boot, rotation); retried while the file cannot be opened
+        uint32_t session = atomic_load(&SDIO_frame_session);
+        if (sd_up && (session != open_session) &&
+            ((xTaskGetTickCount() - last_open) >= pdMS_TO_TICKS(CAN_STATS_PERIOD_MS)))
+        {
+            last_open = xTaskGetTickCount();
+            if (open_session != SDIO_FRAME_LOG_NO_SESSION)
+            {
+                log_stream_close(&SDIO_frame_stream);
+                atomic_store(&SDIO_frame_open, SDIO_FRAME_LOG_NO_SESSION);
+                open_session = SDIO_FRAME_LOG_NO_SESSION;
+            }
+            session_index_name(&(session_entry_t){.number = session}, "CAN", SDIO_frame_name, sizeof(SDIO_frame_name));
+            if (log_stream_open(&SDIO_frame_stream, &LOG_CAN) == ESP_OK)
+            {
+                open_session = session;
+                atomic_store(&SDIO_frame_open, session);
+                ESP_LOGI(TAG, "Raw frames to %s from byte %lu", LOG_CAN.name, (unsigned long)LOG_CAN.valid);
+            }
+            else
+            {
+                ESP_LOGE(TAG, "Unable to start %s", LOG_CAN.name);
+            }
+        }
+
+        if ((xTaskGetTickCount() - last_stats) >= pdMS_TO_TICKS(CAN_STATS_PERIOD_MS))
+        {
+            last_stats = xTaskGetTickCount();
+            const framelog_stats_t *s = &SDIO_frame_stream.frames->stats;
+            const sd_writer_stats_t *w = &SDIO_frame_stream.writer.stats;
+            ESP_LOGI(TAG, "SD frames: %lu frames in %lu blocks, %llu bytes, %lu lost, max stall %lld us, %lu bytes dropped",
+                     (unsigned long)(s->frames - stats_last.frames), (unsigned long)(s->blocks - stats_last.blocks),
+                     (unsigned long long)(s->bytes - stats_last.bytes), (unsigned long)(s->lost - stats_last.lost),
+                     (long long)w->max_stall_us, (unsigned long)(w->dropped - writer_last.dropped));
+            stats_last = *s;
+            writer_last = *w;
+        }
+
+        esp_err_t err = ESP_OK;
+        if (!can_ring_read(frames, &frame))
+        {
+            // Bus idle: the pending block is written once FRAMELOG_BLOCK_MAX_AGE_US old
+            if (open_session != SDIO_FRAME_LOG_NO_SESSION)
+            {
+                err = log_stream_flush(&SDIO_frame_stream, esp_timer_get_time());
+            }
+            if (err != ESP_FAIL)
+            {
+                can_ring_wait(frames, pdMS_TO_TICKS(SDIO_FRAME_LOG_IDLE_MS));
+            }
         }
         else
         {
+            // Frames the ring overwrote before this task read them
+            uint32_t overruns = can_ring_overruns(frames);
+            uint32_t lost = overruns - overruns_last;
+            overruns_last = overruns;
+            if (open_session == SDIO_FRAME_LOG_NO_SESSION)
+            {
+                unlogged += 1 + lost;
+                continue;
+            }
+            err = log_stream_frame(&SDIO_frame_stream, &frame.msg, frame.timestamp_us, lost + unlogged);
+            // Card lost: the frame and the gap so far are recorded in the reopened file
+            unlogged = (err == ESP_FAIL) ? unlogged + 1 + lost : 0;
+        }
 
-            ESP_LOGI(TAG, "Logged CAN message to %s", LOG_CSV.name);
+        // The card was lost (sd_recovery remounts it): frames are counted until the file is back
+        if (err == ESP_FAIL)
+        {
+            ESP_LOGW(TAG, "%s lost, reopening it", LOG_CAN.name);
+            log_stream_close(&SDIO_frame_stream);
+            atomic_store(&SDIO_frame_open, SDIO_FRAME_LOG_NO_SESSION);
+            open_session = SDIO_FRAME_LOG_NO_SESSION;
+            last_open = xTaskGetTickCount();
+            sd_recovery_lost(&SD_card_recovery);
         }
-        vTaskDelay(pdMS_TO_TICKS(50));
     }
 }
@@ -5,11 +5,28 @@
 #include "freertos/event_groups.h"
 #include "esp_log.h"
 #include "mqtt_client.h"
-#include "driver/twai.h"
+#include "signal_store/signal_store.h"
+#include "can_stats/can_stats.h"
+#include "pipeline_stats/pipeline_stats.h"
+#include "sd_health/sd_health.h"
+#include "esp_timer.h"
+#include "RTC_Time_Sync/rtc_time_sync.h"
+#include "snapshot/snapshot.h"
+#include "record_codec/record_codec.h"
+
+#define MQTT_PUBLISH_PERIOD_MS 10 // Changed messages of the signal store are published at this period
 
 static const char *TAG = "mqtt_sender";
 static bool mqtt_connected;
 
+#if USE_MQTT
+// Record stream: MQTT_RECORD_BATCH rows coded as one packet (record_codec.h)
+static SDIO_TxBuffer record_row;
+static binlog_record_t record_batch[MQTT_RECORD_BATCH];
+static uint8_t record_packet[sizeof(record_codec_packet_t) + MQTT_RECORD_BATCH * RECORD_CODEC_MAX_RECORD];
+static uint8_t record_schema[BINLOG_HEADER_SIZE];
+#endif
+
 #if USE_MQTT
 const char mqtt_root_ca_pem[] =
 "-----BEGIN CERTIFICATE-----\n"
@@ -65,7 +82,7 @@ void mqtt_sender_task(void *pvParameters)
 {
     ESP_LOGI("mqtt_sender_task", "Running on core %d", xPortGetCoreID());
 #if USE_MQTT
-    QueueHandle_t telemetry_queue = (QueueHandle_t)pvParameters;
+    const signal_store_t *store = (const signal_store_t *)pvParameters;
     EventGroupHandle_t eg = wifi_event_group();
     xEventGroupWaitBits(eg, WIFI_CONNECTED_BIT, pdFALSE, pdTRUE, portMAX_DELAY);
 
@@ -73,29 +90,59 @@ void mqtt_sender_task(void *pvParameters)
         .broker.address.uri = MQTT_URI,
         .credentials.username = MQTT_USER,
         .credentials.authentication.password = MQTT_PASS,
+#if MQTT_USE_TLS
         .broker.verification.certificate = mqtt_root_ca_pem,
         .broker.verification.certificate_len = sizeof(mqtt_root_ca_pem)
+#endif
     };
     esp_mqtt_client_handle_t client = esp_mqtt_client_init(&cfg);
     esp_mqtt_client_register_event(client, ESP_EVENT_ANY_ID, mqtt_event_handler, NULL);
     esp_mqtt_client_start(client);
 
-    twai_message_t current, newer;
-    int len = sizeof(twai_message_t);
+    signal_store_value_t value;
+    uint32_t sent_version[SIGNAL_STORE_MAX_SLOTS] = {0};
+    telemetry_frame_t current;
+    int len = sizeof(telemetry_frame_t);
     bool warned = false;
+    static can_stats_report_t stats_report;
+    static sd_health_report_t health_report;
+    can_stats_window_t stats_window = {0};
+    TickType_t last_stats = xTaskGetTickCount();
+    static snapshot_t snapshot;
+    int64_t row_us;
+    uint16_t batched = 0;
+    uint32_t sequence = 0;
+    bool schema_sent = false;
+    size_t schema_len = binlog_header_build(record_schema, sizeof(record_schema), 0);
+
+    if (snapshot_init(&snapshot, &SDIO_log_dispatch, store, MQTT_RECORD_RATE_HZ, xTaskGetCurrentTaskHandle()) != ESP_OK) {
+        ESP_LOGE(TAG, "Unable to start the %d Hz record timer", MQTT_RECORD_RATE_HZ);
+    }
     while (1) {
-        if (xQueueReceive(telemetry_queue, &current, portMAX_DELAY) != pdTRUE) {
-            ESP_LOGE(TAG, "Queue receive failed");
-            continue;
+        if ((xTaskGetTickCount() - last_stats) >= pdMS_TO_TICKS(CAN_STATS_PERIOD_MS)) {
+            last_stats = xTaskGetTickCount();
+            can_stats_snapshot(&CAN_bus_stats, &stats_window, &stats_report);
+            if (mqtt_connected &&
+                esp_mqtt_client_publish(client, MQTT_STATS_TOPIC, (const char *)&stats_report,
+                                        can_stats_report_size(&stats_report), 0, 0) >= 0) {
+                pipeline_stats_add_bytes(&CAN_pipeline_stats, PIPELINE_STAGE_NET, can_stats_report_size(&stats_report));
+            }
+            // Card health on the same topic, told apart by SD_HEALTH_MAGIC
+            sd_health_snapshot(&SD_card_health, &health_report);
+            if (mqtt_connected &&
+                esp_mqtt_client_publish(client, MQTT_STATS_TOPIC, (const char *)&health_report,
+                                        sizeof(health_report), 0, 0) >= 0) {
+                pipeline_stats_add_bytes(&CAN_pipeline_stats, PIPELINE_STAGE_NET, sizeof(health_report));
+            }
         }
-        if (xQueueReceive(telemetry_queue, &newer, 0) == pdTRUE)
-            current = newer;
 
         if ((xEventGroupGetBits(eg) & WIFI_CONNECTED_BIT) == 0 || !mqtt_connected) {
             if (!warned) {
                 ESP_LOGW(TAG, "MQTT not connected, waiting...");
                 warned = true;
             }
+            schema_sent = false;
+            batched = 0; // A packet never spans a reconnect, the next one starts with a keyframe
             xEventGroupWaitBits(eg, WIFI_CONNECTED_BIT, pdFALSE, pdTRUE, portMAX_DELAY);
             while (!mqtt_connected) {
                 vTaskDelay(pdMS_TO_TICKS(100));
@@ -103,8 +150,40 @@ void mqtt_sender_task(void *pvParameters)
             warned = false;
             continue;
         }
-        esp_mqtt_client_publish(client, MQTT_PUB_TOPIC, (const char *)&current, len, 0, 0);
-        vTaskDelay(pdMS_TO_TICKS(10));
+
+        // Latest frame of every message that changed since its last publish
+        for (uint16_t slot = 0; slot < store->count; slot++) {
+            if (signal_store_version(store, slot) == sent_version[slot] ||
+                !signal_store_read(store, slot, &value)) {
+                continue; // Unchanged, or kept busy by the writer: retried next period
+            }
+            current.time_us = Time_Sync_epoch_us(value.timestamp_us);
+            current.msg = value.msg;
+            if (esp_mqtt_client_publish(client, MQTT_PUB_TOPIC, (const char *)&current, len, 0, 0) >= 0) {
+                sent_version[slot] = value.version;
+                pipeline_stats_record(&CAN_pipeline_stats, PIPELINE_STAGE_NET, esp_timer_get_time() - value.timestamp_us);
+                pipeline_stats_add_bytes(&CAN_pipeline_stats, PIPELINE_STAGE_NET, len);
+            }
+        }
+
+        // Schema first (retained, so late subscribers get it too), then the coded rows
+        if (!schema_sent) {
+            schema_sent = esp_mqtt_client_publish(client, MQTT_SCHEMA_TOPIC, (const char *)record_schema,
+                                                  schema_len, 1, 1) >= 0;
+        }
+        if (snapshot_due(&snapshot, &row_us)) {
+            snapshot_take(&snapshot, &record_row, row_us);
+            binlog_record_fill(&record_batch[batched++], &record_row, row_us);
+        }
+        if (batched == MQTT_RECORD_BATCH) {
+            size_t size = record_codec_packet_build(record_packet, sizeof(record_packet), record_batch, batched, sequence++);
+            if (size != 0 &&
+                esp_mqtt_client_publish(client, MQTT_RECORD_TOPIC, (const char *)record_packet, size, 0, 0) >= 0) {
+                pipeline_stats_add_bytes(&CAN_pipeline_stats, PIPELINE_STAGE_NET, size);
+            }
+            batched = 0;
+        }
+        vTaskDelay(pdMS_TO_TICKS(MQTT_PUBLISH_PERIOD_MS));
     }
 #else
     (void)pvParameters;
@@ -0,0 +1,169 @@
+/*
+ * pipeline_stats.c
+ *
+ *  Description: Implementation of the per-stage pipeline latency histograms.
+ *      Note: pipeline_stats_record runs once per frame or row: no locks, no division.
+ */
+
+#include "pipeline_stats.h"
+#include <stddef.h>
+
+pipeline_stats_t CAN_pipeline_stats;
+
+static const char *const pipeline_stage_names[PIPELINE_STAGE_COUNT] = {"rx_queue", "sd", "net", "sd_write"};
+
+/*
+ * ================================================================
+ * 					Local Functions Definition
+ * ================================================================
+ *
+ * */
+
+// Single writer increment: plain load / store, no read-modify-write needed
+static inline void pipeline_stats_inc(_Atomic uint32_t *counter, uint32_t value)
+{
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + value, memory_order_relaxed);
+}
+
+// Values below 8 have their own bucket, above: 8 buckets per power of two
+static inline uint16_t pipeline_stats_bucket(uint32_t value)
+{
+    if (value < PIPELINE_STATS_SUB_COUNT)
+    {
+        return (uint16_t)value;
+    }
+    uint32_t shift = (31 - __builtin_clz(value)) - PIPELINE_STATS_SUB_BITS;
+    uint32_t bucket = ((shift + 1) << PIPELINE_STATS_SUB_BITS) + ((value >> shift) & (PIPELINE_STATS_SUB_COUNT - 1));
+    return (bucket < PIPELINE_STATS_BUCKETS) ? (uint16_t)bucket : (PIPELINE_STATS_BUCKETS - 1);
+}
+
+// Largest value counted in a bucket
+static uint32_t pipeline_stats_bucket_max(uint16_t bucket)
+{
+    if (bucket < PIPELINE_STATS_SUB_COUNT)
+    {
+        return bucket;
+    }
+    uint32_t shift = (bucket >> PIPELINE_STATS_SUB_BITS) - 1;
+    uint32_t low = (PIPELINE_STATS_SUB_COUNT + (bucket & (PIPELINE_STATS_SUB_COUNT - 1))) << shift;
+    return low + ((1u << shift) - 1);
+}
+
+/*
+ * ================================================================
+ * 					API Functions Definition
+ * ================================================================
+ *
+ * */
+
+/**================================================================
+ * @Fn				- pipeline_stats_record
+ * @breif			- Accounts one latency sample of a stage
+ * @param [in]		- stats: Statistics object
+ * @param [in]		- stage: Stage of the sample, written by one task only
+ * @param [in]		- latency_us: Latency in microseconds, negative values count as 0
+ * @retval			- None
+ */
+void pipeline_stats_record(pipeline_stats_t *stats, pipeline_stage_t stage, int64_t latency_us)
+{
+    pipeline_stage_stats_t *s = &stats->stages[stage];
+    uint32_t value = (latency_us <= 0) ? 0 : (latency_us > UINT32_MAX) ? UINT32_MAX : (uint32_t)latency_us;
+
+    pipeline_stats_inc(&s->hist[pipeline_stats_bucket(value)], 1);
+    pipeline_stats_inc(&s->count, 1);
+    if (value > atomic_load_explicit(&s->max_us, memory_order_relaxed))
+    {
+        atomic_store_explicit(&s->max_us, value, memory_order_relaxed);
+    }
+}
+
+/**================================================================
+ * @Fn				- pipeline_stats_add_bytes
+ * @breif			- Accounts bytes written (SD) or sent (network) by a stage
+ * @param [in]		- stats: Statistics object
+ * @param [in]		- stage: Stage of the bytes, written by one task only
+ * @param [in]		- bytes: Byte count to add
+ * @retval			- None
+ */
+void pipeline_stats_add_bytes(pipeline_stats_t *stats, pipeline_stage_t stage, uint32_t bytes)
+{
+    _Atomic uint64_t *counter = &stats->stages[stage].bytes;
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + bytes, memory_order_relaxed);
+}
+
+/**================================================================
+ * @Fn				- pipeline_stats_percentile
+ * @breif			- Latency below which permille / 1000 of the samples of a stage fall
+ * @param [in]		- stats: Statistics object
+ * @param [in]		- stage: Stage to query
+ * @param [in]		- permille: 500 for the median, 990 for p99, 999 for p99.9
+ * @retval			- Upper bound of the bucket holding the percentile (us), 0 without samples
+ * Note				- Reads while the writer runs, the result can lag by the samples in flight
+ */
+uint32_t pipeline_stats_percentile(const pipeline_stats_t *stats, pipeline_stage_t stage, uint32_t permille)
+{
+    const pipeline_stage_stats_t *s = &stats->stages[stage];
+    uint32_t count = atomic_load_explicit(&s->count, memory_order_relaxed);
+    uint64_t rank = ((uint64_t)count * permille + 999) / 1000;
+    uint64_t seen = 0;
+
+    if (count == 0)
+    {
+        return 0;
+    }
+    for (uint16_t bucket = 0; bucket < PIPELINE_STATS_BUCKETS; bucket++)
+    {
+        seen += atomic_load_explicit(&s->hist[bucket], memory_order_relaxed);
+        if ((seen >= rank) && (seen != 0))
+        {
+            uint32_t bound = pipeline_stats_bucket_max(bucket);
+            uint32_t max = atomic_load_explicit(&s->max_us, memory_order_relaxed);
+            return ((bound < max) && (bucket != PIPELINE_STATS_BUCKETS - 1)) ? bound : max;
+        }
+    }
+    return atomic_load_explicit(&s->max_us, memory_order_relaxed);
+}
+
+/**================================================================
+ * @Fn				- pipeline_stats_fold
+ * @breif			- Coarse histogram of a stage for telemetry: power of two buckets
+ * @param [in]		- stats: Statistics object
+ * @param [in]		- stage: Stage to fold
+ * @param [in]		- base_us: Upper bound of the first bucket, a power of two of at least 8
+ * @param [out]		- counts: counts[k] = samples below base_us << k, the last bucket is open-ended
+ * @param [in]		- count: Number of buckets
+ * @retval			- None
+ * Note				- Every log-linear bucket from 8 up lies within one power of two, so the
+ * 					  folding is exact for a power of two base
+ */
+void pipeline_stats_fold(const pipeline_stats_t *stats, pipeline_stage_t stage, uint32_t base_us, uint32_t *counts,
+                         uint8_t count)
+{
+    const pipeline_stage_stats_t *s = &stats->stages[stage];
+    uint8_t k = 0;
+
+    for (uint8_t i = 0; i < count; i++)
+    {
+        counts[i] = 0;
+    }
+    for (uint16_t bucket = 0; (bucket < PIPELINE_STATS_BUCKETS) && (count != 0); bucket++)
+    {
+        uint32_t bound = pipeline_stats_bucket_max(bucket);
+        while ((k < count - 1) && ((uint64_t)bound >= ((uint64_t)base_us << k)))
+        {
+            k++;
+        }
+        counts[k] += atomic_load_explicit(&s->hist[bucket], memory_order_relaxed);
+    }
+}
+
+/**================================================================
+ * @Fn				- pipeline_stats_stage_name
+ * @breif			- Short stage name used in logs and benchmark results
+ * @param [in]		- stage: Stage to name
+ * @retval			- Constant string
+ */
+const char *pipeline_stats_stage_name(pipeline_stage_t stage)
+{
+    return (stage < PIPELINE_STAGE_COUNT) ? pipeline_stage_names[stage] : "?";
+}
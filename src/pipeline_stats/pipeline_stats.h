@@ -0,0 +1,70 @@
+/*
+ * pipeline_stats.h
+ *
+ *  Description: Per-stage latency histograms and byte counters of the CAN pipeline:
+ *               driver RX queue -> CAN_Receive_Task, CAN_Receive_Task -> SD row written and
+ *               CAN_Receive_Task -> telemetry packet sent, plus the duration of every write() /
+ *               fsync() of the SD writer task. Every stage has a single writer task
+ *               (relaxed atomics, as can_stats), percentiles are computed by the readers.
+ *               Buckets are log-linear: 8 linear steps per power of two (< 12.5% error).
+ */
+
+#ifndef PIPELINE_STATS_H
+#define PIPELINE_STATS_H
+
+//==================================Standard Libraries Includes=======================//
+#include <stdint.h>
+#include <stdatomic.h>
+
+//----------------------------
+// Pipeline Statistics Macros
+//----------------------------
+#define PIPELINE_STATS_SUB_BITS 3 // 2^3 linear sub-buckets per power of two
+#define PIPELINE_STATS_SUB_COUNT (1u << PIPELINE_STATS_SUB_BITS)
+#define PIPELINE_STATS_BUCKETS 200 // Covers latencies up to ~2^27 us, the last bucket is open-ended
+
+//===============================================
+// User type definitions (structures)
+//===============================================
+typedef enum
+{
+	PIPELINE_STAGE_RX_QUEUE, // Frame queued by the driver -> taken by CAN_Receive_Task (host build only)
+	PIPELINE_STAGE_SD,		 // Receive timestamp -> SD row holding the frame written
+	PIPELINE_STAGE_NET,		 // Receive timestamp -> telemetry packet handed to the network stack
+	PIPELINE_STAGE_SD_WRITE, // One write() / fsync() of the SD writer task (duration, not a latency)
+	PIPELINE_STAGE_COUNT,
+} pipeline_stage_t;
+
+typedef struct
+{
+	_Atomic uint32_t count;		 // Latency samples
+	_Atomic uint32_t max_us;	 // Largest sample
+	_Atomic uint64_t bytes;		 // Bytes written / sent by the stage
+	_Atomic uint32_t hist[PIPELINE_STATS_BUCKETS];
+} pipeline_stage_stats_t;
+
+typedef struct
+{
+	pipeline_stage_stats_t stages[PIPELINE_STAGE_COUNT];
+} pipeline_stats_t;
+
+//===============================================
+// Pipeline statistics instance
+//===============================================
+extern pipeline_stats_t CAN_pipeline_stats;
+
+//===============================================
+// APIs Supported by "PIPELINE STATS"
+//===============================================
+
+// Writer side (one task per stage)
+void pipeline_stats_record(pipeline_stats_t *stats, pipeline_stage_t stage, int64_t latency_us);
+void pipeline_stats_add_bytes(pipeline_stats_t *stats, pipeline_stage_t stage, uint32_t bytes);
+
+// Reader side
+uint32_t pipeline_stats_percentile(const pipeline_stats_t *stats, pipeline_stage_t stage, uint32_t permille);
+void pipeline_stats_fold(const pipeline_stats_t *stats, pipeline_stage_t stage, uint32_t base_us, uint32_t *counts,
+						 uint8_t count);
+const char *pipeline_stats_stage_name(pipeline_stage_t stage);
+
+#endif // PIPELINE_STATS_H
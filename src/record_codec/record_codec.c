@@ -0,0 +1,245 @@
+/*
+ * record_codec.c
+ *
+ *  Description: Implementation of the record delta / XOR codec.
+ *      Note: The per-signal code is generated from COMM_MESSAGE_TABLE, so a record costs one
+ *            pass over its fields with no table lookups; the encoder checks the room left once
+ *            per record (RECORD_CODEC_MAX_RECORD), the decoder checks every byte.
+ */
+
+#include "record_codec.h"
+#include <stdbool.h>
+#include <string.h>
+
+typedef struct
+{
+    const uint8_t *p;
+    const uint8_t *end;
+    bool ok; // Cleared when a varint runs past end
+} record_codec_reader_t;
+
+/*
+ * ================================================================
+ * 					Local Functions Definition
+ * ================================================================
+ *
+ * */
+static inline uint64_t record_codec_zigzag(int64_t v)
+{
+    return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static inline int64_t record_codec_unzigzag(uint64_t v)
+{
+    return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+static inline uint8_t *record_codec_put(uint8_t *p, uint64_t v)
+{
+    while (v >= 0x80)
+    {
+        *p++ = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    *p++ = (uint8_t)v;
+    return p;
+}
+
+static inline uint64_t record_codec_get(record_codec_reader_t *r)
+{
+    uint64_t v = 0;
+    for (uint8_t shift = 0; (shift < 64) && (r->p < r->end); shift += 7)
+    {
+        uint8_t byte = *r->p++;
+        v |= (uint64_t)(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0)
+        {
+            return v;
+        }
+    }
+    r->ok = false;
+    return 0;
+}
+
+// Signals by COMM_signal_type_t
+static inline uint8_t *record_codec_put_U16(uint8_t *p, uint16_t value, uint16_t prev)
+{
+    return record_codec_put(p, record_codec_zigzag((int16_t)(uint16_t)(value - prev)));
+}
+
+static inline uint16_t record_codec_get_U16(record_codec_reader_t *r, uint16_t prev)
+{
+    return (uint16_t)(prev + (uint16_t)record_codec_unzigzag(record_codec_get(r)));
+}
+
+static inline uint8_t *record_codec_put_U32(uint8_t *p, uint32_t value, uint32_t prev)
+{
+    return record_codec_put(p, record_codec_zigzag((int32_t)(value - prev)));
+}
+
+static inline uint32_t record_codec_get_U32(record_codec_reader_t *r, uint32_t prev)
+{
+    return prev + (uint32_t)record_codec_unzigzag(record_codec_get(r));
+}
+
+static inline uint8_t *record_codec_put_F32(uint8_t *p, float value, float prev)
+{
+    uint32_t a, b;
+    memcpy(&a, &value, sizeof(a));
+    memcpy(&b, &prev, sizeof(b));
+    uint32_t x = a ^ b;
+    if (x == 0)
+    {
+        return record_codec_put(p, 0);
+    }
+    uint8_t t = (uint8_t)(__builtin_ctz(x) / 8);
+    return record_codec_put(p, ((uint64_t)(x >> (8 * t)) << 2) | t);
+}
+
+static inline float record_codec_get_F32(record_codec_reader_t *r, float prev)
+{
+    uint64_t code = record_codec_get(r);
+    uint32_t bits;
+    memcpy(&bits, &prev, sizeof(bits));
+    bits ^= (uint32_t)((code >> 2) << (8 * (code & 3)));
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+#define RECORD_CODEC_X_PUT(P, FIELD, CSV, TYPE, BIT, WIDTH, SCALE, UNIT) \
+    p = record_codec_put_##TYPE(p, cur->P.FIELD, prev->P.FIELD);
+#define RECORD_CODEC_X_PUT_MESSAGE(P, NAME, ID, EXTD, ELEMENT, DLC) COMM_SIGNALS_##NAME(RECORD_CODEC_X_PUT, ELEMENT)
+
+#define RECORD_CODEC_X_GET(P, FIELD, CSV, TYPE, BIT, WIDTH, SCALE, UNIT) \
+    cur->P.FIELD = record_codec_get_##TYPE(&r, prev->P.FIELD);
+#define RECORD_CODEC_X_GET_MESSAGE(P, NAME, ID, EXTD, ELEMENT, DLC) COMM_SIGNALS_##NAME(RECORD_CODEC_X_GET, ELEMENT)
+
+/*
+ * ================================================================
+ * 					API Functions Definition
+ * ================================================================
+ *
+ * */
+
+/**================================================================
+ * @Fn				- record_codec_encode
+ * @breif			- Encodes a sequence of records, the first one as a keyframe
+ * @param [in]		- records: Records in time order
+ * @param [in]		- count: Number of records, 1 at least
+ * @param [out]		- out: Encoded bytes
+ * @param [in]		- out_len: Size of out
+ * @retval			- Encoded size, 0 if it may not fit out (keep the records as they are)
+ */
+size_t record_codec_encode(const binlog_record_t *records, uint16_t count, uint8_t *out, size_t out_len)
+{
+    uint8_t *p = out;
+    uint8_t *end = out + out_len;
+    uint64_t time_delta = 0;
+    int64_t dt_delta[COMM_MESSAGE_COUNT] = {0};
+
+    if ((count == 0) || (out_len < sizeof(binlog_record_t)))
+    {
+        return 0;
+    }
+    memcpy(p, &records[0], sizeof(binlog_record_t));
+    p += sizeof(binlog_record_t);
+
+    for (uint16_t i = 1; i < count; i++)
+    {
+        const binlog_record_t *cur = &records[i];
+        const binlog_record_t *prev = &records[i - 1];
+        if ((size_t)(end - p) < RECORD_CODEC_MAX_RECORD)
+        {
+            return 0;
+        }
+
+        uint64_t delta = (uint64_t)cur->timestamp_us - (uint64_t)prev->timestamp_us;
+        p = record_codec_put(p, record_codec_zigzag((int64_t)(delta - time_delta)));
+        time_delta = delta;
+        p = record_codec_put(p, cur->fresh ^ prev->fresh);
+        for (uint8_t m = 0; m < COMM_MESSAGE_COUNT; m++)
+        {
+            int64_t dt = (int64_t)cur->message_dt_us[m] - prev->message_dt_us[m];
+            p = record_codec_put(p, record_codec_zigzag(dt - dt_delta[m]));
+            dt_delta[m] = dt;
+        }
+        COMM_MESSAGE_TABLE(RECORD_CODEC_X_PUT_MESSAGE, _)
+    }
+    return (size_t)(p - out);
+}
+
+/**================================================================
+ * @Fn				- record_codec_packet_build
+ * @breif			- Builds a telemetry packet of records: record_codec_packet_t and the encoding
+ * @param [out]		- out: Packet
+ * @param [in]		- out_len: Size of out, sizeof(record_codec_packet_t) + count *
+ * 					  RECORD_CODEC_MAX_RECORD is always enough
+ * @param [in]		- records: Records in time order, the first one becomes the keyframe
+ * @param [in]		- count: Number of records
+ * @param [in]		- sequence: Packet number
+ * @retval			- Size of the packet, 0 if it does not fit out
+ */
+size_t record_codec_packet_build(uint8_t *out, size_t out_len, const binlog_record_t *records, uint16_t count,
+                                 uint32_t sequence)
+{
+    if (out_len < sizeof(record_codec_packet_t))
+    {
+        return 0;
+    }
+    size_t size = record_codec_encode(records, count, out + sizeof(record_codec_packet_t),
+                                      out_len - sizeof(record_codec_packet_t));
+    if ((size == 0) || (size > UINT16_MAX))
+    {
+        return 0;
+    }
+    record_codec_packet_t header = {
+        .magic = RECORD_CODEC_PACKET_MAGIC,
+        .schema = binlog_schema_id(),
+        .sequence = sequence,
+        .count = count,
+        .size = (uint16_t)size,
+    };
+    memcpy(out, &header, sizeof(header));
+    return sizeof(header) + size;
+}
+
+/**================================================================
+ * @Fn				- record_codec_decode
+ * @breif			- Restores a sequence of records encoded by record_codec_encode
+ * @param [in]		- in: Encoded bytes
+ * @param [in]		- len: Size of in
+ * @param [out]		- records: Restored records
+ * @param [in]		- count: Number of records encoded
+ * @retval			- Bytes of in used, 0 if the data is corrupt or shorter than count records
+ */
+size_t record_codec_decode(const uint8_t *in, size_t len, binlog_record_t *records, uint16_t count)
+{
+    record_codec_reader_t r = {.p = in, .end = in + len, .ok = true};
+    uint64_t time_delta = 0;
+    int64_t dt_delta[COMM_MESSAGE_COUNT] = {0};
+
+    if ((count == 0) || (len < sizeof(binlog_record_t)))
+    {
+        return 0;
+    }
+    memcpy(&records[0], r.p, sizeof(binlog_record_t));
+    r.p += sizeof(binlog_record_t);
+
+    for (uint16_t i = 1; (i < count) && r.ok; i++)
+    {
+        binlog_record_t *cur = &records[i];
+        const binlog_record_t *prev = &records[i - 1];
+
+        time_delta += (uint64_t)record_codec_unzigzag(record_codec_get(&r));
+        cur->timestamp_us = (int64_t)((uint64_t)prev->timestamp_us + time_delta);
+        cur->fresh = prev->fresh ^ record_codec_get(&r);
+        for (uint8_t m = 0; m < COMM_MESSAGE_COUNT; m++)
+        {
+            dt_delta[m] += record_codec_unzigzag(record_codec_get(&r));
+            cur->message_dt_us[m] = (int32_t)(prev->message_dt_us[m] + dt_delta[m]);
+        }
+        COMM_MESSAGE_TABLE(RECORD_CODEC_X_GET_MESSAGE, _)
+    }
+    return r.ok ? (size_t)(r.p - in) : 0;
+}
@@ -0,0 +1,59 @@
+/*
+ * record_codec.h
+ *
+ *  Description: Delta / XOR codec of binlog_record_t sequences (SD log blocks, MQTT record
+ *               packets), in the spirit of Gorilla time series compression but byte aligned:
+ *               consecutive snapshots differ in a few low bits of most fields.
+ *               The first record of a sequence is a keyframe (copied as is), so decoding starts
+ *               at any block or packet. Every following record holds, in binlog_record_t order:
+ *                 timestamp_us      delta of delta, zig-zag varint
+ *                 fresh             XOR with the previous record, varint
+ *                 message_dt_us[]   delta of delta, zig-zag varint
+ *                 U16 / U32 signals delta (wrapping at the signal width), zig-zag varint
+ *                 F32 signals       XOR of the bit patterns: 0, or varint of
+ *                                   (xor >> 8 * t) << 2 | t, t = trailing zero bytes of xor
+ *               Varints are LEB128 (7 bits per byte, LSB first). The field list follows the
+ *               signal descriptors of the file header, scripts/binlog_to_csv.py decodes it.
+ *      Packets: record_codec_packet_t then the encoded records, one packet per
+ *               MQTT_RECORD_BATCH rows on MQTT_RECORD_TOPIC; the binlog file header describing
+ *               the records is retained on MQTT_SCHEMA_TOPIC (scripts/telemetry_receiver.py).
+ */
+
+#ifndef RECORD_CODEC_H
+#define RECORD_CODEC_H
+
+//==================================Standard Libraries Includes=======================//
+#include <stdint.h>
+#include <stddef.h>
+
+//==================================ESP32 Libraries Includes==========================//
+#include "binlog/binlog.h"
+
+//----------------------------
+// Codec Macros
+//----------------------------
+#define RECORD_CODEC_MAX_RECORD (2 * sizeof(binlog_record_t)) // Worst encoded record, keyframe included
+#define RECORD_CODEC_PACKET_MAGIC 0x43455241u					// "AREC": first word of a packet
+
+//===============================================
+// User type definitions (structures)
+//===============================================
+typedef struct __attribute__((packed))
+{
+	uint32_t magic;	   // RECORD_CODEC_PACKET_MAGIC
+	uint32_t schema;   // binlog_schema_id of the records
+	uint32_t sequence; // Packet number since boot, a gap is a lost packet
+	uint16_t count;	   // Records in the packet
+	uint16_t size;	   // Encoded bytes after this header
+} record_codec_packet_t;
+
+//===============================================
+// APIs Supported by "RECORD CODEC"
+//===============================================
+
+size_t record_codec_encode(const binlog_record_t *records, uint16_t count, uint8_t *out, size_t out_len);
+size_t record_codec_decode(const uint8_t *in, size_t len, binlog_record_t *records, uint16_t count);
+size_t record_codec_packet_build(uint8_t *out, size_t out_len, const binlog_record_t *records, uint16_t count,
+								 uint32_t sequence);
+
+#endif // RECORD_CODEC_H
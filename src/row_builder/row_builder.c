@@ -0,0 +1,378 @@
+/*
+ * row_builder.c
+ *
+ *  Description: Implementation of the row builder.
+ *      Note: Digits are produced backwards into a small stack buffer, then copied into the row
+ *            with one bounds check per field. 64-bit divisions (library calls on the ESP32) are
+ *            only used for values that do not fit 32 bits.
+ */
+
+#include "row_builder.h"
+#include <string.h>
+
+// "00" .. "99": two digits per division by 100
+static const char row_builder_digits[200] = "0001020304050607080910111213141516171819"
+                                            "2021222324252627282930313233343536373839"
+                                            "4041424344454647484950515253545556575859"
+                                            "6061626364656667686970717273747576777879"
+                                            "8081828384858687888990919293949596979899";
+
+static const uint32_t row_builder_pow10[ROW_BUILDER_MAX_DECIMALS + 1] = {
+    1u, 10u, 100u, 1000u, 10000u, 100000u, 1000000u, 10000000u, 100000000u, 1000000000u};
+
+/*
+ * ================================================================
+ * 					Local Functions Definition
+ * ================================================================
+ *
+ * */
+
+// Decimal digits of value written backwards, ending at end; returns the first digit
+static char *row_builder_format_u32(char *end, uint32_t value)
+{
+    char *p = end;
+    while (value >= 100)
+    {
+        uint32_t pair = (value % 100) * 2;
+        value /= 100;
+        p -= 2;
+        memcpy(p, &row_builder_digits[pair], 2);
+    }
+    if (value >= 10)
+    {
+        p -= 2;
+        memcpy(p, &row_builder_digits[value * 2], 2);
+    }
+    else
+    {
+        *--p = (char)('0' + value);
+    }
+    return p;
+}
+
+// Exactly digits decimal digits of value (zero padded) at out
+static void row_builder_format_padded(char *out, uint32_t value, uint8_t digits)
+{
+    char *p = out + digits;
+    while (p - out >= 2)
+    {
+        p -= 2;
+        memcpy(p, &row_builder_digits[(value % 100) * 2], 2);
+        value /= 100;
+    }
+    if (p > out)
+    {
+        *--p = (char)('0' + value % 10);
+    }
+}
+
+// Decimal digits of a 64-bit value written backwards, ending at end (20 characters at most)
+static char *row_builder_format_u64(char *end, uint64_t value)
+{
+    if (value <= UINT32_MAX)
+    {
+        return row_builder_format_u32(end, (uint32_t)value);
+    }
+    // 8 digits per 64-bit division, two divisions at most
+    uint64_t high = value / 100000000u;
+    char *p = end - 8;
+    row_builder_format_padded(p, (uint32_t)(value - high * 100000000u), 8);
+    if (high > UINT32_MAX)
+    {
+        uint64_t top = high / 100000000u;
+        p -= 8;
+        row_builder_format_padded(p, (uint32_t)(high - top * 100000000u), 8);
+        high = top;
+    }
+    return row_builder_format_u32(p, (uint32_t)high);
+}
+
+// Integer mantissa * 2^exponent of a float beyond 64 bits (exponent 41 .. 104), up to 39 digits
+static char *row_builder_format_big(char *end, uint64_t mantissa, int32_t exponent)
+{
+    uint32_t limbs[5] = {0};
+    uint64_t shifted = mantissa << (exponent % 32);
+    limbs[exponent / 32] = (uint32_t)shifted;
+    limbs[exponent / 32 + 1] = (uint32_t)(shifted >> 32);
+
+    char *p = end;
+    bool more;
+    do
+    {
+        // Long division by 10^9, the remainder gives the next 9 digits
+        uint64_t rest = 0;
+        more = false;
+        for (int8_t i = 4; i >= 0; i--)
+        {
+            uint64_t current = (rest << 32) | limbs[i];
+            limbs[i] = (uint32_t)(current / 1000000000u);
+            rest = current % 1000000000u;
+            more |= (limbs[i] != 0);
+        }
+        if (more)
+        {
+            p -= 9;
+            row_builder_format_padded(p, (uint32_t)rest, 9);
+        }
+        else
+        {
+            p = row_builder_format_u32(p, (uint32_t)rest);
+        }
+    } while (more);
+    return p;
+}
+
+static inline bool row_builder_room(row_builder_t *row, size_t n)
+{
+    if (row->overflow || (row->used + n >= row->len))
+    {
+        row->overflow = true;
+        return false;
+    }
+    return true;
+}
+
+static void row_builder_put(row_builder_t *row, const char *text, size_t n)
+{
+    if (row_builder_room(row, n))
+    {
+        memcpy(row->buf + row->used, text, n);
+        row->used += n;
+    }
+}
+
+/*
+ * ================================================================
+ * 					API Functions Definition
+ * ================================================================
+ *
+ * */
+
+/**================================================================
+ * @Fn				- row_builder_init
+ * @breif			- Starts a row in a caller buffer
+ * @param [out]		- row: Row builder
+ * @param [in]		- buf: Destination of the row
+ * @param [in]		- len: Size of buf, terminator included
+ * @retval			- None
+ */
+void row_builder_init(row_builder_t *row, char *buf, size_t len)
+{
+    row->buf = buf;
+    row->len = len;
+    row->used = 0;
+    row->overflow = (len == 0);
+}
+
+/**================================================================
+ * @Fn				- row_builder_end
+ * @breif			- Terminates the row
+ * @param [in]		- row: Row builder
+ * @retval			- Length of the row, -1 if a field did not fit (buf then holds the fields
+ * 					  before it)
+ */
+int row_builder_end(row_builder_t *row)
+{
+    if (row->len == 0)
+    {
+        return -1;
+    }
+    row->buf[row->used] = '\0';
+    return row->overflow ? -1 : (int)row->used;
+}
+
+/**================================================================
+ * @Fn				- row_builder_char
+ * @breif			- Appends one character (separator, newline)
+ * @param [in]		- row: Row builder
+ * @param [in]		- c: Character
+ * @retval			- None
+ */
+void row_builder_char(row_builder_t *row, char c)
+{
+    if (row_builder_room(row, 1))
+    {
+        row->buf[row->used++] = c;
+    }
+}
+
+/**================================================================
+ * @Fn				- row_builder_str
+ * @breif			- Appends a string as is
+ * @param [in]		- row: Row builder
+ * @param [in]		- str: NUL terminated string
+ * @retval			- None
+ */
+void row_builder_str(row_builder_t *row, const char *str)
+{
+    row_builder_put(row, str, strlen(str));
+}
+
+/**================================================================
+ * @Fn				- row_builder_u32
+ * @breif			- Appends an unsigned integer in decimal ("%u")
+ * @param [in]		- row: Row builder
+ * @param [in]		- value: Integer
+ * @retval			- None
+ */
+void row_builder_u32(row_builder_t *row, uint32_t value)
+{
+    char text[10];
+    char *p = row_builder_format_u32(text + sizeof(text), value);
+    row_builder_put(row, p, text + sizeof(text) - p);
+}
+
+/**================================================================
+ * @Fn				- row_builder_u64
+ * @breif			- Appends a 64-bit unsigned integer in decimal ("%" PRIu64)
+ * @param [in]		- row: Row builder
+ * @param [in]		- value: Integer
+ * @retval			- None
+ */
+void row_builder_u64(row_builder_t *row, uint64_t value)
+{
+    char text[20];
+    char *p = row_builder_format_u64(text + sizeof(text), value);
+    row_builder_put(row, p, text + sizeof(text) - p);
+}
+
+/**================================================================
+ * @Fn				- row_builder_i64
+ * @breif			- Appends a 64-bit signed integer in decimal ("%" PRId64)
+ * @param [in]		- row: Row builder
+ * @param [in]		- value: Integer
+ * @retval			- None
+ */
+void row_builder_i64(row_builder_t *row, int64_t value)
+{
+    char text[21];
+    uint64_t magnitude = (value < 0) ? (0u - (uint64_t)value) : (uint64_t)value;
+    char *p = row_builder_format_u64(text + sizeof(text), magnitude);
+    if (value < 0)
+    {
+        *--p = '-';
+    }
+    row_builder_put(row, p, text + sizeof(text) - p);
+}
+
+/**================================================================
+ * @Fn				- row_builder_hex
+ * @breif			- Appends an unsigned integer in hexadecimal, without prefix ("%0<min_digits>x")
+ * @param [in]		- row: Row builder
+ * @param [in]		- value: Integer
+ * @param [in]		- min_digits: Zero padded to this many digits (16 at most)
+ * @param [in]		- upper: A-F instead of a-f
+ * @retval			- None
+ */
+void row_builder_hex(row_builder_t *row, uint64_t value, uint8_t min_digits, bool upper)
+{
+    const char *alphabet = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+    char text[16];
+    char *end = text + sizeof(text);
+    char *p = end;
+
+    if (min_digits > sizeof(text))
+    {
+        min_digits = sizeof(text);
+    }
+    do
+    {
+        *--p = alphabet[value & 0xF];
+        value >>= 4;
+    } while (value != 0);
+    while ((end - p) < min_digits)
+    {
+        *--p = '0';
+    }
+    row_builder_put(row, p, end - p);
+}
+
+/**================================================================
+ * @Fn				- row_builder_f32
+ * @breif			- Appends a float in fixed point ("%.<decimals>f")
+ * @param [in]		- row: Row builder
+ * @param [in]		- value: Float
+ * @param [in]		- decimals: Digits after the point, ROW_BUILDER_MAX_DECIMALS at most
+ * 					  (0 = no point)
+ * @retval			- None
+ * Note				- value = mantissa * 2^exponent exactly, so the scaled value is
+ * 					  mantissa * 10^decimals (below 2^54) shifted right with round half to even:
+ * 					  the digits printf gives, without a double operation
+ */
+void row_builder_f32(row_builder_t *row, float value, uint8_t decimals)
+{
+    char text[1 + 39 + 1 + ROW_BUILDER_MAX_DECIMALS];
+    char *end = text + sizeof(text);
+    char *p = end;
+    uint32_t bits;
+
+    memcpy(&bits, &value, sizeof(bits));
+    bool negative = (bits >> 31) != 0;
+    uint32_t biased = (bits >> 23) & 0xFF;
+    uint64_t mantissa = bits & 0x7FFFFF;
+    if (biased == 0xFF)
+    {
+        row_builder_str(row, (mantissa != 0) ? "nan" : (negative ? "-inf" : "inf"));
+        return;
+    }
+    int32_t exponent = -149; // Subnormal
+    if (biased != 0)
+    {
+        mantissa |= (uint64_t)1 << 23;
+        exponent = (int32_t)biased - 150;
+    }
+    if (decimals > ROW_BUILDER_MAX_DECIMALS)
+    {
+        decimals = ROW_BUILDER_MAX_DECIMALS;
+    }
+    uint32_t pow10 = row_builder_pow10[decimals];
+
+    uint64_t integer = 0;
+    uint32_t fraction = 0;
+    bool big = false;
+    if (exponent >= 0)
+    {
+        // Integer value, no fraction
+        big = (exponent > 40);
+        integer = big ? 0 : (mantissa << exponent);
+    }
+    else
+    {
+        uint32_t shift = (uint32_t)-exponent;
+        uint64_t scaled = 0;
+        if (shift < 55) // Otherwise below half of the last decimal
+        {
+            uint64_t product = mantissa * pow10;
+            uint64_t half = (uint64_t)1 << (shift - 1);
+            uint64_t rest = product & ((half << 1) - 1);
+            scaled = product >> shift;
+            if ((rest > half) || ((rest == half) && (scaled & 1)))
+            {
+                scaled++;
+            }
+        }
+        if (scaled <= UINT32_MAX)
+        {
+            integer = (uint32_t)scaled / pow10;
+            fraction = (uint32_t)scaled - (uint32_t)integer * pow10;
+        }
+        else
+        {
+            integer = scaled / pow10;
+            fraction = (uint32_t)(scaled - integer * pow10);
+        }
+    }
+
+    if (decimals != 0)
+    {
+        p -= decimals;
+        row_builder_format_padded(p, fraction, decimals);
+        *--p = '.';
+    }
+    p = big ? row_builder_format_big(p, mantissa, exponent) : row_builder_format_u64(p, integer);
+    if (negative)
+    {
+        *--p = '-';
+    }
+    row_builder_put(row, p, end - p);
+}
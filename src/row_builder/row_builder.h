@@ -0,0 +1,54 @@
+/*
+ * row_builder.h
+ *
+ *  Description: Allocation-free text formatting of the log and statistics rows. A row builder
+ *               appends fields to a caller buffer: integers through a two-digit table (one
+ *               division per two digits), floats as fixed point with a given number of decimals,
+ *               computed from the mantissa and exponent with integer operations only (the ESP32
+ *               has no double precision FPU, and newlib's "%f" goes through _dtoa and the reent
+ *               structure). The output is the one of printf: "%u", "%" PRIu64, "%" PRId64,
+ *               "%x" / "%X" with a minimum width, "%.<decimals>f" correctly rounded (ties to even),
+ *               "inf" / "nan".
+ *               A field that does not fit marks the row as overflowed, row_builder_end reports it.
+ */
+
+#ifndef ROW_BUILDER_H
+#define ROW_BUILDER_H
+
+//==================================Standard Libraries Includes=======================//
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+//----------------------------
+// Row Builder Macros
+//----------------------------
+#define ROW_BUILDER_MAX_DECIMALS 9 // Largest precision of row_builder_f32
+
+//===============================================
+// User type definitions (structures)
+//===============================================
+typedef struct
+{
+	char *buf;	   // Caller buffer
+	size_t len;	   // Size of buf, one byte is kept for the terminator
+	size_t used;   // Characters appended so far
+	bool overflow; // A field did not fit, the row is incomplete
+} row_builder_t;
+
+//===============================================
+// APIs Supported by "ROW BUILDER"
+//===============================================
+
+void row_builder_init(row_builder_t *row, char *buf, size_t len);
+int row_builder_end(row_builder_t *row);
+
+void row_builder_char(row_builder_t *row, char c);
+void row_builder_str(row_builder_t *row, const char *str);
+void row_builder_u32(row_builder_t *row, uint32_t value);
+void row_builder_u64(row_builder_t *row, uint64_t value);
+void row_builder_i64(row_builder_t *row, int64_t value);
+void row_builder_hex(row_builder_t *row, uint64_t value, uint8_t min_digits, bool upper);
+void row_builder_f32(row_builder_t *row, float value, uint8_t decimals);
+
+#endif // ROW_BUILDER_H
@@ -0,0 +1,335 @@
+/*
+ * sd_health.c
+ *
+ *  Description: Implementation of the SD card qualification and health reports.
+ *      Note: The qualification writes the scratch file as sd_writer would (one write() per write
+ *            size at aligned offsets, an fsync() every SD_WRITER_SYNC_BYTES), so the latencies
+ *            are those the writer task will see, FAT allocation included.
+ */
+
+#include "sd_health.h"
+#include "pipeline_stats/pipeline_stats.h"
+#include "sd_recovery/sd_recovery.h"
+#include "log_stream/log_stream.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *TAG = "sd_health";
+
+sd_health_t SD_card_health;
+
+// Per-write latencies of one candidate size, sorted for the percentiles
+static uint32_t sd_health_latency[SD_HEALTH_TEST_BYTES / SD_WRITER_MIN_WRITE_SIZE];
+
+/*
+ * ================================================================
+ * 					Local Functions Definition
+ * ================================================================
+ *
+ * */
+static inline uint32_t sd_health_us(int64_t elapsed)
+{
+    return (elapsed <= 0) ? 0 : (elapsed > UINT32_MAX) ? UINT32_MAX : (uint32_t)elapsed;
+}
+
+// kB/s (1000 bytes) of bytes moved in busy_us
+static uint32_t sd_health_kbps(uint64_t bytes, int64_t busy_us)
+{
+    return (busy_us > 0) ? (uint32_t)(bytes * 1000 / (uint64_t)busy_us) : 0;
+}
+
+static int sd_health_compare(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+// Pattern of the scratch file: every word holds its file offset, so a misplaced block shows
+static void sd_health_fill(uint8_t *data, size_t size, off_t offset)
+{
+    for (size_t i = 0; i < size; i += sizeof(uint32_t))
+    {
+        uint32_t word = (uint32_t)(offset + (off_t)i) ^ 0xA5A55A5Au;
+        memcpy(data + i, &word, sizeof(word));
+    }
+}
+
+static bool sd_health_check(const uint8_t *data, size_t size, off_t offset)
+{
+    for (size_t i = 0; i < size; i += sizeof(uint32_t))
+    {
+        uint32_t word;
+        memcpy(&word, data + i, sizeof(word));
+        if (word != ((uint32_t)(offset + (off_t)i) ^ 0xA5A55A5Au))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Writes then reads back SD_HEALTH_TEST_BYTES of the scratch file with one write size
+static esp_err_t sd_health_measure(const char *path, uint8_t *scratch, size_t size, sd_health_t *health,
+                                   sd_health_size_t *result)
+{
+    uint32_t count = SD_HEALTH_TEST_BYTES / size;
+    int64_t busy_us = 0;
+    size_t unsynced = 0;
+
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        return ESP_FAIL;
+    }
+    for (uint32_t i = 0; i < count; i++)
+    {
+        off_t offset = (off_t)i * (off_t)size;
+        sd_health_fill(scratch, size, offset);
+        int64_t start_us = esp_timer_get_time();
+        ssize_t written = pwrite(fd, scratch, size, offset);
+        int64_t elapsed = esp_timer_get_time() - start_us;
+        sd_health_latency[i] = sd_health_us(elapsed);
+        busy_us += elapsed;
+        if (written != (ssize_t)size)
+        {
+            health->errors++;
+        }
+        unsynced += size;
+        if ((unsynced >= SD_WRITER_SYNC_BYTES) || (i == count - 1))
+        {
+            start_us = esp_timer_get_time();
+            if (fsync(fd) != 0)
+            {
+                health->errors++;
+            }
+            elapsed = esp_timer_get_time() - start_us;
+            busy_us += elapsed;
+            if (sd_health_us(elapsed) > health->sync_max_us)
+            {
+                health->sync_max_us = sd_health_us(elapsed);
+            }
+            unsynced = 0;
+        }
+    }
+    close(fd);
+
+    qsort(sd_health_latency, count, sizeof(sd_health_latency[0]), sd_health_compare);
+    result->write_size = (uint32_t)size;
+    result->write_kbps = sd_health_kbps(SD_HEALTH_TEST_BYTES, busy_us);
+    result->p99_us = sd_health_latency[(count * 99 + 99) / 100 - 1];
+    result->max_us = sd_health_latency[count - 1];
+
+    // Read back in the same sizes, after a reopen so no sector buffer is reused
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        health->errors++;
+        return ESP_OK;
+    }
+    busy_us = 0;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        off_t offset = (off_t)i * (off_t)size;
+        int64_t start_us = esp_timer_get_time();
+        ssize_t read_len = pread(fd, scratch, size, offset);
+        busy_us += esp_timer_get_time() - start_us;
+        if ((read_len != (ssize_t)size) || !sd_health_check(scratch, size, offset))
+        {
+            health->errors++;
+        }
+    }
+    close(fd);
+    result->read_kbps = sd_health_kbps(SD_HEALTH_TEST_BYTES, busy_us);
+    return ESP_OK;
+}
+
+// Time the producer keeps appending at SD_HEALTH_LOG_KBPS into the other buffers of the pool
+static uint32_t sd_health_slack_us(uint32_t write_size)
+{
+    return (uint32_t)((uint64_t)(SD_WRITER_POOL_SIZE - write_size) * 1000 / SD_HEALTH_LOG_KBPS);
+}
+
+/*
+ * ================================================================
+ * 					API Functions Definition
+ * ================================================================
+ *
+ * */
+
+/**================================================================
+ * @Fn				- sd_health_qualify
+ * @breif			- Measures the card with every candidate write size and chooses the sd_writer policy
+ * @param [in]		- dir: Mount point, the scratch file is created and removed there
+ * @param [in]		- scratch: Buffer of at least SD_WRITER_BUFFER_SIZE bytes
+ * @param [in]		- len: Size of scratch
+ * @param [out]		- health: Results and policy, the sd_writer defaults if the test cannot run
+ * @retval			- ESP_OK, ESP_ERR_INVALID_SIZE for a short buffer, ESP_FAIL if the scratch file
+ * 					  cannot be created
+ * Note				- Takes about SD_HEALTH_SIZE_COUNT * 2 * SD_HEALTH_TEST_BYTES of card time. The
+ * 					  chosen size is the fastest one (>= SD_HEALTH_MIN_KBPS) whose slowest write is
+ * 					  shorter than the pool slack; without one, the size with the most slack left
+ * 					  and the card is not qualified
+ */
+esp_err_t sd_health_qualify(const char *dir, uint8_t *scratch, size_t len, sd_health_t *health)
+{
+    char path[64];
+
+    memset(health, 0, sizeof(*health));
+    health->chosen = SD_HEALTH_SIZE_COUNT - 1;
+    health->policy.write_size = SD_WRITER_BUFFER_SIZE;
+    health->policy.sync_bytes = SD_WRITER_SYNC_BYTES;
+    health->policy.sync_ms = SD_WRITER_SYNC_MS;
+    if (len < SD_WRITER_BUFFER_SIZE)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    snprintf(path, sizeof(path), "%s/%s", dir, SD_HEALTH_SCRATCH_NAME);
+
+    for (uint8_t i = 0; i < SD_HEALTH_SIZE_COUNT; i++)
+    {
+        size_t size = SD_WRITER_BUFFER_SIZE >> (SD_HEALTH_SIZE_COUNT - 1 - i);
+        if (sd_health_measure(path, scratch, size, health, &health->sizes[i]) != ESP_OK)
+        {
+            ESP_LOGE(TAG, "Unable to create %s", path);
+            return ESP_FAIL;
+        }
+        const sd_health_size_t *s = &health->sizes[i];
+        ESP_LOGI(TAG, "%lu B writes: %lu kB/s, read %lu kB/s, p99 %lu us, max %lu us (slack %lu us)",
+                 (unsigned long)s->write_size, (unsigned long)s->write_kbps, (unsigned long)s->read_kbps,
+                 (unsigned long)s->p99_us, (unsigned long)s->max_us,
+                 (unsigned long)sd_health_slack_us(s->write_size));
+    }
+    unlink(path);
+    health->tested = true;
+
+    // Fastest size that fits, or the one with the most slack left
+    int8_t chosen = -1;
+    uint64_t best_ratio = UINT64_MAX;
+    for (uint8_t i = 0; i < SD_HEALTH_SIZE_COUNT; i++)
+    {
+        const sd_health_size_t *s = &health->sizes[i];
+        uint32_t slack_us = sd_health_slack_us(s->write_size);
+        if ((s->write_kbps >= SD_HEALTH_MIN_KBPS) && (s->max_us < slack_us) &&
+            ((chosen < 0) || (s->write_kbps > health->sizes[chosen].write_kbps)))
+        {
+            chosen = (int8_t)i;
+        }
+        uint64_t ratio = (uint64_t)s->max_us * 1000 / slack_us;
+        if (ratio < best_ratio)
+        {
+            best_ratio = ratio;
+            health->chosen = i;
+        }
+    }
+    if (chosen >= 0)
+    {
+        health->chosen = (uint8_t)chosen;
+    }
+
+    // The slowest fsync stays below 1 / SD_HEALTH_SYNC_SHARE of the time, bytes scaled alike
+    uint32_t sync_ms = (uint32_t)((uint64_t)health->sync_max_us * SD_HEALTH_SYNC_SHARE / 1000);
+    health->qualified = (chosen >= 0) && (health->errors == 0) && (sync_ms <= SD_HEALTH_SYNC_MS_MAX);
+    if (sync_ms < SD_WRITER_SYNC_MS)
+    {
+        sync_ms = SD_WRITER_SYNC_MS;
+    }
+    else if (sync_ms > SD_HEALTH_SYNC_MS_MAX)
+    {
+        sync_ms = SD_HEALTH_SYNC_MS_MAX;
+    }
+    health->policy.write_size = health->sizes[health->chosen].write_size;
+    health->policy.sync_ms = sync_ms;
+    health->policy.sync_bytes = (size_t)((uint64_t)SD_WRITER_SYNC_BYTES * sync_ms / SD_WRITER_SYNC_MS);
+
+    ESP_LOGI(TAG, "Card %s: %lu B writes, sync every %lu bytes or %lu ms (slowest fsync %lu us), %lu errors",
+             health->qualified ? "qualified" : "NOT qualified", (unsigned long)health->policy.write_size,
+             (unsigned long)health->policy.sync_bytes, (unsigned long)health->policy.sync_ms,
+             (unsigned long)health->sync_max_us, (unsigned long)health->errors);
+    return ESP_OK;
+}
+
+/**================================================================
+ * @Fn				- sd_health_snapshot
+ * @breif			- Fills a health report: qualification, writer counters and write latencies
+ * @param [in]		- health: Qualification results (SD_card_health)
+ * @param [out]		- report: Report to send, sizeof(*report) bytes
+ * @retval			- None
+ * Note				- Reads the counters while the writer task runs, as can_stats_snapshot
+ */
+void sd_health_snapshot(const sd_health_t *health, sd_health_report_t *report)
+{
+    const pipeline_stage_stats_t *stage = &CAN_pipeline_stats.stages[PIPELINE_STAGE_SD_WRITE];
+    uint32_t hist[SD_HEALTH_LATENCY_BUCKETS];
+    sd_writer_stats_t total;
+
+    sd_writer_totals(&total);
+    memset(report, 0, sizeof(*report));
+    report->magic = SD_HEALTH_MAGIC;
+    report->version = SD_HEALTH_VERSION;
+    report->uptime_ms = (uint32_t)(esp_timer_get_time() / 1000);
+
+    memcpy(report->sizes, health->sizes, sizeof(report->sizes));
+    report->sync_max_us = health->sync_max_us;
+    report->write_size = (uint32_t)health->policy.write_size;
+    report->sync_bytes = (uint32_t)health->policy.sync_bytes;
+    report->sync_ms = health->policy.sync_ms;
+
+    report->written = total.written;
+    report->writes = total.writes;
+    report->syncs = total.syncs;
+    report->errors = total.errors;
+    report->stalls = total.stalls;
+    report->dropped = total.dropped;
+    report->p50_us = pipeline_stats_percentile(&CAN_pipeline_stats, PIPELINE_STAGE_SD_WRITE, 500);
+    report->p99_us = pipeline_stats_percentile(&CAN_pipeline_stats, PIPELINE_STAGE_SD_WRITE, 990);
+    report->p999_us = pipeline_stats_percentile(&CAN_pipeline_stats, PIPELINE_STAGE_SD_WRITE, 999);
+    report->max_us = atomic_load_explicit(&stage->max_us, memory_order_relaxed);
+    pipeline_stats_fold(&CAN_pipeline_stats, PIPELINE_STAGE_SD_WRITE, SD_HEALTH_LATENCY_BASE_US, hist,
+                        SD_HEALTH_LATENCY_BUCKETS);
+    memcpy(report->hist, hist, sizeof(report->hist));
+
+    // The session samples hold the fsyncs too, compared with the slower of both qualification figures
+    uint32_t reference = health->sizes[health->chosen].p99_us;
+    reference = (health->sync_max_us > reference) ? health->sync_max_us : reference;
+    report->status = health->tested ? (health->qualified ? SD_HEALTH_QUALIFIED : 0) : SD_HEALTH_UNTESTED;
+    if (health->tested && (report->p99_us > (uint64_t)reference * SD_HEALTH_DEGRADED_FACTOR))
+    {
+        report->status |= SD_HEALTH_SLOW;
+    }
+
+    const sd_recovery_t *rec = &SD_card_recovery;
+    const log_stream_stats_t *rows = &SDIO_log_stream.stats;
+    report->recovery = (uint8_t)sd_recovery_state(rec);
+    report->outages = rec->outages;
+    report->attempts = rec->attempts;
+    report->down_ms = rec->down_ms;
+    report->rows = rows->records;
+    report->spilled = rec->spilled;
+    report->replayed = rec->replayed;
+    report->spill_dropped = rec->dropped;
+    report->spill_pending = rec->count;
+    report->row_dropped = rows->dropped;
+    report->row_torn = rows->torn;
+    report->unverified = rows->unverified;
+    const framelog_block_t *frames = SDIO_frame_stream.frames;
+    report->frames_lost = (frames != NULL) ? (frames->stats.lost + frames->lost) : 0; // Recorded, and pending
+    if (report->recovery != SD_RECOVERY_UP)
+    {
+        report->status |= SD_HEALTH_RECOVERING;
+    }
+
+    if ((total.dropped != 0) || (rec->dropped != 0) || (rows->dropped != 0) || (rows->torn != 0))
+    {
+        report->status |= SD_HEALTH_DROPPING;
+    }
+    if (total.errors != 0)
+    {
+        report->status |= SD_HEALTH_ERRORS;
+    }
+}
@@ -0,0 +1,136 @@
+/*
+ * sd_health.h
+ *
+ *  Description: SD card qualification and session write-latency health. At mount time
+ *               sd_health_qualify writes and reads back a scratch file with every candidate write
+ *               size (fractions of the FAT cluster), times each write(), read and fsync(), and
+ *               chooses the write size and sync policy of sd_writer: the fastest size whose worst
+ *               write still fits the time the producer can keep filling the rest of the writer pool
+ *               at the design log rate, and a sync period long enough for the slowest fsync to stay
+ *               a small share of the time. During the session the write() / fsync() durations of
+ *               the writer task are kept by pipeline_stats (PIPELINE_STAGE_SD_WRITE);
+ *               sd_health_snapshot packs them with the qualification results, the writer
+ *               counters and the outages of the card (sd_recovery) with the rows and frames they
+ *               cost into a report sent as-is over UDP / MQTT.
+ */
+
+#ifndef SD_HEALTH_H
+#define SD_HEALTH_H
+
+//==================================Standard Libraries Includes=======================//
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+//==================================ESP32 Libraries Includes==========================//
+#include "esp_err.h"
+#include "sd_writer/sd_writer.h"
+
+//----------------------------
+// Health Macros
+//----------------------------
+#define SD_HEALTH_SCRATCH_NAME "QUAL.TMP" // Scratch file of the qualification, removed afterwards
+#define SD_HEALTH_SIZE_COUNT 3			   // Candidate write sizes: SD_WRITER_BUFFER_SIZE / 4, / 2, / 1
+#define SD_HEALTH_TEST_BYTES (256 * 1024)  // Bytes written and read back per candidate size
+#define SD_HEALTH_MIN_KBPS 500			   // Slowest write throughput of a qualified card
+#define SD_HEALTH_LOG_KBPS 128			   // Design append rate of one writer (rows or frames)
+#define SD_HEALTH_SYNC_SHARE 50			   // Sync period of at least this many slowest fsync() times
+#define SD_HEALTH_SYNC_MS_MAX 5000		   // Longest sync period chosen for a slow card
+#define SD_HEALTH_DEGRADED_FACTOR 4		   // Session p99 beyond this many qualification p99: SLOW
+#define SD_HEALTH_LATENCY_BUCKETS 16	   // Bucket k: write() / fsync() < SD_HEALTH_LATENCY_BASE_US << k
+#define SD_HEALTH_LATENCY_BASE_US 64	   // Upper bound of bucket 0, the last bucket is open-ended
+#define SD_HEALTH_MAGIC 0x4C484453u		   // "SDHL": first word of a health packet
+#define SD_HEALTH_VERSION 2
+
+// Status flags of a report
+#define SD_HEALTH_QUALIFIED 0x01 // Every requirement met at mount time
+#define SD_HEALTH_UNTESTED 0x02	 // Qualification could not run, sd_writer defaults in use
+#define SD_HEALTH_SLOW 0x04		 // Session p99 beyond SD_HEALTH_DEGRADED_FACTOR times the qualification
+#define SD_HEALTH_DROPPING 0x08	 // Bytes, rows or frames lost this session
+#define SD_HEALTH_ERRORS 0x10	 // Failed write() / fsync() this session
+#define SD_HEALTH_RECOVERING 0x20 // Card away: unmounted, remounting or logs being reopened
+
+//===============================================
+// User type definitions (structures)
+//===============================================
+
+//----------------------------
+// Wire format (little-endian, packed), decoded by scripts/telemetry_receiver.py
+//----------------------------
+typedef struct __attribute__((packed))
+{
+	uint32_t write_size; // Bytes per write()
+	uint32_t write_kbps; // Throughput of the writes and fsyncs of the scratch file
+	uint32_t read_kbps;	 // Throughput of the read back
+	uint32_t p99_us;	 // Per-write latency
+	uint32_t max_us;
+} sd_health_size_t;
+
+typedef struct __attribute__((packed))
+{
+	uint32_t magic;	  // SD_HEALTH_MAGIC
+	uint8_t version;  // SD_HEALTH_VERSION
+	uint8_t status;	  // SD_HEALTH_ flags
+	uint8_t recovery; // sd_recovery_state_t
+	uint8_t reserved;
+	uint32_t uptime_ms;
+	// Qualification at mount time
+	sd_health_size_t sizes[SD_HEALTH_SIZE_COUNT];
+	uint32_t sync_max_us; // Slowest fsync() of the scratch file
+	uint32_t write_size;  // Policy given to sd_writer_configure
+	uint32_t sync_bytes;
+	uint32_t sync_ms;
+	// Session, every writer
+	uint64_t written;
+	uint32_t writes;
+	uint32_t syncs;
+	uint32_t errors;
+	uint32_t stalls;
+	uint32_t dropped;
+	uint32_t p50_us; // write() / fsync() durations of the writer task
+	uint32_t p99_us;
+	uint32_t p999_us;
+	uint32_t max_us;
+	uint32_t hist[SD_HEALTH_LATENCY_BUCKETS];
+	// Outages of the card (version 2)
+	uint32_t outages;
+	uint32_t attempts;		// Remount attempts
+	uint32_t down_ms;		// Outages ended
+	uint32_t rows;			// Rows taken by the snapshot log
+	uint32_t spilled;		// Rows kept in RAM while the card was away
+	uint32_t replayed;		// Of spilled: written back
+	uint32_t spill_dropped; // Of spilled: overwritten in the full ring
+	uint32_t spill_pending;
+	uint32_t row_dropped; // Rows refused by the writer
+	uint32_t row_torn;	  // Rows appended before an outage, missing from the recovered file
+	uint32_t unverified;  // Of row_torn: counted without a file offset to compare
+	uint32_t frames_lost; // Frames the frame log records as lost (ring overruns, outages)
+} sd_health_report_t;
+
+typedef struct
+{
+	sd_health_size_t sizes[SD_HEALTH_SIZE_COUNT];
+	uint32_t sync_max_us;
+	uint32_t errors;		   // Failed or short scratch file operations, pattern mismatches
+	bool tested;			   // The scratch file could be created
+	bool qualified;			   // The chosen size meets every requirement
+	uint8_t chosen;			   // Index in sizes of the write size of the policy
+	sd_writer_config_t policy; // Given to sd_writer_configure
+} sd_health_t;
+
+//===============================================
+// Card health instance (qualified by app_main)
+//===============================================
+extern sd_health_t SD_card_health;
+
+//===============================================
+// APIs Supported by "SD HEALTH"
+//===============================================
+
+// Once the card is mounted, before sd_writer_init
+esp_err_t sd_health_qualify(const char *dir, uint8_t *scratch, size_t len, sd_health_t *health);
+
+// Reader side
+void sd_health_snapshot(const sd_health_t *health, sd_health_report_t *report);
+
+#endif // SD_HEALTH_H
@@ -0,0 +1,227 @@
+/*
+ * sd_recovery.c
+ *
+ *  Description: Implementation of the SD card fault recovery.
+ *      Note: Only the recovery task unmounts and mounts the card, and only once every user has
+ *            released it and no writer holds a file: a user that has not released it after
+ *            SD_RECOVERY_CLOSE_MS has its writers failed and their files closed by the writer
+ *            task (sd_writer_abort), the card is never unmounted under an open descriptor.
+ */
+
+#include "sd_recovery.h"
+#include "sd_writer/sd_writer.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include <string.h>
+
+static const char *TAG = "sd_recovery";
+
+sd_recovery_t SD_card_recovery;
+
+/*
+ * ================================================================
+ * 					Local Functions Definition
+ * ================================================================
+ *
+ * */
+static void sd_recovery_task(void *pvParameters)
+{
+    sd_recovery_t *rec = (sd_recovery_t *)pvParameters;
+
+    while (1)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        if (atomic_load(&rec->state) != SD_RECOVERY_LOST)
+        {
+            continue;
+        }
+
+        // Users close their files first, each release notifies this task
+        TickType_t start = xTaskGetTickCount();
+        while ((atomic_load(&rec->released) != SD_RECOVERY_USERS) &&
+               ((xTaskGetTickCount() - start) < pdMS_TO_TICKS(SD_RECOVERY_CLOSE_MS)))
+        {
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(10));
+        }
+        if (atomic_load(&rec->released) != SD_RECOVERY_USERS)
+        {
+            ESP_LOGW(TAG, "Users 0x%02x still hold files, closing them", SD_RECOVERY_USERS & ~atomic_load(&rec->released));
+            sd_writer_abort();
+        }
+
+        // The writer task may still be inside write() / fsync(): waited for, however long it takes
+        start = xTaskGetTickCount();
+        while (sd_writer_open_files() != 0)
+        {
+            if ((xTaskGetTickCount() - start) >= pdMS_TO_TICKS(SD_RECOVERY_CLOSE_MS))
+            {
+                start = xTaskGetTickCount();
+                ESP_LOGW(TAG, "%u files still open, unmount delayed", sd_writer_open_files());
+            }
+            vTaskDelay(pdMS_TO_TICKS(10));
+        }
+        SDIO_SD_DeInit();
+        atomic_store(&rec->state, SD_RECOVERY_RETRY);
+
+        rec->backoff_ms = SD_RECOVERY_RETRY_MIN_MS;
+        while (1)
+        {
+            vTaskDelay(pdMS_TO_TICKS(rec->backoff_ms));
+            rec->attempts++;
+            esp_err_t err = SDIO_SD_Remount();
+            if (err == ESP_OK)
+            {
+                break;
+            }
+            rec->backoff_ms = (rec->backoff_ms >= SD_RECOVERY_RETRY_MAX_MS / 2) ? SD_RECOVERY_RETRY_MAX_MS
+                                                                               : rec->backoff_ms * 2;
+            ESP_LOGW(TAG, "Remount failed (%s), next attempt in %lu ms", esp_err_to_name(err),
+                     (unsigned long)rec->backoff_ms);
+        }
+        ESP_LOGI(TAG, "Card mounted again after %lld ms", (long long)((esp_timer_get_time() - rec->lost_us) / 1000));
+        atomic_store(&rec->state, SD_RECOVERY_MOUNTED);
+    }
+}
+
+/*
+ * ================================================================
+ * 					API Functions Definition
+ * ================================================================
+ *
+ * */
+
+/**================================================================
+ * @Fn				- sd_recovery_init
+ * @breif			- Takes the spill ring from the heap and creates the recovery task, the card is UP
+ * @param [in]		- rec: Recovery object (SD_card_recovery)
+ * @retval			- ESP_OK, ESP_ERR_NO_MEM if the task cannot be created
+ * Note				- Without the SD_RECOVERY_SPILL_SIZE bytes of the ring the recovery still runs,
+ * 					  rows that cannot be written during an outage are then counted as dropped
+ */
+esp_err_t sd_recovery_init(sd_recovery_t *rec)
+{
+    memset(rec, 0, sizeof(*rec));
+    rec->rows = heap_caps_malloc(SD_RECOVERY_SPILL_SIZE, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (rec->rows != NULL)
+    {
+        rec->capacity = SD_RECOVERY_SPILL_SIZE / sizeof(SDIO_TxBuffer);
+    }
+    else
+    {
+        ESP_LOGW(TAG, "No RAM for the spill ring, rows are dropped while the card is away");
+    }
+    atomic_store(&rec->state, SD_RECOVERY_UP);
+    if (xTaskCreatePinnedToCore(sd_recovery_task, "sd_recovery", 4096, rec, SD_RECOVERY_TASK_PRIORITY, &rec->task,
+                                SD_RECOVERY_TASK_CORE) != pdPASS)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+/**================================================================
+ * @Fn				- sd_recovery_lost
+ * @breif			- Reports a failed write, sync or reopen: starts the recovery
+ * @param [in]		- rec: Recovery object
+ * @retval			- None
+ * Note				- Returns at once; from UP it starts an outage, from MOUNTED (reopen failed) the
+ * 					  card is unmounted again, otherwise the recovery is already running
+ */
+void sd_recovery_lost(sd_recovery_t *rec)
+{
+    uint8_t state = SD_RECOVERY_UP;
+    if (atomic_compare_exchange_strong(&rec->state, &state, SD_RECOVERY_LOST))
+    {
+        rec->lost_us = esp_timer_get_time();
+        rec->outages++;
+        ESP_LOGW(TAG, "Card lost, recovering in the background");
+    }
+    else if ((state != SD_RECOVERY_MOUNTED) || !atomic_compare_exchange_strong(&rec->state, &state, SD_RECOVERY_LOST))
+    {
+        return;
+    }
+    xTaskNotifyGive(rec->task);
+}
+
+/**================================================================
+ * @Fn				- sd_recovery_release
+ * @breif			- Tells the recovery task that a user has closed its files
+ * @param [in]		- rec: Recovery object
+ * @param [in]		- user: SD_RECOVERY_USER_ flag of the caller
+ * @retval			- None
+ * Note				- Called by each user whenever the state is not UP, repeated calls are ignored
+ */
+void sd_recovery_release(sd_recovery_t *rec, uint8_t user)
+{
+    if ((atomic_fetch_or(&rec->released, user) & user) == 0)
+    {
+        xTaskNotifyGive(rec->task);
+    }
+}
+
+sd_recovery_state_t sd_recovery_state(const sd_recovery_t *rec)
+{
+    return (sd_recovery_state_t)atomic_load(&rec->state);
+}
+
+/**================================================================
+ * @Fn				- sd_recovery_resume
+ * @breif			- Ends the outage once the logs are reopened on the remounted card
+ * @param [in]		- rec: Recovery object
+ * @retval			- None
+ * Note				- Only from MOUNTED; the users open their files again once the state is UP
+ */
+void sd_recovery_resume(sd_recovery_t *rec)
+{
+    if (atomic_load(&rec->state) != SD_RECOVERY_MOUNTED)
+    {
+        return;
+    }
+    rec->down_ms += (uint32_t)((esp_timer_get_time() - rec->lost_us) / 1000);
+    atomic_store(&rec->released, 0);
+    atomic_store(&rec->state, SD_RECOVERY_UP);
+}
+
+/**================================================================
+ * @Fn				- sd_recovery_spill
+ * @breif			- Keeps a row that cannot be written now
+ * @param [in]		- rec: Recovery object
+ * @param [in]		- row: Readings, copied
+ * @retval			- None
+ * Note				- A full ring overwrites its oldest row, counted in dropped (every row without a ring)
+ */
+void sd_recovery_spill(sd_recovery_t *rec, const SDIO_TxBuffer *row)
+{
+    if (rec->capacity == 0)
+    {
+        rec->dropped++;
+        return;
+    }
+    if (rec->count == rec->capacity)
+    {
+        rec->head = (rec->head + 1) % rec->capacity;
+        rec->count--;
+        rec->dropped++;
+    }
+    rec->rows[(rec->head + rec->count) % rec->capacity] = *row;
+    rec->count++;
+    rec->spilled++;
+}
+
+// Oldest spilled row, NULL once the ring is empty
+const SDIO_TxBuffer *sd_recovery_spilled(const sd_recovery_t *rec)
+{
+    return (rec->count != 0) ? &rec->rows[rec->head] : NULL;
+}
+
+// The oldest spilled row was taken by the log
+void sd_recovery_replayed(sd_recovery_t *rec)
+{
+    if (rec->count != 0)
+    {
+        rec->head = (rec->head + 1) % rec->capacity;
+        rec->count--;
+        rec->replayed++;
+    }
+}
@@ -0,0 +1,105 @@
+/*
+ * sd_recovery.h
+ *
+ *  Description: SD card fault recovery. A failed write or sync no longer stops the logging tasks:
+ *               the task that sees the failure calls sd_recovery_lost and carries on. The recovery
+ *               task waits for the SD tasks to close their files (failing the writers of a task that
+ *               does not within SD_RECOVERY_CLOSE_MS), unmounts the card and remounts it
+ *               with an exponential retry (SD_RECOVERY_RETRY_MIN_MS doubled up to
+ *               SD_RECOVERY_RETRY_MAX_MS), never blocking a producer.
+ *               States: UP -> LOST (files being closed) -> RETRY (unmounted, remount attempts) ->
+ *               MOUNTED (SDIO_Log_Task reopens the logs, a failed reopen goes back to LOST) -> UP.
+ *               While the card is not UP, SDIO_Log_Task keeps its rows in a bounded RAM spill ring
+ *               (SD_RECOVERY_SPILL_SIZE bytes of heap taken by sd_recovery_init, about 2.5 s of rows at
+ *               50 Hz), written back in order once the logs are reopened; rows overwritten in a full ring are counted as dropped.
+ *               Frames of the raw frame log are not spilled: they are counted as lost and recorded
+ *               in the next block (framelog.h).
+ */
+
+#ifndef SD_RECOVERY_H
+#define SD_RECOVERY_H
+
+//==================================Standard Libraries Includes=======================//
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+//==================================ESP32 Libraries Includes==========================//
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include "esp_err.h"
+#include "Logging/logging.h"
+
+//----------------------------
+// Recovery Macros
+//----------------------------
+#define SD_RECOVERY_RETRY_MIN_MS 500	// First remount attempt after the unmount
+#define SD_RECOVERY_RETRY_MAX_MS 30000	// Longest wait between two remount attempts
+#define SD_RECOVERY_CLOSE_MS 1000		// Wait for the SD tasks to close their files before sd_writer_abort
+#define SD_RECOVERY_SPILL_SIZE (16 * 1024) // Heap for the rows kept while the card is away (~128 rows)
+#define SD_RECOVERY_REPLAY_ROWS 32		// Spilled rows written back per row period
+#define SD_RECOVERY_TASK_PRIORITY 2
+#define SD_RECOVERY_TASK_CORE 0
+
+// Users of the card, each closes its files before the unmount
+#define SD_RECOVERY_USER_LOG 0x01	 // SDIO_Log_Task: snapshot log and bus statistics
+#define SD_RECOVERY_USER_FRAMES 0x02 // SDIO_Frame_Log_Task: raw frame log
+#define SD_RECOVERY_USERS (SD_RECOVERY_USER_LOG | SD_RECOVERY_USER_FRAMES)
+
+//===============================================
+// User type definitions (structures)
+//===============================================
+typedef enum
+{
+	SD_RECOVERY_UP,		 // Files open, rows written to the card
+	SD_RECOVERY_LOST,	 // A write failed: the users close their files
+	SD_RECOVERY_RETRY,	 // Unmounted, remount attempts with backoff
+	SD_RECOVERY_MOUNTED, // Mounted again, waiting for SDIO_Log_Task to reopen the logs
+} sd_recovery_state_t;
+
+typedef struct
+{
+	_Atomic uint8_t state;	  // sd_recovery_state_t
+	_Atomic uint8_t released; // SD_RECOVERY_USER_ flags of the users whose files are closed
+	TaskHandle_t task;
+	int64_t lost_us;	 // Start of the current outage
+	uint32_t outages;	 // Times the card was lost
+	uint32_t attempts;	 // Remount attempts, every outage
+	uint32_t down_ms;	 // Time the card was not UP, every outage ended
+	uint32_t backoff_ms; // Wait before the next remount attempt
+	// Spill ring, SDIO_Log_Task only
+	SDIO_TxBuffer *rows; // Heap, capacity rows (none if the allocation failed: rows dropped)
+	uint16_t capacity;	 // SD_RECOVERY_SPILL_SIZE / sizeof(SDIO_TxBuffer)
+	uint16_t head;		 // Oldest row
+	uint16_t count;		 // Rows waiting to be written back
+	uint32_t spilled;	 // Rows put in the ring
+	uint32_t replayed;	 // Rows written back to the log
+	uint32_t dropped;	 // Oldest rows overwritten while the ring was full (every row without a ring)
+} sd_recovery_t;
+
+//===============================================
+// Recovery instance of the SD card (started by app_main)
+//===============================================
+extern sd_recovery_t SD_card_recovery;
+
+//===============================================
+// APIs Supported by "SD RECOVERY"
+//===============================================
+
+// Once the card is mounted (creates the recovery task, takes the spill ring from the heap)
+esp_err_t sd_recovery_init(sd_recovery_t *rec);
+
+// Users of the card
+void sd_recovery_lost(sd_recovery_t *rec);
+void sd_recovery_release(sd_recovery_t *rec, uint8_t user);
+sd_recovery_state_t sd_recovery_state(const sd_recovery_t *rec);
+
+// SDIO_Log_Task: logs reopened after MOUNTED
+void sd_recovery_resume(sd_recovery_t *rec);
+
+// SDIO_Log_Task: spill ring
+void sd_recovery_spill(sd_recovery_t *rec, const SDIO_TxBuffer *row);
+const SDIO_TxBuffer *sd_recovery_spilled(const sd_recovery_t *rec);
+void sd_recovery_replayed(sd_recovery_t *rec);
+
+#endif // SD_RECOVERY_H
@@ -0,0 +1,582 @@
+/*
+ * sd_writer.c
+ *
+ *  Description: Implementation of the write-behind SD writer.
+ *      Note: Buffers move active -> job queue -> writer task -> free queue of their writer -> active.
+ *            The active buffer is filled by the producer only; the writer task may write the bytes
+ *            already published in it (used, release / acquire) for a timed sync, and writes the
+ *            whole buffer again at the same offset once it is full, so every cluster ends up
+ *            written by one aligned write() and the partial writes only cost durability syncs.
+ *            The job queue is FIFO and the active buffer of a writer is always queued after its
+ *            other buffers, so a producer never takes back a buffer the writer task is still syncing.
+ */
+
+#include "sd_writer.h"
+#include "pipeline_stats/pipeline_stats.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "sdkconfig.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+
+#if CONFIG_IDF_TARGET_LINUX
+#include "host_port.h" // Host build: card faults injected with TELE_HOST_SD_FAULT
+#define SD_WRITER_FAULT() host_sdmmc_fault()
+#else
+#define SD_WRITER_FAULT() false
+#endif
+
+#define SD_WRITER_CLOSE_FLAG 0x80 // Set on the index of the last buffer queued by sd_writer_close
+
+static const char *TAG = "sd_writer";
+
+// Buffer handed to the writer task
+typedef struct
+{
+    sd_writer_t *writer; // NULL: sd_writer_abort, every open file is closed
+    uint8_t index;		 // Buffer of the writer, SD_WRITER_CLOSE_FLAG on the last one
+} sd_writer_job_t;
+
+// Shared by every writer object, created by the first sd_writer_init
+static QueueHandle_t sd_writer_jobs;
+static TaskHandle_t sd_writer_task_handle;
+static sd_writer_t *sd_writer_files[SD_WRITER_MAX_FILES];
+static uint8_t sd_writer_file_count;
+static int64_t sd_writer_last_sync_us; // Writer task only: last timed sync of all files
+static sd_writer_config_t sd_writer_config = {
+    .write_size = SD_WRITER_BUFFER_SIZE,
+    .sync_bytes = SD_WRITER_SYNC_BYTES,
+    .sync_ms = SD_WRITER_SYNC_MS,
+};
+
+/*
+ * ================================================================
+ * 					Local Functions Definition
+ * ================================================================
+ *
+ * */
+static void sd_writer_account(sd_writer_t *writer, int64_t start_us, bool ok)
+{
+    int64_t elapsed = esp_timer_get_time() - start_us;
+    pipeline_stats_record(&CAN_pipeline_stats, PIPELINE_STAGE_SD_WRITE, elapsed);
+    writer->stats.write_us += elapsed;
+    if (elapsed > writer->stats.max_write_us)
+    {
+        writer->stats.max_write_us = elapsed;
+    }
+    if (!ok)
+    {
+        writer->stats.errors++;
+        atomic_store(&writer->failed, true);
+    }
+}
+
+// Writes the published bytes of a buffer at its file offset
+static void sd_writer_write(sd_writer_t *writer, sd_writer_buffer_t *buffer, size_t len)
+{
+    int fd = atomic_load(&writer->fd);
+    int64_t start_us = esp_timer_get_time();
+    ssize_t written = SD_WRITER_FAULT() ? -1 : pwrite(fd, buffer->data, len, buffer->offset);
+
+    sd_writer_account(writer, start_us, written == (ssize_t)len);
+    writer->stats.writes++;
+    if (written > 0)
+    {
+        writer->stats.written += (uint64_t)written;
+        writer->unsynced += (size_t)written;
+    }
+}
+
+// Durability point: published bytes of the active buffer, fsync, then the commit of the complete appends
+static void sd_writer_sync(sd_writer_t *writer)
+{
+    // Read first: every byte before the boundary is in a written buffer or below used
+    off_t boundary = (off_t)atomic_load_explicit(&writer->boundary, memory_order_acquire);
+    sd_writer_buffer_t *buffer = &writer->buffers[atomic_load_explicit(&writer->active, memory_order_acquire)];
+    size_t used = atomic_load_explicit(&buffer->used, memory_order_acquire);
+
+    off_t durable = writer->flushed;
+    if ((used != 0) && (used != buffer->capacity))
+    {
+        sd_writer_write(writer, buffer, used);
+    }
+    // The active buffer only counts once the buffers before it are written
+    if ((buffer->offset == writer->flushed) && (used != buffer->capacity))
+    {
+        durable += (off_t)used;
+    }
+    if (boundary > durable)
+    {
+        boundary = durable;
+    }
+    if (writer->unsynced != 0)
+    {
+        int64_t start_us = esp_timer_get_time();
+        sd_writer_account(writer, start_us, !SD_WRITER_FAULT() && (fsync(atomic_load(&writer->fd)) == 0));
+        writer->stats.syncs++;
+        writer->unsynced = 0;
+    }
+    if (!atomic_load(&writer->failed) && (boundary > (off_t)atomic_load_explicit(&writer->durable, memory_order_relaxed)))
+    {
+        atomic_store_explicit(&writer->durable, (uint32_t)boundary, memory_order_release);
+    }
+    // Durable with the next sync or the close, recovery falls back to the other slot meanwhile
+    if ((writer->commit != NULL) && (boundary != writer->committed) && !atomic_load(&writer->failed))
+    {
+        int64_t start_us = esp_timer_get_time();
+        bool ok = writer->commit(atomic_load(&writer->fd), boundary, writer->commit_ctx);
+        sd_writer_account(writer, start_us, ok);
+        writer->stats.commits++;
+        writer->committed = boundary;
+    }
+}
+
+// Card lost: every open file is closed without another write, its writer stays failed
+static void sd_writer_abort_files(void)
+{
+    for (uint8_t i = 0; i < sd_writer_file_count; i++)
+    {
+        sd_writer_t *writer = sd_writer_files[i];
+        int fd = atomic_load(&writer->fd);
+        if (fd >= 0)
+        {
+            atomic_store(&writer->failed, true);
+            close(fd);
+            atomic_store(&writer->fd, -1);
+            ESP_LOGW(TAG, "File of writer %u closed by an abort", i);
+        }
+    }
+}
+
+static void sd_writer_task(void *pvParameters)
+{
+    sd_writer_job_t job;
+
+    ESP_LOGI(TAG, "Running on core %d", xPortGetCoreID());
+    sd_writer_last_sync_us = esp_timer_get_time();
+    while (1)
+    {
+        if (xQueueReceive(sd_writer_jobs, &job, pdMS_TO_TICKS(sd_writer_config.sync_ms / 4)) == pdTRUE)
+        {
+            if (job.writer == NULL)
+            {
+                sd_writer_abort_files();
+                continue;
+            }
+            sd_writer_t *writer = job.writer;
+            uint8_t index = job.index;
+            sd_writer_buffer_t *buffer = &writer->buffers[index & ~SD_WRITER_CLOSE_FLAG];
+            size_t used = atomic_load_explicit(&buffer->used, memory_order_acquire);
+
+            // File closed by an abort: buffers are given back unwritten
+            if (atomic_load(&writer->fd) < 0)
+            {
+                if (index & SD_WRITER_CLOSE_FLAG)
+                {
+                    xSemaphoreGive(writer->closed);
+                }
+                else
+                {
+                    xQueueSend(writer->free, &index, 0);
+                }
+                continue;
+            }
+            if (index & SD_WRITER_CLOSE_FLAG)
+            {
+                // Last buffer: written here if full, by the sync if partial
+                if (used == buffer->capacity)
+                {
+                    sd_writer_write(writer, buffer, used);
+                    writer->flushed = buffer->offset + (off_t)used;
+                }
+                sd_writer_sync(writer);
+
+                // Finalize: the unused part of a preallocated region is released
+                int fd = atomic_load(&writer->fd);
+                writer->end = buffer->offset + (off_t)used;
+                if (lseek(fd, 0, SEEK_END) > writer->end)
+                {
+                    int64_t start_us = esp_timer_get_time();
+                    sd_writer_account(writer, start_us, ftruncate(fd, writer->end) == 0);
+                }
+                close(fd);
+                atomic_store(&writer->fd, -1);
+                xSemaphoreGive(writer->closed);
+                continue;
+            }
+            if (used != 0)
+            {
+                sd_writer_write(writer, buffer, used);
+            }
+            writer->flushed = buffer->offset + (off_t)used;
+            xQueueSend(writer->free, &index, 0);
+
+            // Queued buffers first, the syncs below are then batched over every file
+            if ((uxQueueMessagesWaiting(sd_writer_jobs) != 0) &&
+                ((esp_timer_get_time() - sd_writer_last_sync_us) < (int64_t)sd_writer_config.sync_ms * 1000))
+            {
+                continue;
+            }
+        }
+
+        // Bytes: the file that reached the limit; time: every open file in one pass
+        bool timed = (esp_timer_get_time() - sd_writer_last_sync_us) >= (int64_t)sd_writer_config.sync_ms * 1000;
+        for (uint8_t i = 0; i < sd_writer_file_count; i++)
+        {
+            sd_writer_t *writer = sd_writer_files[i];
+            if ((atomic_load(&writer->fd) >= 0) && (timed || (writer->unsynced >= sd_writer_config.sync_bytes)))
+            {
+                sd_writer_sync(writer);
+            }
+        }
+        if (timed)
+        {
+            sd_writer_last_sync_us = esp_timer_get_time();
+        }
+    }
+}
+
+/*
+ * ================================================================
+ * 					API Functions Definition
+ * ================================================================
+ *
+ * */
+
+/**================================================================
+ * @Fn				- sd_writer_configure
+ * @breif			- Sets the write size and sync policy of every writer
+ * @param [in]		- config: Policy, write_size must be SD_WRITER_BUFFER_SIZE, half or a quarter of it
+ * @retval			- ESP_OK, ESP_ERR_INVALID_ARG for an unsupported policy, ESP_ERR_INVALID_STATE
+ * 					  once a writer is registered
+ * Note				- Called once the card is qualified (sd_health_qualify), before sd_writer_init.
+ * 					  The write size divides the cluster, so a write never spans two clusters
+ */
+esp_err_t sd_writer_configure(const sd_writer_config_t *config)
+{
+    if (sd_writer_file_count != 0)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if ((config->write_size < SD_WRITER_MIN_WRITE_SIZE) || (config->write_size > SD_WRITER_BUFFER_SIZE) ||
+        ((SD_WRITER_BUFFER_SIZE % config->write_size) != 0) || (config->sync_bytes == 0) || (config->sync_ms < 4))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    sd_writer_config = *config;
+    return ESP_OK;
+}
+
+/**================================================================
+ * @Fn				- sd_writer_init
+ * @breif			- Allocates the pool and creates the queues of a writer object, then registers it
+ * 					  with the writer task
+ * @param [out]		- writer: Writer object, one per file open at the same time
+ * @param [in]		- pool_size: RAM of the writer, SD_WRITER_SMALL_POOL_SIZE to SD_WRITER_POOL_SIZE
+ * @retval			- ESP_OK, ESP_ERR_NO_MEM if the pool, a queue or the task cannot be created,
+ * 					  ESP_ERR_INVALID_STATE beyond SD_WRITER_MAX_FILES writers,
+ * 					  ESP_ERR_INVALID_ARG for a pool size out of range
+ * Note				- Called once per writer object before the producer tasks start (the first
+ * 					  call creates the writer task), files are then opened / closed with
+ * 					  sd_writer_open / _close
+ */
+esp_err_t sd_writer_init(sd_writer_t *writer, size_t pool_size)
+{
+    if (sd_writer_file_count >= SD_WRITER_MAX_FILES)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if ((pool_size < SD_WRITER_SMALL_POOL_SIZE) || (pool_size > SD_WRITER_POOL_SIZE))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memset(writer, 0, sizeof(*writer));
+    atomic_store(&writer->fd, -1);
+    // Internal RAM (no SPIRAM on this board), at least two buffers per writer
+    writer->pool = heap_caps_malloc(pool_size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (writer->pool == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    writer->write_size = (sd_writer_config.write_size <= pool_size / 2) ? sd_writer_config.write_size : pool_size / 2;
+    writer->buffer_count = (uint8_t)(pool_size / writer->write_size);
+    for (uint8_t i = 0; i < writer->buffer_count; i++)
+    {
+        writer->buffers[i].data = writer->pool + (size_t)i * writer->write_size;
+    }
+    writer->free = xQueueCreate(SD_WRITER_MAX_BUFFERS, sizeof(uint8_t));
+    writer->closed = xSemaphoreCreateBinary();
+    if ((writer->free == NULL) || (writer->closed == NULL))
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    if (sd_writer_jobs == NULL)
+    {
+        // Every buffer of every writer fits, so handing a buffer over never blocks
+        sd_writer_jobs = xQueueCreate(SD_WRITER_MAX_FILES * SD_WRITER_MAX_BUFFERS, sizeof(sd_writer_job_t));
+        if ((sd_writer_jobs == NULL) ||
+            (xTaskCreatePinnedToCore(sd_writer_task, "sd_writer", 4096, NULL, SD_WRITER_TASK_PRIORITY,
+                                     &sd_writer_task_handle, SD_WRITER_TASK_CORE) != pdPASS))
+        {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    sd_writer_files[sd_writer_file_count++] = writer;
+    return ESP_OK;
+}
+
+/**================================================================
+ * @Fn				- sd_writer_open
+ * @breif			- Opens an existing file for appending through the writer task
+ * @param [in]		- writer: Writer object
+ * @param [in]		- path: File to append to (header already written)
+ * @param [in]		- end: End of the data in the file (SDIO_FileConfig.valid, or writer->end
+ * 					  to resume after sd_writer_close), -1 = end of the file
+ * @param [in]		- commit: Commit hook called after every sync, NULL = none
+ * @param [in]		- ctx: Argument of the hook
+ * @retval			- ESP_OK, ESP_ERR_INVALID_STATE if a file is open, ESP_FAIL if it cannot be opened
+ * Note				- The first buffer ends on the next write size boundary of the file, the
+ * 					  following ones are aligned to it
+ */
+esp_err_t sd_writer_open(sd_writer_t *writer, const char *path, off_t end, sd_writer_commit_t commit, void *ctx)
+{
+    if (atomic_load(&writer->fd) >= 0)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    int fd = open(path, O_WRONLY);
+    if (fd < 0)
+    {
+        ESP_LOGE(TAG, "Unable to open %s", path);
+        return ESP_FAIL;
+    }
+    off_t size = (end >= 0) ? end : lseek(fd, 0, SEEK_END);
+
+    // No buffer of this writer is queued while it is closed
+    xQueueReset(writer->free);
+    for (uint8_t i = 1; i < writer->buffer_count; i++)
+    {
+        xQueueSend(writer->free, &i, 0);
+    }
+    sd_writer_buffer_t *first = &writer->buffers[0];
+    first->offset = size;
+    first->capacity = writer->write_size - (size_t)(size % writer->write_size);
+    atomic_store(&first->used, 0);
+    atomic_store(&writer->active, 0);
+    writer->handed_over = false;
+    writer->end = size;
+    atomic_store(&writer->boundary, (uint32_t)size);
+    atomic_store(&writer->durable, (uint32_t)size);
+    writer->flushed = size;
+    writer->committed = size;
+    writer->commit = commit;
+    writer->commit_ctx = ctx;
+
+    writer->unsynced = 0;
+    atomic_store(&writer->failed, false);
+    atomic_store(&writer->fd, fd);
+    return ESP_OK;
+}
+
+/**================================================================
+ * @Fn				- sd_writer_close
+ * @breif			- Writes every pending byte, syncs and closes the file
+ * @param [in]		- writer: Writer object
+ * @retval			- ESP_OK, ESP_ERR_TIMEOUT if the writer task did not finish within 5 s
+ * Note				- Called by the producer task, no append may run concurrently
+ */
+esp_err_t sd_writer_close(sd_writer_t *writer)
+{
+    if (atomic_load(&writer->fd) < 0)
+    {
+        return ESP_OK;
+    }
+    sd_writer_job_t last = {.writer = writer, .index = atomic_load(&writer->active) | SD_WRITER_CLOSE_FLAG};
+    xSemaphoreTake(writer->closed, 0);
+    xQueueSend(sd_writer_jobs, &last, portMAX_DELAY);
+    return (xSemaphoreTake(writer->closed, pdMS_TO_TICKS(5000)) == pdTRUE) ? ESP_OK : ESP_ERR_TIMEOUT;
+}
+
+/**================================================================
+ * @Fn				- sd_writer_append
+ * @breif			- Copies bytes into the active buffer, handing full buffers to the writer task
+ * @param [in]		- writer: Writer object
+ * @param [in]		- data: Bytes to append
+ * @param [in]		- len: Number of bytes
+ * @retval			- ESP_OK, ESP_FAIL if no file is open or a write failed (reopen the card),
+ * 					  ESP_ERR_TIMEOUT if the bytes were dropped because the buffers they need stayed
+ * 					  busy for SD_WRITER_MAX_STALL_MS, ESP_ERR_INVALID_SIZE if they can never fit the pool
+ * Note				- All or nothing: the buffers the bytes need are taken before any byte is
+ * 					  copied, so a dropped append never leaves part of a row or block in the file
+ */
+esp_err_t sd_writer_append(sd_writer_t *writer, const void *data, size_t len)
+{
+    if ((atomic_load(&writer->fd) < 0) || atomic_load(&writer->failed))
+    {
+        return ESP_FAIL;
+    }
+    const uint8_t *bytes = (const uint8_t *)data;
+    int64_t start_us = esp_timer_get_time();
+    esp_err_t err = ESP_OK;
+    bool stalled = false;
+
+    writer->stats.bytes += len;
+
+    // Buffers needed beyond the room left in the active one, taken from free before copying
+    uint8_t index = atomic_load_explicit(&writer->active, memory_order_relaxed);
+    sd_writer_buffer_t *buffer = &writer->buffers[index];
+    size_t room = buffer->capacity - atomic_load_explicit(&buffer->used, memory_order_relaxed);
+    size_t needed = (len > room) ? ((len - room + writer->write_size - 1) / writer->write_size) : 0;
+    uint8_t reserved[SD_WRITER_MAX_BUFFERS];
+    uint8_t taken = 0;
+
+    if (needed >= writer->buffer_count)
+    {
+        writer->stats.dropped += len;
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if ((room == 0) && !writer->handed_over)
+    {
+        // Queued once, even if no buffer comes free before the next append
+        sd_writer_job_t job = {.writer = writer, .index = index};
+        xQueueSend(sd_writer_jobs, &job, 0);
+        writer->handed_over = true;
+    }
+    while (taken < needed)
+    {
+        int64_t left_us = (SD_WRITER_MAX_STALL_MS * 1000LL) - (esp_timer_get_time() - start_us);
+        stalled |= (uxQueueMessagesWaiting(writer->free) == 0);
+        if ((left_us <= 0) ||
+            (xQueueReceive(writer->free, &reserved[taken], pdMS_TO_TICKS(left_us / 1000)) != pdTRUE))
+        {
+            break;
+        }
+        taken++;
+    }
+    if (taken < needed)
+    {
+        // Not enough buffers in time: the whole append is dropped, the ones taken go back
+        while (taken > 0)
+        {
+            taken--;
+            xQueueSend(writer->free, &reserved[taken], 0);
+        }
+        writer->stats.dropped += len;
+        err = ESP_ERR_TIMEOUT;
+        len = 0;
+    }
+
+    uint8_t next_reserved = 0;
+    while (len > 0)
+    {
+        index = atomic_load_explicit(&writer->active, memory_order_relaxed);
+        buffer = &writer->buffers[index];
+        size_t used = atomic_load_explicit(&buffer->used, memory_order_relaxed);
+
+        if (used == buffer->capacity)
+        {
+            if (!writer->handed_over)
+            {
+                sd_writer_job_t job = {.writer = writer, .index = index};
+                xQueueSend(sd_writer_jobs, &job, 0);
+            }
+            uint8_t next = reserved[next_reserved++];
+            sd_writer_buffer_t *following = &writer->buffers[next];
+            following->offset = buffer->offset + buffer->capacity;
+            following->capacity = writer->write_size;
+            atomic_store_explicit(&following->used, 0, memory_order_relaxed);
+            atomic_store_explicit(&writer->active, next, memory_order_release);
+            writer->handed_over = false;
+            continue;
+        }
+
+        size_t n = (len < (buffer->capacity - used)) ? len : (buffer->capacity - used);
+        memcpy(buffer->data + used, bytes, n);
+        atomic_store_explicit(&buffer->used, used + n, memory_order_release);
+        bytes += n;
+        len -= n;
+    }
+
+    if (err == ESP_OK)
+    {
+        sd_writer_buffer_t *buffer = &writer->buffers[atomic_load_explicit(&writer->active, memory_order_relaxed)];
+        off_t end = buffer->offset + (off_t)atomic_load_explicit(&buffer->used, memory_order_relaxed);
+        atomic_store_explicit(&writer->boundary, (uint32_t)end, memory_order_release);
+    }
+
+    int64_t elapsed = esp_timer_get_time() - start_us;
+    if (stalled)
+    {
+        writer->stats.stalls++;
+    }
+    if (elapsed > writer->stats.max_stall_us)
+    {
+        writer->stats.max_stall_us = elapsed;
+    }
+    return err;
+}
+
+/**================================================================
+ * @Fn				- sd_writer_abort
+ * @breif			- Fails every writer and has the writer task close their files
+ * @param [in]		- None
+ * @retval			- None
+ * Note				- For sd_recovery, when a producer does not close its file after the card was
+ * 					  lost; queued after the pending buffers, nothing more is written. The files
+ * 					  are closed once sd_writer_open_files returns 0
+ */
+void sd_writer_abort(void)
+{
+    for (uint8_t i = 0; i < sd_writer_file_count; i++)
+    {
+        atomic_store(&sd_writer_files[i]->failed, true);
+    }
+    sd_writer_job_t job = {.writer = NULL, .index = 0};
+    xQueueSend(sd_writer_jobs, &job, portMAX_DELAY);
+}
+
+// Files still open by the writer objects, 0 once the card can be unmounted
+uint8_t sd_writer_open_files(void)
+{
+    uint8_t open = 0;
+    for (uint8_t i = 0; i < sd_writer_file_count; i++)
+    {
+        open += (atomic_load(&sd_writer_files[i]->fd) >= 0) ? 1 : 0;
+    }
+    return open;
+}
+
+/**================================================================
+ * @Fn				- sd_writer_totals
+ * @breif			- Adds up the counters of every registered writer (largest for the max_ fields)
+ * @param [out]		- total: Counters of the whole card
+ * @retval			- None
+ * Note				- Reads while the writer task runs, a counter can lag by the call in flight
+ */
+void sd_writer_totals(sd_writer_stats_t *total)
+{
+    memset(total, 0, sizeof(*total));
+    for (uint8_t i = 0; i < sd_writer_file_count; i++)
+    {
+        const sd_writer_stats_t *s = &sd_writer_files[i]->stats;
+        total->bytes += s->bytes;
+        total->written += s->written;
+        total->write_us += s->write_us;
+        total->writes += s->writes;
+        total->syncs += s->syncs;
+        total->errors += s->errors;
+        total->stalls += s->stalls;
+        total->dropped += s->dropped;
+        total->commits += s->commits;
+        if (s->max_write_us > total->max_write_us)
+        {
+            total->max_write_us = s->max_write_us;
+        }
+        if (s->max_stall_us > total->max_stall_us)
+        {
+            total->max_stall_us = s->max_stall_us;
+        }
+    }
+}
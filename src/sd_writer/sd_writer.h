@@ -0,0 +1,147 @@
+/*
+ * sd_writer.h
+ *
+ *  Description: Write-behind SD writer of the log files. Each open file has its own writer object
+ *               (buffers, file descriptor, counters); its producer task appends rows into the
+ *               active RAM buffer (a copy, never a file operation). Full buffers of every file are
+ *               handed to one writer task through one FIFO, which writes each one with a single
+ *               write() of the write size (a whole FAT cluster by default, a power of two fraction
+ *               of it after sd_writer_configure; aligned to the file offset), so the card sees the
+ *               data of all files in the order it filled up. The RAM of a writer is a pool taken
+ *               from the heap by sd_writer_init and cut into buffers of the write size: smaller
+ *               writes give more buffers, a small pool (a file of a few rows per second) gets
+ *               smaller writes.
+ *               Durability follows a bytes-or-time policy: a file is synced once it has
+ *               sync_bytes unsynced, and every sync_ms the partial buffers of all files are
+ *               written and synced in one pass (SD_WRITER_SYNC_BYTES / SD_WRITER_SYNC_MS unless
+ *               configured).
+ *               The producer only waits when every buffer is still being written; that wait is
+ *               bounded and measured (max_stall_us), an append that does not get the buffers it
+ *               needs in time is dropped whole (never part of a row or block in the file).
+ *               Appends start at the given end of data, so a preallocated file is filled in place;
+ *               closing truncates the file to its data.
+ *               After every sync the commit hook (if set) receives the end of the last complete
+ *               append now on the card, the journal of the file format records it; the producer
+ *               reads the same end from durable.
+ */
+
+#ifndef SD_WRITER_H
+#define SD_WRITER_H
+
+//==================================Standard Libraries Includes=======================//
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <sys/types.h>
+
+//==================================ESP32 Libraries Includes==========================//
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include "esp_err.h"
+#include "Logging/logging.h"
+
+//----------------------------
+// Writer Macros
+//----------------------------
+#define SD_WRITER_BUFFERS 2								  // RAM of a writer in default buffers, one being filled while the others are written
+#define SD_WRITER_BUFFER_SIZE SDIO_ALLOCATION_UNIT_SIZE	  // Default write size: one FAT cluster per write()
+#define SD_WRITER_POOL_SIZE (SD_WRITER_BUFFERS * SD_WRITER_BUFFER_SIZE) // RAM of a busy writer, cut into buffers of the write size
+#define SD_WRITER_MIN_WRITE_SIZE (SD_WRITER_BUFFER_SIZE / 4)			// Smallest write size of sd_writer_configure
+#define SD_WRITER_SMALL_POOL_SIZE (2 * SD_WRITER_MIN_WRITE_SIZE)		// RAM of a writer of a few rows per second
+#define SD_WRITER_MAX_BUFFERS (SD_WRITER_POOL_SIZE / SD_WRITER_MIN_WRITE_SIZE)
+#define SD_WRITER_SYNC_BYTES (4 * SD_WRITER_BUFFER_SIZE) // Unsynced bytes before an fsync
+#define SD_WRITER_SYNC_MS 1000							  // Longest time appended rows stay in RAM only
+#define SD_WRITER_MAX_STALL_MS 20						  // Longest producer wait for a free buffer
+#define SD_WRITER_MAX_FILES 4							  // Writer objects served by the writer task
+#define SD_WRITER_TASK_PRIORITY 3
+#define SD_WRITER_TASK_CORE 0
+
+//===============================================
+// User type definitions (structures)
+//===============================================
+
+// Called by the writer task after a sync: every append ending at or before end is durable.
+// Returns false if the commit could not be written
+typedef bool (*sd_writer_commit_t)(int fd, off_t end, void *ctx);
+
+// Write and durability policy of every writer, chosen at mount time (sd_health_qualify)
+typedef struct
+{
+	size_t write_size;	 // Bytes per write(): SD_WRITER_BUFFER_SIZE divided by 1, 2 or 4
+	size_t sync_bytes;	 // Unsynced bytes of a file before an fsync
+	uint32_t sync_ms;	 // Longest time appended rows stay in RAM only
+} sd_writer_config_t;
+
+typedef struct
+{
+	uint8_t *data;		 // write_size bytes of the pool of the writer
+	_Atomic size_t used; // Bytes appended, published by the producer (release)
+	size_t capacity;	 // Bytes up to the next write size boundary of the file
+	off_t offset;		 // File offset of data[0]
+} sd_writer_buffer_t;
+
+// Counters, written by the writer task (bytes, writes, syncs) or the producer (stalls, dropped)
+typedef struct
+{
+	uint64_t bytes;		  // Bytes appended by the producer
+	uint64_t written;	  // Bytes written to the card, partial buffers included every time
+	int64_t write_us;	  // Time spent in write() and fsync()
+	uint32_t writes;	  // write() calls
+	uint32_t syncs;		  // fsync() calls
+	uint32_t errors;	  // Failed write() / fsync() calls
+	int64_t max_write_us; // Slowest write() / fsync()
+	uint32_t stalls;	  // Appends that waited for a free buffer
+	int64_t max_stall_us; // Longest sd_writer_append call
+	uint32_t dropped;	  // Bytes of the appends dropped whole: no room within SD_WRITER_MAX_STALL_MS
+	uint32_t commits;	  // Commit hook calls
+} sd_writer_stats_t;
+
+typedef struct
+{
+	uint8_t *pool;				   // Heap, SD_WRITER_SMALL_POOL_SIZE to SD_WRITER_POOL_SIZE bytes
+	size_t write_size;			   // Bytes per write(): the configured size, at most half the pool
+	sd_writer_buffer_t buffers[SD_WRITER_MAX_BUFFERS];
+	uint8_t buffer_count;		   // Buffers cut from the pool, set by sd_writer_init
+	_Atomic uint8_t active;		   // Buffer being filled by the producer
+	_Atomic int fd;				   // Log file, -1 while closed
+	_Atomic bool failed;		   // A write failed since sd_writer_open
+	bool handed_over;			   // Producer only: the full active buffer is already queued
+	QueueHandle_t free;			   // Buffer indexes written, ready to be filled
+	SemaphoreHandle_t closed;	   // Given by the writer task once sd_writer_close is done
+	size_t unsynced;			   // Writer task only
+	off_t end;					   // End of the appended data, set by sd_writer_open / _close
+	_Atomic uint32_t boundary;	   // File offset after the last complete append (release)
+	_Atomic uint32_t durable;	   // File offset up to which every complete append is synced (release)
+	off_t flushed;				   // Writer task only: end of the whole buffers written, in file order
+	off_t committed;			   // Writer task only: last end given to the commit hook
+	sd_writer_commit_t commit;	   // Set with sd_writer_open
+	void *commit_ctx;
+	sd_writer_stats_t stats;
+} sd_writer_t;
+
+//===============================================
+// APIs Supported by "SD WRITER"
+//===============================================
+
+// Before the first sd_writer_init, defaults otherwise
+esp_err_t sd_writer_configure(const sd_writer_config_t *config);
+
+// Before the producer tasks start (registers the writer with the writer task)
+esp_err_t sd_writer_init(sd_writer_t *writer, size_t pool_size);
+esp_err_t sd_writer_open(sd_writer_t *writer, const char *path, off_t end, sd_writer_commit_t commit, void *ctx);
+esp_err_t sd_writer_close(sd_writer_t *writer);
+
+// Producer side (single task only)
+esp_err_t sd_writer_append(sd_writer_t *writer, const void *data, size_t len);
+
+// Card lost (sd_recovery): no file may stay open over the unmount
+void sd_writer_abort(void);
+uint8_t sd_writer_open_files(void);
+
+// Reader side: counters of every registered writer added up
+void sd_writer_totals(sd_writer_stats_t *total);
+
+#endif // SD_WRITER_H
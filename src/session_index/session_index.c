@@ -0,0 +1,177 @@
+/*
+ * session_index.c
+ *
+ *  Description: Implementation of the session index.
+ *      Note: The index is small (SESSION_INDEX_MAX entries), it is kept in RAM and saved as a
+ *            whole; a save costs one sector write and one fsync.
+ */
+
+#include "session_index.h"
+#include "binlog/binlog.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+_Static_assert(sizeof(session_index_t) <= SESSION_INDEX_SLOT_SIZE, "session_index_t larger than its slot");
+
+/*
+ * ================================================================
+ * 					Local Functions Definition
+ * ================================================================
+ *
+ * */
+static bool session_index_valid(const session_index_t *copy)
+{
+    return (memcmp(copy->magic, SESSION_INDEX_MAGIC, sizeof(copy->magic)) == 0) &&
+           (copy->version == SESSION_INDEX_VERSION) && (copy->count <= SESSION_INDEX_MAX) &&
+           (copy->crc == binlog_crc32(0, copy, offsetof(session_index_t, crc)));
+}
+
+/*
+ * ================================================================
+ * 					API Functions Definition
+ * ================================================================
+ *
+ * */
+
+/**================================================================
+ * @Fn				- session_index_load
+ * @breif			- Reads the current copy of the index
+ * @param [out]		- index: Index, empty if the file has no valid copy
+ * @param [in]		- path: Index file (MOUNT_POINT "/" SESSION_INDEX_NAME)
+ * @retval			- ESP_OK, ESP_ERR_NOT_FOUND if no valid copy was found (new card, or both
+ * 					  copies damaged): the index starts empty
+ */
+esp_err_t session_index_load(session_index_t *index, const char *path)
+{
+    static session_index_t copy;
+    bool found = false;
+    int fd = open(path, O_RDONLY);
+
+    if (fd >= 0)
+    {
+        for (uint8_t slot = 0; slot < 2; slot++)
+        {
+            if ((pread(fd, &copy, sizeof(copy), slot * SESSION_INDEX_SLOT_SIZE) == sizeof(copy)) &&
+                session_index_valid(&copy) && (!found || (copy.generation > index->generation)))
+            {
+                *index = copy;
+                found = true;
+            }
+        }
+        close(fd);
+    }
+    if (!found)
+    {
+        memset(index, 0, sizeof(*index));
+        memcpy(index->magic, SESSION_INDEX_MAGIC, sizeof(index->magic));
+        index->version = SESSION_INDEX_VERSION;
+    }
+    return found ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
+
+/**================================================================
+ * @Fn				- session_index_save
+ * @breif			- Writes the index over its older copy and syncs it
+ * @param [in]		- index: Index, its generation is incremented
+ * @param [in]		- path: Index file
+ * @retval			- ESP_OK, ESP_FAIL if the copy could not be written
+ */
+esp_err_t session_index_save(session_index_t *index, const char *path)
+{
+    int fd = open(path, O_WRONLY | O_CREAT, 0664);
+    if (fd < 0)
+    {
+        return ESP_FAIL;
+    }
+    index->generation++;
+    index->crc = binlog_crc32(0, index, offsetof(session_index_t, crc));
+
+    bool ok = (pwrite(fd, index, sizeof(*index), (index->generation % 2) * SESSION_INDEX_SLOT_SIZE) == sizeof(*index)) &&
+              (fsync(fd) == 0);
+    return ((close(fd) == 0) && ok) ? ESP_OK : ESP_FAIL;
+}
+
+/**================================================================
+ * @Fn				- session_index_last
+ * @breif			- Latest session
+ * @param [in]		- index: Index
+ * @retval			- Entry, NULL if the index is empty
+ */
+session_entry_t *session_index_last(session_index_t *index)
+{
+    return (index->count != 0) ? &index->entries[index->count - 1] : NULL;
+}
+
+/**================================================================
+ * @Fn				- session_index_begin
+ * @breif			- Adds a new open session with the next number
+ * @param [in]		- index: Index
+ * @param [in]		- format: @ref SDIO_File_Types
+ * @param [in]		- version: Log format version
+ * @param [in]		- schema: Schema identifier
+ * @param [in]		- now_us: UTC microseconds since the epoch
+ * @retval			- Entry, NULL if the index is full (session_index_expire first)
+ */
+session_entry_t *session_index_begin(session_index_t *index, uint8_t format, uint16_t version, uint32_t schema,
+                                     int64_t now_us)
+{
+    if (index->count >= SESSION_INDEX_MAX)
+    {
+        return NULL;
+    }
+    session_entry_t *entry = &index->entries[index->count++];
+    memset(entry, 0, sizeof(*entry));
+    entry->number = index->next_number++;
+    entry->format = format;
+    entry->status = SESSION_OPEN;
+    entry->version = version;
+    entry->schema = schema;
+    entry->start_us = now_us;
+    entry->update_us = now_us;
+    entry->boots = 1;
+    return entry;
+}
+
+/**================================================================
+ * @Fn				- session_index_expire
+ * @breif			- Removes the oldest session if the index holds too many sessions or bytes
+ * @param [in]		- index: Index
+ * @param [in]		- max_sessions: Sessions to keep
+ * @param [in]		- max_bytes: Total size to keep
+ * @param [out]		- expired: Removed entry, its file is to be deleted by the caller
+ * @retval			- true if an entry was removed (call again until false)
+ * Note				- The latest session is never removed
+ */
+bool session_index_expire(session_index_t *index, uint16_t max_sessions, uint64_t max_bytes, session_entry_t *expired)
+{
+    uint64_t total = 0;
+
+    for (uint16_t i = 0; i < index->count; i++)
+    {
+        total += index->entries[i].size;
+    }
+    if ((index->count <= 1) || ((index->count <= max_sessions) && (total <= max_bytes)))
+    {
+        return false;
+    }
+    *expired = index->entries[0];
+    index->count--;
+    memmove(&index->entries[0], &index->entries[1], index->count * sizeof(session_entry_t));
+    return true;
+}
+
+/**================================================================
+ * @Fn				- session_index_name
+ * @breif			- File name of a session
+ * @param [in]		- entry: Session
+ * @param [in]		- extension: "BIN" / "CSV"
+ * @param [out]		- name: LOG_<n>.<extension>
+ * @param [in]		- len: Size of name, 13 bytes at least
+ * @retval			- None
+ */
+void session_index_name(const session_entry_t *entry, const char *extension, char *name, size_t len)
+{
+    snprintf(name, len, "LOG_%lu.%s", (unsigned long)(entry->number % SESSION_NAME_MODULO), extension);
+}
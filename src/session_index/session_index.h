@@ -0,0 +1,84 @@
+/*
+ * session_index.h
+ *
+ *  Description: Index of the logging sessions kept on the card (SESSIONS.IDX), replacing the
+ *               stat() probing of LOG_<n> files at boot. Every session has its number (file name),
+ *               start and last update time, size, log format, schema and status. Startup reads the
+ *               index once to continue the last session or start the next one; rotation and
+ *               retention work on the entries, files are deleted by name without directory walks.
+ *      Layout:  two copies of session_index_t, SESSION_INDEX_SLOT_SIZE apart. A save writes the
+ *               older copy and syncs it, so a power cut during a save leaves the other copy
+ *               intact; the valid copy with the larger generation is loaded.
+ */
+
+#ifndef SESSION_INDEX_H
+#define SESSION_INDEX_H
+
+//==================================Standard Libraries Includes=======================//
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+//==================================ESP32 Libraries Includes==========================//
+#include "esp_err.h"
+
+//----------------------------
+// Index Macros
+//----------------------------
+#define SESSION_INDEX_NAME "SESSIONS.IDX"
+#define SESSION_INDEX_MAGIC "ASURTIDX" // First 8 bytes of a copy, no terminator
+#define SESSION_INDEX_VERSION 1
+#define SESSION_INDEX_MAX 64		   // Sessions kept, the oldest file is deleted beyond that
+#define SESSION_INDEX_SLOT_SIZE 4096   // One FAT sector per copy
+#define SESSION_NAME_MODULO 10000	   // LOG_0 .. LOG_9999: 8.3 names without long file name support
+
+//===============================================
+// User type definitions (structures)
+//===============================================
+
+// @ref session_status_t
+typedef enum
+{
+	SESSION_OPEN = 1, // Being written, still open at boot: cut by a power loss
+	SESSION_CLOSED,	  // Closed by a rotation
+} session_status_t;
+
+typedef struct __attribute__((packed))
+{
+	uint32_t number;   // File LOG_<number % SESSION_NAME_MODULO>.<ext>
+	uint8_t format;	   // @ref SDIO_File_Types (BIN / CSV)
+	uint8_t status;	   // @ref session_status_t
+	uint16_t version;  // Log format version (BINLOG_VERSION, 0 for .CSV)
+	uint32_t schema;   // Schema identifier (binlog_schema_id)
+	int64_t start_us;  // UTC microseconds since the epoch
+	int64_t update_us; // Last save of the entry, UTC
+	uint32_t size;	   // Bytes of data at the last save, snapshot log and raw frame log (.CAN)
+	uint16_t boots;	   // Boots that appended to the session
+	uint16_t cuts;	   // Boots that found it open (power loss)
+} session_entry_t;
+
+typedef struct __attribute__((packed))
+{
+	char magic[8];		  // SESSION_INDEX_MAGIC
+	uint16_t version;	  // SESSION_INDEX_VERSION
+	uint16_t count;		  // Entries in use, oldest first
+	uint32_t generation;  // Saves so far, the valid copy with the larger one is current
+	uint32_t next_number; // Number of the next session
+	session_entry_t entries[SESSION_INDEX_MAX];
+	uint32_t crc; // CRC32 of the bytes above
+} session_index_t;
+
+//===============================================
+// APIs Supported by "SESSION INDEX"
+//===============================================
+
+esp_err_t session_index_load(session_index_t *index, const char *path);
+esp_err_t session_index_save(session_index_t *index, const char *path);
+
+session_entry_t *session_index_last(session_index_t *index);
+session_entry_t *session_index_begin(session_index_t *index, uint8_t format, uint16_t version, uint32_t schema,
+									 int64_t now_us);
+bool session_index_expire(session_index_t *index, uint16_t max_sessions, uint64_t max_bytes, session_entry_t *expired);
+void session_index_name(const session_entry_t *entry, const char *extension, char *name, size_t len);
+
+#endif // SESSION_INDEX_H
@@ -0,0 +1,119 @@
+/*
+ * signal_store.c
+ *
+ *  Description: Implementation of the seqlock latest-value store.
+ *      Note: Same protocol as the can_ring slots: the writer makes seq odd, copies the frame and
+ *            makes seq even again; a reader copy is valid if seq was even and unchanged around it.
+ *            Readers only retry while a write is in progress. A reader with a higher priority on
+ *            the writer's core would spin forever on a preempted write, hence the retry limit.
+ */
+
+#include "signal_store.h"
+#include <string.h>
+
+signal_store_t CAN_signal_store;
+
+/*
+ * ================================================================
+ * 					API Functions Definition
+ * ================================================================
+ *
+ * */
+
+/**================================================================
+ * @Fn				- signal_store_init
+ * @breif			- Clears every slot
+ * @param [out]		- store: Store object
+ * @param [in]		- count: Slots in use (dispatch slots of the logged messages)
+ * @retval			- None
+ * Note				- Must be called before CAN_Receive_Task starts
+ */
+void signal_store_init(signal_store_t *store, uint16_t count)
+{
+    memset(store, 0, sizeof(*store));
+    store->count = (count < SIGNAL_STORE_MAX_SLOTS) ? count : SIGNAL_STORE_MAX_SLOTS;
+}
+
+/**================================================================
+ * @Fn				- signal_store_write
+ * @breif			- Replaces the latest frame of a slot
+ * @param [in]		- store: Store object
+ * @param [in]		- slot: Dispatch slot of the frame
+ * @param [in]		- msg: Received frame
+ * @param [in]		- timestamp_us: Receive time (esp_timer_get_time)
+ * @retval			- None
+ * Note				- Single writer, never blocks
+ */
+void signal_store_write(signal_store_t *store, uint16_t slot, const twai_message_t *msg, int64_t timestamp_us)
+{
+    if (slot >= store->count)
+    {
+        return;
+    }
+    signal_store_slot_t *s = &store->slots[slot];
+    uint32_t seq = atomic_load_explicit(&s->seq, memory_order_relaxed);
+
+    // Odd while the payload changes
+    atomic_store_explicit(&s->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    s->msg = *msg;
+    s->timestamp_us = timestamp_us;
+
+    atomic_store_explicit(&s->seq, seq + 2, memory_order_release);
+}
+
+/**================================================================
+ * @Fn				- signal_store_read
+ * @breif			- Copies the latest frame of a slot
+ * @param [in]		- store: Store object
+ * @param [in]		- slot: Dispatch slot to read
+ * @param [out]		- value: Consistent copy, version and retry count
+ * @retval			- true if value holds a frame, false if the slot was never written or the
+ * 					  writer kept it busy for SIGNAL_STORE_MAX_RETRIES attempts
+ */
+bool signal_store_read(const signal_store_t *store, uint16_t slot, signal_store_value_t *value)
+{
+    value->retries = 0;
+    value->version = 0;
+    if (slot >= store->count)
+    {
+        return false;
+    }
+    const signal_store_slot_t *s = &store->slots[slot];
+
+    for (; value->retries < SIGNAL_STORE_MAX_RETRIES; value->retries++)
+    {
+        uint32_t seq_before = atomic_load_explicit(&s->seq, memory_order_acquire);
+        if (seq_before & 1u)
+        {
+            continue;
+        }
+        if (seq_before == 0)
+        {
+            return false;
+        }
+        value->msg = s->msg;
+        value->timestamp_us = s->timestamp_us;
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&s->seq, memory_order_relaxed) == seq_before)
+        {
+            value->version = seq_before / 2;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**================================================================
+ * @Fn				- signal_store_version
+ * @breif			- Number of writes of a slot, without copying it
+ * @param [in]		- store: Store object
+ * @param [in]		- slot: Dispatch slot
+ * @retval			- Version the next signal_store_read would return (at least)
+ * Note				- Lets readers skip slots that did not change since their last copy
+ */
+uint32_t signal_store_version(const signal_store_t *store, uint16_t slot)
+{
+    return (slot < store->count) ? atomic_load_explicit(&store->slots[slot].seq, memory_order_acquire) / 2 : 0;
+}
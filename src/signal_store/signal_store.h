@@ -0,0 +1,72 @@
+/*
+ * signal_store.h
+ *
+ *  Description: Latest-value store of the registered CAN messages, one slot per dispatch slot.
+ *               CAN_Receive_Task is the only writer; every slot is protected by a sequence lock,
+ *               so readers on either core copy a consistent frame without blocking the writer,
+ *               without queues and without mutexes. Readers keep the version of the last value
+ *               they used to know which messages changed (SD snapshots, MQTT publishing, derived
+ *               channels).
+ */
+
+#ifndef SIGNAL_STORE_H
+#define SIGNAL_STORE_H
+
+//==================================Standard Libraries Includes=======================//
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+//==================================ESP32 Libraries Includes==========================//
+#include "driver/twai.h"
+
+//----------------------------
+// Store Macros
+//----------------------------
+#define SIGNAL_STORE_MAX_SLOTS 32
+#define SIGNAL_STORE_MAX_RETRIES 16 // Reads racing the writer more often report busy instead of spinning
+
+//===============================================
+// User type definitions (structures)
+//===============================================
+typedef struct
+{
+	_Atomic uint32_t seq; // Even: stable, odd: being written. seq / 2 = number of writes
+	twai_message_t msg;
+	int64_t timestamp_us; // Receive time (esp_timer_get_time)
+} signal_store_slot_t;
+
+typedef struct
+{
+	signal_store_slot_t slots[SIGNAL_STORE_MAX_SLOTS];
+	uint16_t count; // Slots in use
+} signal_store_t;
+
+// Consistent copy of one slot
+typedef struct
+{
+	twai_message_t msg;
+	int64_t timestamp_us;
+	uint32_t version; // Writes of the slot so far, 0 if never written
+	uint16_t retries; // Copies discarded because the writer was active (contention)
+} signal_store_value_t;
+
+//===============================================
+// Latest values of the logged messages (written by CAN_Receive_Task)
+//===============================================
+extern signal_store_t CAN_signal_store;
+
+//===============================================
+// APIs Supported by "SIGNAL STORE"
+//===============================================
+
+void signal_store_init(signal_store_t *store, uint16_t count);
+
+// Writer side (single task only)
+void signal_store_write(signal_store_t *store, uint16_t slot, const twai_message_t *msg, int64_t timestamp_us);
+
+// Reader side (any task, any core)
+bool signal_store_read(const signal_store_t *store, uint16_t slot, signal_store_value_t *value);
+uint32_t signal_store_version(const signal_store_t *store, uint16_t slot);
+
+#endif // SIGNAL_STORE_H
@@ -0,0 +1,142 @@
+/*
+ * snapshot.c
+ *
+ *  Description: Implementation of the fixed-rate snapshot assembler.
+ *      Note: The timer callback only counts the tick and notifies the consumer task.
+ */
+
+#include "snapshot.h"
+#include <string.h>
+
+/*
+ * ================================================================
+ * 					Local Functions Definition
+ * ================================================================
+ *
+ * */
+static void snapshot_timer_callback(void *arg)
+{
+    snapshot_t *snapshot = (snapshot_t *)arg;
+    atomic_fetch_add_explicit(&snapshot->ticks, 1, memory_order_relaxed);
+    xTaskNotifyGive(snapshot->task);
+}
+
+/*
+ * ================================================================
+ * 					API Functions Definition
+ * ================================================================
+ *
+ * */
+
+/**================================================================
+ * @Fn				- snapshot_init
+ * @breif			- Clears the latest values and starts the row timer
+ * @param [out]		- snapshot: Assembler object
+ * @param [in]		- dispatch: Built dispatch object of the logged messages
+ * @param [in]		- store: Signal store written with the same dispatch slots
+ * @param [in]		- rate_hz: Row rate (10, 50, 100, 200 Hz, ...)
+ * @param [in]		- task: Consumer task, notified on every row tick
+ * @retval			- ESP_OK, ESP_ERR_INVALID_ARG or the esp_timer error
+ */
+esp_err_t snapshot_init(snapshot_t *snapshot, const can_dispatch_t *dispatch, const signal_store_t *store,
+                        uint32_t rate_hz, TaskHandle_t task)
+{
+    if ((rate_hz == 0) || (rate_hz > 1000000))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    memset(snapshot, 0, sizeof(*snapshot));
+    EMPTY_SDIO_BUFFER(snapshot->record);
+    snapshot->dispatch = dispatch;
+    snapshot->store = store;
+    snapshot->task = task;
+    snapshot->period_us = 1000000 / rate_hz;
+
+    // Freshness flags: bit i belongs to COMM_signals[i], the signal column i of the .CSV
+    for (uint16_t slot = 0; (slot < dispatch->count) && (slot < COMM_MESSAGE_COUNT); slot++)
+    {
+        for (uint16_t i = 0; i < COMM_signal_count; i++)
+        {
+            if (COMM_signals[i].can_id == dispatch->table[slot].id)
+            {
+                snapshot->signal_mask[slot] |= (uint64_t)1 << i;
+            }
+        }
+    }
+
+    const esp_timer_create_args_t timer_args = {
+        .callback = snapshot_timer_callback,
+        .arg = snapshot,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "snapshot",
+    };
+    esp_err_t err = esp_timer_create(&timer_args, &snapshot->timer);
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+    snapshot->next_row_us = esp_timer_get_time() + snapshot->period_us;
+    return esp_timer_start_periodic(snapshot->timer, snapshot->period_us);
+}
+
+/**================================================================
+ * @Fn				- snapshot_due
+ * @breif			- Checks whether a row tick is pending
+ * @param [in]		- snapshot: Assembler object
+ * @param [out]		- row_us: Scheduled time of the row (esp_timer time)
+ * @retval			- true if a row has to be written
+ * Note				- A late consumer writes one row for the latest tick, the others count as missed
+ */
+bool snapshot_due(snapshot_t *snapshot, int64_t *row_us)
+{
+    uint32_t pending = atomic_load_explicit(&snapshot->ticks, memory_order_relaxed) - snapshot->ticks_taken;
+    if (pending == 0)
+    {
+        return false;
+    }
+    snapshot->ticks_taken += pending;
+    snapshot->missed += pending - 1;
+    snapshot->next_row_us += (int64_t)(pending - 1) * snapshot->period_us;
+    *row_us = snapshot->next_row_us;
+    snapshot->next_row_us += snapshot->period_us;
+    return true;
+}
+
+/**================================================================
+ * @Fn				- snapshot_take
+ * @breif			- Assembles one row from the latest frame of every message in the store
+ * @param [in]		- snapshot: Assembler object
+ * @param [out]		- row: Row to be written (values, receive times and freshness flags)
+ * @param [in]		- row_us: Scheduled time of the row, from snapshot_due
+ * @retval			- None
+ * Note				- Only slots written since the previous row are copied and decoded, a slot
+ * 					  kept busy by the writer is taken again in the next row
+ */
+void snapshot_take(snapshot_t *snapshot, SDIO_TxBuffer *row, int64_t row_us)
+{
+    signal_store_value_t value;
+    uint64_t fresh = 0;
+
+    for (uint16_t slot = 0; slot < COMM_MESSAGE_COUNT; slot++)
+    {
+        if (signal_store_version(snapshot->store, slot) == snapshot->seen[slot])
+        {
+            continue;
+        }
+        if (!signal_store_read(snapshot->store, slot, &value))
+        {
+            snapshot->busy++;
+            continue;
+        }
+        snapshot->seen[slot] = value.version;
+        can_dispatch_decode(snapshot->dispatch, slot, &value.msg, &snapshot->record);
+        snapshot->record.message_us[slot] = value.timestamp_us;
+        fresh |= snapshot->signal_mask[slot];
+    }
+
+    *row = snapshot->record;
+    row->timestamp_us = row_us;
+    row->fresh = fresh;
+    snapshot->rows++;
+}
@@ -0,0 +1,60 @@
+/*
+ * snapshot.h
+ *
+ *  Description: Fixed-rate snapshot assembler of the SD log. A periodic esp_timer wakes the
+ *               consumer task at the row rate, and every row is decoded from the latest frame of
+ *               each registered message in the signal store (snapshot_take). Rows are therefore
+ *               evenly spaced whatever the bus traffic, and the decode cost is bounded by the
+ *               message count per row.
+ *               Each row carries per-signal freshness flags (SDIO_TxBuffer.fresh).
+ */
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+//==================================Standard Libraries Includes=======================//
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+//==================================ESP32 Libraries Includes==========================//
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include "esp_err.h"
+#include "esp_timer.h"
+#include "driver/twai.h"
+#include "can_dispatch/can_dispatch.h"
+#include "signal_store/signal_store.h"
+#include "Logging/logging.h"
+
+//===============================================
+// User type definitions (structures)
+//===============================================
+typedef struct
+{
+	const can_dispatch_t *dispatch;				  // Slots of the registered messages
+	const signal_store_t *store;				  // Latest frame of each slot
+	esp_timer_handle_t timer;					  // Periodic row timer
+	TaskHandle_t task;							  // Consumer task, notified on every row tick
+	int64_t period_us;							  // Row period
+	int64_t next_row_us;						  // Scheduled time of the next row (esp_timer time)
+	_Atomic uint32_t ticks;						  // Row ticks raised by the timer
+	uint32_t ticks_taken;						  // Row ticks handled by the consumer
+	uint32_t rows;								  // Rows assembled
+	uint32_t missed;							  // Row ticks skipped because the consumer was late
+	uint32_t busy;								  // Slot reads that lost the race with the writer
+	uint32_t seen[COMM_MESSAGE_COUNT];			  // Store version of each slot in the previous row
+	uint64_t signal_mask[COMM_MESSAGE_COUNT];	  // Freshness flags of the signals of each slot
+	SDIO_TxBuffer record;						  // Decoded latest values
+} snapshot_t;
+
+//===============================================
+// APIs Supported by "SNAPSHOT"
+//===============================================
+
+esp_err_t snapshot_init(snapshot_t *snapshot, const can_dispatch_t *dispatch, const signal_store_t *store,
+                        uint32_t rate_hz, TaskHandle_t task);
+bool snapshot_due(snapshot_t *snapshot, int64_t *row_us);
+void snapshot_take(snapshot_t *snapshot, SDIO_TxBuffer *row, int64_t row_us);
+
+#endif // SNAPSHOT_H
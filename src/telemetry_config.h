@@ -1,21 +1,52 @@
 #ifndef TELEMETRY_CONFIG_H
 #define TELEMETRY_CONFIG_H
 
+#include <stdint.h>
+#include "sdkconfig.h"
+#include "driver/twai.h"
+
+#if CONFIG_IDF_TARGET_LINUX
+// Host build: UDP receiver and MQTT broker on the loopback interface (host/README.md)
+#define SERVER_IP "127.0.0.1"
+#else
 #define SERVER_IP "41.238.164.247"
+#endif
 #define SERVER_PORT 19132
 
 #define USE_MQTT 1
 
 #if USE_MQTT
+#if CONFIG_IDF_TARGET_LINUX
+#define MQTT_URI       "mqtt://127.0.0.1:1883"
+#define MQTT_USE_TLS   0
+#else
 #define MQTT_URI       "mqtts://5aeaff002e7c423299c2d92361292d54.s1.eu.hivemq.cloud:8883"
+#define MQTT_USE_TLS   1
+#endif
 #define MQTT_USER      "yousef"
 #define MQTT_PASS      "Yousef123"
 #define MQTT_PUB_TOPIC "com/yousef/esp32/data"
+#define MQTT_STATS_TOPIC MQTT_PUB_TOPIC "/stats" // Bus statistics (can_stats_report_t) and card health (sd_health_report_t)
+#define MQTT_RECORD_TOPIC MQTT_PUB_TOPIC "/records" // Coded rows (record_codec_packet_t)
+#define MQTT_SCHEMA_TOPIC MQTT_PUB_TOPIC "/schema"   // binlog file header of the rows, retained
+#define MQTT_RECORD_RATE_HZ 10 // Rows of the record stream
+#define MQTT_RECORD_BATCH 10   // Rows per record packet
 extern const char mqtt_root_ca_pem[];
 #endif
 
+// Frame packet sent over UDP / MQTT: receive time (UTC, microseconds since the epoch) + raw frame
+typedef struct __attribute__((packed)) {
+    int64_t time_us;
+    twai_message_t msg;
+} telemetry_frame_t;
+
+#if CONFIG_IDF_TARGET_LINUX
+#define CONNECTIVITY_TEST_IP "127.0.0.1"
+#define CONNECTIVITY_TEST_PORT 1883
+#else
 #define CONNECTIVITY_TEST_IP "8.8.8.8"
 #define CONNECTIVITY_TEST_PORT 53
+#endif
 #define CONNECTIVITY_CHECK_INTERVAL_MS 1000
 #define CONNECTIVITY_FAIL_THRESHOLD 3
 
@@ -8,7 +8,12 @@
 #include "esp_log.h"
 #include "esp_heap_caps.h"
 #include "telemetry_config.h"
-#include "driver/twai.h"
+#include "can_ring/can_ring.h"
+#include "can_stats/can_stats.h"
+#include "pipeline_stats/pipeline_stats.h"
+#include "sd_health/sd_health.h"
+#include "esp_timer.h"
+#include "RTC_Time_Sync/rtc_time_sync.h"
 #include <string.h>
 #include <errno.h>
 #include <unistd.h>
@@ -80,9 +85,25 @@ void udp_socket_close(void) {
     xSemaphoreGive(udp_mutex);
 }
 
+// Bus statistics and card health go to the same port, the receiver tells them apart by their magic
+static void udp_send_stats(const void *report, size_t size) {
+    xSemaphoreTake(udp_mutex, portMAX_DELAY);
+    int ret = sendto(udp_sock,
+                     report, size, 0,
+                     (struct sockaddr *)&dest_addr,
+                     sizeof(dest_addr));
+    int err = errno;
+    xSemaphoreGive(udp_mutex);
+    if (ret < 0) {
+        ESP_LOGW(TAG, "Statistics not sent (errno %d)", err);
+    } else {
+        pipeline_stats_add_bytes(&CAN_pipeline_stats, PIPELINE_STAGE_NET, ret);
+    }
+}
+
 void udp_sender_task(void *pvParameters)
 {
-    QueueHandle_t telemetry_queue = (QueueHandle_t)pvParameters;
+    can_ring_consumer_t *frames = (can_ring_consumer_t *)pvParameters;
     EventGroupHandle_t eg = wifi_event_group();
     xEventGroupWaitBits(eg,
                         WIFI_CONNECTED_BIT,
@@ -97,14 +118,31 @@ void udp_sender_task(void *pvParameters)
         return;
     }
 
-    twai_message_t current, newer;
-    int len = sizeof(twai_message_t);
+    can_frame_t frame;
+    can_frame_t current;
+    telemetry_frame_t packet;
+    int len = sizeof(telemetry_frame_t);
+    static can_stats_report_t stats_report;
+    static sd_health_report_t health_report;
+    can_stats_window_t stats_window = {0};
+    TickType_t last_stats = xTaskGetTickCount();
 
     while (1) {
-        if (xQueueReceive(telemetry_queue, &current, portMAX_DELAY) != pdTRUE) {
-            ESP_LOGE(TAG, "Queue receive failed");
+        if ((xTaskGetTickCount() - last_stats) >= pdMS_TO_TICKS(CAN_STATS_PERIOD_MS)) {
+            last_stats = xTaskGetTickCount();
+            can_stats_snapshot(&CAN_bus_stats, &stats_window, &stats_report);
+            if (xEventGroupGetBits(eg) & WIFI_CONNECTED_BIT) {
+                udp_send_stats(&stats_report, can_stats_report_size(&stats_report));
+                sd_health_snapshot(&SD_card_health, &health_report);
+                udp_send_stats(&health_report, sizeof(health_report));
+            }
+        }
+
+        if (!can_ring_read(frames, &frame)) {
+            can_ring_wait(frames, pdMS_TO_TICKS(CAN_STATS_PERIOD_MS));
             continue;
         }
+        current = frame;
 
         if ((xEventGroupGetBits(eg) & WIFI_CONNECTED_BIT) == 0) {
             ESP_LOGW(TAG, "Wi-Fi lost, waiting to reconnect...");
@@ -120,15 +158,17 @@ void udp_sender_task(void *pvParameters)
         bool sent = false;
         int last_err = 0;
         for (int attempt = 1; attempt <= UDP_MAX_RETRIES; ++attempt) {
-            if (xQueueReceive(telemetry_queue, &newer, 0) == pdTRUE) {
-                current = newer;
+            if (can_ring_read(frames, &frame)) {
+                current = frame;
                 attempt = 0;
                 continue;
             }
 
+            packet.time_us = Time_Sync_epoch_us(current.timestamp_us);
+            packet.msg = current.msg;
             xSemaphoreTake(udp_mutex, portMAX_DELAY);
             int ret = sendto(udp_sock,
-                             &current, len, 0,
+                             &packet, len, 0,
                              (struct sockaddr *)&dest_addr,
                              sizeof(dest_addr));
             last_err = errno;
@@ -146,6 +186,8 @@ void udp_sender_task(void *pvParameters)
                 vTaskDelay(pdMS_TO_TICKS(UDP_BASE_DELAY_MS << (attempt - 1)));
             } else {
                 sent = true;
+                pipeline_stats_record(&CAN_pipeline_stats, PIPELINE_STAGE_NET, esp_timer_get_time() - current.timestamp_us);
+                pipeline_stats_add_bytes(&CAN_pipeline_stats, PIPELINE_STAGE_NET, ret);
                 break;
             }
         }
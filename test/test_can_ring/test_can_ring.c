@@ -0,0 +1,163 @@
+/*
+ * test_can_ring.c
+ *
+ *  Description: Unit tests of the CAN frame broadcast ring (src/can_ring): order of the frames,
+ *               overrun accounting of a consumer that falls behind, a slot marked busy by the
+ *               producer, and a producer / consumer race in which every accepted copy must be
+ *               whole (a torn copy is retried as an overrun, never returned).
+ *               Run with "pio test -f test_can_ring".
+ */
+
+#include <unity.h>
+#include "can_ring/can_ring.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <string.h>
+
+#define TEST_RING_RACE_FRAMES 200000 // Frames published by the producer task of the race test
+
+static can_ring_t ring;
+static can_ring_consumer_t consumer;
+static _Atomic bool producer_done;
+
+// Frame whose every field is derived from its index, so a torn copy is detected
+static void test_frame_make(uint32_t index, twai_message_t *msg)
+{
+    memset(msg, 0, sizeof(*msg));
+    msg->identifier = index & TWAI_STD_ID_MASK;
+    msg->data_length_code = TWAI_FRAME_MAX_DLC;
+    for (uint8_t i = 0; i < 4; i++)
+    {
+        msg->data[i] = (uint8_t)(index >> (8 * i));
+        msg->data[4 + i] = (uint8_t)~(index >> (8 * i));
+    }
+}
+
+static bool test_frame_whole(const can_frame_t *frame)
+{
+    twai_message_t expected;
+    test_frame_make((uint32_t)frame->timestamp_us, &expected);
+    return (frame->msg.identifier == expected.identifier) &&
+           (memcmp(frame->msg.data, expected.data, TWAI_FRAME_MAX_DLC) == 0);
+}
+
+static void test_publish(uint32_t count)
+{
+    uint32_t first = atomic_load(&ring.head);
+    for (uint32_t i = first; i < first + count; i++)
+    {
+        twai_message_t msg;
+        test_frame_make(i, &msg);
+        can_ring_publish(&ring, &msg, i);
+    }
+}
+
+void setUp(void)
+{
+    can_ring_init(&ring);
+    TEST_ASSERT_EQUAL(ESP_OK, can_ring_add_consumer(&ring, &consumer, "test"));
+}
+
+void tearDown(void)
+{
+}
+
+static void test_frames_read_in_order(void)
+{
+    can_frame_t frame;
+
+    TEST_ASSERT_FALSE(can_ring_read(&consumer, &frame));
+    test_publish(10);
+    TEST_ASSERT_EQUAL_UINT32(10, can_ring_pending(&consumer));
+    for (uint32_t i = 0; i < 10; i++)
+    {
+        TEST_ASSERT_TRUE(can_ring_read(&consumer, &frame));
+        TEST_ASSERT_EQUAL_INT64(i, frame.timestamp_us);
+        TEST_ASSERT_TRUE(test_frame_whole(&frame));
+    }
+    TEST_ASSERT_FALSE(can_ring_read(&consumer, &frame));
+    TEST_ASSERT_EQUAL_UINT32(0, can_ring_overruns(&consumer));
+}
+
+static void test_overrun_resumes_half_a_ring_behind(void)
+{
+    const uint32_t published = CAN_RING_SIZE + 100;
+    can_frame_t frame;
+    uint32_t read = 0;
+
+    test_publish(published);
+    TEST_ASSERT_TRUE(can_ring_read(&consumer, &frame));
+    read++;
+    // The oldest frames were overwritten: the consumer skips to half a ring behind the producer
+    TEST_ASSERT_EQUAL_INT64(published - CAN_RING_SIZE / 2, frame.timestamp_us);
+    TEST_ASSERT_EQUAL_UINT32(published - CAN_RING_SIZE / 2, can_ring_overruns(&consumer));
+    TEST_ASSERT_EQUAL_UINT32(published, consumer.max_lag);
+
+    int64_t last = frame.timestamp_us;
+    while (can_ring_read(&consumer, &frame))
+    {
+        TEST_ASSERT_EQUAL_INT64(last + 1, frame.timestamp_us);
+        TEST_ASSERT_TRUE(test_frame_whole(&frame));
+        last = frame.timestamp_us;
+        read++;
+    }
+    TEST_ASSERT_EQUAL_INT64(published - 1, last);
+    TEST_ASSERT_EQUAL_UINT32(published, read + can_ring_overruns(&consumer));
+}
+
+static void test_busy_slot_is_never_returned(void)
+{
+    can_frame_t frame;
+
+    // A full ring, the producer has started to overwrite frame 0 with frame CAN_RING_SIZE
+    test_publish(CAN_RING_SIZE);
+    atomic_store(&ring.slots[0].seq, CAN_RING_SIZE + 1);
+
+    TEST_ASSERT_TRUE(can_ring_read(&consumer, &frame));
+    TEST_ASSERT_EQUAL_INT64(CAN_RING_SIZE / 2, frame.timestamp_us);
+    TEST_ASSERT_EQUAL_UINT32(CAN_RING_SIZE / 2, can_ring_overruns(&consumer));
+}
+
+static void test_producer_task(void *pvParameters)
+{
+    test_publish(TEST_RING_RACE_FRAMES);
+    atomic_store(&producer_done, true);
+    vTaskDelete(NULL);
+}
+
+static void test_race_never_returns_a_torn_frame(void)
+{
+    can_frame_t frame;
+    uint32_t read = 0;
+    uint32_t torn = 0;
+    int64_t last = -1;
+
+    atomic_store(&producer_done, false);
+    TEST_ASSERT_EQUAL(pdPASS, xTaskCreatePinnedToCore(test_producer_task, "test_producer", 4096, NULL,
+                                                      uxTaskPriorityGet(NULL), NULL, 1));
+    while (!atomic_load(&producer_done) || (can_ring_pending(&consumer) != 0))
+    {
+        if (!can_ring_read(&consumer, &frame))
+        {
+            taskYIELD();
+            continue;
+        }
+        torn += test_frame_whole(&frame) ? 0 : 1;
+        TEST_ASSERT_GREATER_THAN(last, frame.timestamp_us);
+        last = frame.timestamp_us;
+        read++;
+    }
+    TEST_ASSERT_EQUAL_UINT32(0, torn);
+    TEST_ASSERT_EQUAL_INT64(TEST_RING_RACE_FRAMES - 1, last);
+    TEST_ASSERT_EQUAL_UINT32(TEST_RING_RACE_FRAMES, read + can_ring_overruns(&consumer));
+}
+
+void app_main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_frames_read_in_order);
+    RUN_TEST(test_overrun_resumes_half_a_ring_behind);
+    RUN_TEST(test_busy_slot_is_never_returned);
+    RUN_TEST(test_race_never_returns_a_torn_frame);
+    UNITY_END();
+}
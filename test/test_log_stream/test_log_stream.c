@@ -0,0 +1,239 @@
+/*
+ * test_log_stream.c
+ *
+ *  Description: Unit tests of the recovery of a log file cut by a power loss (log_stream_recover).
+ *               Each test writes a raw frame log on the card block by block with its commit slots
+ *               (the layout of log_stream_open / the sd_writer commit hook), damages it the way a
+ *               power cut does and checks the length recovered and the size the file is cut to:
+ *               blocks written after the commit, a torn last block, a stale commit slot next to a
+ *               torn newer one, the preallocated tail after a cut, and a torn .CSV row.
+ *               Run with "pio test -f test_log_stream" (needs a mounted card on the target).
+ */
+
+#include <unity.h>
+#include "log_stream/log_stream.h"
+#include "framelog/framelog.h"
+#include "binlog/binlog.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdio.h>
+#include <sys/stat.h>
+
+#define TEST_BLOCKS 4			// Blocks of the test file
+#define TEST_BLOCK_FRAMES 100	// Frames per block
+#define TEST_PREALLOCATE 65536	// Size of the preallocated file
+
+static SDIO_FileConfig file = {.name = "TEST.CAN", .type = FRAMES};
+static framelog_block_t block;
+static off_t ends[TEST_BLOCKS + 1]; // ends[i]: file offset after block i, ends[0]: start of the data
+static uint16_t tag;
+static esp_err_t card = ESP_FAIL; // SDIO_SD_Init result
+
+// Writes the commit of the blocks up to ends[blocks] to the slot of its number
+static void test_commit(uint32_t count, uint8_t blocks)
+{
+    binlog_commit_t commit;
+    uint32_t slot = binlog_commit_build(&commit, count, (uint32_t)ends[blocks], tag, 0);
+    int fd = open(file.path, O_RDWR);
+    TEST_ASSERT_TRUE(fd >= 0);
+    TEST_ASSERT_EQUAL(sizeof(commit), pwrite(fd, &commit, sizeof(commit), BINLOG_COMMIT_OFFSET(FRAMELOG_HEADER_SIZE) + slot));
+    close(fd);
+}
+
+// Frame log of TEST_BLOCKS full blocks and empty commit slots, in a file of preallocate bytes (0: data only)
+static void test_file_write(uint32_t preallocate)
+{
+    uint8_t header[FRAMELOG_HEADER_SIZE];
+    static const uint8_t zeros[BINLOG_DATA_OFFSET(FRAMELOG_HEADER_SIZE)];
+    twai_message_t msg = {.identifier = 0x123, .data_length_code = TWAI_FRAME_MAX_DLC};
+    int64_t timestamp_us = 0;
+
+    snprintf(file.path, sizeof(file.path), "%s/%s", MOUNT_POINT, file.name);
+    file.preallocate = preallocate;
+    TEST_ASSERT_EQUAL(FRAMELOG_HEADER_SIZE, framelog_header_build(header, sizeof(header), 0, 500000));
+    tag = framelog_file_tag(header, sizeof(header));
+    framelog_block_init(&block, tag);
+
+    int fd = open(file.path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    TEST_ASSERT_TRUE(fd >= 0);
+    TEST_ASSERT_EQUAL(sizeof(zeros), pwrite(fd, zeros, sizeof(zeros), 0));
+    TEST_ASSERT_EQUAL(sizeof(header), pwrite(fd, header, sizeof(header), 0));
+    if (preallocate != 0)
+    {
+        TEST_ASSERT_EQUAL(0, ftruncate(fd, preallocate)); // Zeros up to the end of the region
+    }
+    ends[0] = BINLOG_DATA_OFFSET(FRAMELOG_HEADER_SIZE);
+    for (uint8_t i = 1; i <= TEST_BLOCKS; i++)
+    {
+        for (uint16_t frame = 0; frame < TEST_BLOCK_FRAMES; frame++)
+        {
+            msg.data[0] = (uint8_t)frame;
+            framelog_block_add(&block, &msg, timestamp_us += 100);
+        }
+        size_t size = framelog_block_seal(&block);
+        TEST_ASSERT_EQUAL(size, pwrite(fd, block.data, size, ends[i - 1]));
+        ends[i] = ends[i - 1] + size;
+    }
+    close(fd);
+}
+
+static void test_file_damage(off_t offset)
+{
+    uint8_t byte;
+    int fd = open(file.path, O_RDWR);
+    TEST_ASSERT_TRUE(fd >= 0);
+    TEST_ASSERT_EQUAL(1, pread(fd, &byte, 1, offset));
+    byte ^= 0xFF;
+    TEST_ASSERT_EQUAL(1, pwrite(fd, &byte, 1, offset));
+    close(fd);
+}
+
+static void test_file_cut(off_t size)
+{
+    TEST_ASSERT_EQUAL(0, truncate(file.path, size));
+}
+
+static off_t test_file_size(void)
+{
+    struct stat st;
+    TEST_ASSERT_EQUAL(0, stat(file.path, &st));
+    return st.st_size;
+}
+
+// Recovers the file and checks the length found and the size it was cut to
+static void test_recover(off_t expected)
+{
+    TEST_ASSERT_EQUAL(ESP_OK, log_stream_recover(NULL, &file));
+    TEST_ASSERT_EQUAL_UINT32(expected, file.valid);
+    TEST_ASSERT_EQUAL_INT64(expected, test_file_size());
+}
+
+void setUp(void)
+{
+    TEST_ASSERT_EQUAL(ESP_OK, card);
+    file.name = "TEST.CAN";
+    file.type = FRAMES;
+}
+
+void tearDown(void)
+{
+    unlink(file.path);
+}
+
+static void test_blocks_after_the_commit_are_kept(void)
+{
+    test_file_write(0);
+    test_commit(1, 2);
+    test_recover(ends[TEST_BLOCKS]);
+}
+
+static void test_file_without_commit_is_walked(void)
+{
+    test_file_write(0);
+    test_recover(ends[TEST_BLOCKS]);
+}
+
+static void test_torn_last_block_is_cut(void)
+{
+    test_file_write(0);
+    test_commit(1, 2);
+    test_file_cut(ends[TEST_BLOCKS - 1] + 100);
+    test_recover(ends[TEST_BLOCKS - 1]);
+}
+
+static void test_corrupted_block_ends_the_data(void)
+{
+    test_file_write(0);
+    test_commit(1, 1);
+    test_file_damage(ends[2] + 200); // Payload of block 3: block 4 is whole but follows a torn one
+    test_recover(ends[2]);
+}
+
+static void test_latest_commit_slot_is_used(void)
+{
+    test_file_write(0);
+    test_commit(1, 1);
+    test_commit(2, 3);
+    test_file_damage(ends[1] + 200); // Block 2 is covered by the latest commit: not read again
+    test_recover(ends[TEST_BLOCKS]);
+}
+
+static void test_stale_commit_slot_after_a_torn_commit(void)
+{
+    test_file_write(0);
+    test_commit(1, 1);
+    test_commit(2, 3);
+    test_file_damage(BINLOG_COMMIT_OFFSET(FRAMELOG_HEADER_SIZE) + (2 % BINLOG_COMMIT_SLOTS) * BINLOG_COMMIT_SLOT_SIZE + 8);
+    test_file_damage(ends[1] + 200); // Walked from the stale commit: the data ends before block 2
+    test_recover(ends[1]);
+}
+
+static void test_commit_past_the_end_is_ignored(void)
+{
+    test_file_write(0);
+    test_commit(1, TEST_BLOCKS);
+    test_file_cut(ends[2]); // Commit slot on the card, blocks 3 and 4 lost
+    test_recover(ends[2]);
+}
+
+static void test_preallocated_tail_is_cut(void)
+{
+    test_file_write(TEST_PREALLOCATE);
+    test_commit(1, 2);
+    TEST_ASSERT_EQUAL_INT64(TEST_PREALLOCATE, test_file_size());
+    test_recover(ends[TEST_BLOCKS]);
+}
+
+static void test_preallocated_tail_after_a_torn_block_is_cut(void)
+{
+    test_file_write(TEST_PREALLOCATE);
+    test_commit(1, 1);
+    test_file_damage(ends[2] + 200);
+    test_recover(ends[2]);
+    // Recovering again finds the same end: nothing after the cut is taken for data
+    test_recover(ends[2]);
+}
+
+static void test_torn_csv_row_is_cut(void)
+{
+    static const char text[] = "Time,Value\n1,2\n3,4\n5,";
+    file.name = "TEST.CSV";
+    file.type = CSV;
+    snprintf(file.path, sizeof(file.path), "%s/%s", MOUNT_POINT, file.name);
+
+    int fd = open(file.path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    TEST_ASSERT_TRUE(fd >= 0);
+    TEST_ASSERT_EQUAL(strlen(text), write(fd, text, strlen(text)));
+    close(fd);
+    test_recover(strlen(text) - 2);
+}
+
+static void test_foreign_file_is_rejected(void)
+{
+    test_file_write(0);
+    test_file_damage(0); // Magic of the header
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, log_stream_recover(NULL, &file));
+}
+
+void app_main(void)
+{
+    card = SDIO_SD_Init();
+    UNITY_BEGIN();
+    RUN_TEST(test_blocks_after_the_commit_are_kept);
+    RUN_TEST(test_file_without_commit_is_walked);
+    RUN_TEST(test_torn_last_block_is_cut);
+    RUN_TEST(test_corrupted_block_ends_the_data);
+    RUN_TEST(test_latest_commit_slot_is_used);
+    RUN_TEST(test_stale_commit_slot_after_a_torn_commit);
+    RUN_TEST(test_commit_past_the_end_is_ignored);
+    RUN_TEST(test_preallocated_tail_is_cut);
+    RUN_TEST(test_preallocated_tail_after_a_torn_block_is_cut);
+    RUN_TEST(test_torn_csv_row_is_cut);
+    RUN_TEST(test_foreign_file_is_rejected);
+    UNITY_END();
+    if (card == ESP_OK)
+    {
+        SDIO_SD_DeInit();
+    }
+}
@@ -0,0 +1,205 @@
+/*
+ * test_lzss.c
+ *
+ *  Description: Unit tests of the LZSS codec of the SD log blocks (src/lzss): compress /
+ *               decompress round trips of log-like, repetitive and random blocks, long matches and a
+ *               match at the longest distance, incompressible input refused (0) and stored as is by
+ *               binlog_block_seal, and corrupt input rejected by the decompressor.
+ *               Run with "pio test -f test_lzss".
+ */
+
+#include <unity.h>
+#include "lzss/lzss.h"
+#include "binlog/binlog.h"
+#include <string.h>
+
+#define TEST_LZSS_MAX 8192 // Largest input of the tests, twice the window
+
+static lzss_state_t state;
+static uint8_t in[TEST_LZSS_MAX];
+static uint8_t packed[TEST_LZSS_MAX * 2];
+static uint8_t out[TEST_LZSS_MAX];
+static binlog_block_t block;
+static binlog_record_t records[BINLOG_BLOCK_RECORDS];
+static binlog_record_t decoded[BINLOG_BLOCK_RECORDS];
+static uint8_t scratch[BINLOG_BLOCK_SIZE];
+static uint32_t seed;
+
+static uint32_t test_random(void)
+{
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed;
+}
+
+static void test_random_fill(uint8_t *data, size_t len)
+{
+    for (size_t i = 0; i < len; i++)
+    {
+        data[i] = (uint8_t)test_random();
+    }
+}
+
+// Compresses in[0..len), decompresses it and checks every byte, returns the compressed size
+static size_t test_round_trip(size_t len)
+{
+    size_t size = lzss_compress(&state, in, len, packed, sizeof(packed));
+    TEST_ASSERT_TRUE((size != 0) || (len == 0));
+    TEST_ASSERT_EQUAL_size_t(len, lzss_decompress(packed, size, out, sizeof(out)));
+    TEST_ASSERT_EQUAL_MEMORY(in, out, len);
+    return size;
+}
+
+// Fills and seals one full block: rows of steady signals every 10 ms, or random bytes
+static size_t test_block_seal(uint8_t codec, bool random)
+{
+    SDIO_TxBuffer row;
+
+    memset(&block, 0, sizeof(block));
+    binlog_block_init(&block, 0x55AA, codec);
+    for (uint16_t i = 0; i < BINLOG_BLOCK_RECORDS; i++)
+    {
+        memset(&row, 0, sizeof(row));
+        row.timestamp_us = 1000000 + 10000 * i;
+        for (uint8_t m = 0; m < COMM_MESSAGE_COUNT; m++)
+        {
+            row.message_us[m] = row.timestamp_us - 100 * m;
+        }
+        binlog_block_add(&block, &row, row.timestamp_us);
+    }
+    if (random)
+    {
+        test_random_fill(block.data + sizeof(binlog_block_header_t), sizeof(records));
+    }
+    memcpy(records, block.data + sizeof(binlog_block_header_t), sizeof(records));
+    return binlog_block_seal(&block);
+}
+
+void setUp(void)
+{
+    seed = 0x12345678;
+}
+
+void tearDown(void)
+{
+}
+
+static void test_empty_and_short_inputs(void)
+{
+    TEST_ASSERT_EQUAL_size_t(0, lzss_compress(&state, in, 0, packed, sizeof(packed)));
+    for (size_t len = 1; len <= 2 * LZSS_MIN_MATCH; len++)
+    {
+        test_random_fill(in, len);
+        test_round_trip(len);
+    }
+}
+
+static void test_repetitive_block_shrinks(void)
+{
+    for (size_t i = 0; i < BINLOG_BLOCK_SIZE; i++)
+    {
+        in[i] = (uint8_t)((i % 64) < 8 ? i / 64 : i % 64); // 64-byte records, a counter in the first bytes
+    }
+    size_t size = test_round_trip(BINLOG_BLOCK_SIZE);
+    TEST_ASSERT_LESS_THAN(BINLOG_BLOCK_SIZE / 4, size);
+}
+
+static void test_long_runs_use_long_matches(void)
+{
+    memset(in, 0xA5, LZSS_WINDOW);
+    size_t size = test_round_trip(LZSS_WINDOW);
+    // A few literals, then matches of LZSS_MAX_MATCH bytes: 3 bytes each
+    TEST_ASSERT_LESS_THAN(64, size);
+
+    // Every length code around the extended one
+    for (size_t len = LZSS_MIN_MATCH; len <= 20; len++)
+    {
+        test_random_fill(in, 32);
+        memcpy(in + 32, in, len);
+        test_random_fill(in + 32 + len, 32);
+        test_round_trip(64 + len);
+    }
+}
+
+static void test_matches_beyond_the_window(void)
+{
+    // The second half repeats the first from 4096 bytes back (the longest distance) and beyond
+    test_random_fill(in, TEST_LZSS_MAX / 2);
+    memcpy(in + TEST_LZSS_MAX / 2, in, TEST_LZSS_MAX / 2);
+    test_round_trip(TEST_LZSS_MAX);
+
+    // A match exactly LZSS_WINDOW bytes back
+    memset(in, 0, LZSS_WINDOW + 64);
+    memcpy(in, "ASURTDAC", 8);
+    memcpy(in + LZSS_WINDOW, "ASURTDAC", 8);
+    size_t size = test_round_trip(LZSS_WINDOW + 64);
+    TEST_ASSERT_LESS_THAN(64, size);
+}
+
+static void test_incompressible_input_is_refused(void)
+{
+    test_random_fill(in, BINLOG_BLOCK_SIZE);
+    TEST_ASSERT_EQUAL_size_t(0, lzss_compress(&state, in, BINLOG_BLOCK_SIZE, packed, BINLOG_BLOCK_SIZE - 4));
+
+    // With room enough it still decodes: one flag byte per 8 literals
+    size_t size = test_round_trip(BINLOG_BLOCK_SIZE);
+    TEST_ASSERT_GREATER_THAN(BINLOG_BLOCK_SIZE, size);
+}
+
+static void test_incompressible_block_is_stored(void)
+{
+    size_t size = test_block_seal(BINLOG_CODEC_LZSS, true);
+    binlog_block_header_t header;
+
+    memcpy(&header, block.sealed, sizeof(header));
+    TEST_ASSERT_EQUAL_UINT32(BINLOG_BLOCK_MAGIC, header.magic);
+    TEST_ASSERT_TRUE(block.sealed == block.data);
+    TEST_ASSERT_EQUAL_UINT32(0, block.stats.packed);
+    TEST_ASSERT_EQUAL_size_t(size, binlog_block_check(block.sealed, size, 0x55AA));
+    TEST_ASSERT_EQUAL_UINT16(BINLOG_BLOCK_RECORDS, binlog_block_decode(block.sealed, decoded, scratch));
+    TEST_ASSERT_EQUAL_MEMORY(records, decoded, sizeof(records));
+}
+
+static void test_compressible_block_is_packed(void)
+{
+    size_t size = test_block_seal(BINLOG_CODEC_LZSS, false);
+    binlog_block_header_t header;
+
+    memcpy(&header, block.sealed, sizeof(header));
+    TEST_ASSERT_EQUAL_UINT32(BINLOG_LZ_MAGIC, header.magic);
+    TEST_ASSERT_EQUAL_UINT32(1, block.stats.packed);
+    TEST_ASSERT_LESS_THAN(sizeof(binlog_block_header_t) + sizeof(records), size);
+    TEST_ASSERT_EQUAL_size_t(size, binlog_block_check(block.sealed, size, 0x55AA));
+    TEST_ASSERT_EQUAL_UINT16(BINLOG_BLOCK_RECORDS, binlog_block_decode(block.sealed, decoded, scratch));
+    TEST_ASSERT_EQUAL_MEMORY(records, decoded, sizeof(records));
+}
+
+static void test_corrupt_input_is_rejected(void)
+{
+    // Match before the start of the block
+    static const uint8_t before_start[] = {0x00, 0x10, 0x00};
+    TEST_ASSERT_EQUAL_size_t(0, lzss_decompress(before_start, sizeof(before_start), out, sizeof(out)));
+    // Token cut by the end of the input
+    static const uint8_t cut[] = {0x01, 'a', 0x00};
+    TEST_ASSERT_EQUAL_size_t(0, lzss_decompress(cut, sizeof(cut), out, sizeof(out)));
+
+    // Output larger than the room given
+    memset(in, 0, BINLOG_BLOCK_SIZE);
+    size_t size = lzss_compress(&state, in, BINLOG_BLOCK_SIZE, packed, sizeof(packed));
+    TEST_ASSERT_EQUAL_size_t(0, lzss_decompress(packed, size, out, BINLOG_BLOCK_SIZE - 1));
+}
+
+void app_main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_empty_and_short_inputs);
+    RUN_TEST(test_repetitive_block_shrinks);
+    RUN_TEST(test_long_runs_use_long_matches);
+    RUN_TEST(test_matches_beyond_the_window);
+    RUN_TEST(test_incompressible_input_is_refused);
+    RUN_TEST(test_incompressible_block_is_stored);
+    RUN_TEST(test_compressible_block_is_packed);
+    RUN_TEST(test_corrupt_input_is_rejected);
+    UNITY_END();
+}
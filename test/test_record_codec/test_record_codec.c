@@ -0,0 +1,191 @@
+/*
+ * test_record_codec.c
+ *
+ *  Description: Unit tests of the delta / XOR codec of binlog records (src/record_codec): every
+ *               sequence decodes to the records encoded, bit for bit (steady snapshots, random
+ *               bytes, NaN floats, missing messages, wrapping counters, time going back), a lone
+ *               keyframe, the worst case bound, and short or cut input refused.
+ *               Run with "pio test -f test_record_codec".
+ */
+
+#include <unity.h>
+#include "record_codec/record_codec.h"
+#include <string.h>
+#include <math.h>
+
+#define TEST_RECORDS 64
+
+static binlog_record_t records[TEST_RECORDS];
+static binlog_record_t decoded[TEST_RECORDS];
+static uint8_t encoded[sizeof(record_codec_packet_t) + TEST_RECORDS * RECORD_CODEC_MAX_RECORD];
+static uint32_t seed;
+
+static uint32_t test_random(void)
+{
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed;
+}
+
+// Snapshots every 10 ms: messages received a few hundred microseconds before, slowly moving signals
+static void test_records_steady(uint16_t count)
+{
+    memset(records, 0, sizeof(records));
+    for (uint16_t i = 0; i < count; i++)
+    {
+        binlog_record_t *record = &records[i];
+        record->timestamp_us = 1760000000000000LL + 10000LL * i + (test_random() % 50);
+        record->fresh = (i % 2) ? 0x3F : 0x15;
+        for (uint8_t m = 0; m < COMM_MESSAGE_COUNT; m++)
+        {
+            record->message_dt_us[m] = -(int32_t)(100 * m + test_random() % 200);
+        }
+        // Signal values: a slow ramp in every byte of the element area
+        uint8_t *signals = (uint8_t *)&record->message_dt_us[COMM_MESSAGE_COUNT];
+        size_t len = sizeof(*record) - (size_t)(signals - (uint8_t *)record);
+        for (size_t b = 0; b < len; b++)
+        {
+            signals[b] = (uint8_t)((b % 4 == 0) ? i / 8 : b);
+        }
+    }
+}
+
+static void test_records_random(uint16_t count)
+{
+    uint8_t *bytes = (uint8_t *)records;
+    for (size_t b = 0; b < count * sizeof(binlog_record_t); b++)
+    {
+        bytes[b] = (uint8_t)test_random();
+    }
+}
+
+// Encodes records[0..count), decodes it and checks every bit, returns the encoded size
+static size_t test_round_trip(uint16_t count)
+{
+    size_t size = record_codec_encode(records, count, encoded, sizeof(encoded));
+    TEST_ASSERT_NOT_EQUAL(0, size);
+    TEST_ASSERT_LESS_OR_EQUAL(count * RECORD_CODEC_MAX_RECORD, size);
+    memset(decoded, 0xEE, sizeof(decoded));
+    TEST_ASSERT_EQUAL_size_t(size, record_codec_decode(encoded, size, decoded, count));
+    TEST_ASSERT_EQUAL_MEMORY(records, decoded, count * sizeof(binlog_record_t));
+    return size;
+}
+
+void setUp(void)
+{
+    seed = 0x9E3779B9;
+}
+
+void tearDown(void)
+{
+}
+
+static void test_steady_records_round_trip(void)
+{
+    test_records_steady(TEST_RECORDS);
+    size_t size = test_round_trip(TEST_RECORDS);
+    // Keyframe, then a few bytes per record
+    TEST_ASSERT_LESS_THAN(sizeof(binlog_record_t) + (TEST_RECORDS - 1) * sizeof(binlog_record_t) / 2, size);
+}
+
+static void test_random_records_round_trip(void)
+{
+    for (uint8_t pass = 0; pass < 16; pass++)
+    {
+        test_records_random(TEST_RECORDS);
+        test_round_trip(TEST_RECORDS);
+    }
+}
+
+static void test_edge_values_round_trip(void)
+{
+    test_records_steady(TEST_RECORDS);
+    records[1].timestamp_us = INT64_MAX;
+    records[2].timestamp_us = INT64_MIN;
+    records[3].timestamp_us = records[0].timestamp_us; // Time going back
+    records[4].fresh = UINT64_MAX;
+    records[5].message_dt_us[0] = BINLOG_DT_MISSING;
+    records[6].message_dt_us[0] = INT32_MAX;
+    records[7].message_dt_us[COMM_MESSAGE_COUNT - 1] = BINLOG_DT_MISSING;
+
+    // Every signal byte all ones then all zeros: U16 / U32 wrap, F32 NaN and infinity patterns
+    uint8_t *signals = (uint8_t *)&records[8].message_dt_us[COMM_MESSAGE_COUNT];
+    size_t len = sizeof(binlog_record_t) - (size_t)(signals - (uint8_t *)&records[8]);
+    memset(signals, 0xFF, len);
+    memset((uint8_t *)&records[9].message_dt_us[COMM_MESSAGE_COUNT], 0x00, len);
+    memset((uint8_t *)&records[10].message_dt_us[COMM_MESSAGE_COUNT], 0x7F, len);
+    float inf = INFINITY;
+    for (size_t b = 0; b + sizeof(inf) <= len; b += sizeof(inf))
+    {
+        memcpy((uint8_t *)&records[11].message_dt_us[COMM_MESSAGE_COUNT] + b, &inf, sizeof(inf));
+    }
+    test_round_trip(TEST_RECORDS);
+}
+
+static void test_keyframe_alone_round_trips(void)
+{
+    test_records_random(1);
+    TEST_ASSERT_EQUAL_size_t(sizeof(binlog_record_t), test_round_trip(1));
+}
+
+static void test_decoding_starts_at_any_sequence(void)
+{
+    // A block holds a sequence of its own: the second half decodes without the first
+    test_records_steady(TEST_RECORDS);
+    size_t size = record_codec_encode(&records[TEST_RECORDS / 2], TEST_RECORDS / 2, encoded, sizeof(encoded));
+    TEST_ASSERT_NOT_EQUAL(0, size);
+    TEST_ASSERT_EQUAL_size_t(size, record_codec_decode(encoded, size, decoded, TEST_RECORDS / 2));
+    TEST_ASSERT_EQUAL_MEMORY(&records[TEST_RECORDS / 2], decoded, (TEST_RECORDS / 2) * sizeof(binlog_record_t));
+}
+
+static void test_small_output_is_refused(void)
+{
+    test_records_random(TEST_RECORDS);
+    TEST_ASSERT_EQUAL_size_t(0, record_codec_encode(records, 0, encoded, sizeof(encoded)));
+    TEST_ASSERT_EQUAL_size_t(0, record_codec_encode(records, 1, encoded, sizeof(binlog_record_t) - 1));
+    // Room for the keyframe only: the next record may not fit
+    TEST_ASSERT_EQUAL_size_t(0, record_codec_encode(records, 2, encoded, sizeof(binlog_record_t) + 8));
+}
+
+static void test_cut_input_is_refused(void)
+{
+    test_records_steady(TEST_RECORDS);
+    size_t size = record_codec_encode(records, TEST_RECORDS - 1, encoded, sizeof(encoded));
+    TEST_ASSERT_NOT_EQUAL(0, size);
+    TEST_ASSERT_EQUAL_size_t(0, record_codec_decode(encoded, size - 1, decoded, TEST_RECORDS - 1));
+    TEST_ASSERT_EQUAL_size_t(0, record_codec_decode(encoded, sizeof(binlog_record_t) - 1, decoded, 1));
+    // More records asked for than encoded
+    TEST_ASSERT_EQUAL_size_t(0, record_codec_decode(encoded, size, decoded, TEST_RECORDS));
+}
+
+static void test_packet_round_trips(void)
+{
+    record_codec_packet_t header;
+
+    test_records_steady(TEST_RECORDS);
+    size_t size = record_codec_packet_build(encoded, sizeof(encoded), records, TEST_RECORDS, 42);
+    TEST_ASSERT_NOT_EQUAL(0, size);
+    memcpy(&header, encoded, sizeof(header));
+    TEST_ASSERT_EQUAL_UINT32(RECORD_CODEC_PACKET_MAGIC, header.magic);
+    TEST_ASSERT_EQUAL_UINT32(binlog_schema_id(), header.schema);
+    TEST_ASSERT_EQUAL_UINT32(42, header.sequence);
+    TEST_ASSERT_EQUAL_UINT16(TEST_RECORDS, header.count);
+    TEST_ASSERT_EQUAL_size_t(size, sizeof(header) + header.size);
+    TEST_ASSERT_EQUAL_size_t(header.size, record_codec_decode(encoded + sizeof(header), header.size, decoded, header.count));
+    TEST_ASSERT_EQUAL_MEMORY(records, decoded, sizeof(records));
+}
+
+void app_main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_steady_records_round_trip);
+    RUN_TEST(test_random_records_round_trip);
+    RUN_TEST(test_edge_values_round_trip);
+    RUN_TEST(test_keyframe_alone_round_trips);
+    RUN_TEST(test_decoding_starts_at_any_sequence);
+    RUN_TEST(test_small_output_is_refused);
+    RUN_TEST(test_cut_input_is_refused);
+    RUN_TEST(test_packet_round_trips);
+    UNITY_END();
+}
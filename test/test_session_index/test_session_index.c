@@ -0,0 +1,222 @@
+/*
+ * test_session_index.c
+ *
+ *  Description: Unit tests of the session index (src/session_index): saves alternate between the
+ *               two copies, a damaged copy (power cut during a save) falls back to the other one,
+ *               and expiry removes the oldest sessions but never the latest.
+ *               Run with "pio test -f test_session_index" (needs a mounted card on the target).
+ */
+
+#include <unity.h>
+#include "session_index/session_index.h"
+#include "Logging/logging.h"
+#include "binlog/binlog.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdio.h>
+
+static char path[SDIO_PATH_MAX];
+static session_index_t index_saved;
+static session_index_t index_loaded;
+static esp_err_t card = ESP_FAIL; // SDIO_SD_Init result
+
+// Generation of the copy in a slot, 0 if the slot is not in the file
+static uint32_t test_slot_generation(uint8_t slot)
+{
+    session_index_t copy;
+    int fd = open(path, O_RDONLY);
+    TEST_ASSERT_TRUE(fd >= 0);
+    ssize_t n = pread(fd, &copy, sizeof(copy), slot * SESSION_INDEX_SLOT_SIZE);
+    close(fd);
+    return (n == sizeof(copy)) ? copy.generation : 0;
+}
+
+// One byte of the entries of a copy flipped, as a save torn by a power cut leaves it
+static void test_slot_damage(uint8_t slot)
+{
+    uint8_t byte;
+    off_t offset = slot * SESSION_INDEX_SLOT_SIZE + offsetof(session_index_t, entries) + 5;
+    int fd = open(path, O_RDWR);
+    TEST_ASSERT_TRUE(fd >= 0);
+    TEST_ASSERT_EQUAL(1, pread(fd, &byte, 1, offset));
+    byte ^= 0xFF;
+    TEST_ASSERT_EQUAL(1, pwrite(fd, &byte, 1, offset));
+    close(fd);
+}
+
+static void test_sessions_add(session_index_t *index, uint16_t count, uint32_t size)
+{
+    for (uint16_t i = 0; i < count; i++)
+    {
+        session_entry_t *entry = session_index_begin(index, BIN, BINLOG_VERSION, 0x1234, 1000 * i);
+        TEST_ASSERT_NOT_NULL(entry);
+        entry->size = size;
+    }
+}
+
+void setUp(void)
+{
+    TEST_ASSERT_EQUAL(ESP_OK, card);
+    snprintf(path, sizeof(path), "%s/%s", MOUNT_POINT, SESSION_INDEX_NAME);
+    unlink(path);
+}
+
+void tearDown(void)
+{
+    unlink(path);
+}
+
+static void test_missing_file_loads_empty(void)
+{
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, session_index_load(&index_loaded, path));
+    TEST_ASSERT_EQUAL_UINT16(0, index_loaded.count);
+    TEST_ASSERT_NULL(session_index_last(&index_loaded));
+    TEST_ASSERT_EQUAL_MEMORY(SESSION_INDEX_MAGIC, index_loaded.magic, sizeof(index_loaded.magic));
+}
+
+static void test_saves_alternate_slots(void)
+{
+    session_index_load(&index_saved, path);
+    test_sessions_add(&index_saved, 1, 100);
+    TEST_ASSERT_EQUAL(ESP_OK, session_index_save(&index_saved, path));
+    TEST_ASSERT_EQUAL_UINT32(1, test_slot_generation(1));
+    TEST_ASSERT_EQUAL_UINT32(0, test_slot_generation(0));
+
+    test_sessions_add(&index_saved, 1, 200);
+    TEST_ASSERT_EQUAL(ESP_OK, session_index_save(&index_saved, path));
+    TEST_ASSERT_EQUAL_UINT32(1, test_slot_generation(1));
+    TEST_ASSERT_EQUAL_UINT32(2, test_slot_generation(0));
+
+    TEST_ASSERT_EQUAL(ESP_OK, session_index_save(&index_saved, path));
+    TEST_ASSERT_EQUAL_UINT32(3, test_slot_generation(1));
+    TEST_ASSERT_EQUAL_UINT32(2, test_slot_generation(0));
+
+    TEST_ASSERT_EQUAL(ESP_OK, session_index_load(&index_loaded, path));
+    TEST_ASSERT_EQUAL_MEMORY(&index_saved, &index_loaded, sizeof(index_saved));
+}
+
+static void test_damaged_newer_copy_loads_the_older(void)
+{
+    session_index_load(&index_saved, path);
+    test_sessions_add(&index_saved, 1, 100);
+    TEST_ASSERT_EQUAL(ESP_OK, session_index_save(&index_saved, path)); // Generation 1, slot 1
+    session_index_t older = index_saved;
+    test_sessions_add(&index_saved, 1, 200);
+    TEST_ASSERT_EQUAL(ESP_OK, session_index_save(&index_saved, path)); // Generation 2, slot 0
+
+    test_slot_damage(0);
+    TEST_ASSERT_EQUAL(ESP_OK, session_index_load(&index_loaded, path));
+    TEST_ASSERT_EQUAL_MEMORY(&older, &index_loaded, sizeof(older));
+
+    // The next save goes over the damaged copy, the older one stays intact
+    TEST_ASSERT_EQUAL(ESP_OK, session_index_save(&index_loaded, path));
+    TEST_ASSERT_EQUAL_UINT32(2, test_slot_generation(0));
+    TEST_ASSERT_EQUAL_UINT32(1, test_slot_generation(1));
+    TEST_ASSERT_EQUAL(ESP_OK, session_index_load(&index_loaded, path));
+    TEST_ASSERT_EQUAL_UINT16(1, index_loaded.count);
+}
+
+static void test_damaged_older_copy_loads_the_newer(void)
+{
+    session_index_load(&index_saved, path);
+    test_sessions_add(&index_saved, 1, 100);
+    TEST_ASSERT_EQUAL(ESP_OK, session_index_save(&index_saved, path));
+    test_sessions_add(&index_saved, 1, 200);
+    TEST_ASSERT_EQUAL(ESP_OK, session_index_save(&index_saved, path));
+
+    test_slot_damage(1);
+    TEST_ASSERT_EQUAL(ESP_OK, session_index_load(&index_loaded, path));
+    TEST_ASSERT_EQUAL_MEMORY(&index_saved, &index_loaded, sizeof(index_saved));
+}
+
+static void test_both_copies_damaged_load_empty(void)
+{
+    session_index_load(&index_saved, path);
+    test_sessions_add(&index_saved, 2, 100);
+    TEST_ASSERT_EQUAL(ESP_OK, session_index_save(&index_saved, path));
+    TEST_ASSERT_EQUAL(ESP_OK, session_index_save(&index_saved, path));
+
+    test_slot_damage(0);
+    test_slot_damage(1);
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, session_index_load(&index_loaded, path));
+    TEST_ASSERT_EQUAL_UINT16(0, index_loaded.count);
+}
+
+static void test_expire_removes_the_oldest_first(void)
+{
+    session_entry_t expired;
+
+    session_index_load(&index_saved, path);
+    test_sessions_add(&index_saved, 5, 100);
+    TEST_ASSERT_TRUE(session_index_expire(&index_saved, 3, UINT64_MAX, &expired));
+    TEST_ASSERT_EQUAL_UINT32(0, expired.number);
+    TEST_ASSERT_TRUE(session_index_expire(&index_saved, 3, UINT64_MAX, &expired));
+    TEST_ASSERT_EQUAL_UINT32(1, expired.number);
+    TEST_ASSERT_FALSE(session_index_expire(&index_saved, 3, UINT64_MAX, &expired));
+    TEST_ASSERT_EQUAL_UINT16(3, index_saved.count);
+    TEST_ASSERT_EQUAL_UINT32(2, index_saved.entries[0].number);
+
+    // 300 bytes over a budget of 250: the oldest session goes
+    TEST_ASSERT_TRUE(session_index_expire(&index_saved, SESSION_INDEX_MAX, 250, &expired));
+    TEST_ASSERT_EQUAL_UINT32(2, expired.number);
+    TEST_ASSERT_FALSE(session_index_expire(&index_saved, SESSION_INDEX_MAX, 250, &expired));
+    TEST_ASSERT_EQUAL_UINT16(2, index_saved.count);
+}
+
+static void test_expire_never_removes_the_last_session(void)
+{
+    session_entry_t expired;
+    uint16_t removed = 0;
+
+    session_index_load(&index_saved, path);
+    test_sessions_add(&index_saved, 4, 1000);
+    while (session_index_expire(&index_saved, 0, 0, &expired))
+    {
+        removed++;
+    }
+    TEST_ASSERT_EQUAL_UINT16(3, removed);
+    TEST_ASSERT_EQUAL_UINT16(1, index_saved.count);
+    TEST_ASSERT_EQUAL_UINT32(3, session_index_last(&index_saved)->number);
+    TEST_ASSERT_FALSE(session_index_expire(&index_saved, 0, 0, &expired));
+}
+
+static void test_full_index_refuses_a_session(void)
+{
+    session_index_load(&index_saved, path);
+    test_sessions_add(&index_saved, SESSION_INDEX_MAX, 0);
+    TEST_ASSERT_NULL(session_index_begin(&index_saved, BIN, BINLOG_VERSION, 0, 0));
+    TEST_ASSERT_EQUAL(ESP_OK, session_index_save(&index_saved, path));
+    TEST_ASSERT_EQUAL(ESP_OK, session_index_load(&index_loaded, path));
+    TEST_ASSERT_EQUAL_UINT16(SESSION_INDEX_MAX, index_loaded.count);
+    TEST_ASSERT_EQUAL_UINT32(SESSION_INDEX_MAX, index_loaded.next_number);
+}
+
+static void test_names_wrap_at_the_modulo(void)
+{
+    session_entry_t entry = {.number = SESSION_NAME_MODULO + 7};
+    char name[16];
+
+    session_index_name(&entry, "BIN", name, sizeof(name));
+    TEST_ASSERT_EQUAL_STRING("LOG_7.BIN", name);
+}
+
+void app_main(void)
+{
+    card = SDIO_SD_Init();
+    UNITY_BEGIN();
+    RUN_TEST(test_missing_file_loads_empty);
+    RUN_TEST(test_saves_alternate_slots);
+    RUN_TEST(test_damaged_newer_copy_loads_the_older);
+    RUN_TEST(test_damaged_older_copy_loads_the_newer);
+    RUN_TEST(test_both_copies_damaged_load_empty);
+    RUN_TEST(test_expire_removes_the_oldest_first);
+    RUN_TEST(test_expire_never_removes_the_last_session);
+    RUN_TEST(test_full_index_refuses_a_session);
+    RUN_TEST(test_names_wrap_at_the_modulo);
+    UNITY_END();
+    if (card == ESP_OK)
+    {
+        SDIO_SD_DeInit();
+    }
+}